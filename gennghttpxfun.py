@@ -214,6 +214,21 @@ OPTIONS = [
     "frontend-min-write-rate",
     "frontend-initial-write-rate-timeout",
     "frontend-max-write-rate-timeout",
+    "io-uring",
+    "tunnel-splice",
+    "frontend-zerocopy-threshold",
+    "tls-session-cache-size",
+    "subcert-cache-size",
+    "backend-concurrency-limit",
+    "backend-hedge-budget",
+    "backend-http2-min-idle-connections",
+    "backend-tcp-fastopen",
+    "backend-tls-early-data",
+    "backend-outlier-errors",
+    "backend-outlier-latency",
+    "backend-outlier-ejection-time",
+    "backend-outlier-max-ejection-percent",
+    "worker-loop-lag-threshold",
 ]
 
 LOGVARS = [
@@ -249,6 +264,7 @@ LOGVARS = [
     "path_without_query",
     "protocol_version",
     "tls_ech_accepted",
+    "dns_time",
 ]
 
 if __name__ == '__main__':
@@ -25,6 +25,9 @@
 #include "HttpServer.h"
 
 #include <sys/stat.h>
+#ifdef HAVE_SYS_SENDFILE_H
+#  include <sys/sendfile.h>
+#endif // defined(HAVE_SYS_SENDFILE_H)
 #ifdef HAVE_SYS_SOCKET_H
 #  include <sys/socket.h>
 #endif // defined(HAVE_SYS_SOCKET_H)
@@ -504,11 +507,17 @@ Http2Handler::Http2Handler(Sessions *sessions, int fd, SSL *ssl,
   } else {
     read_ = &Http2Handler::read_clear;
     write_ = &Http2Handler::write_clear;
+#ifdef HAVE_SYS_SENDFILE_H
+    sendfile_ = true;
+#endif // defined(HAVE_SYS_SENDFILE_H)
   }
 }
 
 Http2Handler::~Http2Handler() {
   on_session_closed(this, session_id_);
+  if (file_pending_.ent) {
+    sessions_->release_fd(file_pending_.ent);
+  }
   nghttp2_session_del(session_);
   if (ssl_) {
     SSL_set_shutdown(ssl_, SSL_get_shutdown(ssl_) | SSL_RECEIVED_SHUTDOWN);
@@ -532,6 +541,34 @@ struct ev_loop *Http2Handler::get_loop() const { return sessions_->get_loop(); }
 
 Http2Handler::WriteBuf *Http2Handler::get_wb() { return &wb_; }
 
+bool Http2Handler::sendfile_enabled() const { return sendfile_; }
+
+void Http2Handler::set_file_pending(Stream *stream, int fd, int64_t offset,
+                                    size_t len) {
+  assert(file_pending_.len == 0);
+
+  file_pending_.ent = stream->file_ent;
+  if (file_pending_.ent) {
+    // The stream might be closed before the range is sent.  Keep fd
+    // open until then.
+    ++file_pending_.ent->usecount;
+  }
+  file_pending_.fd = fd;
+  file_pending_.offset = offset;
+  file_pending_.len = len;
+}
+
+void Http2Handler::drain_file_pending(size_t n) {
+  file_pending_.offset += as_signed(n);
+  file_pending_.len -= n;
+
+  if (file_pending_.len || !file_pending_.ent) {
+    return;
+  }
+
+  sessions_->release_fd(std::exchange(file_pending_.ent, nullptr));
+}
+
 void Http2Handler::start_settings_timer() {
   ev_timer_start(sessions_->get_loop(), &settings_timerev_);
 }
@@ -606,8 +643,17 @@ std::expected<void, Error> Http2Handler::write_clear() {
   auto loop = sessions_->get_loop();
   for (;;) {
     if (wb_.rleft() > 0) {
+      int flags = 0;
+#ifdef MSG_MORE
+      if (file_pending_.len) {
+        // Let the kernel send DATA frame header together with its
+        // payload which follows.
+        flags = MSG_MORE;
+      }
+#endif // defined(MSG_MORE)
+
       ssize_t nwrite;
-      while ((nwrite = write(fd_, wb_.pos, wb_.rleft())) == -1 &&
+      while ((nwrite = send(fd_, wb_.pos, wb_.rleft(), flags)) == -1 &&
              errno == EINTR)
         ;
       if (nwrite == -1) {
@@ -620,6 +666,19 @@ std::expected<void, Error> Http2Handler::write_clear() {
       wb_.drain(as_unsigned(nwrite));
       continue;
     }
+#ifdef HAVE_SYS_SENDFILE_H
+    if (file_pending_.len) {
+      auto maybe_nwrite = sendfile_clear();
+      if (!maybe_nwrite) {
+        return std::unexpected{maybe_nwrite.error()};
+      }
+      if (*maybe_nwrite == 0) {
+        ev_io_start(loop, &wev_);
+        return {};
+      }
+      continue;
+    }
+#endif // defined(HAVE_SYS_SENDFILE_H)
     wb_.reset();
     if (auto rv = fill_wb(); !rv) {
       return rv;
@@ -674,6 +733,15 @@ std::expected<void, Error> Http2Handler::tls_handshake() {
   read_ = &Http2Handler::read_tls;
   write_ = &Http2Handler::write_tls;
 
+#ifdef BIO_get_ktls_send
+  // SSL_sendfile requires that the kernel encrypts records.
+  sendfile_ = BIO_get_ktls_send(SSL_get_wbio(ssl_));
+
+  if (sendfile_ && sessions_->get_config()->verbose) {
+    std::println(stderr, "kTLS is used for transmission");
+  }
+#endif // defined(BIO_get_ktls_send)
+
   if (auto rv = connection_made(); !rv) {
     return rv;
   }
@@ -755,6 +823,19 @@ std::expected<void, Error> Http2Handler::write_tls() {
       wb_.drain(static_cast<size_t>(nwrite));
       continue;
     }
+#ifdef BIO_get_ktls_send
+    if (file_pending_.len) {
+      auto maybe_nwrite = sendfile_tls();
+      if (!maybe_nwrite) {
+        return std::unexpected{maybe_nwrite.error()};
+      }
+      if (*maybe_nwrite == 0) {
+        ev_io_start(loop, &wev_);
+        return {};
+      }
+      continue;
+    }
+#endif // defined(BIO_get_ktls_send)
     wb_.reset();
     if (auto rv = fill_wb(); !rv) {
       return rv;
@@ -778,6 +859,54 @@ std::expected<void, Error> Http2Handler::write_tls() {
   return {};
 }
 
+#ifdef HAVE_SYS_SENDFILE_H
+std::expected<size_t, Error> Http2Handler::sendfile_clear() {
+  auto offset = static_cast<off_t>(file_pending_.offset);
+
+  ssize_t nwrite;
+  while ((nwrite = sendfile(fd_, file_pending_.fd, &offset,
+                            file_pending_.len)) == -1 &&
+         errno == EINTR)
+    ;
+  if (nwrite == -1) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return 0;
+    }
+    return std::unexpected{Error::SYSCALL};
+  }
+  if (nwrite == 0) {
+    // The file was truncated.  DATA frame header has already been
+    // sent, and there is no way to recover.
+    return std::unexpected{Error::SYSCALL};
+  }
+
+  drain_file_pending(as_unsigned(nwrite));
+
+  return as_unsigned(nwrite);
+}
+#endif // defined(HAVE_SYS_SENDFILE_H)
+
+#ifdef BIO_get_ktls_send
+std::expected<size_t, Error> Http2Handler::sendfile_tls() {
+  ERR_clear_error();
+
+  auto nwrite = SSL_sendfile(ssl_, file_pending_.fd,
+                             static_cast<off_t>(file_pending_.offset),
+                             file_pending_.len, 0);
+  if (nwrite <= 0) {
+    auto err = SSL_get_error(ssl_, static_cast<int>(nwrite));
+    if (err == SSL_ERROR_WANT_WRITE) {
+      return 0;
+    }
+    return std::unexpected{Error::CRYPTO};
+  }
+
+  drain_file_pending(static_cast<size_t>(nwrite));
+
+  return static_cast<size_t>(nwrite);
+}
+#endif // defined(BIO_get_ktls_send)
+
 std::expected<void, Error> Http2Handler::on_read() { return read_(*this); }
 
 std::expected<void, Error> Http2Handler::on_write() { return write_(*this); }
@@ -1615,6 +1744,20 @@ int send_data_callback(nghttp2_session *session, nghttp2_frame *frame,
 
   int fd = source->fd;
 
+  if (length && padlen == 0 && hd->sendfile_enabled()) {
+    // Only frame header goes into the write buffer.  The payload is
+    // sent directly from fd after it.  NGHTTP2_ERR_PAUSE makes
+    // nghttp2_session_mem_send2 return so that no other frame is
+    // written before the payload.
+    wb->last = std::ranges::copy_n(framehd, 9, wb->last).out;
+
+    hd->set_file_pending(stream, fd, stream->body_offset, length);
+
+    stream->body_offset += as_signed(length);
+
+    return NGHTTP2_ERR_PAUSE;
+  }
+
   auto p = wb->last;
 
   p = std::ranges::copy_n(framehd, 9, p).out;
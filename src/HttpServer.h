@@ -213,11 +213,30 @@ public:
 
   std::expected<void, Error> fill_wb();
 
+  // Returns true if DATA payload from a file can be sent with
+  // sendfile(2) or SSL_sendfile instead of copying it into the write
+  // buffer.
+  bool sendfile_enabled() const;
+  // Schedules |len| bytes of |fd| starting at |offset| to be sent
+  // right after the bytes in the write buffer.  |stream| is the
+  // stream which owns |fd|.
+  void set_file_pending(Stream *stream, int fd, int64_t offset, size_t len);
+
   std::expected<void, Error> read_clear();
   std::expected<void, Error> write_clear();
   std::expected<void, Error> tls_handshake();
   std::expected<void, Error> read_tls();
   std::expected<void, Error> write_tls();
+  // Sends the pending file range.  They return the number of bytes
+  // sent, or 0 if the socket blocks.
+#ifdef HAVE_SYS_SENDFILE_H
+  std::expected<size_t, Error> sendfile_clear();
+#endif // defined(HAVE_SYS_SENDFILE_H)
+#ifdef BIO_get_ktls_send
+  std::expected<size_t, Error> sendfile_tls();
+#endif // defined(BIO_get_ktls_send)
+  // Consumes |n| bytes of the pending file range.
+  void drain_file_pending(size_t n);
 
   struct ev_loop *get_loop() const;
 
@@ -237,7 +256,18 @@ private:
   Sessions *sessions_;
   SSL *ssl_;
   std::span<const uint8_t> data_pending_;
+  struct {
+    // The file entry which keeps fd open, or nullptr if fd is not
+    // managed by a file entry.
+    FileEntry *ent;
+    int fd;
+    int64_t offset;
+    size_t len;
+  } file_pending_{};
   int fd_;
+  // true if DATA payload from a file is sent with sendfile(2) or
+  // SSL_sendfile.
+  bool sendfile_{};
 };
 
 struct StatusPage {
@@ -116,6 +116,8 @@ enum class Error {
   INVALID_CONFIG,
   // Stream creation is disallowed temporarily due to stream ID limit.
   STREAM_ID_BLOCKED,
+  // Backend has too many requests in flight.
+  OVERLOADED,
 };
 
 } // namespace nghttp2
@@ -245,6 +247,9 @@ struct std::formatter<nghttp2::Error>
     case nghttp2::Error::STREAM_ID_BLOCKED:
       s = "Stream creation blocked"sv;
       break;
+    case nghttp2::Error::OVERLOADED:
+      s = "backend overloaded"sv;
+      break;
     }
 
     return std::formatter<std::string_view>::format(s, ctx);
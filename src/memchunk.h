@@ -70,6 +70,12 @@ template <size_t N> struct Memchunk {
   uint8_t *pos, *last;
   Memchunk *knext;
   Memchunk *next{};
+  // The number of outstanding references which the kernel holds to
+  // buf (e.g., MSG_ZEROCOPY send).  While it is nonzero, this object
+  // is not returned to the freelist.
+  uint32_t pins{};
+  // true if recycle was requested while this object was pinned.
+  bool recycle_pending{};
   static const size_t size = N;
 };
 
@@ -91,10 +97,29 @@ template <typename T> struct Pool {
     return pool;
   }
   void recycle(T *m) {
+    if (m->pins) {
+      m->next = nullptr;
+      m->recycle_pending = true;
+      return;
+    }
+
     m->next = freelist;
     freelist = m;
     freelistsize += T::size;
   }
+  // Drops a reference acquired by incrementing m->pins.  If it is the
+  // last one and recycle was requested in the meantime, |m| is
+  // recycled.
+  void unpin(T *m) {
+    assert(m->pins);
+
+    if (--m->pins || !m->recycle_pending) {
+      return;
+    }
+
+    m->recycle_pending = false;
+    recycle(m);
+  }
   void clear() {
     freelist = nullptr;
     freelistsize = 0;
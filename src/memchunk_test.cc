@@ -38,6 +38,7 @@ namespace nghttp2 {
 namespace {
 const MunitTest tests[]{
   munit_void_test(test_pool_recycle),
+  munit_void_test(test_pool_recycle_pinned),
   munit_void_test(test_memchunks_append),
   munit_void_test(test_memchunks_drain),
   munit_void_test(test_memchunks_remove),
@@ -105,6 +106,39 @@ void test_pool_recycle(void) {
   assert_null(m2->next);
 }
 
+void test_pool_recycle_pinned(void) {
+  MemchunkPool pool;
+
+  auto m1 = pool.get();
+  auto m2 = pool.get();
+
+  ++m1->pins;
+  ++m1->pins;
+
+  pool.recycle(m1);
+
+  assert_null(pool.freelist);
+  assert_size(0, ==, pool.freelistsize);
+  assert_true(m1->recycle_pending);
+
+  pool.unpin(m1);
+
+  assert_null(pool.freelist);
+
+  pool.unpin(m1);
+
+  assert_ptr_equal(m1, pool.freelist);
+  assert_size(MemchunkPool::value_type::size, ==, pool.freelistsize);
+  assert_false(m1->recycle_pending);
+
+  // Unpinning a chunk which is still in use does not recycle it.
+  ++m2->pins;
+  pool.unpin(m2);
+
+  assert_ptr_equal(m1, pool.freelist);
+  assert_null(m1->next);
+}
+
 using Memchunk16 = Memchunk<16>;
 using MemchunkPool16 = Pool<Memchunk16>;
 using Memchunks16 = Memchunks<Memchunk16>;
@@ -38,6 +38,7 @@ namespace nghttp2 {
 extern const MunitSuite memchunk_suite;
 
 munit_void_test_decl(test_pool_recycle)
+munit_void_test_decl(test_pool_recycle_pinned)
 munit_void_test_decl(test_memchunks_append)
 munit_void_test_decl(test_memchunks_drain)
 munit_void_test_decl(test_memchunks_remove)
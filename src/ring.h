@@ -0,0 +1,127 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2026 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef RING_H
+#define RING_H
+
+#include "nghttp2_config.h"
+
+#include <cstddef>
+#include <atomic>
+#include <array>
+#include <concepts>
+
+namespace nghttp2 {
+
+// MPSCRing is a bounded lock-free multi-producer single-consumer
+// queue which holds at most N objects of type T.  N must be a power
+// of 2.  The objects are allocated along with the ring and reused.
+// push and pop hand a slot to the given function so that the payload
+// is written and read in place.  See
+// https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+template <typename T, size_t N> class MPSCRing {
+public:
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of 2");
+
+  MPSCRing() {
+    for (size_t i = 0; i < N; ++i) {
+      slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MPSCRing(const MPSCRing &) = delete;
+  MPSCRing &operator=(const MPSCRing &) = delete;
+
+  // push claims a free slot, calls |f| with the object in it, and
+  // makes the slot visible to the consumer.  This function returns
+  // false without calling |f| if the ring is full.  This function is
+  // thread-safe.
+  template <std::invocable<T &> F> bool push(F &&f) {
+    auto pos = tail_.load(std::memory_order_relaxed);
+
+    for (;;) {
+      auto &slot = slots_[pos & (N - 1)];
+      auto seq = slot.seq.load(std::memory_order_acquire);
+      auto dif = static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos);
+      if (dif == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          f(slot.value);
+
+          slot.seq.store(pos + 1, std::memory_order_release);
+
+          return true;
+        }
+
+        continue;
+      }
+
+      if (dif < 0) {
+        return false;
+      }
+
+      pos = tail_.load(std::memory_order_relaxed);
+    }
+  }
+
+  // pop calls |f| with the oldest object, and then returns the slot
+  // to producers.  This function returns false without calling |f|
+  // if no object is available.  Only the consumer thread may call
+  // this function.
+  template <std::invocable<T &> F> bool pop(F &&f) {
+    auto &slot = slots_[head_ & (N - 1)];
+    if (slot.seq.load(std::memory_order_acquire) != head_ + 1) {
+      return false;
+    }
+
+    f(slot.value);
+
+    slot.seq.store(head_ + N, std::memory_order_release);
+
+    ++head_;
+
+    return true;
+  }
+
+  // empty returns true if pop would return false.  Only the consumer
+  // thread may call this function.
+  [[nodiscard]] bool empty() const {
+    return slots_[head_ & (N - 1)].seq.load(std::memory_order_acquire) !=
+           head_ + 1;
+  }
+
+private:
+  struct alignas(64) Slot {
+    std::atomic<size_t> seq;
+    T value;
+  };
+
+  std::array<Slot, N> slots_;
+  alignas(64) std::atomic<size_t> tail_{};
+  alignas(64) size_t head_{};
+};
+
+} // namespace nghttp2
+
+#endif // !defined(RING_H)
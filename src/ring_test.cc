@@ -0,0 +1,143 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2026 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ring_test.h"
+
+#ifndef NOTHREADS
+#  include <thread>
+#endif // !defined(NOTHREADS)
+#include <vector>
+
+#include "munitxx.h"
+
+#include "ring.h"
+
+namespace nghttp2 {
+
+namespace {
+const MunitTest tests[]{
+  munit_void_test(test_mpsc_ring_push_pop),
+  munit_void_test(test_mpsc_ring_wrap_around),
+  munit_void_test(test_mpsc_ring_concurrent_push),
+  munit_test_end(),
+};
+} // namespace
+
+const MunitSuite ring_suite{
+  .prefix = "/ring",
+  .tests = tests,
+};
+
+void test_mpsc_ring_push_pop(void) {
+  MPSCRing<int, 4> ring;
+  auto called = false;
+
+  assert_true(ring.empty());
+  assert_false(ring.pop([&called](int &) { called = true; }));
+  assert_false(called);
+
+  for (int i = 0; i < 4; ++i) {
+    assert_true(ring.push([i](int &v) { v = i; }));
+  }
+
+  // The ring is full.
+  assert_false(ring.push([&called](int &) { called = true; }));
+  assert_false(called);
+  assert_false(ring.empty());
+
+  for (int i = 0; i < 4; ++i) {
+    int v = -1;
+
+    assert_true(ring.pop([&v](int &x) { v = x; }));
+    assert_int(i, ==, v);
+  }
+
+  assert_true(ring.empty());
+}
+
+void test_mpsc_ring_wrap_around(void) {
+  MPSCRing<int, 4> ring;
+
+  for (int i = 0; i < 100; ++i) {
+    assert_true(ring.push([i](int &v) { v = i; }));
+    assert_true(ring.push([i](int &v) { v = i + 1000; }));
+
+    int v = -1;
+
+    assert_true(ring.pop([&v](int &x) { v = x; }));
+    assert_int(i, ==, v);
+    assert_true(ring.pop([&v](int &x) { v = x; }));
+    assert_int(i + 1000, ==, v);
+  }
+
+  assert_true(ring.empty());
+}
+
+void test_mpsc_ring_concurrent_push(void) {
+#ifndef NOTHREADS
+  constexpr size_t nproducers = 4;
+  constexpr size_t nitems = 10000;
+
+  MPSCRing<size_t, 64> ring;
+
+  std::vector<std::thread> producers;
+
+  for (size_t i = 0; i < nproducers; ++i) {
+    producers.emplace_back([&ring, i] {
+      for (size_t j = 0; j < nitems;) {
+        if (ring.push([i, j](size_t &v) { v = i * nitems + j; })) {
+          ++j;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  // Items from a single producer must be received in order.
+  std::vector<size_t> next(nproducers);
+  size_t nrecv = 0;
+
+  while (nrecv < nproducers * nitems) {
+    if (!ring.pop([&](size_t &v) {
+          auto &n = next[v / nitems];
+          assert_size(n, ==, v % nitems);
+          ++n;
+        })) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    ++nrecv;
+  }
+
+  for (auto &t : producers) {
+    t.join();
+  }
+
+  assert_true(ring.empty());
+#endif // !defined(NOTHREADS)
+}
+
+} // namespace nghttp2
@@ -31,6 +31,7 @@
 // include test cases' include files here
 #include "shrpx_tls_test.h"
 #include "shrpx_downstream_test.h"
+#include "shrpx_downstream_queue_test.h"
 #include "shrpx_config_test.h"
 #include "shrpx_worker_test.h"
 #include "http2_test.h"
@@ -50,6 +51,7 @@
 #  include "siphash_test.h"
 #endif // defined(ENABLE_HTTP3)
 #include "allocator_test.h"
+#include "ring_test.h"
 
 int main(int argc, char *argv[]) {
   shrpx::create_config();
@@ -65,7 +67,9 @@ int main(int argc, char *argv[]) {
 #ifdef ENABLE_HTTP3
     siphash_suite,
 #endif // defined(ENABLE_HTTP3)
-    allocator_suite,     {},
+    allocator_suite,     ring_suite,
+    shrpx::downstream_queue_suite,
+    {},
   };
   const MunitSuite suite = {
     .prefix = "",
@@ -1845,6 +1845,9 @@ void fill_default_config(Config *config) {
     }
 
     downstreamconf.connections_per_host = 8;
+    downstreamconf.hedge_budget = 10;
+    downstreamconf.outlier.ejection_time = 30_s;
+    downstreamconf.outlier.max_ejection_percent = 10;
     downstreamconf.request_buffer_size = 16_k;
     downstreamconf.response_buffer_size = 128_k;
     downstreamconf.family = AF_UNSPEC;
@@ -1980,28 +1983,30 @@ Options:
               together forming  load balancing  group.
 
               Several parameters <PARAM> are accepted after <PATTERN>.
-              The  parameters are  delimited  by  ";".  The  available
-              parameters       are:      "proto=<PROTO>",       "tls",
-              "sni=<SNI_HOST>",         "fall=<N>",        "rise=<N>",
+              The parameters are  delimited  by  ";".   The  available
+              parameters      are:       "proto=<PROTO>",       "tls",
+              "sni=<SNI_HOST>",        "fall=<N>",         "rise=<N>",
               "affinity=<METHOD>",    "dns",    "redirect-if-not-tls",
               "upgrade-scheme",                        "mruby=<PATH>",
               "read-timeout=<DURATION>",   "write-timeout=<DURATION>",
-              "group=<GROUP>",  "group-weight=<N>", "weight=<N>",  and
-              "dnf".    The  parameter   consists   of  keyword,   and
-              optionally followed by "="  and value.  For example, the
-              parameter "proto=h2" consists of the keyword "proto" and
-              value "h2".  The parameter "tls" consists of the keyword
-              "tls"  without value.   Each parameter  is described  as
-              follows.
-
-              The backend application protocol  can be specified using
-              optional  "proto"   parameter,  and   in  the   form  of
+              "group=<GROUP>",    "group-weight=<N>",    "weight=<N>",
+              "lb=<METHOD>",  "dnf",  "collapse",  and  "hedge=<P>".
+              The  parameter  consists  of  keyword,  and  optionally
+              followed by "="  and value.  For example, the parameter
+              "proto=h2" consists of the keyword "proto" and value
+              "h2".  The parameter "tls" consists of the keyword "tls"
+              without value.  Each parameter is described as follows.
+
+              The backend application protocol can be specified  using
+              optional  "proto"  parameter,  and  in   the   form   of
               "proto=<PROTO>".  <PROTO> should be one of the following
-              list  without  quotes:  "h2", "http/1.1".   The  default
-              value of <PROTO> is  "http/1.1".  Note that usually "h2"
-              refers to HTTP/2  over TLS.  But in this  option, it may
-              mean HTTP/2  over cleartext TCP unless  "tls" keyword is
-              used (see below).
+              list  without  quotes:  "h2",  "http/1.1",  "h3".    The
+              default value  of  <PROTO>  is  "http/1.1".   Note  that
+              usually "h2" refers to HTTP/2 over  TLS.   But  in  this
+              option, it may mean HTTP/2  over  cleartext  TCP  unless
+              "tls" keyword is used (see below).  "h3" is HTTP/3  over
+              QUIC, and it implies "tls".  "h3" is only  available  if
+              nghttpx is built with HTTP/3 support.
 
               TLS  can   be  enabled  by  specifying   optional  "tls"
               parameter.  TLS is not enabled by default.
@@ -2010,37 +2015,42 @@ Options:
               SNI  field  value  with  given  <SNI_HOST>.   This  will
               default to the backend <HOST> name
 
-              The  feature  to detect  whether  backend  is online  or
-              offline can be enabled  using optional "fall" and "rise"
+              The  feature  to  detect  whether  backend  is online or
+              offline  can be enabled using optional "fall" and "rise"
               parameters.   Using  "fall=<N>"  parameter,  if  nghttpx
-              cannot connect  to a  this backend <N>  times in  a row,
-              this  backend  is  assumed  to be  offline,  and  it  is
+              cannot  connect  to  a  this backend <N> times in a row,
+              this  backend  is  assumed  to  be  offline,  and  it is
               excluded from load balancing.  If <N> is 0, this backend
-              never  be excluded  from load  balancing whatever  times
-              nghttpx cannot connect  to it, and this  is the default.
-              There is  also "rise=<N>" parameter.  After  backend was
+              never  be  excluded  from  load balancing whatever times
+              nghttpx  cannot  connect to it, and this is the default.
+              There  is  also "rise=<N>" parameter.  After backend was
               excluded from load balancing group, nghttpx periodically
               attempts to make a connection to the failed backend, and
-              if the  connection is made  successfully <N> times  in a
-              row, the backend is assumed to  be online, and it is now
-              eligible  for load  balancing target.   If <N>  is 0,  a
-              backend  is permanently  offline, once  it goes  in that
-              state, and this is the default behaviour.
-
-              The     session     affinity    is     enabled     using
-              "affinity=<METHOD>"  parameter.   If  "ip" is  given  in
-              <METHOD>, client  IP based session affinity  is enabled.
-              If "cookie"  is given in <METHOD>,  cookie based session
-              affinity is  enabled.  If  "none" is given  in <METHOD>,
-              session affinity  is disabled, and this  is the default.
-              The session  affinity is  enabled per <PATTERN>.   If at
-              least  one backend  has  "affinity"  parameter, and  its
-              <METHOD> is not "none",  session affinity is enabled for
-              all backend  servers sharing the same  <PATTERN>.  It is
-              advised  to  set  "affinity" parameter  to  all  backend
-              explicitly if session affinity  is desired.  The session
-              affinity  may   break  if   one  of  the   backend  gets
-              unreachable,  or   backend  settings  are   reloaded  or
+              if  the  connection  is made successfully <N> times in a
+              row,  the backend is assumed to be online, and it is now
+              eligible  for  load  balancing  target.   If <N> is 0, a
+              backend  is  permanently  offline,  once it goes in that
+              state,  and  this  is the default behaviour.  "fall" and
+              "rise" cannot be used with "proto=h3".
+
+              The     session     affinity     is     enabled    using
+              "affinity=<METHOD>"  parameter.   If  "ip"  is  given in
+              <METHOD>,  client  IP based session affinity is enabled.
+              If  "cookie"  is given in <METHOD>, cookie based session
+              affinity  is enabled.  If "header" is given in <METHOD>,
+              the  value of a request header field is used for session
+              affinity.   If  "app-cookie"  is  given  in  <METHOD>, a
+              request is forwarded to the backend server which set the
+              cookie  it  carries.   If  "none"  is given in <METHOD>,
+              session  affinity  is disabled, and this is the default.
+              The  session  affinity  is enabled per <PATTERN>.  If at
+              least  one  backend  has  "affinity"  parameter, and its
+              <METHOD>  is not "none", session affinity is enabled for
+              all  backend  servers sharing the same <PATTERN>.  It is
+              advised  to  set  "affinity"  parameter  to  all backend
+              explicitly  if session affinity is desired.  The session
+              affinity   may   break   if  one  of  the  backend  gets
+              unreachable,   or   backend  settings  are  reloaded  or
               replaced by API.
 
               If   "affinity=cookie"    is   used,    the   additional
@@ -2068,6 +2078,41 @@ Options:
               have  an  affinity  cookie.   <STICKINESS>  defaults  to
               "loose".
 
+              If          "affinity=header"          is          used,
+              "affinity-header-name=<NAME>"  must  be  used to specify
+              the    name    of    a   request   header   field.    If
+              "affinity=app-cookie"              is              used,
+              "affinity-cookie-name=<NAME>"  must  be  used to specify
+              the  name  of a cookie.  nghttpx never sets this cookie.
+              It  remembers which backend server set each value of the
+              cookie, up to 65536 values per <PATTERN>, and the values
+              are  shared  by  all  worker threads.  If a value is not
+              known, for example, after the configuration is reloaded,
+              or  its  backend  server  is  unavailable,  the value is
+              hashed  to  choose  a  backend  server  instead.  If the
+              header  field  or cookie is absent, client IP address is
+              used instead.
+
+              "affinity-hash=<METHOD>"  controls  how a backend server
+              is  chosen  from  the  hash  for  session  affinity.  If
+              "ketama"  is  given in <METHOD>, consistent hashing with
+              160 points per backend is used, and this is the default.
+              If "maglev" is given in <METHOD>, Maglev lookup table is
+              used.   It  chooses  a backend in constant time, spreads
+              clients  evenly, and adding or removing a backend remaps
+              only      a      small      fraction     of     clients.
+              "affinity-max-load=<PERCENT>"   bounds   the  number  of
+              requests  in  flight  to  a  backend to <PERCENT> of the
+              average.   If  the  chosen  backend exceeds it, the next
+              backend  in  the hash ring, or the backend which prefers
+              the  slot of the lookup table next is chosen.  <PERCENT>
+              must  be  0  or in the range [100, 10000], inclusive.  0
+              means  unbounded,  and this is the default.  The bounded
+              load  does  not apply to a request with a valid affinity
+              cookie  if  "affinity-cookie-stickiness=strict" is used,
+              or  to a request whose cookie was set by a known backend
+              server if "affinity=app-cookie" is used.
+
               By default, name resolution of backend host name is done
               at  start  up,  or reloading  configuration.   If  "dns"
               parameter   is  given,   name  resolution   takes  place
@@ -2134,6 +2179,23 @@ Options:
               weight  becomes  1.   "weight"  is  ignored  if  session
               affinity is enabled.
 
+              "lb=<METHOD>" parameter  specifies  the  load  balancing
+              method.   If  "wrr"  is  given  in   <METHOD>,   backend
+              addresses are selected by  weighted  round  robin  using
+              "group", "group-weight", and "weight" parameters.   This
+              is the default.  If "p2c" is given in <METHOD>,  nghttpx
+              picks 2 backend addresses  at  random,  and  forwards  a
+              request to the less loaded one.  The load of  a  backend
+              address is the peak  EWMA  of  the  time  to  the  first
+              response header multiplied by the number of requests  in
+              flight,  and   divided   by   "weight".    "group"   and
+              "group-weight" are ignored if "p2c" is used.   The  load
+              is tracked per worker thread.  If at least  one  backend
+              has "lb" parameter, and its <METHOD> is not  "wrr",  the
+              method is used for all backend servers sharing the  same
+              <PATTERN>.  "lb"  is  ignored  if  session  affinity  is
+              enabled.
+
               If "dnf" parameter is  specified, an incoming request is
               not forwarded to a backend  and just consumed along with
               the  request body  (actually a  backend server  never be
@@ -2141,6 +2203,41 @@ Options:
               generated by mruby  script (see "mruby=<PATH>" parameter
               above).  "dnf" is an abbreviation of "do not forward".
 
+              If   "collapse"   parameter   is  specified,  concurrent
+              identical  GET  requests  are  collapsed  into  a single
+              backend  request  within a worker.  The first request is
+              forwarded  to a backend, and the other requests wait for
+              its  response.   Only  a  request  without request body,
+              authorization,   cookie,  and  range  header  fields  is
+              collapsed.   The requests are identical if they have the
+              same scheme, authority, path, and accept-encoding header
+              field.   If  the  response  is  cacheable,  and  is  not
+              private,   it  is  streamed  to  all  waiting  requests.
+              Otherwise,  or  if  the  response header does not arrive
+              within   the  read  timeout,  each  waiting  request  is
+              forwarded to a backend independently.  A waiting request
+              whose  client cannot receive the response as fast as the
+              backend  sends  it  is  reset  when  the  response  data
+              buffered  for  it exceeds --backend-response-buffer.  If
+              at  least  one  backend  has "collapse" parameter, it is
+              enabled   for  all  backend  servers  sharing  the  same
+              <PATTERN>.
+
+              If  "hedge=<P>"  parameter  is  specified, a GET or HEAD
+              request  without request body which has not received the
+              response  header  within  the  <P>th  percentile  of the
+              recently  observed  time to the response header (P is in
+              [50,  99])  is  sent  again to the other backend address
+              over  another  connection.   The  request  which  starts
+              receiving  the response first is used, and the other one
+              is  canceled.   The  number  of  the  hedged requests is
+              limited  by  --backend-hedge-budget.   Session  affinity
+              disables   hedging.    "hedge"  parameter  requires  all
+              backend  servers  sharing  the  same  <PATTERN>  to  use
+              "proto=h1".    If  at  least  one  backend  has  "hedge"
+              parameter, it is enabled for all backend servers sharing
+              the same <PATTERN>.
+
               Since ";" and ":" are  used as delimiter, <PATTERN> must
               not contain  these characters.  In order  to include ":"
               in  <PATTERN>,  one  has  to  specify  "%3A"  (which  is
@@ -2237,6 +2334,46 @@ Options:
               support.   If  threading  is disabled,  this  option  is
               always enabled.)");
 
+  std::println(out, R"(  --io-uring
+              Use  io_uring  in  worker threads.  Incoming connections
+              are   accepted   with   io_uring,  and  the  clear  text
+              connections  from  clients  receive  data with multishot
+              recv  into  the  buffers  provided  to the kernel, which
+              saves  a  system  call per read.  The data is still sent
+              with   writev(2).   Connections  which  use  TLS,  PROXY
+              protocol,  or  MSG_ZEROCOPY  read  data  as  usual.  The
+              tunnel of a connection which receives data with io_uring
+              is  not  forwarded  with splice(2).  The submissions are
+              batched,  and  passed  to the kernel once per event loop
+              iteration.   If  io_uring  is  not available at runtime,
+              nghttpx   falls  back  to  the  default  event  backend.
+              Receiving  data  with  io_uring  requires  Linux 5.19 or
+              later.   This  option  is  only  available if nghttpx is
+              built  with  liburing.   Otherwise, it is ignored with a
+              warning.)");
+
+  std::println(out, R"(  --tunnel-splice
+              Forward the upgraded HTTP/1.1 connections (CONNECT,  and
+              Upgrade such as WebSocket) with  splice(2).   The  bytes
+              are moved between frontend and  backend  sockets  inside
+              the kernel without copying them into user space.  It  is
+              only used if both frontend and backend  connections  are
+              cleartext HTTP/1.1.  Otherwise, the upgraded  connection
+              is forwarded as usual.  This option is only effective on
+              the platforms which support splice(2).)");
+
+  std::println(out, R"(  --frontend-zerocopy-threshold=<SIZE>
+              Send the response data to cleartext HTTP/1.1 and  HTTP/2
+              frontend connections with MSG_ZEROCOPY if the length  of
+              the pending data is at least <SIZE> bytes.   The  kernel
+              transmits the buffers without copying them, and  nghttpx
+              does not reuse them until the kernel reports completion.
+              This is only beneficial for large responses.  0 disables
+              this feature.  This option  is  only  effective  on  the
+              platforms which support MSG_ZEROCOPY.
+              Default: {})",
+               config->conn.upstream.zerocopy_threshold);
+
   std::println(out, R"(  --read-rate=<SIZE>
               Set maximum  average read  rate on  frontend connection.
               Setting 0 to this option means read rate is unlimited.
@@ -2314,6 +2451,79 @@ Options:
               Default: {})",
                config->conn.downstream->connections_per_frontend);
 
+  std::println(out, R"(  --backend-http2-min-idle-connections=<N>
+              Set the minimum number of  HTTP/2 connections to each
+              backend address  per worker.  They  are established
+              before requests arrive: at  startup, after configuration
+              reload,  and  after  the   backend  recovers  from  a
+              failure.  The liveness of an idle connection is checked
+              with PING periodically, so that  a request does not pay
+              for the check.   This option only affects  the backend
+              which uses HTTP/2.  0 disables this feature.
+              Default: {})",
+               config->conn.downstream->http2_min_idle_connections);
+
+  std::println(out, R"(  --backend-concurrency-limit=<N>
+              Enable  the  adaptive limit of the number of requests in
+              flight  to each backend address, and set its upper bound
+              to  <N>.  The limit grows while the time to the response
+              header  stays  close to the minimum observed one, and it
+              shrinks  when  the latency grows or a request fails.  An
+              address  at  its limit is skipped when a backend address
+              is selected.  A request is rejected with 503 immediately
+              only  when  all available addresses are at their limits.
+              The  current  limits  are  available  via  API  endpoint
+              /api/v1beta1/backendconcurrency.     0    disables   the
+              adaptive limit.
+              Default: {})",
+               config->conn.downstream->concurrency_limit);
+
+  std::println(out, R"(  --backend-hedge-budget=<PERCENT>
+              Set the maximum  percentage  of  the  hedged  requests
+              in  the  requests  which  can  be  hedged.   Hedging  is
+              enabled per pattern by "hedge=<P>" parameter of
+              --backend option.
+              Default: {})",
+               config->conn.downstream->hedge_budget);
+
+  std::println(out, R"(  --backend-outlier-errors=<N>
+              Temporarily eject a backend address from load balancing
+              after <N>  consecutive requests  to it  failed.  A request
+              fails if the backend responds with 5xx status code, or
+              the  stream or  connection  is  reset or times out before
+              the response header arrives.  0 disables it.
+              Default: {})",
+               config->conn.downstream->outlier.errors);
+
+  std::println(out, R"(  --backend-outlier-latency=<N>
+              Temporarily eject a backend address from load balancing
+              if its latency is more than  <N> times  the median of the
+              addresses in the same group.  It requires at least 3
+              addresses which have served requests  recently.  0
+              disables it.
+              Default: {})",
+               config->conn.downstream->outlier.latency);
+
+  std::println(
+    out, R"(  --backend-outlier-ejection-time=<DURATION>
+              Set the duration  of the first  ejection of  a backend
+              address   by   --backend-outlier-errors   or
+              --backend-outlier-latency.   It  doubles  each  time the
+              address is ejected again, and it is capped by
+              --backend-max-backoff.   The  count  is reset  after the
+              address has served  requests without  ejection  for the
+              duration of --backend-max-backoff.
+              Default: {})",
+    util::duration_str(config->conn.downstream->outlier.ejection_time));
+
+  std::println(out, R"(  --backend-outlier-max-ejection-percent=<PERCENT>
+              Set the maximum percentage of the addresses in a backend
+              group which are ejected at  the same time.   One address
+              can be  ejected regardless  of this  value, but at least
+              one address is always left in load balancing.
+              Default: {})",
+               config->conn.downstream->outlier.max_ejection_percent);
+
   std::println(out, R"(  --rlimit-nofile=<N>
               Set maximum number of open files (RLIMIT_NOFILE) to <N>.
               If 0 is given, nghttpx does not set the limit.
@@ -2345,6 +2555,15 @@ Options:
               Default: {})",
                config->conn.listener.fastopen);
 
+  std::println(out, R"(  --backend-tcp-fastopen
+              Enables "TCP Fast Open" for  backend connections, so that
+              the first data is sent in SYN  if the backend has handed
+              out a  cookie before.  Because the  connection failure
+              is  only  noticed  after  the  request  has been  sent,
+              the request may not be  retried on another backend.  This
+              option is only effective on  the platforms which support
+              TCP_FASTOPEN_CONNECT socket option.)");
+
   std::println(out,
                R"(  --no-kqueue
               Don't use  kqueue.  This  option is only  applicable for
@@ -2442,6 +2661,18 @@ Options:
               Default: {})",
                util::duration_str(config->conn.listener.timeout.sleep));
 
+  std::println(
+    out, R"(  --worker-loop-lag-threshold=<DURATION>
+              If the longest event  loop iteration of a  worker during
+              the last  second exceeds  <DURATION>, the  worker  stops
+              accepting new connections until the iteration time falls
+              below <DURATION>  again.   The event loop  statistics of
+              the  workers are  available  through the  API  endpoint
+              /api/v1beta1/workerloop.   Specifying  0 disables   this
+              feature.
+              Default: {})",
+    util::duration_str(config->conn.listener.loop_lag_threshold));
+
   std::println(out, R"(  --frontend-http2-setting-timeout=<DURATION>
               Specify  timeout before  SETTINGS ACK  is received  from
               client.
@@ -2575,6 +2806,20 @@ Options:
               feature   requires   OpenSSL   >=   1.0.2.    See   also
               --tls-sct-dir option.)");
 
+  std::println(out, R"(  --subcert-cache-size=<N>
+              Load the certificates given by --subcert on demand,  and
+              keep at most <N> of them in memory.  At startup, nghttpx
+              only  reads  the  certificate  files  to   learn   their
+              hostnames.  The private key  is  loaded  when  a  client
+              first asks for one of the hostnames via TLS  SNI.   When
+              the cache is full, the least recently  used  certificate
+              is dropped, and it  is  loaded  again  when  needed.   A
+              certificate  that  fails  to  load  at  runtime  is  not
+              retried, and the default certificate is used instead.  0
+              loads all certificates at startup.
+              Default: {})",
+               config->tls.subcert_cache_size);
+
   std::println(out, R"(  --dh-param-file=<PATH>
               Path to file that contains  DH parameters in PEM format.
               Without  this   option,  DHE   cipher  suites   are  not
@@ -2725,6 +2970,20 @@ Options:
               Path to client private  key for memcached connections to
               get TLS ticket keys.)");
 
+  std::println(out, R"(  --tls-session-cache-size=<SIZE>
+              Enable the TLS session cache  which  is  shared  by  all
+              worker threads, and set  its  memory  budget  to  <SIZE>
+              bytes.  The frontend TLS sessions  are  stored  in  this
+              cache instead of the per SSL_CTX internal cache, and the
+              backend TLS sessions are shared among worker threads  so
+              that a session established by one worker can be  resumed
+              by another.  The cache is split into  shards,  and  each
+              shard evicts the least recently used  sessions  to  stay
+              within its share of the budget.  The sessions resumed by
+              TLS session ticket do not use this  cache.   0  disables
+              the cache.
+              Default: {})",
+               util::utos_unit(config->tls.session_cache.max_size));
   std::println(out, R"(  --tls-dyn-rec-warmup-threshold=<SIZE>
               Specify the  threshold size for TLS  dynamic record size
               behaviour.  During  a TLS  session, after  the threshold
@@ -2812,6 +3071,16 @@ Options:
               Default: {})",
                util::utos_unit(config->tls.max_early_data));
 
+  std::println(out, R"(  --backend-tls-early-data
+              Send  GET and  HEAD requests  without  body to  HTTP/1.1
+              backend in 0-RTT  early data when the TLS session to the
+              backend is resumed, and the server allows early data.  If
+              the server rejects early data, the request is sent again
+              after the handshake.  If the  server responds with  425
+              (Too Early), the request is  retried on a new connection
+              without early data.  This option requires  OpenSSL as the
+              TLS library.)");
+
   std::println(out, R"(  --tls-ktls
               Enable ktls.)");
 
@@ -3018,6 +3287,9 @@ Options:
                 request.  "-" if backend host is not available.
               * $backend_port:  backend  port   used  to  fulfill  the
                 request.  "-" if backend host is not available.
+              * $dns_time: time that the request spent waiting for the
+                backend name lookup in  seconds with milliseconds
+                resolution.
               * $method: HTTP method
               * $path:  Request  path  including query.   For  CONNECT
                 request, authority is recorded.
@@ -3238,6 +3510,11 @@ Options:
   std::println(out, R"(  --dns-cache-timeout=<DURATION>
               Set duration that cached DNS results remain valid.  Note
               that nghttpx caches the unsuccessful results as well.
+              The cache is shared by  all worker threads.  When 3/4 of
+              the  duration has  passed,  a  successful  result  is
+              refreshed in background  while the cached result is still
+              used.  If  a name  resolves to multiple  addresses,
+              connections are distributed over them in round robin.
               Default: {})",
                util::duration_str(config->dns.timeout.cache));
 
@@ -4223,6 +4500,29 @@ int main(int argc, char **argv) {
        &flag, 205},
       {SHRPX_OPT_FRONTEND_MAX_WRITE_RATE_TIMEOUT.data(), required_argument,
        &flag, 206},
+      {SHRPX_OPT_IO_URING.data(), no_argument, &flag, 207},
+      {SHRPX_OPT_TUNNEL_SPLICE.data(), no_argument, &flag, 208},
+      {SHRPX_OPT_FRONTEND_ZEROCOPY_THRESHOLD.data(), required_argument, &flag,
+       209},
+      {SHRPX_OPT_TLS_SESSION_CACHE_SIZE.data(), required_argument, &flag, 210},
+      {SHRPX_OPT_SUBCERT_CACHE_SIZE.data(), required_argument, &flag, 211},
+      {SHRPX_OPT_BACKEND_CONCURRENCY_LIMIT.data(), required_argument, &flag,
+       212},
+      {SHRPX_OPT_BACKEND_HEDGE_BUDGET.data(), required_argument, &flag, 213},
+      {SHRPX_OPT_BACKEND_HTTP2_MIN_IDLE_CONNECTIONS.data(), required_argument,
+       &flag, 214},
+      {SHRPX_OPT_BACKEND_TCP_FASTOPEN.data(), no_argument, &flag, 215},
+      {SHRPX_OPT_BACKEND_TLS_EARLY_DATA.data(), no_argument, &flag, 216},
+      {SHRPX_OPT_BACKEND_OUTLIER_ERRORS.data(), required_argument, &flag,
+       217},
+      {SHRPX_OPT_BACKEND_OUTLIER_LATENCY.data(), required_argument, &flag,
+       218},
+      {SHRPX_OPT_BACKEND_OUTLIER_EJECTION_TIME.data(), required_argument,
+       &flag, 219},
+      {SHRPX_OPT_BACKEND_OUTLIER_MAX_EJECTION_PERCENT.data(),
+       required_argument, &flag, 220},
+      {SHRPX_OPT_WORKER_LOOP_LAG_THRESHOLD.data(), required_argument, &flag,
+       221},
       {nullptr, 0, nullptr, 0}};
 
     int option_index = 0;
@@ -5197,6 +5497,77 @@ int main(int argc, char **argv) {
         cmdcfgs.emplace_back(SHRPX_OPT_FRONTEND_MAX_WRITE_RATE_TIMEOUT,
                              std::string_view{optarg});
         break;
+      case 207:
+        // --io-uring
+        cmdcfgs.emplace_back(SHRPX_OPT_IO_URING, "yes"sv);
+        break;
+      case 208:
+        // --tunnel-splice
+        cmdcfgs.emplace_back(SHRPX_OPT_TUNNEL_SPLICE, "yes"sv);
+        break;
+      case 209:
+        // --frontend-zerocopy-threshold
+        cmdcfgs.emplace_back(SHRPX_OPT_FRONTEND_ZEROCOPY_THRESHOLD,
+                             std::string_view{optarg});
+        break;
+      case 210:
+        // --tls-session-cache-size
+        cmdcfgs.emplace_back(SHRPX_OPT_TLS_SESSION_CACHE_SIZE,
+                             std::string_view{optarg});
+        break;
+      case 211:
+        // --subcert-cache-size
+        cmdcfgs.emplace_back(SHRPX_OPT_SUBCERT_CACHE_SIZE,
+                             std::string_view{optarg});
+        break;
+      case 212:
+        // --backend-concurrency-limit
+        cmdcfgs.emplace_back(SHRPX_OPT_BACKEND_CONCURRENCY_LIMIT,
+                             std::string_view{optarg});
+        break;
+      case 213:
+        // --backend-hedge-budget
+        cmdcfgs.emplace_back(SHRPX_OPT_BACKEND_HEDGE_BUDGET,
+                             std::string_view{optarg});
+        break;
+      case 214:
+        // --backend-http2-min-idle-connections
+        cmdcfgs.emplace_back(SHRPX_OPT_BACKEND_HTTP2_MIN_IDLE_CONNECTIONS,
+                             std::string_view{optarg});
+        break;
+      case 215:
+        // --backend-tcp-fastopen
+        cmdcfgs.emplace_back(SHRPX_OPT_BACKEND_TCP_FASTOPEN, "yes"sv);
+        break;
+      case 216:
+        // --backend-tls-early-data
+        cmdcfgs.emplace_back(SHRPX_OPT_BACKEND_TLS_EARLY_DATA, "yes"sv);
+        break;
+      case 217:
+        // --backend-outlier-errors
+        cmdcfgs.emplace_back(SHRPX_OPT_BACKEND_OUTLIER_ERRORS,
+                             std::string_view{optarg});
+        break;
+      case 218:
+        // --backend-outlier-latency
+        cmdcfgs.emplace_back(SHRPX_OPT_BACKEND_OUTLIER_LATENCY,
+                             std::string_view{optarg});
+        break;
+      case 219:
+        // --backend-outlier-ejection-time
+        cmdcfgs.emplace_back(SHRPX_OPT_BACKEND_OUTLIER_EJECTION_TIME,
+                             std::string_view{optarg});
+        break;
+      case 220:
+        // --backend-outlier-max-ejection-percent
+        cmdcfgs.emplace_back(SHRPX_OPT_BACKEND_OUTLIER_MAX_EJECTION_PERCENT,
+                             std::string_view{optarg});
+        break;
+      case 221:
+        // --worker-loop-lag-threshold
+        cmdcfgs.emplace_back(SHRPX_OPT_WORKER_LOOP_LAG_THRESHOLD,
+                             std::string_view{optarg});
+        break;
       default:
         break;
       }
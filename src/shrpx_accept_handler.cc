@@ -34,6 +34,9 @@
 #include "shrpx_config.h"
 #include "shrpx_log.h"
 #include "shrpx_worker.h"
+#ifdef HAVE_LIBURING
+#  include "shrpx_io_uring.h"
+#endif // defined(HAVE_LIBURING)
 #include "util.h"
 
 using namespace nghttp2;
@@ -54,15 +57,48 @@ void acceptcb(struct ev_loop *loop, ev_io *w, int revent) {
 }
 } // namespace
 
+#ifdef HAVE_LIBURING
+namespace {
+void io_uring_acceptcb(IOUringOp *op, const io_uring_cqe *cqe) {
+  auto h = static_cast<AcceptHandler *>(op->data);
+
+  if (cqe->res < 0) {
+    if (h) {
+      h->on_io_uring_accept_error(op, -cqe->res);
+    }
+
+    return;
+  }
+
+  if (!h) {
+    // AcceptHandler has gone.
+    close(cqe->res);
+
+    return;
+  }
+
+  h->on_io_uring_accept(op, cqe->res);
+}
+} // namespace
+#endif // defined(HAVE_LIBURING)
+
 AcceptHandler::AcceptHandler(Worker *worker, const UpstreamAddr *faddr)
-  : worker_(worker), faddr_(faddr) {
+  : worker_(worker),
+    faddr_(faddr)
+#ifdef HAVE_LIBURING
+    ,
+    io_uring_(worker->get_io_uring()),
+    io_uring_ops_{}
+#endif // defined(HAVE_LIBURING)
+{
   ev_io_init(&wev_, acceptcb, faddr_->fd, EV_READ);
   wev_.data = this;
-  ev_io_start(worker_->get_loop(), &wev_);
+
+  enable();
 }
 
 AcceptHandler::~AcceptHandler() {
-  ev_io_stop(worker_->get_loop(), &wev_);
+  disable();
   close(faddr_->fd);
 }
 
@@ -159,9 +195,116 @@ void AcceptHandler::drain_connection() {
   }
 }
 
-void AcceptHandler::enable() { ev_io_start(worker_->get_loop(), &wev_); }
+void AcceptHandler::enable() {
+#ifdef HAVE_LIBURING
+  if (io_uring_) {
+    if (io_uring_ops_[0]) {
+      // Already enabled.
+      return;
+    }
+
+    if (start_io_uring_accept()) {
+      return;
+    }
+
+    fallback_from_io_uring();
+
+    return;
+  }
+#endif // defined(HAVE_LIBURING)
+
+  ev_io_start(worker_->get_loop(), &wev_);
+}
+
+void AcceptHandler::disable() {
+#ifdef HAVE_LIBURING
+  for (auto &op : io_uring_ops_) {
+    if (op) {
+      io_uring_->delete_op(op);
+      op = nullptr;
+    }
+  }
+#endif // defined(HAVE_LIBURING)
+
+  ev_io_stop(worker_->get_loop(), &wev_);
+}
+
+#ifdef HAVE_LIBURING
+std::expected<void, Error> AcceptHandler::start_io_uring_accept() {
+  // Multishot accept is not used because it writes the remote
+  // addresses of all accepted sockets to the same storage.  Instead,
+  // a few accepts are kept in flight.
+  for (auto &op : io_uring_ops_) {
+    if (!op) {
+      op = io_uring_->create_op(io_uring_acceptcb, this);
+    }
+
+    if (auto rv = io_uring_->accept(op, faddr_->fd); !rv) {
+      return rv;
+    }
+  }
+
+  return {};
+}
+
+void AcceptHandler::restart_io_uring_accept(IOUringOp *op) {
+  // |op| has been deleted if acceptor was disabled.
+  if (std::ranges::find(io_uring_ops_, op) == std::ranges::end(io_uring_ops_) ||
+      op->active) {
+    return;
+  }
+
+  if (!io_uring_->accept(op, faddr_->fd)) {
+    fallback_from_io_uring();
+  }
+}
+
+void AcceptHandler::fallback_from_io_uring() {
+  Log{WARN} << "acceptor: accept with io_uring is not available; fall back "
+               "to the default event backend";
 
-void AcceptHandler::disable() { ev_io_stop(worker_->get_loop(), &wev_); }
+  for (auto &op : io_uring_ops_) {
+    if (op) {
+      io_uring_->delete_op(op);
+      op = nullptr;
+    }
+  }
+
+  io_uring_ = nullptr;
+
+  ev_io_start(worker_->get_loop(), &wev_);
+}
+
+void AcceptHandler::on_io_uring_accept(IOUringOp *op, int fd) {
+  // The kernel has written the remote address to |op|.
+  (void)worker_->handle_connection(
+    fd, reinterpret_cast<const sockaddr *>(&op->addr), op->addrlen, faddr_);
+
+  restart_io_uring_accept(op);
+}
+
+void AcceptHandler::on_io_uring_accept_error(IOUringOp *op, int error) {
+  switch (error) {
+  case EINVAL:
+  case EOPNOTSUPP:
+    // The running kernel does not support accept with io_uring.
+    fallback_from_io_uring();
+
+    return;
+  case EMFILE:
+  case ENFILE:
+    Log{WARN} << "acceptor: running out file descriptor; disable acceptor "
+                 "temporarily";
+    worker_->sleep_listener(get_config()->conn.listener.timeout.sleep);
+    break;
+  default:
+    break;
+  }
+
+  // If acceptor has not been disabled, accept again.
+  restart_io_uring_accept(op);
+}
+#endif // defined(HAVE_LIBURING)
 
 int AcceptHandler::get_fd() const { return faddr_->fd; }
 
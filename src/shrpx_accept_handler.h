@@ -28,6 +28,7 @@
 #include "shrpx.h"
 
 #include <expected>
+#include <array>
 
 #include <ev.h>
 
@@ -39,6 +40,14 @@ namespace shrpx {
 
 class Worker;
 struct UpstreamAddr;
+#ifdef HAVE_LIBURING
+class IOUring;
+struct IOUringOp;
+
+// The number of accepts with io_uring which are in flight per
+// listener.
+constexpr size_t IO_URING_ACCEPT_DEPTH = 4;
+#endif // defined(HAVE_LIBURING)
 
 class AcceptHandler {
 public:
@@ -49,11 +58,37 @@ public:
   void enable();
   void disable();
   int get_fd() const;
+#ifdef HAVE_LIBURING
+  // Handles the accepted socket |fd| which io_uring produced for
+  // |op|.
+  void on_io_uring_accept(IOUringOp *op, int fd);
+  // Handles error |error| of accept for |op|.
+  void on_io_uring_accept_error(IOUringOp *op, int error);
+#endif // defined(HAVE_LIBURING)
 
 private:
+#ifdef HAVE_LIBURING
+  // Submits accepts using io_uring.
+  std::expected<void, Error> start_io_uring_accept();
+  // Submits accept for |op| again if |op| is still used.
+  void restart_io_uring_accept(IOUringOp *op);
+  // Stops using io_uring, and starts accepting connections with
+  // libev.
+  void fallback_from_io_uring();
+#endif // defined(HAVE_LIBURING)
+
   ev_io wev_;
   Worker *worker_;
   const UpstreamAddr *faddr_;
+#ifdef HAVE_LIBURING
+  // io_uring instance of worker_.  This is nullptr if io_uring is not
+  // used.
+  IOUring *io_uring_;
+  // Accept operations which are in flight.  Each of them has its own
+  // storage for the remote address.  They are nullptr if accepting
+  // with io_uring is disabled.
+  std::array<IOUringOp *, IO_URING_ACCEPT_DEPTH> io_uring_ops_;
+#endif // defined(HAVE_LIBURING)
 };
 
 } // namespace shrpx
@@ -52,6 +52,27 @@ const auto configrevision_endpoint = APIEndpoint{
   (1 << API_METHOD_GET),
   &APIDownstreamConnection::handle_configrevision,
 };
+
+const auto backendconcurrency_endpoint = APIEndpoint{
+  "/api/v1beta1/backendconcurrency"sv,
+  true,
+  (1 << API_METHOD_GET),
+  &APIDownstreamConnection::handle_backendconcurrency,
+};
+
+const auto backendhedge_endpoint = APIEndpoint{
+  "/api/v1beta1/backendhedge"sv,
+  true,
+  (1 << API_METHOD_GET),
+  &APIDownstreamConnection::handle_backendhedge,
+};
+
+const auto workerloop_endpoint = APIEndpoint{
+  "/api/v1beta1/workerloop"sv,
+  true,
+  (1 << API_METHOD_GET),
+  &APIDownstreamConnection::handle_workerloop,
+};
 } // namespace
 
 // The method string.  This must be same order of APIMethod.
@@ -157,6 +178,24 @@ std::expected<void, Error> APIDownstreamConnection::send_reply(
 namespace {
 const APIEndpoint *lookup_api(std::string_view path) {
   switch (path.size()) {
+  case 23:
+    switch (path[22]) {
+    case 'p':
+      if (util::streq("/api/v1beta1/workerloo"sv, path.substr(0, 22))) {
+        return &workerloop_endpoint;
+      }
+      break;
+    }
+    break;
+  case 25:
+    switch (path[24]) {
+    case 'e':
+      if (util::streq("/api/v1beta1/backendhedg"sv, path.substr(0, 24))) {
+        return &backendhedge_endpoint;
+      }
+      break;
+    }
+    break;
   case 26:
     switch (path[25]) {
     case 'g':
@@ -175,6 +214,15 @@ const APIEndpoint *lookup_api(std::string_view path) {
       break;
     }
     break;
+  case 31:
+    switch (path[30]) {
+    case 'y':
+      if (util::streq("/api/v1beta1/backendconcurrenc"sv, path.substr(0, 30))) {
+        return &backendconcurrency_endpoint;
+      }
+      break;
+    }
+    break;
   }
   return nullptr;
 }
@@ -349,6 +397,13 @@ std::expected<void, Error> APIDownstreamConnection::handle_backendconfig() {
   downstreamconf->timeout = src->timeout;
   downstreamconf->connections_per_host = src->connections_per_host;
   downstreamconf->connections_per_frontend = src->connections_per_frontend;
+  downstreamconf->concurrency_limit = src->concurrency_limit;
+  downstreamconf->hedge_budget = src->hedge_budget;
+  downstreamconf->http2_min_idle_connections =
+    src->http2_min_idle_connections;
+  downstreamconf->tcp_fastopen = src->tcp_fastopen;
+  downstreamconf->tls_early_data = src->tls_early_data;
+  downstreamconf->outlier = src->outlier;
   downstreamconf->request_buffer_size = src->request_buffer_size;
   downstreamconf->response_buffer_size = src->response_buffer_size;
   downstreamconf->family = src->family;
@@ -405,6 +460,16 @@ std::expected<void, Error> APIDownstreamConnection::handle_backendconfig() {
 
   auto conn_handler = worker_->get_connection_handler();
 
+#ifdef ENABLE_HTTP3
+  // SSL_CTX for HTTP/3 backends is only created at startup.
+  if (!conn_handler->get_quic_cl_ssl_ctx() &&
+      downstream_http3_configured(*downstreamconf)) {
+    Log{ERROR} << "backend: proto: h3 backend cannot be added by API unless "
+                  "it is configured at startup";
+    return send_reply(400, APIStatusCode::FAILURE);
+  }
+#endif // defined(ENABLE_HTTP3)
+
   conn_handler->send_replace_downstream(downstreamconf);
 
   return send_reply(200, APIStatusCode::SUCCESS);
@@ -426,6 +491,163 @@ std::expected<void, Error> APIDownstreamConnection::handle_configrevision() {
   return send_reply(200, APIStatusCode::SUCCESS, data);
 }
 
+std::expected<void, Error>
+APIDownstreamConnection::handle_backendconcurrency() {
+  auto &balloc = downstream_->get_block_allocator();
+
+  // Construct the following string:
+  //   ,
+  //   "data":{
+  //     "backends":[
+  //       {
+  //         "pattern": "...",
+  //         "address": "...",
+  //         "limit": N,
+  //         "inflight": N,
+  //         "minRtt": N,
+  //         "rejected": N
+  //       }, ...
+  //     ]
+  //   }
+  //
+  // The values are the ones maintained by the worker thread which
+  // handles this request.
+  std::string s = R"(,"data":{"backends":[)";
+
+  auto first = true;
+
+  for (auto &group : worker_->get_downstream_addr_groups()) {
+    auto &shared_addr = group->shared_addr;
+    if (shared_addr->concurrency_limit == 0) {
+      continue;
+    }
+
+    for (auto &addr : shared_addr->addrs) {
+      if (!first) {
+        s += ',';
+      }
+
+      first = false;
+
+      std::format_to(
+        std::back_inserter(s),
+        R"({{"pattern":"{}","address":"{}","limit":{},"inflight":{},)"
+        R"("minRtt":{:.6f},"rejected":{}}})",
+        as_string_view(group->pattern), addr.hostport,
+        static_cast<size_t>(addr.concurrency_limit), addr.num_inflight,
+        addr.min_rtt, addr.num_concurrency_rejected);
+    }
+  }
+
+  s += "]}";
+
+  return send_reply(200, APIStatusCode::SUCCESS, make_string_ref(balloc, s));
+}
+
+std::expected<void, Error> APIDownstreamConnection::handle_backendhedge() {
+  auto &balloc = downstream_->get_block_allocator();
+
+  // Construct the following string:
+  //   ,
+  //   "data":{
+  //     "patterns":[
+  //       {
+  //         "pattern": "...",
+  //         "delay": N,
+  //         "hedged": N,
+  //         "won": N
+  //       }, ...
+  //     ]
+  //   }
+  //
+  // The values are the ones maintained by the worker thread which
+  // handles this request.
+  std::string s = R"(,"data":{"patterns":[)";
+
+  auto first = true;
+
+  for (auto &group : worker_->get_downstream_addr_groups()) {
+    auto &shared_addr = group->shared_addr;
+    if (shared_addr->hedge_percentile == 0) {
+      continue;
+    }
+
+    if (!first) {
+      s += ',';
+    }
+
+    first = false;
+
+    auto &hedge = shared_addr->hedge;
+
+    std::format_to(
+      std::back_inserter(s),
+      R"({{"pattern":"{}","delay":{:.6f},"hedged":{},"won":{}}})",
+      as_string_view(group->pattern), hedge.delay, hedge.num_hedged,
+      hedge.num_won);
+  }
+
+  s += "]}";
+
+  return send_reply(200, APIStatusCode::SUCCESS, make_string_ref(balloc, s));
+}
+
+std::expected<void, Error> APIDownstreamConnection::handle_workerloop() {
+  auto &balloc = downstream_->get_block_allocator();
+
+  // Construct the following string:
+  //   ,
+  //   "data":{
+  //     "workers":[
+  //       {
+  //         "index": N,
+  //         "maxIterationTime": N,
+  //         "busyRatio": N,
+  //         "iterations": N,
+  //         "tlsHandshakeTime": N,
+  //         "mrubyTime": N,
+  //         "throttled": true|false
+  //       }, ...
+  //     ]
+  //   }
+  //
+  // The values are aggregated over the last LOOP_STAT_INTERVAL by
+  // each worker thread.
+  std::string s = R"(,"data":{"workers":[)";
+
+  auto first = true;
+
+  for (auto &worker : worker_->get_connection_handler()->get_workers()) {
+    auto &stat = worker->get_loop_stat();
+
+    if (!first) {
+      s += ',';
+    }
+
+    first = false;
+
+    std::format_to(
+      std::back_inserter(s),
+      R"({{"index":{},"maxIterationTime":{:.6f},"busyRatio":{:.6f},)"
+      R"("iterations":{},"tlsHandshakeTime":{:.6f},"mrubyTime":{:.6f},)"
+      R"("throttled":{}}})",
+      worker->get_index(),
+      stat.max_iteration_time.load(std::memory_order_relaxed),
+      stat.busy_ratio.load(std::memory_order_relaxed),
+      stat.num_iterations.load(std::memory_order_relaxed),
+      stat
+        .category_time[static_cast<size_t>(LoopCategory::TLS_HANDSHAKE)]
+        .load(std::memory_order_relaxed),
+      stat.category_time[static_cast<size_t>(LoopCategory::MRUBY)].load(
+        std::memory_order_relaxed),
+      stat.throttled.load(std::memory_order_relaxed));
+  }
+
+  s += "]}";
+
+  return send_reply(200, APIStatusCode::SUCCESS, make_string_ref(balloc, s));
+}
+
 void APIDownstreamConnection::pause_read(IOCtrlReason reason) {}
 
 void APIDownstreamConnection::force_resume_read() {}
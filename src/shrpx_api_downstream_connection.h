@@ -104,6 +104,12 @@ public:
   std::expected<void, Error> handle_backendconfig();
   // Handles configrevision API request.
   std::expected<void, Error> handle_configrevision();
+  // Handles backendconcurrency API request.
+  std::expected<void, Error> handle_backendconcurrency();
+  // Handles backendhedge API request.
+  std::expected<void, Error> handle_backendhedge();
+  // Handles workerloop API request.
+  std::expected<void, Error> handle_workerloop();
 
 private:
   Worker *worker_;
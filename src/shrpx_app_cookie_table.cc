@@ -0,0 +1,82 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2026 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_app_cookie_table.h"
+
+#include <cassert>
+
+namespace shrpx {
+
+AppCookieTable::AppCookieTable(size_t max_entries)
+  : max_entries_(max_entries) {
+  assert(max_entries_);
+}
+
+void AppCookieTable::add(std::string_view value, uint32_t addr_hash) {
+  std::lock_guard<std::mutex> g(mu_);
+
+  if (auto it = index_.find(value); it != std::ranges::end(index_)) {
+    auto ent = (*it).second;
+
+    (*ent).addr_hash = addr_hash;
+    lru_.splice(std::ranges::begin(lru_), lru_, ent);
+
+    return;
+  }
+
+  if (lru_.size() == max_entries_) {
+    index_.erase(lru_.back().value);
+    lru_.pop_back();
+  }
+
+  lru_.push_front(Entry{
+    .value = std::string{value},
+    .addr_hash = addr_hash,
+  });
+
+  index_.emplace(lru_.front().value, std::ranges::begin(lru_));
+}
+
+std::expected<uint32_t, Error> AppCookieTable::get(std::string_view value) {
+  std::lock_guard<std::mutex> g(mu_);
+
+  auto it = index_.find(value);
+  if (it == std::ranges::end(index_)) {
+    return std::unexpected{Error::ENTITY_NOT_FOUND};
+  }
+
+  auto ent = (*it).second;
+
+  lru_.splice(std::ranges::begin(lru_), lru_, ent);
+
+  return (*ent).addr_hash;
+}
+
+size_t AppCookieTable::size() {
+  std::lock_guard<std::mutex> g(mu_);
+
+  return lru_.size();
+}
+
+} // namespace shrpx
@@ -0,0 +1,80 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2026 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef SHRPX_APP_COOKIE_TABLE_H
+#define SHRPX_APP_COOKIE_TABLE_H
+
+#include "shrpx.h"
+
+#include <mutex>
+#include <list>
+#include <unordered_map>
+#include <string>
+#include <expected>
+
+#include "errors.h"
+
+using namespace nghttp2;
+
+namespace shrpx {
+
+// The maximum number of cookie values which AppCookieTable of a
+// backend group remembers.
+constexpr size_t APP_COOKIE_TABLE_MAX_ENTRIES = 65536;
+
+// AppCookieTable remembers which backend address issued each value
+// of the cookie used by affinity=app-cookie.  It is shared by all
+// worker threads in a process, and holds at most the fixed number of
+// values, evicting the least recently used one.
+class AppCookieTable {
+public:
+  AppCookieTable(size_t max_entries);
+
+  // add records that the backend address identified by |addr_hash|
+  // issued the cookie value |value|.
+  void add(std::string_view value, uint32_t addr_hash);
+  // get returns the hash of the backend address which issued the
+  // cookie value |value|.  It returns Error::ENTITY_NOT_FOUND if
+  // |value| is unknown.
+  std::expected<uint32_t, Error> get(std::string_view value);
+  // size returns the number of entries.
+  [[nodiscard]] size_t size();
+
+private:
+  struct Entry {
+    std::string value;
+    uint32_t addr_hash;
+  };
+
+  std::mutex mu_;
+  // lru_ is ordered from the most recently used entry to the least
+  // recently used one.
+  std::list<Entry> lru_;
+  std::unordered_map<std::string_view, std::list<Entry>::iterator> index_;
+  size_t max_entries_;
+};
+
+} // namespace shrpx
+
+#endif // !defined(SHRPX_APP_COOKIE_TABLE_H)
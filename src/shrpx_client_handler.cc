@@ -36,6 +36,7 @@
 
 #include <cerrno>
 #include <algorithm>
+#include <ranges>
 
 #include "shrpx_upstream.h"
 #include "shrpx_http2_upstream.h"
@@ -52,9 +53,16 @@
 #include "shrpx_api_downstream_connection.h"
 #include "shrpx_health_monitor_downstream_connection.h"
 #include "shrpx_null_downstream_connection.h"
+#include "shrpx_collapsed_downstream_connection.h"
+#include "shrpx_app_cookie_table.h"
 #ifdef ENABLE_HTTP3
 #  include "shrpx_http3_upstream.h"
+#  include "shrpx_http3_session.h"
+#  include "shrpx_http3_downstream_connection.h"
 #endif // defined(ENABLE_HTTP3)
+#ifdef HAVE_LIBURING
+#  include "shrpx_io_uring.h"
+#endif // defined(HAVE_LIBURING)
 #include "shrpx_log.h"
 #include "util.h"
 #include "template.h"
@@ -77,6 +85,18 @@ void timeoutcb(struct ev_loop *loop, ev_timer *w, int revents) {
 }
 } // namespace
 
+namespace {
+void read_timeoutcb(TimerWheelEntry *ent) {
+  auto handler = static_cast<ClientHandler *>(ent->data);
+
+  if (log_enabled(INFO)) {
+    Log{INFO, handler} << "Time out";
+  }
+
+  delete handler;
+}
+} // namespace
+
 namespace {
 void shutdowncb(struct ev_loop *loop, ev_timer *w, int revents) {
   auto handler = static_cast<ClientHandler *>(w->data);
@@ -124,6 +144,13 @@ void writecb(struct ev_loop *loop, ev_io *w, int revents) {
 } // namespace
 
 std::expected<void, Error> ClientHandler::read_clear() {
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+  // Completion notifications of MSG_ZEROCOPY make socket readable.
+  if (auto rv = conn_.handle_zerocopy_completions(); !rv) {
+    return rv;
+  }
+#endif // defined(SO_EE_ORIGIN_ZEROCOPY)
+
   auto should_break = false;
   rb_.ensure_chunk();
   for (;;) {
@@ -164,11 +191,36 @@ std::expected<void, Error> ClientHandler::read_clear() {
 std::expected<void, Error> ClientHandler::write_clear() {
   std::array<iovec, 2> iovbuf;
 
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+  if (auto rv = conn_.handle_zerocopy_completions(); !rv) {
+    return rv;
+  }
+#endif // defined(SO_EE_ORIGIN_ZEROCOPY)
+
   for (;;) {
     if (auto rv = on_write(); !rv) {
       return rv;
     }
 
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+    if (auto buf = upstream_->get_response_buf();
+        buf && conn_.zerocopy_wanted(buf->rleft())) {
+      auto maybe_nwrite = conn_.write_zerocopy(*buf);
+      if (!maybe_nwrite) {
+        return std::unexpected{maybe_nwrite.error()};
+      }
+
+      auto nwrite = *maybe_nwrite;
+      if (nwrite == 0) {
+        return {};
+      }
+
+      upstream_->response_drain(nwrite);
+
+      continue;
+    }
+#endif // defined(SO_EE_ORIGIN_ZEROCOPY)
+
     auto iov = upstream_->response_riovec(iovbuf);
     if (iov.empty()) {
       break;
@@ -193,6 +245,79 @@ std::expected<void, Error> ClientHandler::write_clear() {
   return {};
 }
 
+#ifdef HAVE_SPLICE
+std::expected<void, Error> ClientHandler::read_splice() {
+  if (rb_.chunk_avail()) {
+    // The bytes read before splice was started must be forwarded
+    // first.
+    if (rb_.rleft()) {
+      if (auto rv = on_read(); !rv) {
+        return rv;
+      }
+
+      if (rb_.rleft()) {
+        return {};
+      }
+    }
+
+    rb_.release_chunk();
+  }
+
+  // upstream_ is always HttpsUpstream if splice is used.
+  return static_cast<HttpsUpstream *>(upstream_.get())->splice_read();
+}
+
+std::expected<void, Error> ClientHandler::write_splice() {
+  // upstream_ is always HttpsUpstream if splice is used.
+  auto upstream = static_cast<HttpsUpstream *>(upstream_.get());
+  auto pipe = upstream->get_response_pipe();
+
+  std::array<iovec, 2> iovbuf;
+
+  for (;;) {
+    if (auto rv = on_write(); !rv) {
+      return rv;
+    }
+
+    // The bytes buffered before splice was started must be written
+    // first.
+    auto iov = upstream->response_riovec(iovbuf);
+
+    std::expected<size_t, Error> maybe_nwrite;
+    if (!iov.empty()) {
+      maybe_nwrite = conn_.writev_clear(iov);
+    } else if (pipe->len) {
+      maybe_nwrite = conn_.splice_write(*pipe);
+    } else {
+      break;
+    }
+
+    if (!maybe_nwrite) {
+      return std::unexpected{maybe_nwrite.error()};
+    }
+
+    auto nwrite = *maybe_nwrite;
+    if (nwrite == 0) {
+      return {};
+    }
+
+    if (!iov.empty()) {
+      upstream->response_drain(nwrite);
+      continue;
+    }
+
+    if (auto rv = upstream->response_splice_drain(nwrite); !rv) {
+      return rv;
+    }
+  }
+
+  conn_.wlimit.stopw();
+  ev_timer_stop(conn_.loop, &conn_.wt);
+
+  return {};
+}
+#endif // defined(HAVE_SPLICE)
+
 std::expected<void, Error> ClientHandler::proxy_protocol_peek_clear() {
   rb_.ensure_chunk();
 
@@ -225,11 +350,15 @@ std::expected<void, Error> ClientHandler::proxy_protocol_peek_clear() {
 }
 
 std::expected<void, Error> ClientHandler::tls_handshake() {
-  ev_timer_again(conn_.loop, &conn_.rt);
+  repeat_read_timer();
 
   ERR_clear_error();
 
+  auto t = ev_time();
   auto rv = conn_.tls_handshake();
+
+  worker_->add_loop_time(LoopCategory::TLS_HANDSHAKE, ev_time() - t);
+
   if (!rv) {
     if (rv.error() == Error::TLS_HANDSHAKE_INPROGRESS) {
       return {};
@@ -466,13 +595,41 @@ ClientHandler::ClientHandler(Worker *worker, int fd, SSL *ssl,
 
   write_rate_timer_.data = this;
 
+  read_timer_.cb = read_timeoutcb;
+  read_timer_.data = this;
+
   if (!faddr->quic) {
     conn_.rlimit.startw();
   }
-  ev_timer_again(conn_.loop, &conn_.rt);
+  repeat_read_timer();
 
   auto config = get_config();
 
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+  if (!faddr->quic && !ssl && (family == AF_INET || family == AF_INET6) &&
+      config->conn.upstream.zerocopy_threshold) {
+    // If this fails, data is just copied as usual.
+    (void)conn_.enable_zerocopy(worker->get_mcpool(),
+                                config->conn.upstream.zerocopy_threshold);
+  }
+#endif // defined(SO_EE_ORIGIN_ZEROCOPY)
+
+#ifdef HAVE_LIBURING
+  // PROXY protocol peeks at the socket, and MSG_ZEROCOPY relies on
+  // the readiness of the socket to reap completions.
+  if (auto ring = worker->get_io_uring();
+      ring && ring->recv_available() && !faddr->quic && !ssl &&
+      !faddr_->accept_proxy_protocol &&
+      !config->conn.upstream.accept_proxy_protocol
+#  ifdef SO_EE_ORIGIN_ZEROCOPY
+      && !conn_.zerocopy
+#  endif // defined(SO_EE_ORIGIN_ZEROCOPY)
+  ) {
+    // If this fails, data is just read with read(2) as usual.
+    (void)conn_.enable_io_uring_recv(ring);
+  }
+#endif // defined(HAVE_LIBURING)
+
   if (!faddr->quic) {
     if (faddr_->accept_proxy_protocol ||
         config->conn.upstream.accept_proxy_protocol) {
@@ -544,6 +701,13 @@ void ClientHandler::setup_upstream_io_callback() {
   }
 }
 
+#ifdef HAVE_SPLICE
+void ClientHandler::setup_splice_io_callback() {
+  read_ = &ClientHandler::read_splice;
+  write_ = &ClientHandler::write_splice;
+}
+#endif // defined(HAVE_SPLICE)
+
 #ifdef ENABLE_HTTP3
 void ClientHandler::setup_http3_upstream(
   std::unique_ptr<Http3Upstream> &&upstream) {
@@ -574,6 +738,7 @@ ClientHandler::~ClientHandler() {
 
   ev_timer_stop(conn_.loop, &write_rate_timer_);
   ev_timer_stop(conn_.loop, &reneg_shutdown_timer_);
+  worker_->get_timer_wheel()->stop(&read_timer_);
 
   // TODO If backend is http/2, and it is in CONNECTED state, signal
   // it and make it loopbreak when output is zero.
@@ -592,9 +757,9 @@ Upstream *ClientHandler::get_upstream() { return upstream_.get(); }
 struct ev_loop *ClientHandler::get_loop() const { return conn_.loop; }
 
 void ClientHandler::reset_upstream_read_timeout(ev_tstamp t) {
-  conn_.rt.repeat = t;
+  conn_.read_timeout = t;
 
-  ev_timer_again(conn_.loop, &conn_.rt);
+  repeat_read_timer();
 }
 
 void ClientHandler::reset_upstream_write_timeout(ev_tstamp t) {
@@ -604,10 +769,12 @@ void ClientHandler::reset_upstream_write_timeout(ev_tstamp t) {
 }
 
 void ClientHandler::repeat_read_timer() {
-  ev_timer_again(conn_.loop, &conn_.rt);
+  worker_->get_timer_wheel()->start(&read_timer_, conn_.read_timeout);
 }
 
-void ClientHandler::stop_read_timer() { ev_timer_stop(conn_.loop, &conn_.rt); }
+void ClientHandler::stop_read_timer() {
+  worker_->get_timer_wheel()->stop(&read_timer_);
+}
 
 std::expected<void, Error> ClientHandler::validate_next_proto() {
   const unsigned char *next_proto = nullptr;
@@ -718,14 +885,15 @@ void ClientHandler::pool_downstream_connection(
 }
 
 namespace {
-// Computes 32bits hash for session affinity for IP address |ip|.
-uint32_t compute_affinity_from_ip(std::string_view ip) {
+// Computes 32bits hash for session affinity from |key| which is
+// client IP address, or the value of request header field or cookie.
+uint32_t compute_affinity_from_key(std::string_view key) {
   std::array<uint8_t, 32> buf;
 
-  if (!util::sha256(buf, ip)) {
+  if (!util::sha256(buf, key)) {
     // Not sure when sha256 failed.  Just fall back to another
     // function.
-    return util::hash32(ip);
+    return util::hash32(key);
   }
 
   return (static_cast<uint32_t>(buf[0]) << 24) |
@@ -786,6 +954,60 @@ Http2Session *ClientHandler::get_http2_session(
   return session;
 }
 
+#ifdef ENABLE_HTTP3
+Http3Session *ClientHandler::get_http3_session(
+  const std::shared_ptr<DownstreamAddrGroup> &group, DownstreamAddr *addr) {
+  auto &shared_addr = group->shared_addr;
+
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "Selected DownstreamAddr=" << addr
+                    << ", index=" << (addr - shared_addr->addrs.data());
+  }
+
+  for (auto session = addr->http3_extra_freelist.head; session;) {
+    auto next = session->dlnext;
+
+    if (session->max_concurrency_reached(0)) {
+      if (log_enabled(INFO)) {
+        Log{INFO, this} << "Maximum streams have been reached for Http3Session("
+                        << session << ").  Skip it";
+      }
+
+      session->remove_from_freelist();
+      session = next;
+
+      continue;
+    }
+
+    if (log_enabled(INFO)) {
+      Log{INFO, this} << "Use Http3Session " << session
+                      << " from http3_extra_freelist";
+    }
+
+    if (session->max_concurrency_reached(1)) {
+      if (log_enabled(INFO)) {
+        Log{INFO, this} << "Maximum streams are reached for Http3Session("
+                        << session << ").";
+      }
+
+      session->remove_from_freelist();
+    }
+    return session;
+  }
+
+  auto session = new Http3Session(conn_.loop, worker_->get_quic_cl_ssl_ctx(),
+                                  worker_, group, addr);
+
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "Create new Http3Session " << session;
+  }
+
+  session->add_to_extra_freelist();
+
+  return session;
+}
+#endif // defined(ENABLE_HTTP3)
+
 uint32_t ClientHandler::get_affinity_cookie(Downstream *downstream,
                                             std::string_view cookie_name) {
   auto h = downstream->find_affinity_cookie(cookie_name);
@@ -802,6 +1024,164 @@ uint32_t ClientHandler::get_affinity_cookie(Downstream *downstream,
   return h;
 }
 
+uint32_t ClientHandler::get_affinity_ip() {
+  if (!affinity_hash_computed_) {
+    affinity_hash_ = compute_affinity_from_key(ipaddr_);
+    affinity_hash_computed_ = true;
+  }
+
+  return affinity_hash_;
+}
+
+namespace {
+// Returns true if |addr| can take one more request without exceeding
+// the bounded load of |shared_addr|.
+bool affinity_addr_within_load(const SharedDownstreamAddr &shared_addr,
+                               const DownstreamAddr &addr) {
+  auto max_load = shared_addr.affinity.max_load;
+  if (max_load == 0) {
+    return true;
+  }
+
+  // The capacity is computed as if this request were already in
+  // flight so that it is never 0.
+  auto n = shared_addr.addrs.size() * 100;
+  auto capacity = (max_load * (shared_addr.num_inflight + 1) + n - 1) / n;
+
+  return addr.num_inflight < capacity;
+}
+} // namespace
+
+namespace {
+// Returns true if |addr| is not blocked, and it can take one more
+// request without exceeding its adaptive concurrency limit.
+bool downstream_addr_usable(const SharedDownstreamAddr &shared_addr,
+                            const DownstreamAddr &addr) {
+  if (addr.connect_blocker->blocked()) {
+    return false;
+  }
+
+  return shared_addr.concurrency_limit == 0 ||
+         downstream_addr_concurrency_available(addr);
+}
+} // namespace
+
+namespace {
+// Returns the error for a request to |shared_addr| for which no
+// backend address is usable.  If some addresses are not blocked, they
+// are all at their concurrency limit.  Then the request is rejected as
+// overloaded, and the rejection is counted on each of them.  If
+// |exclude| is not nullptr, the request is a hedged copy of the
+// request in flight to |exclude|.  It is not counted as rejection
+// because the original request is still served.
+Error no_avail_downstream_error(SharedDownstreamAddr &shared_addr,
+                                const DownstreamAddr *exclude) {
+  if (shared_addr.concurrency_limit == 0 || exclude) {
+    return Error::NO_AVAIL_DOWNSTREAM;
+  }
+
+  auto overloaded = false;
+
+  for (auto &addr : shared_addr.addrs) {
+    if (addr.connect_blocker->blocked()) {
+      continue;
+    }
+
+    ++addr.num_concurrency_rejected;
+    overloaded = true;
+  }
+
+  return overloaded ? Error::OVERLOADED : Error::NO_AVAIL_DOWNSTREAM;
+}
+} // namespace
+
+namespace {
+// Returns true if |addr| is usable and is within the bounded load of
+// |shared_addr|.  If |addr| is usable, but exceeds the bounded load,
+// it is assigned to |fallback| unless |fallback| is already assigned.
+bool affinity_addr_available(const SharedDownstreamAddr &shared_addr,
+                             DownstreamAddr *addr, DownstreamAddr *&fallback) {
+  if (!downstream_addr_usable(shared_addr, *addr)) {
+    return false;
+  }
+
+  if (affinity_addr_within_load(shared_addr, *addr)) {
+    return true;
+  }
+
+  if (!fallback) {
+    fallback = addr;
+  }
+
+  return false;
+}
+} // namespace
+
+namespace {
+// Selects a backend address for session affinity hash |hash| from
+// the Maglev lookup table of |shared_addr|.  If the owner of the slot
+// is not available, the other backend addresses are tried in the
+// order of their preference for the slot, so that each address is
+// visited at most once.  If all usable addresses exceed the bounded
+// load, the first usable one is returned.  If no address is usable,
+// returns nullptr.
+DownstreamAddr *select_maglev_addr(SharedDownstreamAddr &shared_addr,
+                                   uint32_t hash) {
+  const auto &table = *shared_addr.maglev_table;
+  auto slot = hash % table.slots.size();
+  auto addr = &shared_addr.addrs[table.slots[slot]];
+  DownstreamAddr *fallback = nullptr;
+
+  if (affinity_addr_available(shared_addr, addr, fallback)) {
+    return addr;
+  }
+
+  for (auto idx : maglev_rank_backends(table, slot) | std::views::drop(1)) {
+    addr = &shared_addr.addrs[idx];
+    if (affinity_addr_available(shared_addr, addr, fallback)) {
+      return addr;
+    }
+  }
+
+  return fallback;
+}
+} // namespace
+
+namespace {
+// Selects a backend address for session affinity hash |hash|.
+// Returns nullptr if no backend address is available.
+DownstreamAddr *select_affinity_addr(SharedDownstreamAddr &shared_addr,
+                                     uint32_t hash) {
+  if (shared_addr.affinity.hash == AffinityHashMethod::MAGLEV) {
+    return select_maglev_addr(shared_addr, hash);
+  }
+
+  const auto &affinity_hash = shared_addr.affinity_hash;
+
+  auto it =
+    std::ranges::lower_bound(affinity_hash, hash, {}, &AffinityHash::hash);
+  if (it == std::ranges::end(affinity_hash)) {
+    it = std::ranges::begin(affinity_hash);
+  }
+
+  auto first = static_cast<size_t>(
+    std::ranges::distance(std::ranges::begin(affinity_hash), it));
+  DownstreamAddr *fallback = nullptr;
+
+  // Walk the ring in circular order.  Each address has a bounded
+  // number of points in the ring.
+  for (size_t i = 0; i < affinity_hash.size(); ++i) {
+    auto addr =
+      &shared_addr.addrs[affinity_hash[(first + i) % affinity_hash.size()].idx];
+    if (affinity_addr_available(shared_addr, addr, fallback)) {
+      return addr;
+    }
+  }
+
+  return fallback;
+}
+} // namespace
+
 namespace {
 void reschedule_addr(
   std::priority_queue<DownstreamAddrEntry, std::vector<DownstreamAddrEntry>,
@@ -830,9 +1210,35 @@ void reschedule_wg(
 }
 } // namespace
 
+namespace {
+// Returns the backend address which issued the cookie value |val| for
+// affinity=app-cookie.  The bounded load does not apply to it.  It
+// returns nullptr if the address is unknown or not usable.
+DownstreamAddr *find_app_cookie_addr(SharedDownstreamAddr &shared_addr,
+                                     std::string_view val) {
+  auto addr_hash = shared_addr.app_cookie_table->get(val);
+  if (!addr_hash) {
+    return nullptr;
+  }
+
+  auto it = shared_addr.affinity_hash_map.find(*addr_hash);
+  if (it == std::ranges::end(shared_addr.affinity_hash_map)) {
+    return nullptr;
+  }
+
+  auto addr = &shared_addr.addrs[(*it).second];
+  if (!downstream_addr_usable(shared_addr, *addr)) {
+    return nullptr;
+  }
+
+  return addr;
+}
+} // namespace
+
 std::expected<DownstreamAddr *, Error>
 ClientHandler::get_downstream_addr(DownstreamAddrGroup *group,
-                                   Downstream *downstream) {
+                                   Downstream *downstream,
+                                   const DownstreamAddr *exclude) {
   switch (faddr_->alt_mode) {
   case UpstreamAltMode::API:
   case UpstreamAltMode::HEALTHMON:
@@ -844,14 +1250,13 @@ ClientHandler::get_downstream_addr(DownstreamAddrGroup *group,
   auto &shared_addr = group->shared_addr;
 
   if (shared_addr->affinity.type != SessionAffinity::NONE) {
+    // Requests to the group with session affinity are never hedged.
+    assert(!exclude);
+
     uint32_t hash;
     switch (shared_addr->affinity.type) {
     case SessionAffinity::IP:
-      if (!affinity_hash_computed_) {
-        affinity_hash_ = compute_affinity_from_ip(ipaddr_);
-        affinity_hash_computed_ = true;
-      }
-      hash = affinity_hash_;
+      hash = get_affinity_ip();
       break;
     case SessionAffinity::COOKIE:
       if (shared_addr->affinity.cookie.stickiness ==
@@ -861,55 +1266,81 @@ ClientHandler::get_downstream_addr(DownstreamAddrGroup *group,
 
       hash = get_affinity_cookie(downstream, shared_addr->affinity.cookie.name);
       break;
-    default:
-      assert(0);
+    case SessionAffinity::HEADER: {
+      auto kv = downstream->request().fs.header(shared_addr->affinity.header);
+      // Fall back to client IP address if the header field is absent.
+      hash = kv && !kv->value.empty() ? compute_affinity_from_key(kv->value)
+                                      : get_affinity_ip();
+      break;
     }
+    case SessionAffinity::APP_COOKIE: {
+      auto val =
+        downstream->find_request_cookie(shared_addr->affinity.cookie.name);
+      // Fall back to client IP address if the cookie is absent.
+      if (val.empty()) {
+        hash = get_affinity_ip();
+        break;
+      }
 
-    const auto &affinity_hash = shared_addr->affinity_hash;
+      if (auto addr = find_app_cookie_addr(*shared_addr, val); addr) {
+        return addr;
+      }
 
-    auto it =
-      std::ranges::lower_bound(affinity_hash, hash, {}, &AffinityHash::hash);
-    if (it == std::ranges::end(affinity_hash)) {
-      it = std::ranges::begin(affinity_hash);
+      // The backend which issued the cookie is unknown or
+      // unavailable.  Hash the cookie value instead.
+      hash = compute_affinity_from_key(val);
+      break;
+    }
+    default:
+      assert(0);
     }
 
-    auto aff_idx = static_cast<size_t>(
-      std::ranges::distance(std::ranges::begin(affinity_hash), it));
-    auto idx = (*it).idx;
-    auto addr = &shared_addr->addrs[idx];
-
-    if (addr->connect_blocker->blocked()) {
-      size_t i;
-      for (i = aff_idx + 1; i != aff_idx; ++i) {
-        if (i == shared_addr->affinity_hash.size()) {
-          i = 0;
-        }
-        addr = &shared_addr->addrs[shared_addr->affinity_hash[i].idx];
-        if (addr->connect_blocker->blocked()) {
-          continue;
-        }
-        break;
-      }
-      if (i == aff_idx) {
-        return std::unexpected{Error::NO_AVAIL_DOWNSTREAM};
-      }
+    auto addr = select_affinity_addr(*shared_addr, hash);
+    if (!addr) {
+      return std::unexpected{no_avail_downstream_error(*shared_addr, nullptr)};
     }
 
     return addr;
   }
 
+  if (shared_addr->lb == LoadBalancing::P2C) {
+    return get_downstream_addr_p2c(shared_addr, exclude);
+  }
+
   auto &wgpq = shared_addr->pq;
+  // The addresses skipped because they are at their concurrency
+  // limit or excluded, and the weight groups which have no usable
+  // address other than them.  Unlike blocked ones, nothing queues
+  // them again later, so they are put back with their current cycle.
+  std::vector<DownstreamAddr *> saturated_addrs;
+  std::vector<WeightGroup *> saturated_wgs;
+
+  auto requeue_saturated = [&wgpq, &saturated_addrs, &saturated_wgs]() {
+    for (auto addr : saturated_addrs) {
+      addr->wg->pq.push(DownstreamAddrEntry{addr, addr->seq, addr->cycle});
+      addr->queued = true;
+    }
+
+    for (auto wg : saturated_wgs) {
+      wgpq.push(WeightGroupEntry{wg, wg->seq, wg->cycle});
+      wg->queued = true;
+    }
+  };
 
   for (;;) {
     if (wgpq.empty()) {
+      requeue_saturated();
+
       Log{INFO, this} << "No working downstream address found";
-      return std::unexpected{Error::NO_AVAIL_DOWNSTREAM};
+      return std::unexpected{no_avail_downstream_error(*shared_addr, exclude)};
     }
 
     auto wg = wgpq.top().wg;
     wgpq.pop();
     wg->queued = false;
 
+    auto nsaturated = saturated_addrs.size();
+
     for (;;) {
       if (wg->pq.empty()) {
         break;
@@ -923,26 +1354,97 @@ ClientHandler::get_downstream_addr(DownstreamAddrGroup *group,
         continue;
       }
 
+      if (addr == exclude || !downstream_addr_usable(*shared_addr, *addr)) {
+        saturated_addrs.push_back(addr);
+        continue;
+      }
+
+      requeue_saturated();
+
       reschedule_addr(wg->pq, addr);
       reschedule_wg(wgpq, wg);
 
       return addr;
     }
+
+    if (saturated_addrs.size() != nsaturated) {
+      saturated_wgs.push_back(wg);
+    }
+  }
+}
+
+std::expected<DownstreamAddr *, Error> ClientHandler::get_downstream_addr_p2c(
+  const std::shared_ptr<SharedDownstreamAddr> &shared_addr,
+  const DownstreamAddr *exclude) {
+  auto &addrs = shared_addr->addrs;
+  auto &gen = worker_->get_randgen();
+  auto now = ev_now(conn_.loop);
+
+  if (addrs.size() >= 2) {
+    // Fast path.  Pick 2 distinct addresses at random.
+    auto i = std::uniform_int_distribution<size_t>(0, addrs.size() - 1)(gen);
+    auto j = std::uniform_int_distribution<size_t>(0, addrs.size() - 2)(gen);
+    if (j >= i) {
+      ++j;
+    }
+
+    auto a = &addrs[i];
+    auto b = &addrs[j];
+
+    if (a != exclude && b != exclude &&
+        downstream_addr_usable(*shared_addr, *a) &&
+        downstream_addr_usable(*shared_addr, *b)) {
+      return downstream_addr_load(*a, now) <= downstream_addr_load(*b, now)
+               ? a
+               : b;
+    }
+  }
+
+  // Some addresses are not usable or excluded, or there is only one
+  // address.  Choose 2 addresses among the usable ones.
+  std::vector<DownstreamAddr *> avail;
+  avail.reserve(addrs.size());
+
+  for (auto &addr : addrs) {
+    if (&addr != exclude && downstream_addr_usable(*shared_addr, addr)) {
+      avail.push_back(&addr);
+    }
   }
+
+  switch (avail.size()) {
+  case 0:
+    if (log_enabled(INFO)) {
+      Log{INFO, this} << "No working downstream address found";
+    }
+    return std::unexpected{no_avail_downstream_error(*shared_addr, exclude)};
+  case 1:
+    return avail[0];
+  default:
+    break;
+  }
+
+  auto i = std::uniform_int_distribution<size_t>(0, avail.size() - 1)(gen);
+  auto j = std::uniform_int_distribution<size_t>(0, avail.size() - 2)(gen);
+  if (j >= i) {
+    ++j;
+  }
+
+  return downstream_addr_load(*avail[i], now) <=
+             downstream_addr_load(*avail[j], now)
+           ? avail[i]
+           : avail[j];
 }
 
 std::expected<DownstreamAddr *, Error>
 ClientHandler::get_downstream_addr_strict_affinity(
   const std::shared_ptr<SharedDownstreamAddr> &shared_addr,
   Downstream *downstream) {
-  const auto &affinity_hash = shared_addr->affinity_hash;
-
   auto h = downstream->find_affinity_cookie(shared_addr->affinity.cookie.name);
   if (h) {
     auto it = shared_addr->affinity_hash_map.find(h);
     if (it != std::ranges::end(shared_addr->affinity_hash_map)) {
       auto addr = &shared_addr->addrs[(*it).second];
-      if (!addr->connect_blocker->blocked()) {
+      if (downstream_addr_usable(*shared_addr, *addr)) {
         return addr;
       }
     }
@@ -954,35 +1456,13 @@ ClientHandler::get_downstream_addr_strict_affinity(
   }
 
   // Client is not bound to a particular backend, or the bound backend
-  // is not found, or is blocked.  Find new backend using h.  Using
+  // is not found, or is not usable.  Find new backend using h.  Using
   // existing h allows us to find new server in a deterministic way.
   // It is preferable because multiple concurrent requests with the
   // stale cookie might be in-flight.
-  auto it = std::ranges::lower_bound(affinity_hash, h, {}, &AffinityHash::hash);
-  if (it == std::ranges::end(affinity_hash)) {
-    it = std::ranges::begin(affinity_hash);
-  }
-
-  auto aff_idx = static_cast<size_t>(
-    std::ranges::distance(std::ranges::begin(affinity_hash), it));
-  auto idx = (*it).idx;
-  auto addr = &shared_addr->addrs[idx];
-
-  if (addr->connect_blocker->blocked()) {
-    size_t i;
-    for (i = aff_idx + 1; i != aff_idx; ++i) {
-      if (i == shared_addr->affinity_hash.size()) {
-        i = 0;
-      }
-      addr = &shared_addr->addrs[shared_addr->affinity_hash[i].idx];
-      if (addr->connect_blocker->blocked()) {
-        continue;
-      }
-      break;
-    }
-    if (i == aff_idx) {
-      return std::unexpected{Error::NO_AVAIL_DOWNSTREAM};
-    }
+  auto addr = select_affinity_addr(*shared_addr, h);
+  if (!addr) {
+    return std::unexpected{no_avail_downstream_error(*shared_addr, nullptr)};
   }
 
   downstream->renew_affinity_cookie(addr->affinity_hash);
@@ -1079,6 +1559,31 @@ ClientHandler::get_downstream_connection(Downstream *downstream) {
     return dconn;
   }
 
+  // A request which is already forwarded on behalf of collapsed
+  // requests, or which fell back from collapsing is not collapsed
+  // again.
+  if (group->shared_addr->collapse && !downstream->get_collapse_entry() &&
+      !downstream->get_collapse_disabled()) {
+    auto key = create_collapse_key(req);
+    if (!key.empty()) {
+      auto entry = worker_->find_collapse_entry(key);
+      if (entry) {
+        if (log_enabled(INFO)) {
+          Log{INFO, this} << "Collapse request into the identical one in "
+                             "flight";
+        }
+
+        auto dconn = std::make_unique<CollapsedDownstreamConnection>(
+          group, entry, conn_.loop);
+        dconn->set_client_handler(this);
+        return dconn;
+      }
+
+      downstream->set_collapse_entry(
+        std::make_unique<CollapseEntry>(worker_, std::move(key), downstream));
+    }
+  }
+
   auto maybe_addr = get_downstream_addr(group.get(), downstream);
   if (!maybe_addr) {
     return std::unexpected{maybe_addr.error()};
@@ -1087,42 +1592,69 @@ ClientHandler::get_downstream_connection(Downstream *downstream) {
   auto addr = *maybe_addr;
 
   if (addr->proto == Proto::HTTP1) {
-    auto dconn = addr->dconn_pool->pop_downstream_connection();
-    if (dconn) {
-      dconn->set_client_handler(this);
-      return dconn;
-    }
+    return get_http1_downstream_connection(group, addr);
+  }
 
-    if (worker_->get_connect_blocker()->blocked()) {
-      if (log_enabled(INFO)) {
-        Log{INFO, this}
-          << "Worker wide backend connection was blocked temporarily";
-      }
-      return std::unexpected{Error::NO_AVAIL_DOWNSTREAM};
-    }
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "Downstream connection pool is empty."
+                    << " Create new one";
+  }
 
-    if (log_enabled(INFO)) {
-      Log{INFO, this} << "Downstream connection pool is empty."
-                      << " Create new one";
-    }
+#ifdef ENABLE_HTTP3
+  if (addr->proto == Proto::HTTP3) {
+    auto http3session = get_http3_session(group, addr);
+    auto dconn = std::make_unique<Http3DownstreamConnection>(http3session);
+    dconn->set_client_handler(this);
+    return dconn;
+  }
+#endif // defined(ENABLE_HTTP3)
 
-    dconn = std::make_unique<HttpDownstreamConnection>(group, addr, conn_.loop,
-                                                       worker_);
+  auto http2session = get_http2_session(group, addr);
+  auto dconn = std::make_unique<Http2DownstreamConnection>(http2session);
+  dconn->set_client_handler(this);
+  return dconn;
+}
+
+std::expected<std::unique_ptr<DownstreamConnection>, Error>
+ClientHandler::get_http1_downstream_connection(
+  const std::shared_ptr<DownstreamAddrGroup> &group, DownstreamAddr *addr) {
+  auto dconn = addr->dconn_pool->pop_downstream_connection();
+  if (dconn) {
     dconn->set_client_handler(this);
     return dconn;
   }
 
+  if (worker_->get_connect_blocker()->blocked()) {
+    if (log_enabled(INFO)) {
+      Log{INFO, this}
+        << "Worker wide backend connection was blocked temporarily";
+    }
+    return std::unexpected{Error::NO_AVAIL_DOWNSTREAM};
+  }
+
   if (log_enabled(INFO)) {
     Log{INFO, this} << "Downstream connection pool is empty."
                     << " Create new one";
   }
 
-  auto http2session = get_http2_session(group, addr);
-  auto dconn = std::make_unique<Http2DownstreamConnection>(http2session);
+  dconn =
+    std::make_unique<HttpDownstreamConnection>(group, addr, conn_.loop, worker_);
   dconn->set_client_handler(this);
   return dconn;
 }
 
+std::expected<std::unique_ptr<DownstreamConnection>, Error>
+ClientHandler::get_hedge_downstream_connection(
+  Downstream *downstream, const std::shared_ptr<DownstreamAddrGroup> &group,
+  const DownstreamAddr *exclude) {
+  auto maybe_addr = get_downstream_addr(group.get(), downstream, exclude);
+  if (!maybe_addr) {
+    return std::unexpected{maybe_addr.error()};
+  }
+
+  return get_http1_downstream_connection(group, *maybe_addr);
+}
+
 MemchunkPool *ClientHandler::get_mcpool() { return worker_->get_mcpool(); }
 
 SSL *ClientHandler::get_ssl() const { return conn_.tls.ssl; }
@@ -43,6 +43,7 @@
 
 #include "shrpx_rate_limit.h"
 #include "shrpx_connection.h"
+#include "shrpx_timer_wheel.h"
 #include "buffer.h"
 #include "memchunk.h"
 #include "allocator.h"
@@ -65,6 +66,7 @@ struct SharedDownstreamAddr;
 struct DownstreamAddr;
 #ifdef ENABLE_HTTP3
 class Http3Upstream;
+class Http3Session;
 #endif // defined(ENABLE_HTTP3)
 
 class ClientHandler {
@@ -84,6 +86,11 @@ public:
   // Performs TLS I/O
   std::expected<void, Error> read_tls();
   std::expected<void, Error> write_tls();
+#ifdef HAVE_SPLICE
+  // Performs clear text I/O of an upgraded tunnel with splice(2)
+  std::expected<void, Error> read_splice();
+  std::expected<void, Error> write_splice();
+#endif // defined(HAVE_SPLICE)
 
   std::expected<void, Error> upstream_noop() { return {}; }
   std::expected<void, Error> upstream_read();
@@ -115,11 +122,22 @@ public:
 
   void pool_downstream_connection(std::unique_ptr<DownstreamConnection> dconn);
   void remove_downstream_connection(DownstreamConnection *dconn);
+  // Selects a backend address in |group| for |downstream|.  If
+  // |exclude| is not nullptr, it is never selected.
   std::expected<DownstreamAddr *, Error>
-  get_downstream_addr(DownstreamAddrGroup *group, Downstream *downstream);
+  get_downstream_addr(DownstreamAddrGroup *group, Downstream *downstream,
+                      const DownstreamAddr *exclude = nullptr);
   // Returns DownstreamConnection object based on request path.
   std::expected<std::unique_ptr<DownstreamConnection>, Error>
   get_downstream_connection(Downstream *downstream);
+  // Returns HTTP/1 DownstreamConnection object to send the hedged
+  // copy of the request of |downstream|.  The backend address is
+  // selected from |group| excluding |exclude| to which the original
+  // request is in flight.
+  std::expected<std::unique_ptr<DownstreamConnection>, Error>
+  get_hedge_downstream_connection(
+    Downstream *downstream, const std::shared_ptr<DownstreamAddrGroup> &group,
+    const DownstreamAddr *exclude);
   MemchunkPool *get_mcpool();
   SSL *get_ssl() const;
   // Call this function when HTTP/2 connection header is received at
@@ -153,6 +171,12 @@ public:
   ev_io *get_wev();
 
   void setup_upstream_io_callback();
+#ifdef HAVE_SPLICE
+  // Switches to splice(2) based I/O.  This function must be called
+  // by HttpsUpstream which has started forwarding an upgraded tunnel
+  // with splice.
+  void setup_splice_io_callback();
+#endif // defined(HAVE_SPLICE)
 
 #ifdef ENABLE_HTTP3
   void setup_http3_upstream(std::unique_ptr<Http3Upstream> &&upstream);
@@ -175,6 +199,15 @@ public:
   get_http2_session(const std::shared_ptr<DownstreamAddrGroup> &group,
                     DownstreamAddr *addr);
 
+#ifdef ENABLE_HTTP3
+  Http3Session *
+  get_http3_session(const std::shared_ptr<DownstreamAddrGroup> &group,
+                    DownstreamAddr *addr);
+#endif // defined(ENABLE_HTTP3)
+
+  // Returns session affinity hash computed from client IP address.
+  uint32_t get_affinity_ip();
+
   // Returns an affinity cookie value for |downstream|.  |cookie_name|
   // is used to inspect cookie header field in request header fields.
   uint32_t get_affinity_cookie(Downstream *downstream,
@@ -184,6 +217,18 @@ public:
     const std::shared_ptr<SharedDownstreamAddr> &shared_addr,
     Downstream *downstream);
 
+  // Selects a backend address using power of two random choices.
+  // |exclude| is never selected unless it is nullptr.
+  std::expected<DownstreamAddr *, Error> get_downstream_addr_p2c(
+    const std::shared_ptr<SharedDownstreamAddr> &shared_addr,
+    const DownstreamAddr *exclude);
+
+  // Returns HTTP/1 DownstreamConnection object to |addr| in |group|,
+  // reusing the pooled one if available.
+  std::expected<std::unique_ptr<DownstreamConnection>, Error>
+  get_http1_downstream_connection(
+    const std::shared_ptr<DownstreamAddrGroup> &group, DownstreamAddr *addr);
+
   const UpstreamAddr *get_upstream_addr() const;
 
   void repeat_read_timer();
@@ -227,6 +272,10 @@ private:
   Connection conn_;
   ev_timer reneg_shutdown_timer_;
   ev_timer write_rate_timer_;
+  // Read (idle) timer.  Its timeout is Connection::read_timeout.  It
+  // is restarted very often, so it lives in the timer wheel of worker
+  // instead of the timer heap of libev.
+  TimerWheelEntry read_timer_;
   std::unique_ptr<Upstream> upstream_;
   // IP address of client.  If UNIX domain socket is used, this is
   // "localhost".
@@ -0,0 +1,392 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2026 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_collapsed_downstream_connection.h"
+#include "shrpx_upstream.h"
+#include "shrpx_downstream.h"
+#include "shrpx_client_handler.h"
+#include "shrpx_worker.h"
+#include "shrpx_http.h"
+#include "shrpx_log.h"
+#include "http2.h"
+
+namespace shrpx {
+
+CollapseEntry::CollapseEntry(Worker *worker, std::string key,
+                             Downstream *leader)
+  : key_{std::move(key)}, worker_{worker}, leader_{leader}, open_{true} {
+  worker_->add_collapse_entry(this);
+}
+
+CollapseEntry::~CollapseEntry() {
+  close();
+  detach_followers();
+}
+
+void CollapseEntry::close() {
+  if (!open_) {
+    return;
+  }
+
+  worker_->remove_collapse_entry(this);
+  open_ = false;
+}
+
+void CollapseEntry::detach_followers() {
+  for (auto dconn = followers_.head; dconn;) {
+    auto next = dconn->dlnext;
+    followers_.remove(dconn);
+    dconn->detach_entry();
+    dconn = next;
+  }
+}
+
+void CollapseEntry::add_follower(CollapsedDownstreamConnection *dconn) {
+  followers_.append(dconn);
+}
+
+void CollapseEntry::remove_follower(CollapsedDownstreamConnection *dconn) {
+  followers_.remove(dconn);
+}
+
+void CollapseEntry::on_response_header() {
+  close();
+
+  const auto &resp = leader_->response();
+
+  if (!http::shareable_response(resp.http_status, resp.fs.headers())) {
+    if (log_enabled(INFO)) {
+      Log{INFO, leader_} << "Response is not shareable; "
+                         << followers_.size()
+                         << " collapsed request(s) fall back";
+    }
+
+    detach_followers();
+
+    return;
+  }
+
+  for (auto dconn = followers_.head; dconn; dconn = dconn->dlnext) {
+    dconn->on_response_header(leader_);
+  }
+}
+
+void CollapseEntry::on_response_body(std::span<const uint8_t> data,
+                                     bool flush) {
+  for (auto dconn = followers_.head; dconn; dconn = dconn->dlnext) {
+    dconn->on_response_body(data, flush);
+  }
+}
+
+void CollapseEntry::on_response_complete() {
+  for (auto dconn = followers_.head; dconn; dconn = dconn->dlnext) {
+    dconn->on_response_complete(leader_);
+  }
+
+  detach_followers();
+}
+
+namespace {
+void timeoutcb(struct ev_loop *loop, ev_timer *w, int revents) {
+  auto dconn = static_cast<CollapsedDownstreamConnection *>(w->data);
+
+  dconn->handle_state();
+}
+} // namespace
+
+CollapsedDownstreamConnection::CollapsedDownstreamConnection(
+  const std::shared_ptr<DownstreamAddrGroup> &group, CollapseEntry *entry,
+  struct ev_loop *loop)
+  : group_{group}, entry_{entry}, loop_{loop}, state_{CollapseState::WAIT} {
+  ev_timer_init(&wt_, timeoutcb, 0., group_->shared_addr->timeout.read);
+  wt_.data = this;
+
+  entry_->add_follower(this);
+}
+
+CollapsedDownstreamConnection::~CollapsedDownstreamConnection() {
+  ev_timer_stop(loop_, &wt_);
+
+  if (entry_) {
+    entry_->remove_follower(this);
+  }
+}
+
+std::expected<void, Error>
+CollapsedDownstreamConnection::attach_downstream(Downstream *downstream) {
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "Attaching to DOWNSTREAM:" << downstream;
+  }
+
+  downstream_ = downstream;
+
+  if (state_ == CollapseState::WAIT) {
+    ev_timer_again(loop_, &wt_);
+  }
+
+  return {};
+}
+
+std::expected<void, Error>
+CollapsedDownstreamConnection::detach_downstream(Downstream *downstream) {
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "Detaching from DOWNSTREAM:" << downstream;
+  }
+
+  ev_timer_stop(loop_, &wt_);
+
+  downstream_ = nullptr;
+
+  return {};
+}
+
+const std::shared_ptr<DownstreamAddrGroup> &
+CollapsedDownstreamConnection::get_downstream_addr_group() const {
+  return group_;
+}
+
+void CollapsedDownstreamConnection::schedule(CollapseState state) {
+  state_ = state;
+
+  ev_timer_stop(loop_, &wt_);
+
+  if (!downstream_) {
+    return;
+  }
+
+  ev_timer_set(&wt_, 0., 0.);
+  ev_timer_start(loop_, &wt_);
+}
+
+void CollapsedDownstreamConnection::on_response_header(
+  const Downstream *leader) {
+  // The response might have been generated by mruby script.
+  if (state_ != CollapseState::WAIT || !downstream_ ||
+      downstream_->get_response_state() != DownstreamState::INITIAL) {
+    return;
+  }
+
+  ev_timer_stop(loop_, &wt_);
+
+  const auto &src = leader->response();
+  const auto &req = downstream_->request();
+  auto &resp = downstream_->response();
+  auto &balloc = downstream_->get_block_allocator();
+
+  resp.http_status = src.http_status;
+  resp.http_major = src.http_major;
+  resp.http_minor = src.http_minor;
+
+  // The leader Downstream may be deleted before the follower finishes
+  // sending the response.  Copy header fields to our allocator.
+  for (auto &kv : src.fs.headers()) {
+    if (kv.token == http2::HD_TRANSFER_ENCODING) {
+      continue;
+    }
+
+    resp.fs.add_header_token(make_string_ref(balloc, kv.name),
+                             make_string_ref(balloc, kv.value), kv.no_index,
+                             kv.token);
+  }
+
+  resp.fs.content_length = src.fs.content_length;
+
+  if (resp.fs.content_length == -1 && downstream_->expect_response_body()) {
+    if (http2::legacy_http1(req.http_major, req.http_minor)) {
+      resp.connection_close = true;
+    } else {
+      resp.fs.add_header_token("transfer-encoding"sv, "chunked"sv, false,
+                               http2::HD_TRANSFER_ENCODING);
+      downstream_->set_chunked_response(true);
+    }
+  }
+
+  downstream_->set_response_state(DownstreamState::HEADER_COMPLETE);
+
+  state_ = CollapseState::STREAMING;
+
+  auto upstream = downstream_->get_upstream();
+
+  if (!upstream->on_downstream_header_complete(downstream_)) {
+    schedule(CollapseState::ABORT);
+
+    return;
+  }
+
+  upstream->get_client_handler()->signal_write();
+}
+
+void CollapsedDownstreamConnection::on_response_body(
+  std::span<const uint8_t> data, bool flush) {
+  if (state_ != CollapseState::STREAMING) {
+    return;
+  }
+
+  auto &resp = downstream_->response();
+
+  resp.recv_body_length += as_signed(data.size());
+
+  auto upstream = downstream_->get_upstream();
+
+  if (!upstream->on_downstream_body(downstream_, data, flush)) {
+    schedule(CollapseState::ABORT);
+
+    return;
+  }
+
+  // The leader reads the response as fast as it can be sent to its
+  // client, and cannot wait for the slowest follower.  The follower
+  // which cannot keep up is aborted rather than buffering the whole
+  // response.
+  if (downstream_->response_buf_full()) {
+    if (log_enabled(INFO)) {
+      Log{INFO, this} << "Response buffer is full; abort collapsed request";
+    }
+
+    schedule(CollapseState::ABORT);
+
+    return;
+  }
+
+  upstream->get_client_handler()->signal_write();
+}
+
+void CollapsedDownstreamConnection::on_response_complete(
+  const Downstream *leader) {
+  if (state_ != CollapseState::STREAMING) {
+    return;
+  }
+
+  auto &resp = downstream_->response();
+  auto &balloc = downstream_->get_block_allocator();
+
+  for (auto &kv : leader->response().fs.trailers()) {
+    resp.fs.add_trailer_token(make_string_ref(balloc, kv.name),
+                              make_string_ref(balloc, kv.value), kv.no_index,
+                              kv.token);
+  }
+
+  downstream_->set_response_state(DownstreamState::MSG_COMPLETE);
+
+  state_ = CollapseState::DONE;
+
+  auto upstream = downstream_->get_upstream();
+
+  if (!upstream->on_downstream_body_complete(downstream_)) {
+    schedule(CollapseState::ABORT);
+
+    return;
+  }
+
+  upstream->get_client_handler()->signal_write();
+}
+
+void CollapsedDownstreamConnection::detach_entry() {
+  entry_ = nullptr;
+
+  switch (state_) {
+  case CollapseState::WAIT:
+    schedule(CollapseState::FALLBACK);
+
+    return;
+  case CollapseState::STREAMING:
+    schedule(CollapseState::ABORT);
+
+    return;
+  default:
+    return;
+  }
+}
+
+void CollapsedDownstreamConnection::handle_state() {
+  auto downstream = downstream_;
+  if (!downstream) {
+    return;
+  }
+
+  auto upstream = downstream->get_upstream();
+  auto handler = upstream->get_client_handler();
+
+  switch (state_) {
+  case CollapseState::WAIT:
+    if (log_enabled(INFO)) {
+      Log{INFO, this} << "Timeout while waiting for the collapsed response";
+    }
+
+    [[fallthrough]];
+  case CollapseState::FALLBACK:
+    if (entry_) {
+      entry_->remove_follower(this);
+      entry_ = nullptr;
+    }
+
+    downstream->disable_collapse();
+
+    // This deletes this object.
+    if (!upstream->on_downstream_reset(downstream, false)) {
+      delete handler;
+    }
+
+    return;
+  case CollapseState::ABORT:
+    downstream->set_response_state(DownstreamState::MSG_RESET);
+
+    // This may delete this object.
+    if (!upstream->downstream_read(this)) {
+      delete handler;
+    }
+
+    return;
+  default:
+    return;
+  }
+}
+
+std::string create_collapse_key(const Request &req) {
+  if (req.method != HTTP_GET || req.upgrade_request ||
+      req.http2_upgrade_seen || req.http2_expect_body ||
+      req.fs.content_length > 0 || req.fs.header(http2::HD_TRANSFER_ENCODING) ||
+      req.fs.header(http2::HD_COOKIE) || req.fs.header("authorization"sv) ||
+      req.fs.header("range"sv)) {
+    return {};
+  }
+
+  auto accept_encoding = req.fs.header(http2::HD_ACCEPT_ENCODING);
+
+  std::string key;
+
+  key += req.scheme;
+  key += ' ';
+  key += req.authority;
+  key += ' ';
+  key += req.path;
+  key += ' ';
+  if (accept_encoding) {
+    key += accept_encoding->value;
+  }
+
+  return key;
+}
+
+} // namespace shrpx
@@ -0,0 +1,173 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2026 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef SHRPX_COLLAPSED_DOWNSTREAM_CONNECTION_H
+#define SHRPX_COLLAPSED_DOWNSTREAM_CONNECTION_H
+
+#include "shrpx.h"
+
+#include <string>
+
+#include <ev.h>
+
+#include "shrpx_downstream_connection.h"
+#include "template.h"
+
+using namespace nghttp2;
+
+namespace shrpx {
+
+class Worker;
+class CollapsedDownstreamConnection;
+struct Request;
+
+// CollapseEntry ties identical requests together so that only one of
+// them, called leader, is forwarded to a backend.  The others, called
+// followers, receive the response to the leader.  CollapseEntry is
+// owned by the leader Downstream.  Followers can join until the final
+// response header of the leader arrives.  If the response is
+// shareable, it is streamed to the followers as it arrives.
+// Otherwise, the followers fall back to their own backend requests.
+class CollapseEntry {
+public:
+  CollapseEntry(Worker *worker, std::string key, Downstream *leader);
+  ~CollapseEntry();
+
+  // Upstream calls these functions when it processes the final
+  // response header, response body, and the end of the response to
+  // the leader respectively.
+  void on_response_header();
+  void on_response_body(std::span<const uint8_t> data, bool flush);
+  void on_response_complete();
+
+  void add_follower(CollapsedDownstreamConnection *dconn);
+  void remove_follower(CollapsedDownstreamConnection *dconn);
+
+  std::string_view get_key() const { return key_; }
+
+private:
+  // Stops accepting new followers.
+  void close();
+  // Removes all followers.  The followers which have not received
+  // the complete response fall back or are aborted.
+  void detach_followers();
+
+  std::string key_;
+  DList<CollapsedDownstreamConnection> followers_;
+  Worker *worker_;
+  Downstream *leader_;
+  // true if this entry accepts new followers.
+  bool open_;
+};
+
+enum class CollapseState {
+  // Waiting for the response header to the leader.
+  WAIT,
+  // The response header has been forwarded to a client, and the
+  // response body is being forwarded.
+  STREAMING,
+  // The complete response has been forwarded.
+  DONE,
+  // The follower should send its own backend request.
+  FALLBACK,
+  // The response is broken in the middle.
+  ABORT,
+};
+
+// CollapsedDownstreamConnection is the DownstreamConnection of a
+// follower.  It does not talk to a backend.  Instead, it relays the
+// response to the leader given by CollapseEntry.  If the response
+// header does not arrive within the read timeout of the group, the
+// follower falls back to its own backend request.
+class CollapsedDownstreamConnection : public DownstreamConnection {
+public:
+  CollapsedDownstreamConnection(
+    const std::shared_ptr<DownstreamAddrGroup> &group, CollapseEntry *entry,
+    struct ev_loop *loop);
+  ~CollapsedDownstreamConnection() override;
+  std::expected<void, Error> attach_downstream(Downstream *downstream) override;
+  std::expected<void, Error> detach_downstream(Downstream *downstream) override;
+
+  std::expected<void, Error> push_request_headers() override { return {}; }
+  std::expected<void, Error>
+  push_upload_data_chunk(std::span<const uint8_t> data) override {
+    return {};
+  }
+  std::expected<void, Error> end_upload_data() override { return {}; }
+
+  void pause_read(IOCtrlReason reason) override {}
+  std::expected<void, Error> resume_read(IOCtrlReason reason,
+                                         size_t consumed) override {
+    return {};
+  }
+  void force_resume_read() override {}
+
+  std::expected<void, Error> on_read() override { return {}; }
+  std::expected<void, Error> on_write() override { return {}; }
+
+  void on_upstream_change(Upstream *upstream) override {}
+
+  // true if this object is poolable.
+  bool poolable() const override { return false; }
+
+  const std::shared_ptr<DownstreamAddrGroup> &
+  get_downstream_addr_group() const override;
+  DownstreamAddr *get_addr() const override { return nullptr; }
+
+  // CollapseEntry calls these functions to relay the response to
+  // |leader|.
+  void on_response_header(const Downstream *leader);
+  void on_response_body(std::span<const uint8_t> data, bool flush);
+  void on_response_complete(const Downstream *leader);
+
+  // CollapseEntry calls this function when it stops relaying the
+  // response.
+  void detach_entry();
+
+  // Processes the state transition scheduled by schedule().
+  void handle_state();
+
+  CollapsedDownstreamConnection *dlnext{}, *dlprev{};
+
+private:
+  // Sets |state| to state_, and schedules handle_state() so that it
+  // runs outside of the context of the leader.
+  void schedule(CollapseState state);
+
+  std::shared_ptr<DownstreamAddrGroup> group_;
+  CollapseEntry *entry_;
+  struct ev_loop *loop_;
+  ev_timer wt_;
+  CollapseState state_;
+};
+
+// Returns the key to find the identical requests to |req|.  It
+// returns an empty string if |req| is not eligible for collapsing.
+// Only GET request without request body, credentials, cookie, and
+// range can be collapsed.
+std::string create_collapse_key(const Request &req);
+
+} // namespace shrpx
+
+#endif // !defined(SHRPX_COLLAPSED_DOWNSTREAM_CONNECTION_H)
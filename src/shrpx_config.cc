@@ -62,6 +62,7 @@
 #include "shrpx_log.h"
 #include "shrpx_tls.h"
 #include "shrpx_http.h"
+#include "shrpx_app_cookie_table.h"
 #ifdef HAVE_MRUBY
 #  include "shrpx_mruby.h"
 #endif // defined(HAVE_MRUBY)
@@ -568,6 +569,15 @@ LogFragmentType log_var_lookup_token(std::string_view name) {
       break;
     }
     break;
+  case 8:
+    switch (name[7]) {
+    case 'e':
+      if (util::strieq("dns_tim"sv, name.substr(0, 7))) {
+        return LogFragmentType::DNS_TIME;
+      }
+      break;
+    }
+    break;
   case 10:
     switch (name[9]) {
     case 'l':
@@ -980,11 +990,45 @@ parse_upstream_params(std::string_view src_params) {
 }
 } // namespace
 
+namespace {
+// Copies session affinity configuration |src| to |dst|.  Strings are
+// allocated by |balloc|.
+void copy_affinity_config(AffinityConfig &dst, const AffinityConfig &src,
+                          BlockAllocator &balloc) {
+  dst.type = src.type;
+
+  switch (src.type) {
+  case SessionAffinity::COOKIE:
+  case SessionAffinity::APP_COOKIE:
+    dst.cookie.name = make_string_ref(balloc, src.cookie.name);
+    if (!src.cookie.path.empty()) {
+      dst.cookie.path = make_string_ref(balloc, src.cookie.path);
+    }
+    dst.cookie.secure = src.cookie.secure;
+    dst.cookie.stickiness = src.cookie.stickiness;
+    break;
+  case SessionAffinity::HEADER: {
+    auto iov = make_byte_ref(balloc, src.header.size() + 1);
+    auto p = util::tolower(src.header, std::ranges::begin(iov));
+    *p = '\0';
+    dst.header = as_string_view(std::ranges::begin(iov), p);
+    break;
+  }
+  default:
+    break;
+  }
+
+  dst.hash = src.hash;
+  dst.max_load = src.max_load;
+}
+} // namespace
+
 struct DownstreamParams {
   std::string_view sni;
   std::string_view mruby;
   std::string_view group;
   AffinityConfig affinity{};
+  LoadBalancing lb{LoadBalancing::WRR};
   ev_tstamp read_timeout{};
   ev_tstamp write_timeout{};
   size_t fall{};
@@ -997,6 +1041,8 @@ struct DownstreamParams {
   bool redirect_if_not_tls{};
   bool upgrade_scheme{};
   bool dnf{};
+  bool collapse{};
+  uint32_t hedge{};
 };
 
 namespace {
@@ -1036,6 +1082,13 @@ parse_downstream_params(std::string_view src_params) {
         out.proto = Proto::HTTP2;
       } else if ("http/1.1"sv == protostr) {
         out.proto = Proto::HTTP1;
+      } else if ("h3"sv == protostr) {
+#ifdef ENABLE_HTTP3
+        out.proto = Proto::HTTP3;
+#else  // !defined(ENABLE_HTTP3)
+        Log{ERROR} << "backend: proto: h3 requires HTTP/3 support";
+        return std::unexpected{Error::INVALID_ARGUMENT};
+#endif // !defined(ENABLE_HTTP3)
       } else {
         Log{ERROR} << "backend: proto: unknown protocol " << protostr;
         return std::unexpected{Error::INVALID_ARGUMENT};
@@ -1082,9 +1135,13 @@ parse_downstream_params(std::string_view src_params) {
         out.affinity.type = SessionAffinity::IP;
       } else if (util::strieq("cookie"sv, valstr)) {
         out.affinity.type = SessionAffinity::COOKIE;
+      } else if (util::strieq("header"sv, valstr)) {
+        out.affinity.type = SessionAffinity::HEADER;
+      } else if (util::strieq("app-cookie"sv, valstr)) {
+        out.affinity.type = SessionAffinity::APP_COOKIE;
       } else {
-        Log{ERROR}
-          << "backend: affinity: value must be one of none, ip, and cookie";
+        Log{ERROR} << "backend: affinity: value must be one of none, ip, "
+                      "cookie, header, and app-cookie";
         return std::unexpected{Error::INVALID_ARGUMENT};
       }
     } else if (util::istarts_with(param, "affinity-cookie-name="sv)) {
@@ -1126,6 +1183,48 @@ parse_downstream_params(std::string_view src_params) {
                       "either loose or strict";
         return std::unexpected{Error::INVALID_ARGUMENT};
       }
+    } else if (util::istarts_with(param, "affinity-header-name="sv)) {
+      auto val =
+        std::string_view{first + str_size("affinity-header-name="), end};
+      if (val.empty()) {
+        Log{ERROR}
+          << "backend: affinity-header-name: non empty string is expected";
+        return std::unexpected{Error::INVALID_ARGUMENT};
+      }
+      out.affinity.header = val;
+    } else if (util::istarts_with(param, "affinity-hash="sv)) {
+      auto valstr = std::string_view{first + str_size("affinity-hash="), end};
+      if (util::strieq("ketama"sv, valstr)) {
+        out.affinity.hash = AffinityHashMethod::KETAMA;
+      } else if (util::strieq("maglev"sv, valstr)) {
+        out.affinity.hash = AffinityHashMethod::MAGLEV;
+      } else {
+        Log{ERROR}
+          << "backend: affinity-hash: value must be either ketama or maglev";
+        return std::unexpected{Error::INVALID_ARGUMENT};
+      }
+    } else if (util::istarts_with(param, "affinity-max-load="sv)) {
+      auto valstr =
+        std::string_view{first + str_size("affinity-max-load="), end};
+      auto maybe_max_load = util::parse_uint(valstr);
+      if (!maybe_max_load ||
+          (*maybe_max_load != 0 && *maybe_max_load < 100) ||
+          *maybe_max_load > 10000) {
+        Log{ERROR} << "backend: affinity-max-load: 0 or integer in [100, "
+                      "10000], inclusive is expected";
+        return std::unexpected{Error::INVALID_ARGUMENT};
+      }
+      out.affinity.max_load = static_cast<uint32_t>(*maybe_max_load);
+    } else if (util::istarts_with(param, "lb="sv)) {
+      auto valstr = std::string_view{first + str_size("lb="), end};
+      if (util::strieq("wrr"sv, valstr)) {
+        out.lb = LoadBalancing::WRR;
+      } else if (util::strieq("p2c"sv, valstr)) {
+        out.lb = LoadBalancing::P2C;
+      } else {
+        Log{ERROR} << "backend: lb: value must be either wrr or p2c";
+        return std::unexpected{Error::INVALID_ARGUMENT};
+      }
     } else if (util::strieq("dns"sv, param)) {
       out.dns = true;
     } else if (util::strieq("redirect-if-not-tls"sv, param)) {
@@ -1192,6 +1291,17 @@ parse_downstream_params(std::string_view src_params) {
       out.group_weight = static_cast<uint32_t>(*n);
     } else if (util::strieq("dnf"sv, param)) {
       out.dnf = true;
+    } else if (util::strieq("collapse"sv, param)) {
+      out.collapse = true;
+    } else if (util::istarts_with(param, "hedge="sv)) {
+      auto valstr = std::string_view{first + str_size("hedge="), end};
+      auto n = util::parse_uint(valstr);
+      if (!n || (*n < 50 || *n > 99)) {
+        Log{ERROR} << "backend: hedge: integer in [50, 99], inclusive is "
+                      "expected";
+        return std::unexpected{Error::INVALID_ARGUMENT};
+      }
+      out.hedge = static_cast<uint32_t>(*n);
     } else if (!param.empty()) {
       Log{ERROR} << "backend: " << param << ": unknown keyword";
       return std::unexpected{Error::INVALID_ARGUMENT};
@@ -1239,10 +1349,30 @@ std::expected<void, Error> parse_mapping(
     return std::unexpected{Error::INVALID_CONFIG};
   }
 
-  if (params.affinity.type == SessionAffinity::COOKIE &&
+  if (addr.host_unix && params.proto == Proto::HTTP3) {
+    Log{ERROR} << "backend: proto: h3 cannot be used for UNIX domain socket";
+    return std::unexpected{Error::INVALID_CONFIG};
+  }
+
+  // The liveness of a backend is probed over TCP, which tells nothing
+  // about a HTTP/3 backend.
+  if (params.proto == Proto::HTTP3 && (params.fall || params.rise)) {
+    Log{ERROR} << "backend: fall and rise cannot be used with proto=h3";
+    return std::unexpected{Error::INVALID_CONFIG};
+  }
+
+  if ((params.affinity.type == SessionAffinity::COOKIE ||
+       params.affinity.type == SessionAffinity::APP_COOKIE) &&
       params.affinity.cookie.name.empty()) {
     Log{ERROR} << "backend: affinity-cookie-name is mandatory if "
-                  "affinity=cookie is specified";
+                  "affinity=cookie or affinity=app-cookie is specified";
+    return std::unexpected{Error::INVALID_CONFIG};
+  }
+
+  if (params.affinity.type == SessionAffinity::HEADER &&
+      params.affinity.header.empty()) {
+    Log{ERROR} << "backend: affinity-header-name is mandatory if "
+                  "affinity=header is specified";
     return std::unexpected{Error::INVALID_CONFIG};
   }
 
@@ -1252,7 +1382,8 @@ std::expected<void, Error> parse_mapping(
   addr.group = make_string_ref(downstreamconf.balloc, params.group);
   addr.group_weight = params.group_weight;
   addr.proto = params.proto;
-  addr.tls = params.tls;
+  // QUIC always uses TLS.
+  addr.tls = params.tls || params.proto == Proto::HTTP3;
   addr.sni = make_string_ref(downstreamconf.balloc, params.sni);
   addr.dns = params.dns;
   addr.upgrade_scheme = params.upgrade_scheme;
@@ -1290,28 +1421,34 @@ std::expected<void, Error> parse_mapping(
       // value under one group.
       if (params.affinity.type != SessionAffinity::NONE) {
         if (g.affinity.type == SessionAffinity::NONE) {
-          g.affinity.type = params.affinity.type;
-          if (params.affinity.type == SessionAffinity::COOKIE) {
-            g.affinity.cookie.name = make_string_ref(
-              downstreamconf.balloc, params.affinity.cookie.name);
-            if (!params.affinity.cookie.path.empty()) {
-              g.affinity.cookie.path = make_string_ref(
-                downstreamconf.balloc, params.affinity.cookie.path);
-            }
-            g.affinity.cookie.secure = params.affinity.cookie.secure;
-            g.affinity.cookie.stickiness = params.affinity.cookie.stickiness;
-          }
+          copy_affinity_config(g.affinity, params.affinity,
+                               downstreamconf.balloc);
         } else if (g.affinity.type != params.affinity.type ||
                    g.affinity.cookie.name != params.affinity.cookie.name ||
                    g.affinity.cookie.path != params.affinity.cookie.path ||
                    g.affinity.cookie.secure != params.affinity.cookie.secure ||
                    g.affinity.cookie.stickiness !=
-                     params.affinity.cookie.stickiness) {
+                     params.affinity.cookie.stickiness ||
+                   !util::strieq(g.affinity.header, params.affinity.header) ||
+                   g.affinity.hash != params.affinity.hash ||
+                   g.affinity.max_load != params.affinity.max_load) {
           Log{ERROR} << "backend: affinity: multiple different affinity "
                         "configurations found in a single group";
           return std::unexpected{Error::INVALID_CONFIG};
         }
       }
+      // If at least one backend uses the load balancing method other
+      // than the default, it is used for all backends sharing the
+      // same pattern.
+      if (params.lb != LoadBalancing::WRR) {
+        if (g.lb == LoadBalancing::WRR) {
+          g.lb = params.lb;
+        } else if (g.lb != params.lb) {
+          Log{ERROR} << "backend: lb: multiple different load balancing "
+                        "methods found in a single group";
+          return std::unexpected{Error::INVALID_CONFIG};
+        }
+      }
       // If at least one backend requires frontend TLS connection,
       // enable it for all backends sharing the same pattern.
       if (params.redirect_if_not_tls) {
@@ -1361,6 +1498,24 @@ std::expected<void, Error> parse_mapping(
       if (params.dnf) {
         g.dnf = true;
       }
+      // If at least one backend enables request collapsing, enable
+      // it for all backends sharing the same pattern.
+      if (params.collapse) {
+        g.collapse = true;
+      }
+      // All backends in the same group must have the same hedge
+      // percentile.  If some backends do not specify it, and there is
+      // at least one backend with it, it is used for all backends in
+      // the group.
+      if (params.hedge) {
+        if (g.hedge == 0) {
+          g.hedge = params.hedge;
+        } else if (g.hedge != params.hedge) {
+          Log{ERROR} << "backend: hedge: multiple different percentiles "
+                        "found in a single group";
+          return std::unexpected{Error::INVALID_CONFIG};
+        }
+      }
 
       g.addrs.push_back(addr);
       continue;
@@ -1371,22 +1526,15 @@ std::expected<void, Error> parse_mapping(
     addr_groups.emplace_back(pattern);
     auto &g = addr_groups.back();
     g.addrs.push_back(addr);
-    g.affinity.type = params.affinity.type;
-    if (params.affinity.type == SessionAffinity::COOKIE) {
-      g.affinity.cookie.name =
-        make_string_ref(downstreamconf.balloc, params.affinity.cookie.name);
-      if (!params.affinity.cookie.path.empty()) {
-        g.affinity.cookie.path =
-          make_string_ref(downstreamconf.balloc, params.affinity.cookie.path);
-      }
-      g.affinity.cookie.secure = params.affinity.cookie.secure;
-      g.affinity.cookie.stickiness = params.affinity.cookie.stickiness;
-    }
+    copy_affinity_config(g.affinity, params.affinity, downstreamconf.balloc);
+    g.lb = params.lb;
     g.redirect_if_not_tls = params.redirect_if_not_tls;
     g.mruby_file = make_string_ref(downstreamconf.balloc, params.mruby);
     g.timeout.read = params.read_timeout;
     g.timeout.write = params.write_timeout;
     g.dnf = params.dnf;
+    g.collapse = params.collapse;
+    g.hedge = params.hedge;
   }
   return {};
 }
@@ -1994,6 +2142,11 @@ int option_lookup_token(std::string_view name) {
         return SHRPX_OPTID_PID_FILE;
       }
       break;
+    case 'g':
+      if (util::strieq("io-urin"sv, name.substr(0, 7))) {
+        return SHRPX_OPTID_IO_URING;
+      }
+      break;
     case 'n':
       if (util::strieq("fastope"sv, name.substr(0, 7))) {
         return SHRPX_OPTID_FASTOPEN;
@@ -2156,6 +2309,9 @@ int option_lookup_token(std::string_view name) {
       if (util::strieq("rlimit-nofil"sv, name.substr(0, 12))) {
         return SHRPX_OPTID_RLIMIT_NOFILE;
       }
+      if (util::strieq("tunnel-splic"sv, name.substr(0, 12))) {
+        return SHRPX_OPTID_TUNNEL_SPLICE;
+      }
       break;
     case 'r':
       if (util::strieq("forwarded-fo"sv, name.substr(0, 12))) {
@@ -2309,6 +2465,11 @@ int option_lookup_token(std::string_view name) {
         return SHRPX_OPTID_TLS_MAX_EARLY_DATA;
       }
       break;
+    case 'e':
+      if (util::strieq("subcert-cache-siz"sv, name.substr(0, 17))) {
+        return SHRPX_OPTID_SUBCERT_CACHE_SIZE;
+      }
+      break;
     case 'r':
       if (util::strieq("add-request-heade"sv, name.substr(0, 17))) {
         return SHRPX_OPTID_ADD_REQUEST_HEADER;
@@ -2380,6 +2541,11 @@ int option_lookup_token(std::string_view name) {
         return SHRPX_OPTID_OCSP_UPDATE_INTERVAL;
       }
       break;
+    case 'n':
+      if (util::strieq("backend-tcp-fastope"sv, name.substr(0, 19))) {
+        return SHRPX_OPTID_BACKEND_TCP_FASTOPEN;
+      }
+      break;
     case 's':
       if (util::strieq("max-worker-processe"sv, name.substr(0, 19))) {
         return SHRPX_OPTID_MAX_WORKER_PROCESSES;
@@ -2389,6 +2555,9 @@ int option_lookup_token(std::string_view name) {
       }
       break;
     case 't':
+      if (util::strieq("backend-hedge-budge"sv, name.substr(0, 19))) {
+        return SHRPX_OPTID_BACKEND_HEDGE_BUDGET;
+      }
       if (util::strieq("backend-read-timeou"sv, name.substr(0, 19))) {
         return SHRPX_OPTID_BACKEND_READ_TIMEOUT;
       }
@@ -2461,6 +2630,16 @@ int option_lookup_token(std::string_view name) {
     break;
   case 22:
     switch (name[21]) {
+    case 'a':
+      if (util::strieq("backend-tls-early-dat"sv, name.substr(0, 21))) {
+        return SHRPX_OPTID_BACKEND_TLS_EARLY_DATA;
+      }
+      break;
+    case 'e':
+      if (util::strieq("tls-session-cache-siz"sv, name.substr(0, 21))) {
+        return SHRPX_OPTID_TLS_SESSION_CACHE_SIZE;
+      }
+      break;
     case 'i':
       if (util::strieq("backend-http-proxy-ur"sv, name.substr(0, 21))) {
         return SHRPX_OPTID_BACKEND_HTTP_PROXY_URI;
@@ -2474,6 +2653,11 @@ int option_lookup_token(std::string_view name) {
         return SHRPX_OPTID_FRONTEND_QUIC_QLOG_DIR;
       }
       break;
+    case 's':
+      if (util::strieq("backend-outlier-error"sv, name.substr(0, 21))) {
+        return SHRPX_OPTID_BACKEND_OUTLIER_ERRORS;
+      }
+      break;
     case 't':
       if (util::strieq("frontend-write-timeou"sv, name.substr(0, 21))) {
         return SHRPX_OPTID_FRONTEND_WRITE_TIMEOUT;
@@ -2517,6 +2701,11 @@ int option_lookup_token(std::string_view name) {
         return SHRPX_OPTID_FRONTEND_HEADER_TIMEOUT;
       }
       break;
+    case 'y':
+      if (util::strieq("backend-outlier-latenc"sv, name.substr(0, 22))) {
+        return SHRPX_OPTID_BACKEND_OUTLIER_LATENCY;
+      }
+      break;
     }
     break;
   case 24:
@@ -2556,6 +2745,11 @@ int option_lookup_token(std::string_view name) {
     break;
   case 25:
     switch (name[24]) {
+    case 'd':
+      if (util::strieq("worker-loop-lag-threshol"sv, name.substr(0, 24))) {
+        return SHRPX_OPTID_WORKER_LOOP_LAG_THRESHOLD;
+      }
+      break;
     case 'e':
       if (util::strieq("backend-http2-window-siz"sv, name.substr(0, 24))) {
         return SHRPX_OPTID_BACKEND_HTTP2_WINDOW_SIZE;
@@ -2578,6 +2772,9 @@ int option_lookup_token(std::string_view name) {
       }
       break;
     case 't':
+      if (util::strieq("backend-concurrency-limi"sv, name.substr(0, 24))) {
+        return SHRPX_OPTID_BACKEND_CONCURRENCY_LIMIT;
+      }
       if (util::strieq("frontend-quic-initial-rt"sv, name.substr(0, 24))) {
         return SHRPX_OPTID_FRONTEND_QUIC_INITIAL_RTT;
       }
@@ -2626,6 +2823,9 @@ int option_lookup_token(std::string_view name) {
   case 27:
     switch (name[26]) {
     case 'd':
+      if (util::strieq("frontend-zerocopy-threshol"sv, name.substr(0, 26))) {
+        return SHRPX_OPTID_FRONTEND_ZEROCOPY_THRESHOLD;
+      }
       if (util::strieq("tls-session-cache-memcache"sv, name.substr(0, 26))) {
         return SHRPX_OPTID_TLS_SESSION_CACHE_MEMCACHED;
       }
@@ -2707,6 +2907,11 @@ int option_lookup_token(std::string_view name) {
     break;
   case 29:
     switch (name[28]) {
+    case 'e':
+      if (util::strieq("backend-outlier-ejection-tim"sv, name.substr(0, 28))) {
+        return SHRPX_OPTID_BACKEND_OUTLIER_EJECTION_TIME;
+      }
+      break;
     case 't':
       if (util::strieq("frontend-stream-write-timeou"sv, name.substr(0, 28))) {
         return SHRPX_OPTID_FRONTEND_STREAM_WRITE_TIMEOUT;
@@ -2809,6 +3014,12 @@ int option_lookup_token(std::string_view name) {
         return SHRPX_OPTID_FRONTEND_HTTP2_DUMP_REQUEST_HEADER;
       }
       break;
+    case 's':
+      if (util::strieq("backend-http2-min-idle-connection"sv,
+                       name.substr(0, 33))) {
+        return SHRPX_OPTID_BACKEND_HTTP2_MIN_IDLE_CONNECTIONS;
+      }
+      break;
     case 't':
       if (util::strieq("backend-http1-connections-per-hos"sv,
                        name.substr(0, 33))) {
@@ -2885,6 +3096,12 @@ int option_lookup_token(std::string_view name) {
         return SHRPX_OPTID_BACKEND_HTTP2_MAX_CONCURRENT_STREAMS;
       }
       break;
+    case 't':
+      if (util::strieq("backend-outlier-max-ejection-percen"sv,
+                       name.substr(0, 35))) {
+        return SHRPX_OPTID_BACKEND_OUTLIER_MAX_EJECTION_PERCENT;
+      }
+      break;
     }
     break;
   case 37:
@@ -4421,6 +4638,97 @@ std::expected<void, Error> parse_config(
     return parse_duration(opt, optarg).transform([config](auto &&r) {
       config->http.upstream.timeout.max_write_rate = r;
     });
+  case SHRPX_OPTID_IO_URING:
+#ifdef HAVE_LIBURING
+    config->io_uring = util::strieq("yes"sv, optarg);
+#else  // !defined(HAVE_LIBURING)
+    if (util::strieq("yes"sv, optarg)) {
+      Log{WARN} << opt << ": nghttpx is built without liburing; ignored";
+    }
+#endif // !defined(HAVE_LIBURING)
+
+    return {};
+  case SHRPX_OPTID_TUNNEL_SPLICE:
+    config->tunnel_splice = util::strieq("yes"sv, optarg);
+
+    return {};
+  case SHRPX_OPTID_FRONTEND_ZEROCOPY_THRESHOLD:
+    return parse_uint_with_unit<size_t>(opt, optarg)
+      .transform(
+        [config](auto &&r) { config->conn.upstream.zerocopy_threshold = r; });
+  case SHRPX_OPTID_TLS_SESSION_CACHE_SIZE:
+    return parse_uint_with_unit<size_t>(opt, optarg)
+      .transform(
+        [config](auto &&r) { config->tls.session_cache.max_size = r; });
+  case SHRPX_OPTID_SUBCERT_CACHE_SIZE:
+    return parse_uint<size_t>(opt, optarg).transform(
+      [config](auto &&r) { config->tls.subcert_cache_size = r; });
+  case SHRPX_OPTID_BACKEND_CONCURRENCY_LIMIT:
+    return parse_uint<size_t>(opt, optarg).transform(
+      [config](auto &&r) { config->conn.downstream->concurrency_limit = r; });
+  case SHRPX_OPTID_BACKEND_HEDGE_BUDGET:
+    return parse_uint<size_t>(opt, optarg)
+      .and_then([config, opt](auto &&r) -> std::expected<void, Error> {
+        if (r > 100) {
+          Log{ERROR} << opt << ": specify an integer in [0, 100], inclusive";
+
+          return std::unexpected{Error::INVALID_CONFIG};
+        }
+
+        config->conn.downstream->hedge_budget = r;
+
+        return {};
+      });
+  case SHRPX_OPTID_BACKEND_HTTP2_MIN_IDLE_CONNECTIONS:
+    return parse_uint<size_t>(opt, optarg).transform([config](auto &&r) {
+      config->conn.downstream->http2_min_idle_connections = r;
+    });
+  case SHRPX_OPTID_BACKEND_TCP_FASTOPEN:
+    config->conn.downstream->tcp_fastopen = util::strieq("yes"sv, optarg);
+
+    return {};
+  case SHRPX_OPTID_BACKEND_TLS_EARLY_DATA:
+    config->conn.downstream->tls_early_data = util::strieq("yes"sv, optarg);
+
+    return {};
+  case SHRPX_OPTID_BACKEND_OUTLIER_ERRORS:
+    return parse_uint<size_t>(opt, optarg).transform([config](auto &&r) {
+      config->conn.downstream->outlier.errors = r;
+    });
+  case SHRPX_OPTID_BACKEND_OUTLIER_LATENCY:
+    return parse_uint<size_t>(opt, optarg)
+      .and_then([config, opt](auto &&r) -> std::expected<void, Error> {
+        if (r == 1) {
+          Log{ERROR} << opt << ": specify 0, or an integer larger than 1";
+
+          return std::unexpected{Error::INVALID_CONFIG};
+        }
+
+        config->conn.downstream->outlier.latency = r;
+
+        return {};
+      });
+  case SHRPX_OPTID_BACKEND_OUTLIER_EJECTION_TIME:
+    return parse_duration(opt, optarg).transform([config](auto &&r) {
+      config->conn.downstream->outlier.ejection_time = r;
+    });
+  case SHRPX_OPTID_BACKEND_OUTLIER_MAX_EJECTION_PERCENT:
+    return parse_uint<size_t>(opt, optarg)
+      .and_then([config, opt](auto &&r) -> std::expected<void, Error> {
+        if (r > 100) {
+          Log{ERROR} << opt << ": specify an integer in [0, 100], inclusive";
+
+          return std::unexpected{Error::INVALID_CONFIG};
+        }
+
+        config->conn.downstream->outlier.max_ejection_percent = r;
+
+        return {};
+      });
+  case SHRPX_OPTID_WORKER_LOOP_LAG_THRESHOLD:
+    return parse_duration(opt, optarg).transform([config](auto &&r) {
+      config->conn.listener.loop_lag_threshold = r;
+    });
   case SHRPX_OPTID_CONF:
     Log{WARN} << "conf: ignored";
 
@@ -4629,6 +4937,18 @@ std::string_view strproto(Proto proto) {
   abort();
 }
 
+bool downstream_http3_configured(const DownstreamConfig &downstreamconf) {
+  for (auto &g : downstreamconf.addr_groups) {
+    for (auto &addr : g.addrs) {
+      if (addr.proto == Proto::HTTP3) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
 namespace {
 // Consistent hashing method described in
 // https://github.com/RJ/ketama.  Generate 160 32-bit hashes per |s|,
@@ -4670,6 +4990,144 @@ std::expected<void, Error> compute_affinity_hash(std::vector<AffinityHash> &res,
 }
 } // namespace
 
+namespace {
+// Returns |a| to the power of |e| modulo |m|.
+uint64_t pow_mod(uint64_t a, uint64_t e, uint64_t m) {
+  uint64_t r = 1;
+
+  a %= m;
+
+  for (; e; e >>= 1) {
+    if (e & 1) {
+      r = r * a % m;
+    }
+
+    a = a * a % m;
+  }
+
+  return r;
+}
+} // namespace
+
+std::expected<MaglevTable, Error>
+compute_maglev_table(std::span<const std::string_view> keys, size_t size) {
+  assert(!keys.empty());
+  assert(size > keys.size());
+  assert(size <= std::numeric_limits<uint32_t>::max());
+
+  struct Permutation {
+    size_t offset;
+    size_t skip;
+    size_t next;
+  };
+
+  std::vector<Permutation> perms;
+  perms.reserve(keys.size());
+
+  std::array<uint8_t, 32> buf;
+
+  for (auto &key : keys) {
+    if (auto rv = util::sha256(buf, key); !rv) {
+      return std::unexpected{rv.error()};
+    }
+
+    auto h1 = (static_cast<uint32_t>(buf[0]) << 24) |
+              (static_cast<uint32_t>(buf[1]) << 16) |
+              (static_cast<uint32_t>(buf[2]) << 8) |
+              static_cast<uint32_t>(buf[3]);
+    auto h2 = (static_cast<uint32_t>(buf[4]) << 24) |
+              (static_cast<uint32_t>(buf[5]) << 16) |
+              (static_cast<uint32_t>(buf[6]) << 8) |
+              static_cast<uint32_t>(buf[7]);
+
+    perms.push_back(Permutation{
+      .offset = h1 % size,
+      .skip = h2 % (size - 1) + 1,
+    });
+  }
+
+  constexpr auto empty = std::numeric_limits<uint32_t>::max();
+
+  MaglevTable table{
+    .slots = std::vector<uint32_t>(size, empty),
+  };
+
+  table.perms.reserve(perms.size());
+
+  for (auto &p : perms) {
+    // |size| is prime.  By Fermat's little theorem, skip^(size - 2)
+    // is the inverse of skip.
+    table.perms.push_back(MaglevTable::Permutation{
+      .offset = static_cast<uint32_t>(p.offset),
+      .skip_inv = static_cast<uint32_t>(pow_mod(p.skip, size - 2, size)),
+    });
+  }
+
+  auto &slots = table.slots;
+  size_t filled = 0;
+
+  // Each backend takes turns filling its next preferred slot which is
+  // not taken yet.  Because |size| is prime, each permutation covers
+  // all slots.
+  for (;;) {
+    for (size_t i = 0; i < perms.size(); ++i) {
+      auto &p = perms[i];
+      size_t c;
+
+      for (;;) {
+        c = (p.offset + p.skip * p.next) % size;
+        ++p.next;
+        if (slots[c] == empty) {
+          break;
+        }
+      }
+
+      slots[c] = static_cast<uint32_t>(i);
+
+      if (++filled == size) {
+        return table;
+      }
+    }
+  }
+}
+
+std::vector<uint32_t> maglev_rank_backends(const MaglevTable &table,
+                                           size_t slot) {
+  auto size = table.slots.size();
+  auto owner = table.slots[slot];
+
+  // The position of |slot| in the permutation of each backend, and
+  // the index of the backend.
+  std::vector<std::pair<uint64_t, uint32_t>> prefs;
+  prefs.reserve(table.perms.size() - 1);
+
+  for (size_t i = 0; i < table.perms.size(); ++i) {
+    if (i == owner) {
+      continue;
+    }
+
+    auto &p = table.perms[i];
+
+    // slot = offset + skip * pos, hence pos = (slot - offset) *
+    // skip_inv.
+    auto pos = (slot + size - p.offset) % size * p.skip_inv % size;
+
+    prefs.emplace_back(pos, static_cast<uint32_t>(i));
+  }
+
+  std::ranges::sort(prefs);
+
+  std::vector<uint32_t> res;
+  res.reserve(table.perms.size());
+  res.push_back(owner);
+
+  for (auto &p : prefs) {
+    res.push_back(p.second);
+  }
+
+  return res;
+}
+
 // Configures the following member in |config|:
 // conn.downstream_router, conn.downstream.addr_groups,
 // conn.downstream.addr_group_catch_all.
@@ -4776,6 +5234,12 @@ configure_downstream_group(Config *config, bool http2_proxy,
     router.add_route(pattern, idx, path_is_wildcard);
   }
 
+  router.compile();
+  rw_router.compile();
+  for (auto &wp : wildcard_patterns) {
+    wp.router.compile();
+  }
+
   ssize_t catch_all_group = -1;
   for (size_t i = 0; i < addr_groups.size(); ++i) {
     auto &g = addr_groups[i];
@@ -4836,6 +5300,15 @@ configure_downstream_group(Config *config, bool http2_proxy,
   std::array<char, util::max_hostport> hostport_buf;
 
   for (auto &g : addr_groups) {
+    // The hedged request races the original one over the second
+    // HTTP/1 connection.
+    if (g.hedge && std::ranges::any_of(g.addrs, [](const auto &addr) {
+          return addr.proto != Proto::HTTP1;
+        })) {
+      Log{FATAL} << "backend: hedge can only be used with proto=h1";
+      return std::unexpected{Error::INVALID_CONFIG};
+    }
+
     std::unordered_map<std::string_view, uint32_t> wgchk;
     for (auto &addr : g.addrs) {
       if (addr.group_weight) {
@@ -4914,6 +5387,7 @@ configure_downstream_group(Config *config, bool http2_proxy,
     }
 
     if (g.affinity.type != SessionAffinity::NONE) {
+      std::vector<std::string_view> keys;
       size_t idx = 0;
       for (auto &addr : g.addrs) {
         std::string_view key;
@@ -4928,12 +5402,16 @@ configure_downstream_group(Config *config, bool http2_proxy,
             reinterpret_cast<const char *>(addr.addr.as_sockaddr()),
             addr.addr.size()};
         }
-        if (auto rv = compute_affinity_hash(g.affinity_hash, idx, key); !rv) {
+        if (g.affinity.hash == AffinityHashMethod::MAGLEV) {
+          keys.push_back(key);
+        } else if (auto rv = compute_affinity_hash(g.affinity_hash, idx, key);
+                   !rv) {
           return rv;
         }
 
-        if (g.affinity.cookie.stickiness ==
-            SessionAffinityCookieStickiness::STRICT) {
+        if (g.affinity.type == SessionAffinity::APP_COOKIE ||
+            g.affinity.cookie.stickiness ==
+              SessionAffinityCookieStickiness::STRICT) {
           addr.affinity_hash = util::hash32(key);
           g.affinity_hash_map.emplace(addr.affinity_hash, idx);
         }
@@ -4941,9 +5419,38 @@ configure_downstream_group(Config *config, bool http2_proxy,
         ++idx;
       }
 
-      std::ranges::sort(g.affinity_hash, [](const auto &lhs, const auto &rhs) {
-        return lhs.hash < rhs.hash;
-      });
+      if (g.affinity.hash == AffinityHashMethod::MAGLEV) {
+        // The table size is a prime number which is at least 100
+        // times larger than the number of backends to keep the
+        // imbalance small.
+        constexpr size_t table_sizes[]{65537, 131071, 262139, 524287,
+                                       1048573, 2097143, 4194301};
+
+        auto it = std::ranges::find_if(table_sizes, [&keys](auto n) {
+          return n >= keys.size() * 100;
+        });
+        if (it == std::ranges::end(table_sizes)) {
+          --it;
+        }
+
+        auto maybe_table = compute_maglev_table(keys, *it);
+        if (!maybe_table) {
+          return std::unexpected{maybe_table.error()};
+        }
+
+        g.maglev_table =
+          std::make_shared<const MaglevTable>(std::move(*maybe_table));
+      } else {
+        std::ranges::sort(g.affinity_hash,
+                          [](const auto &lhs, const auto &rhs) {
+                            return lhs.hash < rhs.hash;
+                          });
+      }
+
+      if (g.affinity.type == SessionAffinity::APP_COOKIE) {
+        g.app_cookie_table =
+          std::make_shared<AppCookieTable>(APP_COOKIE_TABLE_MAX_ENTRIES);
+      }
     }
 
     auto &timeout = g.timeout;
@@ -77,6 +77,7 @@ namespace shrpx {
 struct LogFragment;
 class ConnectBlocker;
 class Http2Session;
+class AppCookieTable;
 
 namespace tls {
 
@@ -402,6 +403,33 @@ inline constexpr auto SHRPX_OPT_FRONTEND_INITIAL_WRITE_RATE_TIMEOUT =
   "frontend-initial-write-rate-timeout"sv;
 inline constexpr auto SHRPX_OPT_FRONTEND_MAX_WRITE_RATE_TIMEOUT =
   "frontend-max-write-rate-timeout"sv;
+inline constexpr auto SHRPX_OPT_IO_URING = "io-uring"sv;
+inline constexpr auto SHRPX_OPT_TUNNEL_SPLICE = "tunnel-splice"sv;
+inline constexpr auto SHRPX_OPT_FRONTEND_ZEROCOPY_THRESHOLD =
+  "frontend-zerocopy-threshold"sv;
+inline constexpr auto SHRPX_OPT_TLS_SESSION_CACHE_SIZE =
+  "tls-session-cache-size"sv;
+inline constexpr auto SHRPX_OPT_SUBCERT_CACHE_SIZE = "subcert-cache-size"sv;
+inline constexpr auto SHRPX_OPT_BACKEND_CONCURRENCY_LIMIT =
+  "backend-concurrency-limit"sv;
+inline constexpr auto SHRPX_OPT_BACKEND_HEDGE_BUDGET =
+  "backend-hedge-budget"sv;
+inline constexpr auto SHRPX_OPT_BACKEND_HTTP2_MIN_IDLE_CONNECTIONS =
+  "backend-http2-min-idle-connections"sv;
+inline constexpr auto SHRPX_OPT_BACKEND_TCP_FASTOPEN =
+  "backend-tcp-fastopen"sv;
+inline constexpr auto SHRPX_OPT_BACKEND_TLS_EARLY_DATA =
+  "backend-tls-early-data"sv;
+inline constexpr auto SHRPX_OPT_BACKEND_OUTLIER_ERRORS =
+  "backend-outlier-errors"sv;
+inline constexpr auto SHRPX_OPT_BACKEND_OUTLIER_LATENCY =
+  "backend-outlier-latency"sv;
+inline constexpr auto SHRPX_OPT_BACKEND_OUTLIER_EJECTION_TIME =
+  "backend-outlier-ejection-time"sv;
+inline constexpr auto SHRPX_OPT_BACKEND_OUTLIER_MAX_EJECTION_PERCENT =
+  "backend-outlier-max-ejection-percent"sv;
+inline constexpr auto SHRPX_OPT_WORKER_LOOP_LAG_THRESHOLD =
+  "worker-loop-lag-threshold"sv;
 
 inline constexpr size_t SHRPX_OBFUSCATED_NODE_LENGTH = 8;
 
@@ -423,6 +451,18 @@ enum class SessionAffinity {
   IP,
   // Cookie based affinity
   COOKIE,
+  // Request header field based affinity
+  HEADER,
+  // Affinity based on a cookie issued by a backend server
+  APP_COOKIE,
+};
+
+enum class AffinityHashMethod {
+  // Consistent hashing described in https://github.com/RJ/ketama
+  KETAMA,
+  // Maglev lookup table described in
+  // https://research.google/pubs/maglev-a-fast-and-reliable-software-network-load-balancer/
+  MAGLEV,
 };
 
 enum class SessionAffinityCookieSecure {
@@ -445,6 +485,15 @@ enum class SessionAffinityCookieStickiness {
   STRICT,
 };
 
+enum class LoadBalancing {
+  // Weighted round robin across weight groups and addresses.
+  WRR,
+  // Power of two random choices.  The backend address with lower
+  // load, which is computed from the number of requests in flight
+  // and the peak EWMA of the response latency, is chosen.
+  P2C,
+};
+
 struct AffinityConfig {
   // Type of session affinity.
   SessionAffinity type;
@@ -458,6 +507,16 @@ struct AffinityConfig {
     // Affinity Stickiness
     SessionAffinityCookieStickiness stickiness;
   } cookie;
+  // Name of a request header field which is hashed to choose a
+  // backend.  It is lowercased.  Only used if type ==
+  // SessionAffinity::HEADER.
+  std::string_view header;
+  // Method to map a hash to a backend.
+  AffinityHashMethod hash;
+  // The maximum number of requests in flight to a backend relative
+  // to the average in percent.  If a backend exceeds it, the next
+  // backend is chosen.  0 means unbounded.
+  uint32_t max_load;
 };
 
 enum shrpx_forwarded_param {
@@ -573,6 +632,24 @@ struct AffinityHash {
   uint32_t hash;
 };
 
+// Maglev lookup table, and the permutation of each backend which
+// fills it.
+struct MaglevTable {
+  struct Permutation {
+    // The first slot which the backend prefers.
+    uint32_t offset;
+    // The multiplicative inverse of the skip of the permutation
+    // modulo slots.size().  It maps a slot to its position in the
+    // permutation.
+    uint32_t skip_inv;
+  };
+
+  // Each element is an index into the backends.
+  std::vector<uint32_t> slots;
+  // The permutation of each backend.
+  std::vector<Permutation> perms;
+};
+
 struct DownstreamAddrGroupConfig {
   DownstreamAddrGroupConfig(std::string_view pattern) : pattern(pattern) {}
 
@@ -583,15 +660,33 @@ struct DownstreamAddrGroupConfig {
   // SessionAffinity::IP.
   std::vector<AffinityHash> affinity_hash;
   // Maps affinity hash of each DownstreamAddrConfig to its index in
-  // addrs.  It is only assigned when strict stickiness is enabled.
+  // addrs.  It is only assigned when strict stickiness or
+  // affinity=app-cookie is enabled.
   std::unordered_map<uint32_t, size_t> affinity_hash_map;
+  // Maglev lookup table.  Each element of its slots is an index into
+  // addrs.  Only used if affinity.hash == AffinityHashMethod::MAGLEV.
+  // It is shared by workers because it is large.
+  std::shared_ptr<const MaglevTable> maglev_table;
+  // The backend address which issued each value of the cookie.  Only
+  // used if affinity.type == SessionAffinity::APP_COOKIE.  It is
+  // shared by workers.
+  std::shared_ptr<AppCookieTable> app_cookie_table;
   // Cookie based session affinity configuration.
   AffinityConfig affinity{SessionAffinity::NONE};
+  // Load balancing method used if session affinity is disabled.
+  LoadBalancing lb{LoadBalancing::WRR};
   // true if this group requires that client connection must be TLS,
   // and the request must be redirected to https URI.
   bool redirect_if_not_tls{};
   // true if a request should not be forwarded to a backend.
   bool dnf{};
+  // true if identical cacheable GET requests in flight are collapsed
+  // into a single backend request.
+  bool collapse{};
+  // The percentile of the time to the response header which is used
+  // as the delay before a slow idempotent request is hedged.  0
+  // disables hedging.
+  uint32_t hedge{};
   // Timeouts for backend connection.
   struct {
     ev_tstamp read;
@@ -715,6 +810,12 @@ struct TLSConfig {
     bool cipher_given;
   } ticket;
 
+  // TLS session cache shared by worker threads
+  struct {
+    // Memory budget of the cache in bytes.  0 disables the cache.
+    size_t max_size;
+  } session_cache;
+
   // Dynamic record sizing configurations
   struct {
     size_t warmup_threshold;
@@ -751,6 +852,10 @@ struct TLSConfig {
   std::unordered_map<std::string_view, std::string_view> psk_secrets;
   // The list of additional TLS certificate pair
   std::vector<TLSCertificate> subcerts;
+  // The maximum number of SSL_CTX for subcerts kept in memory.  If
+  // nonzero, subcerts are loaded on demand.  0 loads all subcerts at
+  // startup.
+  size_t subcert_cache_size;
   std::vector<unsigned char> alpn_prefs;
   // list of supported ALPN protocol strings in the order of
   // preference.
@@ -994,6 +1099,24 @@ struct RouterConfig {
   std::vector<WildcardPattern> wildcard_patterns;
 };
 
+// Passive outlier detection of backend addresses.
+struct OutlierConfig {
+  bool operator==(const OutlierConfig &) const = default;
+
+  // The duration of the first ejection of an address.  It doubles
+  // for each consecutive ejection of the same address.
+  ev_tstamp ejection_time;
+  // The number of consecutive failed requests which ejects an
+  // address.  0 disables it.
+  size_t errors;
+  // An address whose latency is more than this times the median of
+  // its group is ejected.  0 disables it.
+  size_t latency;
+  // The maximum percentage of the addresses in a group which are
+  // ejected at the same time.
+  size_t max_ejection_percent;
+};
+
 struct DownstreamConfig {
   DownstreamConfig() noexcept = default;
 
@@ -1023,12 +1146,29 @@ struct DownstreamConfig {
   size_t addr_group_catch_all{};
   size_t connections_per_host{};
   size_t connections_per_frontend{};
+  // The upper bound of the adaptive limit of the number of requests
+  // in flight to each backend address.  0 disables the adaptive
+  // limit.
+  size_t concurrency_limit{};
+  // The maximum percentage of hedged requests in the requests which
+  // can be hedged.
+  size_t hedge_budget{};
+  // The minimum number of HTTP/2 connections per backend address per
+  // worker which are established before requests arrive, and kept
+  // warm.
+  size_t http2_min_idle_connections{};
+  OutlierConfig outlier{};
   size_t request_buffer_size{};
   size_t response_buffer_size{};
   // Address family of backend connection.  One of either AF_INET,
   // AF_INET6 or AF_UNSPEC.  This is ignored if backend connection
   // is made via Unix domain socket.
   int family{};
+  // true if TCP Fast Open is used for backend connections.
+  bool tcp_fastopen{};
+  // true if an idempotent request is sent in TLS early data when a
+  // TLS session to the backend is resumed.
+  bool tls_early_data{};
 };
 
 struct ConnectionConfig {
@@ -1036,6 +1176,9 @@ struct ConnectionConfig {
     struct {
       ev_tstamp sleep;
     } timeout;
+    // A worker stops accepting new connections while its longest
+    // event loop iteration exceeds this value.  0 disables it.
+    ev_tstamp loop_lag_threshold;
     // address of frontend acceptors
     std::vector<UpstreamAddr> addrs;
     int backlog;
@@ -1062,6 +1205,9 @@ struct ConnectionConfig {
       RateLimitConfig write;
     } ratelimit;
     size_t worker_connections;
+    // Writes whose length is at least this value are done with
+    // MSG_ZEROCOPY.  0 disables it.
+    size_t zerocopy_threshold;
     // Deprecated.  See UpstreamAddr.accept_proxy_protocol.
     bool accept_proxy_protocol;
   } upstream;
@@ -1136,6 +1282,10 @@ struct Config {
   // handling is omitted.
   bool single_process{};
   bool single_thread{};
+  // Use io_uring in worker threads if it is available.
+  bool io_uring{};
+  // Forward upgraded HTTP/1.1 tunnels with splice(2) if possible.
+  bool tunnel_splice{};
   // Ignore mruby compile error for per-pattern mruby script.
   bool ignore_per_pattern_mruby_error{};
   // flags passed to ev_default_loop() and ev_loop_new()
@@ -1167,9 +1317,11 @@ enum {
   SHRPX_OPTID_API_MAX_REQUEST_BODY,
   SHRPX_OPTID_BACKEND,
   SHRPX_OPTID_BACKEND_ADDRESS_FAMILY,
+  SHRPX_OPTID_BACKEND_CONCURRENCY_LIMIT,
   SHRPX_OPTID_BACKEND_CONNECT_TIMEOUT,
   SHRPX_OPTID_BACKEND_CONNECTIONS_PER_FRONTEND,
   SHRPX_OPTID_BACKEND_CONNECTIONS_PER_HOST,
+  SHRPX_OPTID_BACKEND_HEDGE_BUDGET,
   SHRPX_OPTID_BACKEND_HTTP_PROXY_URI,
   SHRPX_OPTID_BACKEND_HTTP1_CONNECTIONS_PER_FRONTEND,
   SHRPX_OPTID_BACKEND_HTTP1_CONNECTIONS_PER_HOST,
@@ -1180,6 +1332,7 @@ enum {
   SHRPX_OPTID_BACKEND_HTTP2_DECODER_DYNAMIC_TABLE_SIZE,
   SHRPX_OPTID_BACKEND_HTTP2_ENCODER_DYNAMIC_TABLE_SIZE,
   SHRPX_OPTID_BACKEND_HTTP2_MAX_CONCURRENT_STREAMS,
+  SHRPX_OPTID_BACKEND_HTTP2_MIN_IDLE_CONNECTIONS,
   SHRPX_OPTID_BACKEND_HTTP2_SETTINGS_TIMEOUT,
   SHRPX_OPTID_BACKEND_HTTP2_WINDOW_BITS,
   SHRPX_OPTID_BACKEND_HTTP2_WINDOW_SIZE,
@@ -1188,12 +1341,18 @@ enum {
   SHRPX_OPTID_BACKEND_KEEP_ALIVE_TIMEOUT,
   SHRPX_OPTID_BACKEND_MAX_BACKOFF,
   SHRPX_OPTID_BACKEND_NO_TLS,
+  SHRPX_OPTID_BACKEND_OUTLIER_EJECTION_TIME,
+  SHRPX_OPTID_BACKEND_OUTLIER_ERRORS,
+  SHRPX_OPTID_BACKEND_OUTLIER_LATENCY,
+  SHRPX_OPTID_BACKEND_OUTLIER_MAX_EJECTION_PERCENT,
   SHRPX_OPTID_BACKEND_READ_TIMEOUT,
   SHRPX_OPTID_BACKEND_REQUEST_BUFFER,
   SHRPX_OPTID_BACKEND_RESPONSE_BUFFER,
   SHRPX_OPTID_BACKEND_STREAM_READ_TIMEOUT,
   SHRPX_OPTID_BACKEND_STREAM_WRITE_TIMEOUT,
+  SHRPX_OPTID_BACKEND_TCP_FASTOPEN,
   SHRPX_OPTID_BACKEND_TLS,
+  SHRPX_OPTID_BACKEND_TLS_EARLY_DATA,
   SHRPX_OPTID_BACKEND_TLS_SNI_FIELD,
   SHRPX_OPTID_BACKEND_WRITE_TIMEOUT,
   SHRPX_OPTID_BACKLOG,
@@ -1266,6 +1425,7 @@ enum {
   SHRPX_OPTID_FRONTEND_STREAM_READ_TIMEOUT,
   SHRPX_OPTID_FRONTEND_STREAM_WRITE_TIMEOUT,
   SHRPX_OPTID_FRONTEND_WRITE_TIMEOUT,
+  SHRPX_OPTID_FRONTEND_ZEROCOPY_THRESHOLD,
   SHRPX_OPTID_GROUPS,
   SHRPX_OPTID_HEADER_FIELD_BUFFER,
   SHRPX_OPTID_HOST_REWRITE,
@@ -1277,6 +1437,7 @@ enum {
   SHRPX_OPTID_IGNORE_PER_PATTERN_MRUBY_ERROR,
   SHRPX_OPTID_INCLUDE,
   SHRPX_OPTID_INSECURE,
+  SHRPX_OPTID_IO_URING,
   SHRPX_OPTID_LISTENER_DISABLE_TIMEOUT,
   SHRPX_OPTID_LOG_LEVEL,
   SHRPX_OPTID_MAX_HEADER_FIELDS,
@@ -1324,6 +1485,7 @@ enum {
   SHRPX_OPTID_STRIP_INCOMING_FORWARDED,
   SHRPX_OPTID_STRIP_INCOMING_X_FORWARDED_FOR,
   SHRPX_OPTID_SUBCERT,
+  SHRPX_OPTID_SUBCERT_CACHE_SIZE,
   SHRPX_OPTID_SYSLOG_FACILITY,
   SHRPX_OPTID_TLS_DYN_REC_IDLE_TIMEOUT,
   SHRPX_OPTID_TLS_DYN_REC_WARMUP_THRESHOLD,
@@ -1339,6 +1501,7 @@ enum {
   SHRPX_OPTID_TLS_SESSION_CACHE_MEMCACHED_CERT_FILE,
   SHRPX_OPTID_TLS_SESSION_CACHE_MEMCACHED_PRIVATE_KEY_FILE,
   SHRPX_OPTID_TLS_SESSION_CACHE_MEMCACHED_TLS,
+  SHRPX_OPTID_TLS_SESSION_CACHE_SIZE,
   SHRPX_OPTID_TLS_TICKET_KEY_CIPHER,
   SHRPX_OPTID_TLS_TICKET_KEY_FILE,
   SHRPX_OPTID_TLS_TICKET_KEY_MEMCACHED,
@@ -1351,11 +1514,13 @@ enum {
   SHRPX_OPTID_TLS_TICKET_KEY_MEMCACHED_TLS,
   SHRPX_OPTID_TLS13_CIPHERS,
   SHRPX_OPTID_TLS13_CLIENT_CIPHERS,
+  SHRPX_OPTID_TUNNEL_SPLICE,
   SHRPX_OPTID_USER,
   SHRPX_OPTID_VERIFY_CLIENT,
   SHRPX_OPTID_VERIFY_CLIENT_CACERT,
   SHRPX_OPTID_VERIFY_CLIENT_TOLERATE_EXPIRED,
   SHRPX_OPTID_WORKER_FRONTEND_CONNECTIONS,
+  SHRPX_OPTID_WORKER_LOOP_LAG_THRESHOLD,
   SHRPX_OPTID_WORKER_PROCESS_GRACE_SHUTDOWN_PERIOD,
   SHRPX_OPTID_WORKER_READ_BURST,
   SHRPX_OPTID_WORKER_READ_RATE,
@@ -1430,11 +1595,29 @@ read_quic_secret_file(std::string_view path);
 // Returns string representation of |proto|.
 std::string_view strproto(Proto proto);
 
+// Returns true if at least one backend in |downstreamconf| uses
+// HTTP/3.
+bool downstream_http3_configured(const DownstreamConfig &downstreamconf);
+
 std::expected<void, Error> configure_downstream_group(Config *config,
                                                       bool http2_proxy,
                                                       bool numeric_addr_only,
                                                       const TLSConfig &tlsconf);
 
+// Computes Maglev lookup table of size |size| for backends identified
+// by |keys|.  |size| must be a prime number which is larger than
+// keys.size().  Each element of the slots of the returned table is an
+// index into |keys|.
+std::expected<MaglevTable, Error>
+compute_maglev_table(std::span<const std::string_view> keys, size_t size);
+
+// Returns the indices of all backends of |table| in the order of
+// preference for |slot|.  The first one is the owner of |slot|.  The
+// others follow in the order in which their permutation reaches
+// |slot|.
+std::vector<uint32_t> maglev_rank_backends(const MaglevTable &table,
+                                           size_t slot);
+
 std::expected<Address, Error> resolve_hostname(const char *hostname,
                                                uint16_t port, int family,
                                                int additional_flags = 0);
@@ -45,6 +45,8 @@ const MunitTest tests[]{
   munit_void_test(test_shrpx_config_parse_log_format),
   munit_void_test(test_shrpx_config_read_tls_ticket_key_file),
   munit_void_test(test_shrpx_config_read_tls_ticket_key_file_aes_256),
+  munit_void_test(test_shrpx_config_compute_maglev_table),
+  munit_void_test(test_shrpx_config_maglev_rank_backends),
   munit_test_end(),
 };
 } // namespace
@@ -264,4 +266,134 @@ void test_shrpx_config_read_tls_ticket_key_file_aes_256(void) {
                                  "a..............................b"sv));
 }
 
+namespace {
+// Returns the percentage of slots in |table| which are mapped to the
+// different backend in |new_table|.  |keys| and |new_keys| identify
+// backends of |table| and |new_table| respectively.
+double maglev_disruption(const std::vector<uint32_t> &table,
+                         std::span<const std::string_view> keys,
+                         const std::vector<uint32_t> &new_table,
+                         std::span<const std::string_view> new_keys) {
+  size_t changed = 0;
+
+  for (size_t i = 0; i < table.size(); ++i) {
+    if (keys[table[i]] != new_keys[new_table[i]]) {
+      ++changed;
+    }
+  }
+
+  return static_cast<double>(changed) * 100 /
+         static_cast<double>(table.size());
+}
+} // namespace
+
+void test_shrpx_config_compute_maglev_table(void) {
+  constexpr size_t size = 65537;
+
+  std::vector<std::string_view> keys{
+    "127.0.0.1:8080"sv, "127.0.0.2:8080"sv, "127.0.0.3:8080"sv,
+    "127.0.0.4:8080"sv, "127.0.0.5:8080"sv, "127.0.0.6:8080"sv,
+    "127.0.0.7:8080"sv, "127.0.0.8:8080"sv, "127.0.0.9:8080"sv,
+    "127.0.0.10:8080"sv,
+  };
+
+  auto maybe_table = compute_maglev_table(keys, size);
+
+  assert_true(maybe_table.has_value());
+
+  auto &table = maybe_table->slots;
+
+  assert_size(size, ==, table.size());
+  assert_size(keys.size(), ==, maybe_table->perms.size());
+
+  // Each backend takes almost the same number of slots.
+  std::vector<size_t> counts(keys.size());
+  for (auto idx : table) {
+    assert_uint32(keys.size(), >, idx);
+
+    ++counts[idx];
+  }
+
+  auto [min, max] = std::ranges::minmax(counts);
+
+  assert_size(1, >=, max - min);
+
+  // The table is deterministic.
+  assert_true(compute_maglev_table(keys, size)->slots == table);
+
+  // Removing a backend ideally remaps 10% of slots.
+  auto removed_keys = keys;
+  removed_keys.erase(std::ranges::begin(removed_keys) + 5);
+
+  auto maybe_removed_table = compute_maglev_table(removed_keys, size);
+
+  assert_true(maybe_removed_table.has_value());
+
+  auto removed_disruption =
+    maglev_disruption(table, keys, maybe_removed_table->slots, removed_keys);
+
+  assert_double(10., <=, removed_disruption);
+  assert_double(12., >, removed_disruption);
+
+  // Adding a backend ideally remaps 1/11 (~9.1%) of slots.
+  auto added_keys = keys;
+  added_keys.push_back("127.0.0.11:8080"sv);
+
+  auto maybe_added_table = compute_maglev_table(added_keys, size);
+
+  assert_true(maybe_added_table.has_value());
+
+  auto added_disruption =
+    maglev_disruption(table, keys, maybe_added_table->slots, added_keys);
+
+  assert_double(9., <=, added_disruption);
+  assert_double(11., >, added_disruption);
+}
+
+
+void test_shrpx_config_maglev_rank_backends(void) {
+  constexpr size_t size = 65537;
+
+  std::vector<std::string_view> keys{
+    "127.0.0.1:8080"sv, "127.0.0.2:8080"sv, "127.0.0.3:8080"sv,
+    "127.0.0.4:8080"sv, "127.0.0.5:8080"sv,
+  };
+
+  auto maybe_table = compute_maglev_table(keys, size);
+
+  assert_true(maybe_table.has_value());
+
+  auto &table = *maybe_table;
+
+  for (auto slot : {size_t{0}, size_t{1}, size_t{4096}, size - 1}) {
+    auto rank = maglev_rank_backends(table, slot);
+
+    // Each backend appears exactly once, and the owner of |slot|
+    // comes first.
+    assert_size(keys.size(), ==, rank.size());
+    assert_uint32(table.slots[slot], ==, rank[0]);
+
+    auto sorted = rank;
+    std::ranges::sort(sorted);
+
+    for (size_t i = 0; i < sorted.size(); ++i) {
+      assert_uint32(i, ==, sorted[i]);
+    }
+  }
+
+  // A backend which prefers a slot first, but does not own it, comes
+  // right after the owner.
+  for (size_t i = 0; i < table.perms.size(); ++i) {
+    auto slot = table.perms[i].offset;
+
+    if (table.slots[slot] == i) {
+      continue;
+    }
+
+    auto rank = maglev_rank_backends(table, slot);
+
+    assert_uint32(i, ==, rank[1]);
+  }
+}
+
 } // namespace shrpx
@@ -75,6 +75,8 @@ void ConnectBlocker::on_failure() {
 
   call_block_func();
 
+  ejected_ = false;
+
   ++fail_count_;
 
   auto base_backoff =
@@ -106,6 +108,7 @@ void ConnectBlocker::offline() {
   }
 
   offline_ = true;
+  ejected_ = false;
 
   ev_timer_stop(loop_, &timer_);
   ev_timer_set(&timer_, std::numeric_limits<double>::max(), 0.);
@@ -120,16 +123,38 @@ void ConnectBlocker::online() {
   fail_count_ = 0;
 
   offline_ = false;
+  ejected_ = false;
 }
 
 bool ConnectBlocker::in_offline() const { return offline_; }
 
+void ConnectBlocker::eject(ev_tstamp t) {
+  if (ev_is_active(&timer_)) {
+    return;
+  }
+
+  call_block_func();
+
+  ejected_ = true;
+
+  ev_timer_set(&timer_, t, 0.);
+  ev_timer_start(loop_, &timer_);
+}
+
+bool ConnectBlocker::ejected() const {
+  return ejected_ && ev_is_active(&timer_);
+}
+
 void ConnectBlocker::call_block_func() {
   if (block_func_) {
     block_func_();
   }
 }
 
+void ConnectBlocker::set_unblock_func(std::function<void()> unblock_func) {
+  unblock_func_ = std::move(unblock_func);
+}
+
 void ConnectBlocker::call_unblock_func() {
   if (unblock_func_) {
     unblock_func_();
@@ -63,9 +63,19 @@ public:
   // Returns true if peer is considered offline.
   bool in_offline() const;
 
+  // Blocks connection for |t| seconds because peer is an outlier.
+  // This does nothing if connection is already blocked.
+  void eject(ev_tstamp t);
+
+  // Returns true if connection is blocked by eject().
+  bool ejected() const;
+
   void call_block_func();
   void call_unblock_func();
 
+  // Replaces the function which is called when unblocked.
+  void set_unblock_func(std::function<void()> unblock_func);
+
 private:
   std::mt19937 &gen_;
   // Called when blocking is started
@@ -79,6 +89,8 @@ private:
   size_t fail_count_{};
   // true if peer is considered offline.
   bool offline_{};
+  // true if blocking was started by eject().
+  bool ejected_{};
 };
 
 } // namespace shrpx
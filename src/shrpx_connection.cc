@@ -27,6 +27,9 @@
 #ifdef HAVE_UNISTD_H
 #  include <unistd.h>
 #endif // defined(HAVE_UNISTD_H)
+#ifdef HAVE_FCNTL_H
+#  include <fcntl.h>
+#endif // defined(HAVE_FCNTL_H)
 #include <netinet/tcp.h>
 
 #include <limits>
@@ -42,14 +45,80 @@
 
 #include "shrpx_tls.h"
 #include "shrpx_log.h"
+#ifdef HAVE_LIBURING
+#  include "shrpx_io_uring.h"
+#endif // defined(HAVE_LIBURING)
 #include "memchunk.h"
 #include "util.h"
+#include "xsi_strerror.h"
 
 using namespace nghttp2;
 using namespace std::chrono_literals;
 
 namespace shrpx {
 
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+namespace {
+// The interval to poll the error queue of a socket which is being
+// closed.
+constexpr ev_tstamp ZEROCOPY_REAP_INTERVAL = 0.1;
+} // namespace
+
+namespace {
+// ZerocopyReaper keeps the socket of a closed connection open until
+// the kernel releases all buffers sent with MSG_ZEROCOPY.  Closing the
+// socket earlier would lose the completion notifications.  It deletes
+// itself when the buffers are released or |timeout| expires.  In the
+// latter case, the pinned buffers are never reused.
+struct ZerocopyReaper {
+  ZerocopyReaper(struct ev_loop *loop, int fd,
+                 std::unique_ptr<ZerocopyState> state, ev_tstamp timeout);
+  ~ZerocopyReaper();
+
+  ev_timer t;
+  struct ev_loop *loop;
+  std::unique_ptr<ZerocopyState> state;
+  ev_tstamp deadline;
+  int fd;
+};
+} // namespace
+
+namespace {
+void zerocopy_reapcb(struct ev_loop *loop, ev_timer *w, int revents) {
+  auto reaper = static_cast<ZerocopyReaper *>(w->data);
+
+  if (auto rv = reaper->state->reap(reaper->fd);
+      rv && !reaper->state->entries.empty() &&
+      ev_now(loop) < reaper->deadline) {
+    return;
+  }
+
+  delete reaper;
+}
+} // namespace
+
+namespace {
+ZerocopyReaper::ZerocopyReaper(struct ev_loop *loop, int fd,
+                               std::unique_ptr<ZerocopyState> state,
+                               ev_tstamp timeout)
+  : loop{loop},
+    state{std::move(state)},
+    deadline{ev_now(loop) + timeout},
+    fd{fd} {
+  ev_timer_init(&t, zerocopy_reapcb, 0., ZEROCOPY_REAP_INTERVAL);
+  t.data = this;
+  ev_timer_again(loop, &t);
+}
+} // namespace
+
+namespace {
+ZerocopyReaper::~ZerocopyReaper() {
+  ev_timer_stop(loop, &t);
+  close(fd);
+}
+} // namespace
+#endif // defined(SO_EE_ORIGIN_ZEROCOPY)
+
 Connection::Connection(struct ev_loop *loop, int fd, SSL *ssl,
                        MemchunkPool *mcpool, ev_tstamp write_timeout,
                        ev_tstamp read_timeout,
@@ -118,9 +187,24 @@ void Connection::disconnect() {
     tls.early_data_finish = false;
   }
 
+#ifdef HAVE_LIBURING
+  // This cancels multishot recv before fd is closed.
+  io_uring_recv.reset();
+#endif // defined(HAVE_LIBURING)
+
   if (proto != Proto::HTTP3 && fd != -1) {
     shutdown(fd, SHUT_WR);
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+    if (zerocopy && handle_zerocopy_completions() &&
+        !zerocopy->entries.empty()) {
+      // The reaper closes fd.
+      new ZerocopyReaper(loop, fd, std::move(zerocopy), wt.repeat);
+    } else {
+      close(fd);
+    }
+#else  // !defined(SO_EE_ORIGIN_ZEROCOPY)
     close(fd);
+#endif // !defined(SO_EE_ORIGIN_ZEROCOPY)
     fd = -1;
   }
 
@@ -384,6 +468,19 @@ std::expected<void, Error> Connection::write_tls_pending_handshake() {
   }
 #endif // defined(NGHTTP2_OPENSSL_IS_BORINGSSL)
 
+#ifdef BIO_get_ktls_send
+  if (BIO_get_ktls_send(SSL_get_wbio(tls.ssl))) {
+    // The kernel encrypts records.  Writing small records during
+    // warm up only adds system calls, because the kernel does not
+    // coalesce them.
+    tls_dyn_rec_warmup_threshold = 0;
+
+    if (log_enabled(INFO)) {
+      Log{INFO} << "kTLS is used for transmission";
+    }
+  }
+#endif // defined(BIO_get_ktls_send)
+
   // We have to start read watcher, since later stage of code expects
   // this.
   rlimit.startw();
@@ -724,7 +821,9 @@ Connection::write_clear(std::span<const uint8_t> data) {
   while ((nwrite = write(fd, data.data(), data.size())) == -1 && errno == EINTR)
     ;
   if (nwrite == -1) {
-    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+    // write(2) fails with EINPROGRESS if TCP Fast Open is enabled, and
+    // the connection has not been established yet.
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS) {
       wlimit.startw();
       ev_timer_again(loop, &wt);
       return 0;
@@ -754,7 +853,7 @@ Connection::writev_clear(std::span<struct iovec> iov) {
          errno == EINTR)
     ;
   if (nwrite == -1) {
-    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS) {
       wlimit.startw();
       ev_timer_again(loop, &wt);
       return 0;
@@ -778,6 +877,17 @@ Connection::read_clear(std::span<uint8_t> data) {
     return {};
   }
 
+#ifdef HAVE_LIBURING
+  if (io_uring_recv) {
+    auto maybe_data = io_uring_recv->read(data);
+    if (maybe_data) {
+      rlimit.drain(maybe_data->size());
+    }
+
+    return maybe_data;
+  }
+#endif // defined(HAVE_LIBURING)
+
   ssize_t nread;
   while ((nread = read(fd, data.data(), data.size())) == -1 && errno == EINTR)
     ;
@@ -799,6 +909,12 @@ Connection::read_clear(std::span<uint8_t> data) {
 
 std::expected<std::span<uint8_t>, Error>
 Connection::read_nolim_clear(std::span<uint8_t> data) {
+#ifdef HAVE_LIBURING
+  if (io_uring_recv) {
+    return io_uring_recv->read(data);
+  }
+#endif // defined(HAVE_LIBURING)
+
   ssize_t nread;
   while ((nread = read(fd, data.data(), data.size())) == -1 && errno == EINTR)
     ;
@@ -836,6 +952,265 @@ Connection::peek_clear(std::span<uint8_t> data) {
   return data.first(as_unsigned(nread));
 }
 
+#ifdef HAVE_LIBURING
+std::expected<void, Error> Connection::enable_io_uring_recv(IOUring *ring) {
+  assert(!io_uring_recv);
+  assert(!tls.ssl);
+
+  auto recv = std::make_unique<IOUringRecv>(ring, loop, &rev, fd);
+  if (auto rv = recv->start(); !rv) {
+    return rv;
+  }
+
+  io_uring_recv = std::move(recv);
+
+  // Data is delivered by io_uring, and EV_READ is fed by
+  // io_uring_recv.  rev must not poll fd, but it is still started
+  // and stopped to tell whether the application wants to read.
+  auto active = ev_is_active(&rev);
+
+  ev_io_stop(loop, &rev);
+  ev_io_set(&rev, fd, 0);
+
+  if (active) {
+    ev_io_start(loop, &rev);
+  }
+
+  return {};
+}
+#endif // defined(HAVE_LIBURING)
+
+#ifdef HAVE_SPLICE
+namespace {
+// The capacity of a pipe assumed when it cannot be queried.
+constexpr size_t DEFAULT_PIPE_CAPACITY = 64_k;
+} // namespace
+
+SplicePipe::~SplicePipe() {
+  for (auto fd : fds) {
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+}
+
+std::expected<void, Error> SplicePipe::init() {
+  if (pipe2(fds.data(), O_NONBLOCK | O_CLOEXEC) != 0) {
+    auto error = errno;
+    std::array<char, STRERROR_BUFSIZE> errbuf;
+    Log{WARN} << "Failed to create pipe for splice: "
+              << xsi_strerror(error, errbuf.data(), errbuf.size());
+    return std::unexpected{Error::SYSCALL};
+  }
+
+#  ifdef F_GETPIPE_SZ
+  auto n = fcntl(fds[1], F_GETPIPE_SZ);
+  capacity = n > 0 ? static_cast<size_t>(n) : DEFAULT_PIPE_CAPACITY;
+#  else  // !defined(F_GETPIPE_SZ)
+  capacity = DEFAULT_PIPE_CAPACITY;
+#  endif // !defined(F_GETPIPE_SZ)
+
+  return {};
+}
+
+std::expected<size_t, Error> Connection::splice_read(SplicePipe &pipe) {
+  auto len = std::min(pipe.wleft(), rlimit.avail());
+  if (len == 0) {
+    return 0;
+  }
+
+  ssize_t nread;
+  while ((nread = splice(fd, nullptr, pipe.fds[1], nullptr, len,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK)) == -1 &&
+         errno == EINTR)
+    ;
+  if (nread == -1) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return 0;
+    }
+    return std::unexpected{Error::NETWORK};
+  }
+
+  if (nread == 0) {
+    return std::unexpected{Error::RECV_EOF};
+  }
+
+  rlimit.drain(as_unsigned(nread));
+  pipe.len += as_unsigned(nread);
+
+  return as_unsigned(nread);
+}
+
+std::expected<size_t, Error> Connection::splice_write(SplicePipe &pipe) {
+  auto len = std::min(pipe.len, wlimit.avail());
+  if (len == 0) {
+    return 0;
+  }
+
+  ssize_t nwrite;
+  while ((nwrite = splice(pipe.fds[0], nullptr, fd, nullptr, len,
+                          SPLICE_F_MOVE | SPLICE_F_NONBLOCK)) == -1 &&
+         errno == EINTR)
+    ;
+  if (nwrite == -1) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS) {
+      wlimit.startw();
+      ev_timer_again(loop, &wt);
+      return 0;
+    }
+    return std::unexpected{Error::NETWORK};
+  }
+
+  wlimit.drain(as_unsigned(nwrite));
+  pipe.len -= as_unsigned(nwrite);
+
+  if (ev_is_active(&wt)) {
+    ev_timer_again(loop, &wt);
+  }
+
+  return as_unsigned(nwrite);
+}
+#endif // defined(HAVE_SPLICE)
+
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+void ZerocopyState::add(const DefaultMemchunks &buf, size_t n) {
+  for (auto m = buf.head; m && n; m = m->next) {
+    ++m->pins;
+    entries.emplace_back(m, next_seq);
+    n -= std::min(n, m->len());
+  }
+
+  ++next_seq;
+}
+
+void ZerocopyState::complete(uint32_t lo, uint32_t hi) {
+  for (auto &ent : entries) {
+    if (static_cast<int32_t>(ent.seq - hi) > 0) {
+      break;
+    }
+
+    if (!ent.chunk || ent.seq - lo > hi - lo) {
+      continue;
+    }
+
+    mcpool->unpin(ent.chunk);
+    ent.chunk = nullptr;
+  }
+
+  // Completions usually arrive in order, but the kernel does not
+  // guarantee it.  Entries are only removed from the front.
+  for (; !entries.empty() && !entries.front().chunk; entries.pop_front())
+    ;
+}
+
+std::expected<void, Error> ZerocopyState::reap(int fd) {
+  for (;;) {
+    alignas(cmsghdr) std::array<uint8_t, 128> cmsgbuf;
+    msghdr msg{};
+    msg.msg_control = cmsgbuf.data();
+    msg.msg_controllen = cmsgbuf.size();
+
+    ssize_t nread;
+    while ((nread = recvmsg(fd, &msg, MSG_ERRQUEUE)) == -1 && errno == EINTR)
+      ;
+    if (nread == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return {};
+      }
+      return std::unexpected{Error::NETWORK};
+    }
+
+    for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+          !(cmsg->cmsg_level == SOL_IPV6 &&
+            cmsg->cmsg_type == IPV6_RECVERR)) {
+        continue;
+      }
+
+      sock_extended_err serr;
+      memcpy(&serr, CMSG_DATA(cmsg), sizeof(serr));
+
+      if (serr.ee_errno != 0 || serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+        continue;
+      }
+
+      if (serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+        copied = true;
+      }
+
+      complete(serr.ee_info, serr.ee_data);
+    }
+  }
+}
+
+std::expected<void, Error> Connection::enable_zerocopy(MemchunkPool *mcpool,
+                                                       size_t threshold) {
+  int val = 1;
+  if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &val, sizeof(val)) != 0) {
+    auto error = errno;
+    std::array<char, STRERROR_BUFSIZE> errbuf;
+    Log{WARN} << "Failed to enable SO_ZEROCOPY: "
+              << xsi_strerror(error, errbuf.data(), errbuf.size());
+    return std::unexpected{Error::SYSCALL};
+  }
+
+  zerocopy = std::make_unique<ZerocopyState>();
+  zerocopy->mcpool = mcpool;
+  zerocopy->threshold = threshold;
+
+  return {};
+}
+
+std::expected<size_t, Error>
+Connection::write_zerocopy(const DefaultMemchunks &buf) {
+  std::array<struct iovec, MAX_WR_IOVCNT> iovbuf;
+
+  auto iov = limit_iovec(buf.riovec(iovbuf), wlimit.avail());
+  if (iov.empty()) {
+    return 0;
+  }
+
+  msghdr msg{};
+  msg.msg_iov = iov.data();
+  msg.msg_iovlen = iov.size();
+
+  ssize_t nwrite;
+  while ((nwrite = sendmsg(fd, &msg, MSG_ZEROCOPY)) == -1 && errno == EINTR)
+    ;
+  if (nwrite == -1) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS) {
+      wlimit.startw();
+      ev_timer_again(loop, &wt);
+      return 0;
+    }
+    if (errno == ENOBUFS) {
+      // Too many pages are pinned by the socket.  Copy them instead.
+      return writev_clear(iov);
+    }
+    return std::unexpected{Error::NETWORK};
+  }
+
+  zerocopy->add(buf, as_unsigned(nwrite));
+
+  wlimit.drain(as_unsigned(nwrite));
+
+  if (ev_is_active(&wt)) {
+    ev_timer_again(loop, &wt);
+  }
+
+  return as_unsigned(nwrite);
+}
+
+std::expected<void, Error> Connection::handle_zerocopy_completions() {
+  if (!zerocopy || zerocopy->entries.empty()) {
+    return {};
+  }
+
+  return zerocopy->reap(fd);
+}
+#endif // defined(SO_EE_ORIGIN_ZEROCOPY)
+
 void Connection::handle_tls_pending_read() {
   if (!ev_is_active(&rev)) {
     return;
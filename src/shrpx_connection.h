@@ -28,8 +28,16 @@
 #include "shrpx_config.h"
 
 #include <sys/uio.h>
+#ifdef HAVE_SYS_SOCKET_H
+#  include <sys/socket.h>
+#endif // defined(HAVE_SYS_SOCKET_H)
+#ifdef HAVE_LINUX_ERRQUEUE_H
+#  include <linux/errqueue.h>
+#endif // defined(HAVE_LINUX_ERRQUEUE_H)
 
 #include <expected>
+#include <deque>
+#include <memory>
 
 #include <ev.h>
 
@@ -59,6 +67,11 @@ namespace tls {
 struct TLSSessionCache;
 } // namespace tls
 
+#ifdef HAVE_LIBURING
+class IOUring;
+class IOUringRecv;
+#endif // defined(HAVE_LIBURING)
+
 struct TLSConnection {
   // Stores TLSv1.3 early data.
   DefaultMemchunks earlybuf;
@@ -90,6 +103,65 @@ struct TCPHint {
   uint32_t rwin;
 };
 
+#ifdef HAVE_SPLICE
+// SplicePipe is a pipe which is used as an intermediate buffer to
+// move bytes between 2 sockets with splice(2) without copying them
+// into user space.
+struct SplicePipe {
+  SplicePipe() noexcept = default;
+  ~SplicePipe();
+  SplicePipe(const SplicePipe &) = delete;
+  SplicePipe &operator=(const SplicePipe &) = delete;
+
+  std::expected<void, Error> init();
+  // Returns the number of bytes that can be moved into the pipe.
+  size_t wleft() const { return capacity - len; }
+
+  // fds[0] is the read end, and fds[1] is the write end.
+  std::array<int, 2> fds{-1, -1};
+  // The number of bytes in the pipe.
+  size_t len{};
+  // The capacity of the pipe.
+  size_t capacity{};
+};
+#endif // defined(HAVE_SPLICE)
+
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+// ZerocopyState tracks the buffers which are sent with MSG_ZEROCOPY.
+// The kernel keeps referring to the pages of those buffers until it
+// posts a completion notification to the error queue of the socket.
+// Until then, the Memchunk16K objects are pinned so that they are not
+// reused.
+struct ZerocopyState {
+  struct Entry {
+    Memchunk16K *chunk;
+    // The sequence number of the send which refers to chunk.
+    uint32_t seq;
+  };
+
+  // Pins the chunks which hold the first |n| bytes of |buf|, and
+  // associates them with the sequence number of the send just done.
+  void add(const DefaultMemchunks &buf, size_t n);
+  // Reads completion notifications from the error queue of |fd|, and
+  // unpins the chunks whose sends have completed.
+  std::expected<void, Error> reap(int fd);
+  // Unpins the chunks which are sent with the sequence numbers in
+  // [|lo|, |hi|], inclusive.
+  void complete(uint32_t lo, uint32_t hi);
+
+  std::deque<Entry> entries;
+  MemchunkPool *mcpool;
+  // Writes whose length is less than this value are done with
+  // writev(2).
+  size_t threshold;
+  // The sequence number which the kernel assigns to the next send.
+  uint32_t next_seq{};
+  // true if the kernel told us that it had to copy data anyway.
+  // MSG_ZEROCOPY is not used once this is set.
+  bool copied{};
+};
+#endif // defined(SO_EE_ORIGIN_ZEROCOPY)
+
 template <typename T> using EVCb = void (*)(struct ev_loop *, T *, int);
 
 using IOCb = EVCb<ev_io>;
@@ -142,6 +214,41 @@ struct Connection {
   read_nolim_clear(std::span<uint8_t> data);
   // Peek at most |len| bytes of data from socket without rate limit.
   std::expected<std::span<uint8_t>, Error> peek_clear(std::span<uint8_t> data);
+#ifdef HAVE_SPLICE
+  // Moves bytes from socket into |pipe| with splice(2).  It returns
+  // the number of bytes moved, or 0 if nothing can be moved.  A pipe
+  // may refuse more bytes before |pipe|.len reaches its capacity.
+  // Caller should therefore stop reading if 0 is returned while
+  // |pipe| is not empty.  Error::RECV_EOF is returned in case of EOF.
+  std::expected<size_t, Error> splice_read(SplicePipe &pipe);
+  // Moves bytes in |pipe| to socket with splice(2).  It returns the
+  // number of bytes moved, or 0 if nothing can be moved.
+  std::expected<size_t, Error> splice_write(SplicePipe &pipe);
+#endif // defined(HAVE_SPLICE)
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+  // Enables MSG_ZEROCOPY on the socket.  Writes whose length is at
+  // least |threshold| bytes are eligible for write_zerocopy.
+  std::expected<void, Error> enable_zerocopy(MemchunkPool *mcpool,
+                                             size_t threshold);
+  // Returns true if |len| bytes should be written with
+  // write_zerocopy.
+  bool zerocopy_wanted(size_t len) const {
+    return zerocopy && !zerocopy->copied && len >= zerocopy->threshold;
+  }
+  // Writes the head of |buf| with MSG_ZEROCOPY.  The chunks written
+  // are pinned until the kernel releases them.  Caller must drain
+  // the bytes written from |buf| as usual.  It falls back to
+  // writev(2) if the kernel cannot pin more pages.
+  std::expected<size_t, Error> write_zerocopy(const DefaultMemchunks &buf);
+  // Processes MSG_ZEROCOPY completion notifications if there are.
+  std::expected<void, Error> handle_zerocopy_completions();
+#endif // defined(SO_EE_ORIGIN_ZEROCOPY)
+#ifdef HAVE_LIBURING
+  // Receives data with multishot recv of |ring| instead of read(2).
+  // Only read_clear() and read_nolim_clear() can be used after this
+  // call.
+  std::expected<void, Error> enable_io_uring_recv(IOUring *ring);
+#endif // defined(HAVE_LIBURING)
 
   void handle_tls_pending_read();
 
@@ -185,6 +292,14 @@ struct Connection {
   std::chrono::steady_clock::time_point last_read;
   // Timeout for read timer |rt|.
   ev_tstamp read_timeout;
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+  // Not nullptr if MSG_ZEROCOPY is enabled.
+  std::unique_ptr<ZerocopyState> zerocopy;
+#endif // defined(SO_EE_ORIGIN_ZEROCOPY)
+#ifdef HAVE_LIBURING
+  // Not nullptr if data is received with io_uring.
+  std::unique_ptr<IOUringRecv> io_uring_recv;
+#endif // defined(HAVE_LIBURING)
 };
 
 #ifdef ENABLE_HTTP3
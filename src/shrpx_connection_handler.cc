@@ -42,6 +42,7 @@
 #include "shrpx_connect_blocker.h"
 #include "shrpx_downstream_connection.h"
 #include "shrpx_memcached_dispatcher.h"
+#include "shrpx_dns_cache.h"
 #include "shrpx_signal.h"
 #include "shrpx_log.h"
 #include "xsi_strerror.h"
@@ -71,6 +72,13 @@ ConnectionHandler::ConnectionHandler(struct ev_loop *loop, std::mt19937 &gen)
   : gen_(gen),
     loop_(loop),
     worker_round_robin_cnt_(get_config()->api.enabled ? 1 : 0) {
+  if (auto max_size = get_config()->tls.session_cache.max_size; max_size) {
+    tls_session_cache_ =
+      std::make_unique<tls::SharedTLSSessionCache>(max_size);
+  }
+
+  dns_cache_ = std::make_unique<SharedDNSCache>();
+
   ev_async_init(&thread_join_asyncev_, thread_join_async_cb);
 
   ev_async_init(&serial_event_asyncev_, serial_event_async_cb);
@@ -94,6 +102,10 @@ ConnectionHandler::~ConnectionHandler() {
     delete tls_ctx_data;
     SSL_CTX_free(ssl_ctx);
   }
+
+  if (quic_cl_ssl_ctx_) {
+    SSL_CTX_free(quic_cl_ssl_ctx_);
+  }
 #endif // defined(ENABLE_HTTP3)
 
   for (auto ssl_ctx : all_ssl_ctx_) {
@@ -137,9 +149,11 @@ void ConnectionHandler::worker_replace_downstream(
 }
 
 std::expected<void, Error> ConnectionHandler::create_single_worker() {
+  create_subcert_caches();
+
   cert_tree_ = tls::create_cert_lookup_tree();
   auto sv_ssl_ctx = tls::setup_server_ssl_context(
-    all_ssl_ctx_, indexed_ssl_ctx_, cert_tree_.get()
+    all_ssl_ctx_, indexed_ssl_ctx_, cert_tree_.get(), subcert_cache_.get()
 #ifdef HAVE_NEVERBLEED
                                       ,
     nb_
@@ -149,7 +163,8 @@ std::expected<void, Error> ConnectionHandler::create_single_worker() {
 #ifdef ENABLE_HTTP3
   quic_cert_tree_ = tls::create_cert_lookup_tree();
   auto quic_sv_ssl_ctx = tls::setup_quic_server_ssl_context(
-    quic_all_ssl_ctx_, quic_indexed_ssl_ctx_, quic_cert_tree_.get()
+    quic_all_ssl_ctx_, quic_indexed_ssl_ctx_, quic_cert_tree_.get(),
+    quic_subcert_cache_.get()
 #  ifdef HAVE_NEVERBLEED
                                                 ,
     nb_
@@ -172,6 +187,16 @@ std::expected<void, Error> ConnectionHandler::create_single_worker() {
 
   auto config = get_config();
 
+#ifdef ENABLE_HTTP3
+  if (downstream_http3_configured(*config->conn.downstream)) {
+    quic_cl_ssl_ctx_ = tls::setup_quic_downstream_client_ssl_context(
+#  ifdef HAVE_NEVERBLEED
+      nb_
+#  endif // defined(HAVE_NEVERBLEED)
+    );
+  }
+#endif // defined(ENABLE_HTTP3)
+
 #if defined(ENABLE_HTTP3) && defined(HAVE_LIBBPF)
   quic_bpf_refs_.resize(config->conn.quic_listener.addrs.size());
 #endif // defined(ENABLE_HTTP3) && defined(HAVE_LIBBPF)
@@ -184,7 +209,7 @@ std::expected<void, Error> ConnectionHandler::create_single_worker() {
   single_worker_ = std::make_unique<Worker>(
     loop_, sv_ssl_ctx, cl_ssl_ctx, cert_tree_.get(),
 #ifdef ENABLE_HTTP3
-    quic_sv_ssl_ctx, quic_cert_tree_.get(), wid,
+    quic_sv_ssl_ctx, quic_cert_tree_.get(), quic_cl_ssl_ctx_, wid,
 #endif // defined(ENABLE_HTTP3)
     /* index = */ 0, ticket_keys_, this, config->conn.downstream);
 #ifdef HAVE_MRUBY
@@ -216,9 +241,11 @@ std::expected<void, Error> ConnectionHandler::create_worker_thread(size_t num) {
 #ifndef NOTHREADS
   assert(workers_.size() == 0);
 
+  create_subcert_caches();
+
   cert_tree_ = tls::create_cert_lookup_tree();
   auto sv_ssl_ctx = tls::setup_server_ssl_context(
-    all_ssl_ctx_, indexed_ssl_ctx_, cert_tree_.get()
+    all_ssl_ctx_, indexed_ssl_ctx_, cert_tree_.get(), subcert_cache_.get()
 #  ifdef HAVE_NEVERBLEED
                                       ,
     nb_
@@ -228,7 +255,8 @@ std::expected<void, Error> ConnectionHandler::create_worker_thread(size_t num) {
 #  ifdef ENABLE_HTTP3
   quic_cert_tree_ = tls::create_cert_lookup_tree();
   auto quic_sv_ssl_ctx = tls::setup_quic_server_ssl_context(
-    quic_all_ssl_ctx_, quic_indexed_ssl_ctx_, quic_cert_tree_.get()
+    quic_all_ssl_ctx_, quic_indexed_ssl_ctx_, quic_cert_tree_.get(),
+    quic_subcert_cache_.get()
 #    ifdef HAVE_NEVERBLEED
                                                 ,
     nb_
@@ -250,6 +278,16 @@ std::expected<void, Error> ConnectionHandler::create_worker_thread(size_t num) {
   }
 
   auto config = get_config();
+
+#  ifdef ENABLE_HTTP3
+  if (downstream_http3_configured(*config->conn.downstream)) {
+    quic_cl_ssl_ctx_ = tls::setup_quic_downstream_client_ssl_context(
+#    ifdef HAVE_NEVERBLEED
+      nb_
+#    endif // defined(HAVE_NEVERBLEED)
+    );
+  }
+#  endif // defined(ENABLE_HTTP3)
   auto &apiconf = config->api;
 
 #  if defined(ENABLE_HTTP3) && defined(HAVE_LIBBPF)
@@ -275,7 +313,8 @@ std::expected<void, Error> ConnectionHandler::create_worker_thread(size_t num) {
     auto worker =
       std::make_unique<Worker>(loop, sv_ssl_ctx, cl_ssl_ctx, cert_tree_.get(),
 #  ifdef ENABLE_HTTP3
-                               quic_sv_ssl_ctx, quic_cert_tree_.get(), wid,
+                               quic_sv_ssl_ctx, quic_cert_tree_.get(),
+                               quic_cl_ssl_ctx_, wid,
 #  endif // defined(ENABLE_HTTP3)
                                i, ticket_keys_, this, config->conn.downstream);
 #  ifdef HAVE_MRUBY
@@ -367,6 +406,15 @@ Worker *ConnectionHandler::get_single_worker() const {
   return single_worker_.get();
 }
 
+std::span<const std::unique_ptr<Worker>>
+ConnectionHandler::get_workers() const {
+  if (single_worker_) {
+    return {&single_worker_, 1};
+  }
+
+  return workers_;
+}
+
 void ConnectionHandler::set_ticket_keys(
   std::shared_ptr<TicketKeys> ticket_keys) {
   ticket_keys_ = std::move(ticket_keys);
@@ -390,6 +438,53 @@ bool ConnectionHandler::get_graceful_shutdown() const {
   return graceful_shutdown_;
 }
 
+tls::SharedTLSSessionCache *ConnectionHandler::get_tls_session_cache() const {
+  return tls_session_cache_.get();
+}
+
+void ConnectionHandler::create_subcert_caches() {
+  auto config = get_config();
+  auto max_size = config->tls.subcert_cache_size;
+
+  if (!max_size || !tls::upstream_tls_enabled(config->conn)) {
+    return;
+  }
+
+  subcert_cache_ = std::make_unique<tls::SubcertCache>(max_size, false
+#ifdef HAVE_NEVERBLEED
+                                                       ,
+                                                       nb_
+#endif // defined(HAVE_NEVERBLEED)
+  );
+
+#ifdef ENABLE_HTTP3
+  quic_subcert_cache_ = std::make_unique<tls::SubcertCache>(max_size, true
+#  ifdef HAVE_NEVERBLEED
+                                                            ,
+                                                            nb_
+#  endif // defined(HAVE_NEVERBLEED)
+  );
+#endif // defined(ENABLE_HTTP3)
+}
+
+SharedDNSCache *ConnectionHandler::get_dns_cache() const {
+  return dns_cache_.get();
+}
+
+tls::SubcertCache *ConnectionHandler::get_subcert_cache() const {
+  return subcert_cache_.get();
+}
+
+#ifdef ENABLE_HTTP3
+SSL_CTX *ConnectionHandler::get_quic_cl_ssl_ctx() const {
+  return quic_cl_ssl_ctx_;
+}
+
+tls::SubcertCache *ConnectionHandler::get_quic_subcert_cache() const {
+  return quic_subcert_cache_.get();
+}
+#endif // defined(ENABLE_HTTP3)
+
 void ConnectionHandler::set_tls_ticket_key_memcached_dispatcher(
   std::unique_ptr<MemcachedDispatcher> dispatcher) {
   tls_ticket_key_memcached_dispatcher_ = std::move(dispatcher);
@@ -583,11 +678,7 @@ std::expected<void, Error> ConnectionHandler::forward_quic_packet(
 
   auto worker = *maybe_worker;
 
-  worker->send(WorkerEvent{
-    .type = WorkerEventType::QUIC_PKT_FORWARD,
-    .quic_pkt = std::make_unique<QUICPacket>(faddr->index, remote_addr,
-                                             local_addr, pi, data),
-  });
+  worker->forward_quic_packet(faddr->index, remote_addr, local_addr, pi, data);
 
   return {};
 }
@@ -773,7 +864,8 @@ std::expected<void, Error> ConnectionHandler::quic_ipc_read() {
 
   ++p;
 
-  auto pkt = std::make_unique<QUICPacket>();
+  Address remote_addr, local_addr;
+  ngtcp2_pkt_info pi{};
 
   auto remote_addrlen = static_cast<socklen_t>(*p++) + 1;
   if (remote_addrlen > sizeof(sockaddr_storage)) {
@@ -793,7 +885,7 @@ std::expected<void, Error> ConnectionHandler::quic_ipc_read() {
 
   sockaddr_storage ss;
   memcpy(&ss, p, remote_addrlen);
-  pkt->remote_addr.set(reinterpret_cast<const sockaddr *>(&ss));
+  remote_addr.set(reinterpret_cast<const sockaddr *>(&ss));
 
   p += remote_addrlen;
 
@@ -813,18 +905,15 @@ std::expected<void, Error> ConnectionHandler::quic_ipc_read() {
   }
 
   memcpy(&ss, p, local_addrlen);
-  pkt->local_addr.set(reinterpret_cast<const sockaddr *>(&ss));
+  local_addr.set(reinterpret_cast<const sockaddr *>(&ss));
 
   p += local_addrlen;
 
-  pkt->pi.ecn = *p++;
+  pi.ecn = *p++;
 
   auto datalen = static_cast<size_t>(nread - (p - buf.data()));
 
-  pkt->data.assign(p, p + datalen);
-
-  // At the moment, UpstreamAddr index is unknown.
-  pkt->upstream_addr_index = static_cast<size_t>(-1);
+  auto data = std::span{p, datalen};
 
   ngtcp2_version_cid vc;
 
@@ -841,7 +930,7 @@ std::expected<void, Error> ConnectionHandler::quic_ipc_read() {
   }
 
   if (single_worker_) {
-    auto maybe_faddr = single_worker_->find_quic_upstream_addr(pkt->local_addr);
+    auto maybe_faddr = single_worker_->find_quic_upstream_addr(local_addr);
     if (!maybe_faddr) {
       Log{ERROR} << "No suitable upstream address found";
 
@@ -850,8 +939,8 @@ std::expected<void, Error> ConnectionHandler::quic_ipc_read() {
 
     auto quic_conn_handler = single_worker_->get_quic_connection_handler();
 
-    quic_conn_handler->handle_packet(*maybe_faddr, pkt->remote_addr,
-                                     pkt->local_addr, pkt->pi, pkt->data);
+    quic_conn_handler->handle_packet(*maybe_faddr, remote_addr, local_addr, pi,
+                                     data);
 
     return {};
   }
@@ -879,10 +968,9 @@ std::expected<void, Error> ConnectionHandler::quic_ipc_read() {
 
   auto worker = *maybe_worker;
 
-  worker->send(WorkerEvent{
-    .type = WorkerEventType::QUIC_PKT_FORWARD,
-    .quic_pkt = std::move(pkt),
-  });
+  // At the moment, UpstreamAddr index is unknown.
+  worker->forward_quic_packet(static_cast<size_t>(-1), remote_addr,
+                              local_addr, pi, data);
 
   return {};
 }
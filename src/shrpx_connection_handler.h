@@ -36,6 +36,7 @@
 #include <memory>
 #include <vector>
 #include <random>
+#include <span>
 #ifndef NOTHREADS
 #  include <future>
 #endif // !defined(NOTHREADS)
@@ -71,10 +72,13 @@ struct WorkerStat;
 struct TicketKeys;
 class MemcachedDispatcher;
 struct UpstreamAddr;
+class SharedDNSCache;
 
 namespace tls {
 
 class CertLookupTree;
+class SharedTLSSessionCache;
+class SubcertCache;
 
 } // namespace tls
 
@@ -137,6 +141,9 @@ public:
   const std::shared_ptr<TicketKeys> &get_ticket_keys() const;
   struct ev_loop *get_loop() const;
   Worker *get_single_worker() const;
+  // Returns all workers.  They are created at startup, and are never
+  // replaced while this object is alive.
+  std::span<const std::unique_ptr<Worker>> get_workers() const;
   void graceful_shutdown_worker();
   void set_graceful_shutdown(bool f);
   bool get_graceful_shutdown() const;
@@ -210,7 +217,39 @@ public:
   void
   worker_replace_downstream(std::shared_ptr<DownstreamConfig> downstreamconf);
 
+  // Returns the TLS session cache shared by workers.  It returns
+  // nullptr if the cache is disabled.
+  tls::SharedTLSSessionCache *get_tls_session_cache() const;
+  // Returns the DNS cache shared by workers.
+  SharedDNSCache *get_dns_cache() const;
+
+  // Returns the cache of SSL_CTX for subcerts which are loaded on
+  // demand.  It returns nullptr if subcerts are loaded at startup.
+  tls::SubcertCache *get_subcert_cache() const;
+#ifdef ENABLE_HTTP3
+  tls::SubcertCache *get_quic_subcert_cache() const;
+  // Returns the SSL_CTX for HTTP/3 backends.  It returns nullptr if
+  // no HTTP/3 backend is configured at startup.
+  SSL_CTX *get_quic_cl_ssl_ctx() const;
+#endif // defined(ENABLE_HTTP3)
+
 private:
+  // Creates subcert_cache_ and quic_subcert_cache_ if subcerts are
+  // configured to be loaded on demand.
+  void create_subcert_caches();
+
+  // The TLS session cache shared by workers.  This must outlive
+  // workers_ and single_worker_.
+  std::unique_ptr<tls::SharedTLSSessionCache> tls_session_cache_;
+  // The DNS cache shared by workers.  This must outlive workers_ and
+  // single_worker_.
+  std::unique_ptr<SharedDNSCache> dns_cache_;
+  // The caches of SSL_CTX for subcerts loaded on demand.  They must
+  // outlive workers_ and single_worker_.
+  std::unique_ptr<tls::SubcertCache> subcert_cache_;
+#ifdef ENABLE_HTTP3
+  std::unique_ptr<tls::SubcertCache> quic_subcert_cache_;
+#endif // defined(ENABLE_HTTP3)
   // Stores all SSL_CTX objects.
   std::vector<SSL_CTX *> all_ssl_ctx_;
   // Stores all SSL_CTX objects in a way that its index is stored in
@@ -230,6 +269,8 @@ private:
   std::unique_ptr<QUICKeyingMaterials> quic_keying_materials_;
   std::vector<SSL_CTX *> quic_all_ssl_ctx_;
   std::vector<std::vector<SSL_CTX *>> quic_indexed_ssl_ctx_;
+  // Client side SSL_CTX for HTTP/3 backend connections.
+  SSL_CTX *quic_cl_ssl_ctx_{};
 #endif // defined(ENABLE_HTTP3)
   std::mt19937 &gen_;
   // ev_loop for each worker
@@ -0,0 +1,85 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2026 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_dns_cache.h"
+
+namespace shrpx {
+
+void SharedDNSCache::add(std::string_view host, DNSCacheEntry ent) {
+  std::lock_guard<std::mutex> g(mu_);
+
+  if (auto it = ents_.find(host); it != std::ranges::end(ents_)) {
+    auto &e = (*it).second;
+
+    if (e.ent.expiry <= ent.expiry) {
+      e.ent = std::move(ent);
+    }
+
+    return;
+  }
+
+  auto host_copy = ImmutableString{host};
+  auto key = as_string_view(host_copy);
+
+  ents_.emplace(key, Entry{
+                       .host = std::move(host_copy),
+                       .ent = std::move(ent),
+                     });
+}
+
+std::expected<DNSCacheEntry, Error>
+SharedDNSCache::get(std::string_view host,
+                    std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> g(mu_);
+
+  auto it = ents_.find(host);
+  if (it == std::ranges::end(ents_)) {
+    return std::unexpected{Error::ENTITY_NOT_FOUND};
+  }
+
+  auto &ent = (*it).second.ent;
+
+  if (ent.expiry <= now) {
+    ents_.erase(it);
+
+    return std::unexpected{Error::ENTITY_NOT_FOUND};
+  }
+
+  return ent;
+}
+
+void SharedDNSCache::gc(std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> g(mu_);
+
+  std::erase_if(ents_,
+                [now](const auto &p) { return p.second.ent.expiry <= now; });
+}
+
+size_t SharedDNSCache::size() {
+  std::lock_guard<std::mutex> g(mu_);
+
+  return ents_.size();
+}
+
+} // namespace shrpx
@@ -0,0 +1,89 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2026 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef SHRPX_DNS_CACHE_H
+#define SHRPX_DNS_CACHE_H
+
+#include "shrpx.h"
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <chrono>
+#include <expected>
+
+#include "shrpx_dns_resolver.h"
+#include "template.h"
+#include "network.h"
+#include "errors.h"
+
+using namespace nghttp2;
+
+namespace shrpx {
+
+struct DNSCacheEntry {
+  // Either DNSResolverStatus::OK or DNSResolverStatus::ERROR.
+  DNSResolverStatus status;
+  // The resolved addresses.  It is empty unless status is
+  // DNSResolverStatus::OK.
+  std::vector<Address> addrs;
+  // time point after which the entry should be refreshed in
+  // background.
+  std::chrono::steady_clock::time_point refresh_time;
+  // time point when the entry expires.
+  std::chrono::steady_clock::time_point expiry;
+};
+
+// SharedDNSCache stores the results of backend name lookups, and is
+// shared by all worker threads in a process so that a host name
+// resolved by one worker can be used by the others without another
+// lookup.
+class SharedDNSCache {
+public:
+  // add stores |ent| under |host|.  If the existing entry expires
+  // later than |ent|, it is kept.
+  void add(std::string_view host, DNSCacheEntry ent);
+  // get returns a copy of the entry stored under |host|.  It returns
+  // Error::ENTITY_NOT_FOUND if there is no such entry, or it has
+  // expired at |now|.
+  std::expected<DNSCacheEntry, Error>
+  get(std::string_view host, std::chrono::steady_clock::time_point now);
+  // gc removes the entries which have expired at |now|.
+  void gc(std::chrono::steady_clock::time_point now);
+  // size returns the number of entries.
+  [[nodiscard]] size_t size();
+
+private:
+  struct Entry {
+    ImmutableString host;
+    DNSCacheEntry ent;
+  };
+
+  std::mutex mu_;
+  std::unordered_map<std::string_view, Entry> ents_;
+};
+
+} // namespace shrpx
+
+#endif // !defined(SHRPX_DNS_CACHE_H)
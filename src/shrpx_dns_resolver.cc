@@ -238,12 +238,16 @@ DNSResolverStatus DNSResolver::get_status(Address *result) const {
   }
 
   if (result) {
-    *result = result_;
+    *result = results_[0];
   }
 
   return status_;
 }
 
+const std::vector<Address> &DNSResolver::get_results() const {
+  return results_;
+}
+
 namespace {
 void start_ev(std::vector<std::unique_ptr<ev_io>> &evs, struct ev_loop *loop,
               int fd, int event, IOCb cb, void *data) {
@@ -307,44 +311,36 @@ void DNSResolver::on_result(int status, ares_addrinfo *ai) {
     return;
   }
 
-  auto ap = ai->nodes;
-
-  for (; ap; ap = ap->ai_next) {
+  for (auto ap = ai->nodes; ap; ap = ap->ai_next) {
     switch (ap->ai_family) {
     case AF_INET: {
-      status_ = DNSResolverStatus::OK;
-
       sockaddr_in sa;
 
       assert(sizeof(sa) == ap->ai_addrlen);
 
       memcpy(&sa, ap->ai_addr, sizeof(sa));
 
-      result_.skaddr.emplace<sockaddr_in>(sa);
+      results_.emplace_back().skaddr.emplace<sockaddr_in>(sa);
 
       break;
     }
     case AF_INET6: {
-      status_ = DNSResolverStatus::OK;
-
       sockaddr_in6 sa;
 
       assert(sizeof(sa) == ap->ai_addrlen);
 
       memcpy(&sa, ap->ai_addr, sizeof(sa));
 
-      result_.skaddr.emplace<sockaddr_in6>(sa);
+      results_.emplace_back().skaddr.emplace<sockaddr_in6>(sa);
 
       break;
     }
     default:
-      continue;
+      break;
     }
-
-    break;
   }
 
-  if (!ap) {
+  if (results_.empty()) {
     if (log_enabled(INFO)) {
       Log{INFO} << "Name lookup for " << name_
                 << " failed: no address returned";
@@ -353,15 +349,14 @@ void DNSResolver::on_result(int status, ares_addrinfo *ai) {
     return;
   }
 
-  if (status_ == DNSResolverStatus::OK) {
-    if (log_enabled(INFO)) {
+  status_ = DNSResolverStatus::OK;
+
+  if (log_enabled(INFO)) {
+    for (auto &addr : results_) {
       Log{INFO} << "Name lookup succeeded: " << name_ << " -> "
-                << util::numeric_name(result_.as_sockaddr(), result_.size());
+                << util::numeric_name(addr.as_sockaddr(), addr.size());
     }
-    return;
   }
-
-  status_ = DNSResolverStatus::ERROR;
 }
 
 void DNSResolver::set_complete_cb(CompleteCb cb) {
@@ -78,8 +78,12 @@ public:
   // Starts resolving hostname |name|.
   std::expected<void, Error> resolve(std::string_view name, int family);
   // Returns status.  If status_ is DNSResolverStatus::SUCCESS &&
-  // |result| is not nullptr, |*result| is filled.
+  // |result| is not nullptr, |*result| is filled with the first
+  // address returned.
   DNSResolverStatus get_status(Address *result) const;
+  // Returns all addresses returned.  It is empty unless status_ is
+  // DNSResolverStatus::OK.
+  const std::vector<Address> &get_results() const;
   // Sets callback function when name lookup finishes.  The callback
   // function is called in a way that it can destroy this DNSResolver.
   void set_complete_cb(CompleteCb cb);
@@ -102,7 +106,7 @@ private:
   std::expected<void, Error> handle_event(int rfd, int wfd);
 
   std::vector<std::unique_ptr<ev_io>> revs_, wevs_;
-  Address result_{};
+  std::vector<Address> results_;
   CompleteCb complete_cb_;
   ev_timer timer_;
   std::string_view name_;
@@ -36,8 +36,9 @@ void gccb(struct ev_loop *loop, ev_timer *w, int revents) {
 }
 } // namespace
 
-DNSTracker::DNSTracker(struct ev_loop *loop, int family)
-  : loop_(loop), family_(family) {
+DNSTracker::DNSTracker(struct ev_loop *loop, int family,
+                       SharedDNSCache *shared_cache)
+  : loop_(loop), shared_cache_(shared_cache), family_(family) {
   ev_timer_init(&gc_timer_, gccb, 0., 12_h);
   gc_timer_.data = this;
 }
@@ -58,167 +59,217 @@ DNSTracker::~DNSTracker() {
   }
 }
 
-ResolverEntry DNSTracker::make_entry(std::unique_ptr<DualDNSResolver> resolv,
-                                     ImmutableString host,
-                                     DNSResolverStatus status,
-                                     const Address *result) {
+void DNSTracker::set_result(ResolverEntry &ent, DNSResolverStatus status,
+                            std::vector<Address> results) {
   auto &dnsconf = get_config()->dns;
+  auto now = std::chrono::steady_clock::now();
 
-  auto ent = ResolverEntry{
-    .host = std::move(host),
-    .resolv = std::move(resolv),
-    .status = status,
-  };
-  switch (status) {
-  case DNSResolverStatus::ERROR:
-  case DNSResolverStatus::OK:
-    ent.expiry = std::chrono::steady_clock::now() +
-                 util::duration_from(dnsconf.timeout.cache);
-    break;
-  default:
-    break;
+  if (status == DNSResolverStatus::ERROR &&
+      ent.status == DNSResolverStatus::OK && now < ent.expiry) {
+    // Background refresh failed.  Keep using the cached result until
+    // it expires.
+    ent.refresh_time = ent.expiry;
+
+    return;
   }
-  if (result) {
-    ent.result = *result;
+
+  ent.status = status;
+  ent.results = std::move(results);
+  ent.expiry = now + util::duration_from(dnsconf.timeout.cache);
+
+  if (status == DNSResolverStatus::OK) {
+    // Start refreshing the result when 3/4 of its lifetime has
+    // passed.
+    ent.refresh_time =
+      now + util::duration_from(dnsconf.timeout.cache * 3 / 4);
+  } else {
+    ent.refresh_time = ent.expiry;
+  }
+
+  if (shared_cache_) {
+    shared_cache_->add(as_string_view(ent.host),
+                       DNSCacheEntry{
+                         .status = ent.status,
+                         .addrs = ent.results,
+                         .refresh_time = ent.refresh_time,
+                         .expiry = ent.expiry,
+                       });
   }
-  return ent;
 }
 
-void DNSTracker::update_entry(ResolverEntry &ent,
-                              std::unique_ptr<DualDNSResolver> resolv,
-                              DNSResolverStatus status, const Address *result) {
-  auto &dnsconf = get_config()->dns;
+bool DNSTracker::load_shared_entry(ResolverEntry &ent,
+                                   std::chrono::steady_clock::time_point now) {
+  if (!shared_cache_) {
+    return false;
+  }
 
-  ent.resolv = std::move(resolv);
-  ent.status = status;
-  switch (status) {
-  case DNSResolverStatus::ERROR:
-  case DNSResolverStatus::OK:
-    ent.expiry = std::chrono::steady_clock::now() +
-                 util::duration_from(dnsconf.timeout.cache);
-    break;
-  default:
-    break;
+  auto host = as_string_view(ent.host);
+
+  auto maybe_shared_ent = shared_cache_->get(host, now);
+  if (!maybe_shared_ent) {
+    return false;
   }
-  if (result) {
-    ent.result = *result;
+
+  auto &shared_ent = *maybe_shared_ent;
+
+  if (shared_ent.expiry <= ent.expiry) {
+    return false;
   }
-}
 
-DNSResolverStatus DNSTracker::resolve(Address *result, DNSQuery *dnsq) {
-  auto it = ents_.find(dnsq->host);
+  if (log_enabled(INFO)) {
+    Log{INFO} << "DNS entry for " << host << " found in shared cache";
+  }
 
-  if (it == std::ranges::end(ents_)) {
-    if (log_enabled(INFO)) {
-      Log{INFO} << "DNS entry not found for " << dnsq->host;
-    }
+  ent.status = shared_ent.status;
+  ent.results = std::move(shared_ent.addrs);
+  ent.refresh_time = shared_ent.refresh_time;
+  ent.expiry = shared_ent.expiry;
 
-    auto resolv = std::make_unique<DualDNSResolver>(loop_, family_);
-    auto host_copy = ImmutableString{dnsq->host};
-    auto host = as_string_view(host_copy);
+  return true;
+}
 
-    if (!resolv->resolve(host)) {
-      if (log_enabled(INFO)) {
-        Log{INFO} << "Name lookup failed for " << host;
-      }
+const Address &DNSTracker::next_result(ResolverEntry &ent) {
+  assert(!ent.results.empty());
+
+  if (ent.next_result >= ent.results.size()) {
+    ent.next_result = 0;
+  }
 
-      ents_.emplace(host, make_entry(nullptr, std::move(host_copy),
-                                     DNSResolverStatus::ERROR, nullptr));
+  return ent.results[ent.next_result++];
+}
 
-      start_gc_timer();
+DNSResolverStatus DNSTracker::start_lookup(ResolverEntry &ent) {
+  auto resolv = std::make_unique<DualDNSResolver>(loop_, family_);
+  auto host = as_string_view(ent.host);
 
-      return DNSResolverStatus::ERROR;
+  if (!resolv->resolve(host)) {
+    if (log_enabled(INFO)) {
+      Log{INFO} << "Name lookup failed for " << host;
     }
 
-    switch (resolv->get_status(result)) {
-    case DNSResolverStatus::ERROR:
-      if (log_enabled(INFO)) {
-        Log{INFO} << "Name lookup failed for " << host;
-      }
+    set_result(ent, DNSResolverStatus::ERROR, {});
+
+    return DNSResolverStatus::ERROR;
+  }
+
+  switch (resolv->get_status(nullptr)) {
+  case DNSResolverStatus::ERROR:
+    if (log_enabled(INFO)) {
+      Log{INFO} << "Name lookup failed for " << host;
+    }
 
-      ents_.emplace(host, make_entry(nullptr, std::move(host_copy),
-                                     DNSResolverStatus::ERROR, nullptr));
+    set_result(ent, DNSResolverStatus::ERROR, {});
 
-      start_gc_timer();
+    return DNSResolverStatus::ERROR;
+  case DNSResolverStatus::OK:
+    set_result(ent, DNSResolverStatus::OK, resolv->get_results());
 
-      return DNSResolverStatus::ERROR;
-    case DNSResolverStatus::OK:
-      if (log_enabled(INFO)) {
+    if (log_enabled(INFO)) {
+      for (auto &addr : ent.results) {
         Log{INFO} << "Name lookup succeeded: " << host << " -> "
-                  << util::numeric_name(result->as_sockaddr(), result->size());
+                  << util::numeric_name(addr.as_sockaddr(), addr.size());
       }
+    }
 
-      ents_.emplace(host, make_entry(nullptr, std::move(host_copy),
-                                     DNSResolverStatus::OK, result));
-
-      start_gc_timer();
+    return DNSResolverStatus::OK;
+  case DNSResolverStatus::RUNNING:
+    resolv->set_complete_cb(
+      [this, &ent](DNSResolverStatus status, const Address *) {
+        on_lookup_complete(ent, status);
+      });
 
-      return DNSResolverStatus::OK;
-    case DNSResolverStatus::RUNNING: {
-      auto p =
-        ents_.emplace(host, make_entry(std::move(resolv), std::move(host_copy),
-                                       DNSResolverStatus::RUNNING, nullptr));
+    ent.resolv = std::move(resolv);
 
-      start_gc_timer();
+    return DNSResolverStatus::RUNNING;
+  default:
+    assert(0);
+    abort();
+  }
+}
 
-      auto &ent = (*p.first).second;
+void DNSTracker::on_lookup_complete(ResolverEntry &ent,
+                                    DNSResolverStatus status) {
+  std::vector<Address> results;
 
-      add_to_qlist(ent, dnsq);
+  if (status == DNSResolverStatus::OK) {
+    results = ent.resolv->get_results();
+  }
 
-      return DNSResolverStatus::RUNNING;
-    }
-    default:
-      assert(0);
+  // The callback is copied before it is called, so it is safe to
+  // delete the resolver here.
+  ent.resolv.reset();
+
+  set_result(ent, status, std::move(results));
+
+  auto &qlist = ent.qlist;
+  while (!qlist.empty()) {
+    auto head = qlist.head;
+    qlist.remove(head);
+    head->status = ent.status;
+    head->in_qlist = false;
+    auto cb = head->cb;
+    if (ent.status == DNSResolverStatus::OK) {
+      cb(DNSResolverStatus::OK, &next_result(ent));
+    } else {
+      cb(DNSResolverStatus::ERROR, nullptr);
     }
   }
+}
 
-  auto &ent = (*it).second;
+DNSResolverStatus DNSTracker::resolve(Address *result, DNSQuery *dnsq) {
+  auto now = std::chrono::steady_clock::now();
+
+  auto it = ents_.find(dnsq->host);
 
-  if (ent.status != DNSResolverStatus::RUNNING &&
-      ent.expiry < std::chrono::steady_clock::now()) {
+  if (it == std::ranges::end(ents_)) {
     if (log_enabled(INFO)) {
-      Log{INFO} << "DNS entry found for " << dnsq->host
-                << ", but it has been expired";
+      Log{INFO} << "DNS entry not found for " << dnsq->host;
     }
 
-    auto resolv = std::make_unique<DualDNSResolver>(loop_, family_);
-    auto host = as_string_view(ent.host);
+    auto host_copy = ImmutableString{dnsq->host};
+    auto host = as_string_view(host_copy);
+
+    it = ents_
+           .emplace(host,
+                    ResolverEntry{
+                      .host = std::move(host_copy),
+                      .status = DNSResolverStatus::IDLE,
+                    })
+           .first;
 
-    if (!resolv->resolve(host)) {
-      if (log_enabled(INFO)) {
-        Log{INFO} << "Name lookup failed for " << host;
-      }
+    start_gc_timer();
+  }
 
-      update_entry(ent, nullptr, DNSResolverStatus::ERROR, nullptr);
+  auto &ent = (*it).second;
 
-      return DNSResolverStatus::ERROR;
+  if (ent.status != DNSResolverStatus::RUNNING && ent.expiry < now) {
+    if (log_enabled(INFO) && ent.status != DNSResolverStatus::IDLE) {
+      Log{INFO} << "DNS entry found for " << dnsq->host
+                << ", but it has been expired";
     }
 
-    switch (resolv->get_status(result)) {
-    case DNSResolverStatus::ERROR:
-      if (log_enabled(INFO)) {
-        Log{INFO} << "Name lookup failed for " << host;
+    if (!load_shared_entry(ent, now)) {
+      if (ent.resolv) {
+        // Background refresh has not finished yet.  Wait for it.
+        ent.status = DNSResolverStatus::RUNNING;
+      } else if (start_lookup(ent) == DNSResolverStatus::RUNNING) {
+        ent.status = DNSResolverStatus::RUNNING;
       }
+    }
+  }
 
-      update_entry(ent, nullptr, DNSResolverStatus::ERROR, nullptr);
+  if (ent.status == DNSResolverStatus::OK && !ent.resolv &&
+      ent.refresh_time <= now) {
+    // Another worker might have refreshed the entry already.
+    load_shared_entry(ent, now);
 
-      return DNSResolverStatus::ERROR;
-    case DNSResolverStatus::OK:
+    if (ent.refresh_time <= now) {
       if (log_enabled(INFO)) {
-        Log{INFO} << "Name lookup succeeded: " << host << " -> "
-                  << util::numeric_name(result->as_sockaddr(), result->size());
+        Log{INFO} << "Refreshing DNS entry for " << dnsq->host
+                  << " in background";
       }
 
-      update_entry(ent, nullptr, DNSResolverStatus::OK, result);
-
-      return DNSResolverStatus::OK;
-    case DNSResolverStatus::RUNNING:
-      update_entry(ent, std::move(resolv), DNSResolverStatus::RUNNING, nullptr);
-      add_to_qlist(ent, dnsq);
-
-      return DNSResolverStatus::RUNNING;
-    default:
-      assert(0);
+      start_lookup(ent);
     }
   }
 
@@ -227,6 +278,7 @@ DNSResolverStatus DNSTracker::resolve(Address *result, DNSQuery *dnsq) {
     if (log_enabled(INFO)) {
       Log{INFO} << "Waiting for name lookup complete for " << dnsq->host;
     }
+    dnsq->wait_start = now;
     ent.qlist.append(dnsq);
     dnsq->in_qlist = true;
     return DNSResolverStatus::RUNNING;
@@ -235,49 +287,23 @@ DNSResolverStatus DNSTracker::resolve(Address *result, DNSQuery *dnsq) {
       Log{INFO} << "Name lookup failed for " << dnsq->host << " (cached)";
     }
     return DNSResolverStatus::ERROR;
-  case DNSResolverStatus::OK:
+  case DNSResolverStatus::OK: {
+    auto &addr = next_result(ent);
     if (log_enabled(INFO)) {
       Log{INFO} << "Name lookup succeeded (cached): " << dnsq->host << " -> "
-                << util::numeric_name(ent.result.as_sockaddr(),
-                                      ent.result.size());
+                << util::numeric_name(addr.as_sockaddr(), addr.size());
     }
     if (result) {
-      *result = ent.result;
+      *result = addr;
     }
     return DNSResolverStatus::OK;
+  }
   default:
     assert(0);
     abort();
   }
 }
 
-void DNSTracker::add_to_qlist(ResolverEntry &ent, DNSQuery *dnsq) {
-  ent.resolv->set_complete_cb(
-    [&ent](DNSResolverStatus status, const Address *result) {
-      auto &qlist = ent.qlist;
-      while (!qlist.empty()) {
-        auto head = qlist.head;
-        qlist.remove(head);
-        head->status = status;
-        head->in_qlist = false;
-        auto cb = head->cb;
-        cb(status, result);
-      }
-
-      auto &dnsconf = get_config()->dns;
-
-      ent.resolv.reset();
-      ent.status = status;
-      ent.expiry = std::chrono::steady_clock::now() +
-                   util::duration_from(dnsconf.timeout.cache);
-      if (ent.status == DNSResolverStatus::OK) {
-        ent.result = *result;
-      }
-    });
-  ent.qlist.append(dnsq);
-  dnsq->in_qlist = true;
-}
-
 void DNSTracker::cancel(DNSQuery *dnsq) {
   if (!dnsq->in_qlist) {
     return;
@@ -309,7 +335,7 @@ void DNSTracker::gc() {
   auto now = std::chrono::steady_clock::now();
   for (auto it = std::ranges::begin(ents_); it != std::ranges::end(ents_);) {
     auto &ent = (*it).second;
-    if (ent.expiry >= now) {
+    if (ent.resolv || !ent.qlist.empty() || ent.expiry >= now) {
       ++it;
       continue;
     }
@@ -317,6 +343,10 @@ void DNSTracker::gc() {
     it = ents_.erase(it);
   }
 
+  if (shared_cache_) {
+    shared_cache_->gc(now);
+  }
+
   if (ents_.empty()) {
     ev_timer_stop(loop_, &gc_timer_);
   }
@@ -28,9 +28,11 @@
 #include "shrpx.h"
 
 #include <unordered_map>
+#include <vector>
 #include <chrono>
 
 #include "shrpx_dual_dns_resolver.h"
+#include "shrpx_dns_cache.h"
 
 using namespace nghttp2;
 
@@ -52,6 +54,10 @@ struct DNSQuery {
   // DNSTracker::resolve().
   CompleteCb cb;
   DNSQuery *dlnext, *dlprev;
+  // time point when this query started waiting for name lookup.  It
+  // is only set if DNSTracker::resolve() returns
+  // DNSResolverStatus::RUNNING.
+  std::chrono::steady_clock::time_point wait_start;
   DNSResolverStatus status;
   // true if this object is in linked list ResolverEntry::qlist.
   bool in_qlist;
@@ -60,23 +66,33 @@ struct DNSQuery {
 struct ResolverEntry {
   // Host name this entry lookups for.
   ImmutableString host;
-  // DNS resolver.  Only non-nullptr if status is
-  // DNSResolverStatus::RUNNING.
+  // DNS resolver.  Only non-nullptr while name lookup is running,
+  // which includes the background refresh of DNSResolverStatus::OK
+  // entry.
   std::unique_ptr<DualDNSResolver> resolv;
   // DNSQuery interested in this name lookup result.  The result is
   // notified to them all.
   DList<DNSQuery> qlist;
   // Use the same enum with DNSResolverStatus
   DNSResolverStatus status;
-  // result and its expiry time
-  Address result;
+  // The resolved addresses.  It is empty unless status is
+  // DNSResolverStatus::OK.
+  std::vector<Address> results;
+  // The index of results which is returned next.  The addresses are
+  // returned in round robin to spread connections over them.
+  size_t next_result;
+  // time point after which name lookup is started in background
+  // while the cached result is still returned.
+  std::chrono::steady_clock::time_point refresh_time;
   // time point when cached result expires.
   std::chrono::steady_clock::time_point expiry;
 };
 
 class DNSTracker {
 public:
-  DNSTracker(struct ev_loop *loop, int family);
+  // |shared_cache| is the cache shared by all workers.  It may be
+  // nullptr.
+  DNSTracker(struct ev_loop *loop, int family, SharedDNSCache *shared_cache);
   ~DNSTracker();
 
   // Lookups host name described in |dnsq|.  If name lookup finishes
@@ -87,7 +103,10 @@ public:
   // filled.  If lookup failed, DNSResolverStatus::ERROR is returned.
   // If name lookup is being done background, it returns
   // DNSResolverStatus::RUNNING.  Its completion is notified by
-  // calling dnsq->cb.
+  // calling dnsq->cb.  If name lookup returns multiple addresses,
+  // they are returned in round robin.  If cached result is about to
+  // expire, it is returned, and name lookup is started in background
+  // to refresh it.
   DNSResolverStatus resolve(Address *result, DNSQuery *dnsq);
   // Cancels name lookup requested by |dnsq|.
   void cancel(DNSQuery *dnsq);
@@ -97,14 +116,25 @@ public:
   void start_gc_timer();
 
 private:
-  ResolverEntry make_entry(std::unique_ptr<DualDNSResolver> resolv,
-                           ImmutableString host, DNSResolverStatus status,
-                           const Address *result);
-
-  void update_entry(ResolverEntry &ent, std::unique_ptr<DualDNSResolver> resolv,
-                    DNSResolverStatus status, const Address *result);
-
-  void add_to_qlist(ResolverEntry &ent, DNSQuery *dnsq);
+  // Starts name lookup for |ent|.  If it finishes within this
+  // function, |ent| is updated, and DNSResolverStatus::OK or
+  // DNSResolverStatus::ERROR is returned.  Otherwise, it returns
+  // DNSResolverStatus::RUNNING.  This function does not change
+  // ent.status in that case.
+  DNSResolverStatus start_lookup(ResolverEntry &ent);
+  // Called when name lookup started by start_lookup finishes in
+  // background.
+  void on_lookup_complete(ResolverEntry &ent, DNSResolverStatus status);
+  // Updates |ent| with the result of name lookup, and stores it in
+  // shared_cache_.
+  void set_result(ResolverEntry &ent, DNSResolverStatus status,
+                  std::vector<Address> results);
+  // Replaces |ent| with the entry in shared_cache_ if the latter
+  // expires later.  It returns true if |ent| is replaced.
+  bool load_shared_entry(ResolverEntry &ent,
+                         std::chrono::steady_clock::time_point now);
+  // Returns the next address in |ent| in round robin.
+  const Address &next_result(ResolverEntry &ent);
 
   std::unordered_map<std::string_view, ResolverEntry> ents_;
   // Periodically iterates ents_, and removes expired entries to avoid
@@ -112,6 +142,7 @@ private:
   // increase memory consumption, interval could be very long.
   ev_timer gc_timer_;
   struct ev_loop *loop_;
+  SharedDNSCache *shared_cache_;
   // IP version preference.
   int family_;
 };
@@ -37,6 +37,8 @@
 #include "shrpx_downstream_queue.h"
 #include "shrpx_worker.h"
 #include "shrpx_http2_session.h"
+#include "shrpx_collapsed_downstream_connection.h"
+#include "shrpx_app_cookie_table.h"
 #include "shrpx_log.h"
 #ifdef HAVE_MRUBY
 #  include "shrpx_mruby.h"
@@ -144,6 +146,14 @@ void downstream_wtimeoutcb(struct ev_loop *loop, ev_timer *w, int revents) {
 }
 } // namespace
 
+namespace {
+void hedge_timeoutcb(struct ev_loop *loop, ev_timer *w, int revents) {
+  auto downstream = static_cast<Downstream *>(w->data);
+
+  downstream->hedge();
+}
+} // namespace
+
 // upstream could be nullptr for unittests
 Downstream::Downstream(Upstream *upstream, MemchunkPool *mcpool,
                        int64_t stream_id)
@@ -152,6 +162,7 @@ Downstream::Downstream(Upstream *upstream, MemchunkPool *mcpool,
     request_start_time_(std::chrono::steady_clock::now()),
     blocked_request_buf_(mcpool),
     request_buf_(mcpool),
+    hedge_request_buf_(mcpool),
     response_buf_(mcpool),
     upstream_(upstream),
     stream_id_(stream_id) {
@@ -168,12 +179,14 @@ Downstream::Downstream(Upstream *upstream, MemchunkPool *mcpool,
                 httpconf.downstream.timeout.stream_read);
   ev_timer_init(&downstream_wtimer_, &downstream_wtimeoutcb, 0.,
                 httpconf.downstream.timeout.stream_write);
+  ev_timer_init(&hedge_timer_, &hedge_timeoutcb, 0., 0.);
 
   header_timer_.data = this;
   upstream_rtimer_.data = this;
   upstream_wtimer_.data = this;
   downstream_rtimer_.data = this;
   downstream_wtimer_.data = this;
+  hedge_timer_.data = this;
 
   rcbufs_.reserve(32);
 #ifdef ENABLE_HTTP3
@@ -199,6 +212,7 @@ Downstream::~Downstream() {
     ev_timer_stop(loop, &downstream_rtimer_);
     ev_timer_stop(loop, &downstream_wtimer_);
     ev_timer_stop(loop, &header_timer_);
+    ev_timer_stop(loop, &hedge_timer_);
 
 #ifdef HAVE_MRUBY
     auto worker = handler->get_worker();
@@ -218,6 +232,12 @@ Downstream::~Downstream() {
   }
 #endif // defined(HAVE_MRUBY)
 
+  cancel_hedge();
+  stop_inflight_tracking();
+
+  // Let the collapsed requests know that this request is gone.
+  collapse_entry_.reset();
+
   // DownstreamConnection may refer to this object.  Delete it now
   // explicitly.
   dconn_.reset();
@@ -245,6 +265,8 @@ std::expected<void, Error> Downstream::attach_downstream_connection(
 
   dconn_ = std::move(dconn);
 
+  start_inflight_tracking(dconn_.get());
+
   return {};
 }
 
@@ -253,6 +275,9 @@ std::expected<void, Error> Downstream::detach_downstream_connection() {
     return {};
   }
 
+  cancel_hedge();
+  stop_inflight_tracking();
+
 #ifdef HAVE_MRUBY
   const auto &group = dconn_->get_downstream_addr_group();
   if (group) {
@@ -278,6 +303,9 @@ DownstreamConnection *Downstream::get_downstream_connection() {
 }
 
 std::unique_ptr<DownstreamConnection> Downstream::pop_downstream_connection() {
+  cancel_hedge();
+  stop_inflight_tracking();
+
 #ifdef HAVE_MRUBY
   if (!dconn_) {
     return nullptr;
@@ -370,7 +398,8 @@ std::string_view Downstream::assemble_request_cookie() {
   return as_string_view(std::ranges::begin(iov), p);
 }
 
-uint32_t Downstream::find_affinity_cookie(std::string_view name) {
+std::string_view
+Downstream::find_request_cookie(std::string_view name) const {
   for (auto &kv : req_.fs.headers()) {
     if (kv.token != http2::HD_COOKIE) {
       continue;
@@ -385,7 +414,7 @@ uint32_t Downstream::find_affinity_cookie(std::string_view name) {
 
       auto end = std::ranges::find(it, std::ranges::end(kv.value), '=');
       if (end == std::ranges::end(kv.value)) {
-        return 0;
+        return ""sv;
       }
 
       if (name != std::string_view{it, end}) {
@@ -394,24 +423,29 @@ uint32_t Downstream::find_affinity_cookie(std::string_view name) {
       }
 
       it = std::ranges::find(end + 1, std::ranges::end(kv.value), ';');
-      auto val = std::string_view{end + 1, it};
-      if (val.size() != 8) {
-        return 0;
-      }
-      uint32_t h = 0;
-      for (auto c : val) {
-        auto n = util::hex_to_uint(c);
-        if (n == 256) {
-          return 0;
-        }
-        h <<= 4;
-        h += n;
-      }
-      affinity_cookie_ = h;
-      return h;
+      return std::string_view{end + 1, it};
     }
   }
-  return 0;
+  return ""sv;
+}
+
+uint32_t Downstream::find_affinity_cookie(std::string_view name) {
+  auto val = find_request_cookie(name);
+  if (val.size() != 8) {
+    return 0;
+  }
+
+  uint32_t h = 0;
+  for (auto c : val) {
+    auto n = util::hex_to_uint(c);
+    if (n == 256) {
+      return 0;
+    }
+    h <<= 4;
+    h += n;
+  }
+  affinity_cookie_ = h;
+  return h;
 }
 
 size_t Downstream::count_crumble_request_cookie() {
@@ -624,6 +658,14 @@ Downstream::get_request_start_time() const {
   return request_start_time_;
 }
 
+void Downstream::add_dns_wait_time(std::chrono::steady_clock::duration d) {
+  dns_wait_time_ += d;
+}
+
+std::chrono::steady_clock::duration Downstream::get_dns_wait_time() const {
+  return dns_wait_time_;
+}
+
 void Downstream::reset_upstream(Upstream *upstream) {
   upstream_ = upstream;
   if (dconn_) {
@@ -1190,6 +1232,296 @@ void Downstream::set_addr(const DownstreamAddr *addr) { addr_ = addr; }
 
 const DownstreamAddr *Downstream::get_addr() const { return addr_; }
 
+void Downstream::start_inflight_tracking(DownstreamConnection *dconn) {
+  // upstream_ is nullptr in unittests.
+  if (!upstream_) {
+    return;
+  }
+
+  auto addr = dconn->get_addr();
+  if (!addr) {
+    return;
+  }
+
+  const auto &group = dconn->get_downstream_addr_group();
+  if (!group) {
+    return;
+  }
+
+  auto &shared_addr = group->shared_addr;
+  if (shared_addr->lb != LoadBalancing::P2C &&
+      shared_addr->affinity.max_load == 0 &&
+      shared_addr->concurrency_limit == 0 &&
+      shared_addr->hedge_percentile == 0 &&
+      !outlier_detection_enabled(shared_addr->outlier)) {
+    return;
+  }
+
+  auto loop = upstream_->get_client_handler()->get_loop();
+
+  inflight_group_ = group;
+  inflight_addr_ = addr;
+  inflight_start_ = ev_now(loop);
+  inflight_rtt_observed_ = false;
+
+  ++addr->num_inflight;
+  ++shared_addr->num_inflight;
+
+  // Session affinity always chooses the same address.  A request is
+  // hedged at most once.
+  if (shared_addr->hedge_percentile == 0 || shared_addr->addrs.size() < 2 ||
+      shared_addr->affinity.type != SessionAffinity::NONE || hedge_addr_ ||
+      !replayable()) {
+    return;
+  }
+
+  auto &hedge = shared_addr->hedge;
+
+  hedge_add_budget(hedge, shared_addr->hedge_budget);
+
+  if (hedge.delay > 0.) {
+    ev_timer_set(&hedge_timer_, hedge.delay, 0.);
+    ev_timer_start(loop, &hedge_timer_);
+  }
+}
+
+void Downstream::stop_inflight_tracking() {
+  if (!inflight_addr_) {
+    return;
+  }
+
+  ev_timer_stop(upstream_->get_client_handler()->get_loop(), &hedge_timer_);
+
+  --inflight_addr_->num_inflight;
+  --inflight_group_->shared_addr->num_inflight;
+
+  if (!inflight_rtt_observed_) {
+    // No response header has been received.  If this request has
+    // been in flight longer than the current estimate, take it into
+    // account so that a stalled backend is penalized.
+    auto now = ev_now(upstream_->get_client_handler()->get_loop());
+    auto rtt = now - inflight_start_;
+    if (rtt > inflight_addr_->rtt_ewma) {
+      downstream_addr_observe_rtt(*inflight_addr_, rtt, now);
+
+      if (inflight_group_->shared_addr->concurrency_limit) {
+        downstream_addr_decrease_concurrency_limit(*inflight_addr_);
+      }
+    }
+  }
+
+  inflight_addr_ = nullptr;
+  inflight_group_.reset();
+}
+
+namespace {
+// Records the value of the cookie |name| in the set-cookie header
+// fields of |fs| in |table| as the one issued by |addr|.
+void remember_app_cookie(AppCookieTable &table, const FieldStore &fs,
+                         std::string_view name, const DownstreamAddr &addr) {
+  for (auto &kv : fs.headers()) {
+    if (kv.name != "set-cookie"sv) {
+      continue;
+    }
+
+    auto eq = std::ranges::find(kv.value, '=');
+    if (eq == std::ranges::end(kv.value) ||
+        name != std::string_view{std::ranges::begin(kv.value), eq}) {
+      continue;
+    }
+
+    auto val = std::string_view{
+      eq + 1, std::ranges::find(eq + 1, std::ranges::end(kv.value), ';')};
+    if (val.empty()) {
+      continue;
+    }
+
+    table.add(val, addr.affinity_hash);
+  }
+}
+} // namespace
+
+void Downstream::on_backend_response_header() {
+  if (addr_ && group_ &&
+      group_->shared_addr->affinity.type == SessionAffinity::APP_COOKIE) {
+    auto &shared_addr = group_->shared_addr;
+
+    remember_app_cookie(*shared_addr->app_cookie_table, resp_.fs,
+                        shared_addr->affinity.cookie.name, *addr_);
+  }
+
+  if (!inflight_addr_ || inflight_rtt_observed_) {
+    return;
+  }
+
+  inflight_rtt_observed_ = true;
+
+  auto now = ev_now(upstream_->get_client_handler()->get_loop());
+
+  auto rtt = now - inflight_start_;
+
+  downstream_addr_observe_rtt(*inflight_addr_, rtt, now);
+
+  auto &shared_addr = inflight_group_->shared_addr;
+
+  if (auto max_limit = shared_addr->concurrency_limit; max_limit) {
+    downstream_addr_update_concurrency_limit(*inflight_addr_, rtt, now,
+                                             max_limit);
+  }
+
+  if (outlier_detection_enabled(shared_addr->outlier)) {
+    downstream_addr_record_outcome(*shared_addr, *inflight_addr_,
+                                   resp_.http_status / 100 == 5, now);
+  }
+
+  if (shared_addr->hedge_percentile) {
+    ev_timer_stop(upstream_->get_client_handler()->get_loop(), &hedge_timer_);
+
+    hedge_add_sample(shared_addr->hedge, rtt, shared_addr->hedge_percentile);
+  }
+}
+
+void Downstream::on_backend_failure() {
+  if (!inflight_addr_ || inflight_rtt_observed_) {
+    return;
+  }
+
+  auto &shared_addr = inflight_group_->shared_addr;
+  if (!outlier_detection_enabled(shared_addr->outlier)) {
+    return;
+  }
+
+  downstream_addr_record_outcome(
+    *shared_addr, *inflight_addr_, true,
+    ev_now(upstream_->get_client_handler()->get_loop()));
+}
+
+bool Downstream::replayable() const {
+  return (req_.method == HTTP_GET || req_.method == HTTP_HEAD) &&
+         !req_.upgrade_request && !req_.http2_upgrade_seen &&
+         !req_.http2_expect_body && req_.fs.content_length <= 0 &&
+         !req_.fs.header(http2::HD_TRANSFER_ENCODING);
+}
+
+void Downstream::hedge() {
+  // The response header might have started to arrive.  The request
+  // must have been fully written, so that the copy of it is complete.
+  if (!inflight_addr_ || inflight_rtt_observed_ || hedge_dconn_ ||
+      request_state_ != DownstreamState::MSG_COMPLETE ||
+      !request_header_sent_ || request_buf_.rleft() ||
+      response_state_ != DownstreamState::INITIAL || resp_.http_status ||
+      !resp_.fs.headers().empty()) {
+    return;
+  }
+
+  auto &hedge = inflight_group_->shared_addr->hedge;
+
+  if (!hedge_consume_budget(hedge)) {
+    if (log_enabled(INFO)) {
+      Log{INFO, this} << "Hedging budget exhausted";
+    }
+
+    return;
+  }
+
+  auto handler = upstream_->get_client_handler();
+
+  auto maybe_dconn = handler->get_hedge_downstream_connection(
+    this, inflight_group_, inflight_addr_);
+  if (!maybe_dconn) {
+    if (log_enabled(INFO)) {
+      Log{INFO, this} << "No other backend address is available for hedging";
+    }
+
+    // Give back the token consumed above.
+    hedge_add_budget(hedge, 1.);
+
+    return;
+  }
+
+  auto &dconn = *maybe_dconn;
+
+  if (!dconn->attach_downstream(this)) {
+    hedge_add_budget(hedge, 1.);
+
+    return;
+  }
+
+  ++hedge.num_hedged;
+
+  hedge_addr_ = inflight_addr_;
+
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "No response header from " << inflight_addr_->hostport
+                    << " in " << hedge.delay << "s; hedge the request to "
+                    << dconn->get_addr()->hostport;
+  }
+
+  hedge_dconn_ = std::move(dconn);
+  hedge_start_ = ev_now(handler->get_loop());
+
+  ++hedge_dconn_->get_addr()->num_inflight;
+  ++inflight_group_->shared_addr->num_inflight;
+
+  // HttpDownstreamConnection writes the host it requests to
+  // request_downstream_host_.  Keep the one of the original request.
+  auto request_downstream_host = request_downstream_host_;
+
+  auto rv = hedge_dconn_->push_request_headers();
+
+  hedge_request_downstream_host_ = request_downstream_host_;
+  request_downstream_host_ = request_downstream_host;
+
+  if (!rv || !hedge_dconn_->end_upload_data()) {
+    cancel_hedge();
+  }
+}
+
+void Downstream::cancel_hedge() {
+  if (!hedge_dconn_) {
+    return;
+  }
+
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "Cancel the hedged request to "
+                    << hedge_dconn_->get_addr()->hostport;
+  }
+
+  const auto &group = hedge_dconn_->get_downstream_addr_group();
+
+  --hedge_dconn_->get_addr()->num_inflight;
+  --group->shared_addr->num_inflight;
+
+  hedge_dconn_.reset();
+  hedge_request_buf_.reset();
+}
+
+void Downstream::promote_hedge() {
+  assert(hedge_dconn_);
+
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "The hedged request to "
+                    << hedge_dconn_->get_addr()->hostport << " won";
+  }
+
+  // The original request has received nothing.  stop_inflight_tracking
+  // penalizes its backend address.
+  stop_inflight_tracking();
+
+  dconn_ = std::move(hedge_dconn_);
+  request_buf_ = std::move(hedge_request_buf_);
+  request_downstream_host_ = hedge_request_downstream_host_;
+
+  // hedge_dconn_ has been counted in num_inflight since it was
+  // created.
+  inflight_group_ = dconn_->get_downstream_addr_group();
+  inflight_addr_ = dconn_->get_addr();
+  inflight_start_ = hedge_start_;
+  inflight_rtt_observed_ = false;
+
+  ++inflight_group_->shared_addr->hedge.num_won;
+}
+
 void Downstream::set_accesslog_written(bool f) { accesslog_written_ = f; }
 
 void Downstream::renew_affinity_cookie(uint32_t h) {
@@ -1218,6 +1550,18 @@ void Downstream::set_blocked_request_data_eof(bool f) {
 
 void Downstream::set_ws_key(std::string_view key) { ws_key_ = key; }
 
+void Downstream::set_collapse_entry(std::unique_ptr<CollapseEntry> entry) {
+  collapse_entry_ = std::move(entry);
+}
+
+CollapseEntry *Downstream::get_collapse_entry() const {
+  return collapse_entry_.get();
+}
+
+void Downstream::disable_collapse() { collapse_disabled_ = true; }
+
+bool Downstream::get_collapse_disabled() const { return collapse_disabled_; }
+
 bool Downstream::get_expect_100_continue() const {
   return expect_100_continue_;
 }
@@ -58,6 +58,7 @@ namespace shrpx {
 
 class Upstream;
 class DownstreamConnection;
+class CollapseEntry;
 struct BlockedLink;
 struct DownstreamAddrGroup;
 struct DownstreamAddr;
@@ -303,6 +304,16 @@ enum class DispatchState {
   FAILURE,
 };
 
+// The state of sending a request to a backend in TLS early data.
+enum class BackendEarlyData {
+  NONE,
+  // The request was sent in early data, and the backend accepted it.
+  ACCEPTED,
+  // The backend responded with 425 to the request sent in early data.
+  // The request must not be sent in early data again.
+  REJECTED,
+};
+
 class Downstream {
 public:
   Downstream(Upstream *upstream, MemchunkPool *mcpool, int64_t stream_id);
@@ -364,6 +375,10 @@ public:
 
   void set_request_start_time(std::chrono::steady_clock::time_point time);
   std::chrono::steady_clock::time_point get_request_start_time() const;
+  // Adds |d| to the time this request has spent waiting for the
+  // backend name lookup.
+  void add_dns_wait_time(std::chrono::steady_clock::duration d);
+  std::chrono::steady_clock::duration get_dns_wait_time() const;
   std::expected<void, Error> push_request_headers();
   bool get_chunked_request() const;
   void set_chunked_request(bool f);
@@ -492,6 +507,50 @@ public:
 
   void set_accesslog_written(bool f);
 
+  // Call this function when response header fields are received from
+  // a backend.  It records the latency of the backend address for
+  // load balancing, and the backend address which issued the cookie
+  // for affinity=app-cookie.
+  void on_backend_response_header();
+  // Call this function when the backend failed before sending the
+  // response header: the stream or connection was reset, closed, or
+  // timed out.  It is counted by passive outlier detection.
+  void on_backend_failure();
+
+  // Sends the copy of the request to the other backend address over
+  // the second connection if the request in flight has not received
+  // the response header yet, and the budget of hedging allows it.
+  // The original request is kept in flight.  This is called when the
+  // hedge delay of the backend group elapses.
+  void hedge();
+  // Returns the connection which carries the hedged copy of the
+  // request, or nullptr if there is none.
+  DownstreamConnection *get_hedge_connection() const {
+    return hedge_dconn_.get();
+  }
+  // Returns the buffer of the hedged copy of the request.
+  DefaultMemchunks *get_hedge_request_buf() { return &hedge_request_buf_; }
+  // Cancels the hedged copy of the request, and deletes its
+  // connection.  The original request is not affected.
+  void cancel_hedge();
+  // Call this function when the response to the hedged copy of the
+  // request arrives first.  The original request is cancelled, and
+  // the hedged one takes over its place.
+  void promote_hedge();
+  // Returns true if this request can be sent to a backend more than
+  // once: it is idempotent, and has no request body.
+  bool replayable() const;
+
+  void set_backend_early_data(BackendEarlyData state) {
+    backend_early_data_ = state;
+  }
+  BackendEarlyData get_backend_early_data() const {
+    return backend_early_data_;
+  }
+
+  // Returns the value of the request cookie whose name is |name|.  If
+  // no such cookie is found, returns an empty string.
+  std::string_view find_request_cookie(std::string_view name) const;
   // Finds affinity cookie from request header fields.  The name of
   // cookie is given in |name|.  If an affinity cookie is found, it is
   // assigned to a member function, and is returned.  If it is not
@@ -506,6 +565,16 @@ public:
 
   void set_ws_key(std::string_view key);
 
+  // Makes this request the one which is forwarded to a backend on
+  // behalf of the identical requests collapsed into |entry|.
+  void set_collapse_entry(std::unique_ptr<CollapseEntry> entry);
+  // Returns CollapseEntry set by set_collapse_entry(), or nullptr.
+  CollapseEntry *get_collapse_entry() const;
+  // Excludes this request from request collapsing.  This is used when
+  // a collapsed request falls back to its own backend request.
+  void disable_collapse();
+  bool get_collapse_disabled() const;
+
   bool get_expect_100_continue() const;
 
   bool get_stop_reading() const;
@@ -534,6 +603,13 @@ public:
   int64_t response_sent_body_length{};
 
 private:
+  // Starts tracking the request in flight to the backend address of
+  // |dconn| if the load balancing method of its group requires it.
+  void start_inflight_tracking(DownstreamConnection *dconn);
+  // Stops tracking the request in flight started by
+  // start_inflight_tracking().
+  void stop_inflight_tracking();
+
   BlockAllocator balloc_{1024, 1024};
 
   std::vector<nghttp2_rcbuf *> rcbufs_;
@@ -545,16 +621,23 @@ private:
   Response resp_;
 
   std::chrono::steady_clock::time_point request_start_time_;
+  // The time this request has spent waiting for the backend name
+  // lookup.
+  std::chrono::steady_clock::duration dns_wait_time_{};
 
   // host we requested to downstream.  This is used to rewrite
   // location header field to decide the location should be rewritten
   // or not.
   std::string_view request_downstream_host_;
+  // request_downstream_host_ of the hedged copy of this request.
+  std::string_view hedge_request_downstream_host_;
 
   // Data arrived in frontend before sending header fields to backend
   // are stored in this buffer.
   DefaultMemchunks blocked_request_buf_;
   DefaultMemchunks request_buf_;
+  // The request sent to hedge_dconn_.
+  DefaultMemchunks hedge_request_buf_;
   DefaultMemchunks response_buf_;
 
   // The Sec-WebSocket-Key field sent to the peer.  This field is used
@@ -569,6 +652,8 @@ private:
   ev_timer downstream_rtimer_;
   ev_timer downstream_wtimer_;
 
+  ev_timer hedge_timer_;
+
   Upstream *upstream_;
   std::unique_ptr<DownstreamConnection> dconn_;
 
@@ -578,6 +663,27 @@ private:
   // logging purpose.
   std::shared_ptr<DownstreamAddrGroup> group_;
   const DownstreamAddr *addr_{};
+  // The backend address which this request is in flight to.  It is
+  // only set if the requests in flight are tracked for the group (see
+  // SharedDownstreamAddr::num_inflight).  inflight_group_ keeps
+  // inflight_addr_ alive.
+  std::shared_ptr<DownstreamAddrGroup> inflight_group_;
+  DownstreamAddr *inflight_addr_{};
+  // The timestamp when this request is handed to inflight_addr_.
+  ev_tstamp inflight_start_{};
+  // The backend address which this request was hedged away from.
+  // A request is hedged at most once.
+  const DownstreamAddr *hedge_addr_{};
+  // The connection which carries the hedged copy of this request to
+  // the other backend address.  It is counted in num_inflight of its
+  // address while it is alive.
+  std::unique_ptr<DownstreamConnection> hedge_dconn_;
+  // The timestamp when the hedged copy of this request is handed to
+  // the backend address of hedge_dconn_.
+  ev_tstamp hedge_start_{};
+  // Non-nullptr if the identical requests are collapsed into this
+  // request.
+  std::unique_ptr<CollapseEntry> collapse_entry_;
   // How many times we tried in backend connection
   size_t num_retry_{};
   // The stream ID in frontend connection
@@ -597,6 +703,7 @@ private:
   DownstreamState response_state_{DownstreamState::INITIAL};
   // only used by HTTP/2 upstream
   DispatchState dispatch_state_{DispatchState::NONE};
+  BackendEarlyData backend_early_data_{BackendEarlyData::NONE};
   // true if the connection is upgraded (HTTP Upgrade or CONNECT),
   // excluding upgrade to HTTP/2.
   bool upgraded_{};
@@ -623,6 +730,10 @@ private:
   bool expect_100_continue_{};
   bool stop_reading_{};
   bool upstream_write_rate_member_{};
+  // true if the latency of inflight_addr_ has been observed.
+  bool inflight_rtt_observed_{};
+  // true if this request must not be collapsed into another request.
+  bool collapse_disabled_{};
 };
 
 } // namespace shrpx
@@ -43,6 +43,9 @@ class Upstream;
 class Downstream;
 struct DownstreamAddrGroup;
 struct DownstreamAddr;
+#ifdef HAVE_SPLICE
+struct SplicePipe;
+#endif // defined(HAVE_SPLICE)
 
 class DownstreamConnection {
 public:
@@ -69,8 +72,26 @@ public:
 
   virtual void on_upstream_change(Upstream *upstream) = 0;
 
+#ifdef HAVE_SPLICE
+  // Starts forwarding the upgraded tunnel with splice(2).  The bytes
+  // from the frontend are read from |request_pipe|, and the bytes
+  // from the backend must be moved into |response_pipe|.  Returns
+  // true if this connection is able to do so.
+  virtual bool start_splice(SplicePipe *request_pipe,
+                            SplicePipe *response_pipe) {
+    return false;
+  }
+  // Tells that new bytes are available in the request pipe.
+  virtual void signal_splice_write() {}
+#endif // defined(HAVE_SPLICE)
+
   // true if this object is poolable.
   virtual bool poolable() const = 0;
+  // true if this is a reused connection, and it has not received any
+  // byte of the response yet.  If such connection is closed, the
+  // backend most likely closed it on its idle timeout before seeing
+  // the request.
+  virtual bool reused_and_idle() const { return false; }
 
   virtual const std::shared_ptr<DownstreamAddrGroup> &
   get_downstream_addr_group() const = 0;
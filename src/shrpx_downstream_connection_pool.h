@@ -43,6 +43,11 @@ public:
   std::unique_ptr<DownstreamConnection> pop_downstream_connection();
   void remove_downstream_connection(DownstreamConnection *dconn);
   void remove_all();
+  // Returns the pooled connections.
+  const std::unordered_set<DownstreamConnection *> &
+  get_downstream_connections() const {
+    return pool_;
+  }
 
 private:
   std::unordered_set<DownstreamConnection *> pool_;
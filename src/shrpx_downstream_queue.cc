@@ -26,6 +26,7 @@
 
 #include <cassert>
 #include <limits>
+#include <algorithm>
 
 #include "shrpx_downstream.h"
 
@@ -44,7 +45,9 @@ DownstreamQueue::~DownstreamQueue() {
   dlist_delete_all(downstreams_);
   for (auto &p : host_entries_) {
     auto &ent = p.second;
-    dlist_delete_all(ent.blocked);
+    for (auto &blocked : ent.blocked) {
+      dlist_delete_all(blocked);
+    }
   }
 }
 
@@ -84,14 +87,19 @@ void DownstreamQueue::mark_active(Downstream *downstream) {
   downstream->set_dispatch_state(DispatchState::ACTIVE);
 }
 
-void DownstreamQueue::mark_blocked(Downstream *downstream) {
+void DownstreamQueue::mark_blocked(Downstream *downstream,
+                                   uint32_t urgency) {
   auto &ent = find_host_entry(make_host_key(downstream));
 
   downstream->set_dispatch_state(DispatchState::BLOCKED);
 
-  auto link = new BlockedLink{};
+  auto link = new BlockedLink{
+    .urgency =
+      std::min(urgency, static_cast<uint32_t>(NUM_URGENCY_LEVELS - 1)),
+  };
   downstream->attach_blocked_link(link);
-  ent.blocked.append(link);
+  ent.blocked[link->urgency].append(link);
+  ++ent.num_blocked;
 }
 
 bool DownstreamQueue::can_activate(std::string_view host) const {
@@ -103,11 +111,56 @@ bool DownstreamQueue::can_activate(std::string_view host) const {
   return ent.num_active < conn_max_per_host_;
 }
 
+namespace {
+// Returns the number of blocked downstreams which are dequeued from
+// the queue of |urgency| per round.  Urgency 0 gets 8 times as many
+// as urgency 7.
+size_t urgency_quantum(size_t urgency) {
+  return NUM_URGENCY_LEVELS - urgency;
+}
+} // namespace
+
+namespace {
+// Removes a blocked link from |ent| in deficit round robin, and
+// returns it.  |ent| must have at least one blocked link.
+BlockedLink *pop_blocked(DownstreamQueue::HostEntry &ent) {
+  assert(ent.num_blocked);
+
+  for (;;) {
+    auto urgency = ent.next_urgency;
+    auto &blocked = ent.blocked[urgency];
+    auto &deficit = ent.deficit[urgency];
+
+    if (blocked.empty()) {
+      deficit = 0;
+      ent.next_urgency = (urgency + 1) % NUM_URGENCY_LEVELS;
+
+      continue;
+    }
+
+    if (deficit == 0) {
+      deficit = urgency_quantum(urgency);
+    }
+
+    auto link = blocked.head;
+    blocked.remove(link);
+    --ent.num_blocked;
+
+    if (--deficit == 0 || blocked.empty()) {
+      deficit = 0;
+      ent.next_urgency = (urgency + 1) % NUM_URGENCY_LEVELS;
+    }
+
+    return link;
+  }
+}
+} // namespace
+
 namespace {
 bool remove_host_entry_if_empty(const DownstreamQueue::HostEntry &ent,
                                 DownstreamQueue::HostEntryMap &host_entries,
                                 std::string_view host) {
-  if (ent.blocked.empty() && ent.num_active == 0) {
+  if (ent.num_blocked == 0 && ent.num_active == 0) {
     host_entries.erase(host);
     return true;
   }
@@ -131,7 +184,8 @@ Downstream *DownstreamQueue::remove_and_get_blocked(Downstream *downstream,
     // For those downstreams deleted while in blocked state
     auto link = downstream->detach_blocked_link();
     if (link) {
-      ent.blocked.remove(link);
+      ent.blocked[link->urgency].remove(link);
+      --ent.num_blocked;
       delete link;
     }
   }
@@ -144,18 +198,17 @@ Downstream *DownstreamQueue::remove_and_get_blocked(Downstream *downstream,
     return nullptr;
   }
 
-  auto link = ent.blocked.head;
-
-  if (!link) {
+  if (ent.num_blocked == 0) {
     return nullptr;
   }
 
+  auto link = pop_blocked(ent);
+
   auto next_downstream = link->downstream;
   auto link2 = next_downstream->detach_blocked_link();
   // This is required with --disable-assert.
   (void)link2;
   assert(link2 == link);
-  ent.blocked.remove(link);
   delete link;
   remove_host_entry_if_empty(ent, host_entries_, host);
 
@@ -30,6 +30,7 @@
 #include <cinttypes>
 #include <unordered_map>
 #include <memory>
+#include <array>
 
 #include "template.h"
 
@@ -39,12 +40,20 @@ namespace shrpx {
 
 class Downstream;
 
+// The number of urgency levels defined by RFC 9218.
+inline constexpr size_t NUM_URGENCY_LEVELS = 8;
+// The default urgency defined by RFC 9218.
+inline constexpr uint32_t DEFAULT_URGENCY = 3;
+
 // Link entry in HostEntry.blocked and downstream because downstream
 // could be deleted in anytime and we'd like to find Downstream in
 // O(1).  Downstream has field to link back to this object.
 struct BlockedLink {
   Downstream *downstream;
   BlockedLink *dlnext, *dlprev;
+  // The urgency of downstream.  This is the index of HostEntry.blocked
+  // which this object belongs to.
+  uint32_t urgency;
 };
 
 class DownstreamQueue {
@@ -60,8 +69,16 @@ public:
 
     // Key that associates this object
     ImmutableString key;
-    // Set of stream ID that blocked by conn_max_per_host_.
-    DList<BlockedLink> blocked;
+    // Set of stream ID that blocked by conn_max_per_host_.  They are
+    // queued per urgency, and dequeued in deficit round robin
+    // weighted by urgency.
+    std::array<DList<BlockedLink>, NUM_URGENCY_LEVELS> blocked;
+    // The deficit counter of each queue in blocked.
+    std::array<size_t, NUM_URGENCY_LEVELS> deficit{};
+    // The index of queue in blocked which is visited next.
+    size_t next_urgency{};
+    // The number of downstreams in blocked.
+    size_t num_blocked{};
     // The number of connections currently made to this host.
     size_t num_active{};
   };
@@ -82,7 +99,11 @@ public:
   void mark_active(Downstream *downstream);
   // Set |downstream| to blocked state, which means that download
   // connection was blocked because conn_max_per_host_ limit.
-  void mark_blocked(Downstream *downstream);
+  // |urgency| is the RFC 9218 urgency of |downstream|.  The blocked
+  // downstreams with lower urgency value get larger share of the
+  // connections freed later.
+  void mark_blocked(Downstream *downstream,
+                    uint32_t urgency = DEFAULT_URGENCY);
   // Returns true if we can make downstream connection to given
   // |host|.
   bool can_activate(std::string_view host) const;
@@ -90,7 +111,8 @@ public:
   // DispatchState::ACTIVE, and |next_blocked| is true, this function
   // may return Downstream object with the same target host in
   // DispatchState::BLOCKED if its connection is now not blocked by
-  // conn_max_per_host_ limit.
+  // conn_max_per_host_ limit.  The blocked Downstream is chosen by
+  // deficit round robin over urgency levels.
   Downstream *remove_and_get_blocked(Downstream *downstream,
                                      bool next_blocked = true);
   Downstream *get_downstreams() const;
@@ -0,0 +1,203 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2026 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_downstream_queue_test.h"
+
+#include <vector>
+#include <unordered_map>
+
+#include "munitxx.h"
+
+#include "shrpx_downstream_queue.h"
+#include "shrpx_downstream.h"
+#include "memchunk.h"
+
+namespace shrpx {
+
+namespace {
+const MunitTest tests[]{
+  munit_void_test(test_downstream_queue_drr_ratio),
+  munit_void_test(test_downstream_queue_drr_no_starvation),
+  munit_void_test(test_downstream_queue_drr_remove_blocked),
+  munit_test_end(),
+};
+} // namespace
+
+const MunitSuite downstream_queue_suite{
+  .prefix = "/downstream_queue",
+  .tests = tests,
+};
+
+namespace {
+// BlockedQueue drives DownstreamQueue with conn_max_per_host = 1.
+// One Downstream is active, and the others are blocked with the given
+// urgency.  next() finishes the active Downstream, activates the one
+// that DownstreamQueue picks, and returns its urgency.
+struct BlockedQueue {
+  BlockedQueue() : mcpool{}, dq{1} {
+    active = add();
+    dq.mark_active(active);
+  }
+
+  Downstream *add() {
+    auto d = std::make_unique<Downstream>(nullptr, &mcpool, next_stream_id);
+    next_stream_id += 2;
+    auto p = d.get();
+    dq.add_pending(std::move(d));
+    return p;
+  }
+
+  Downstream *block(uint32_t urgency) {
+    auto d = add();
+    dq.mark_blocked(d, urgency);
+    urgencies.emplace(d, urgency);
+    return d;
+  }
+
+  // Returns the urgency of the Downstream activated next, or -1 if
+  // nothing is blocked.
+  int next() {
+    auto d = dq.remove_and_get_blocked(active);
+    active = nullptr;
+    if (!d) {
+      return -1;
+    }
+
+    dq.mark_active(d);
+    active = d;
+
+    auto it = urgencies.find(d);
+    assert_true(it != std::ranges::end(urgencies));
+
+    auto urgency = static_cast<int>((*it).second);
+    urgencies.erase(it);
+
+    return urgency;
+  }
+
+  MemchunkPool mcpool;
+  DownstreamQueue dq;
+  std::unordered_map<Downstream *, uint32_t> urgencies;
+  Downstream *active;
+  int64_t next_stream_id{1};
+};
+} // namespace
+
+void test_downstream_queue_drr_ratio(void) {
+  BlockedQueue q;
+
+  for (size_t i = 0; i < 32; ++i) {
+    q.block(0);
+    q.block(3);
+    q.block(7);
+  }
+
+  // Each round dequeues 8 of urgency 0, 5 of urgency 3, and 1 of
+  // urgency 7.
+  for (size_t round = 0; round < 2; ++round) {
+    for (size_t i = 0; i < 8; ++i) {
+      assert_int(0, ==, q.next());
+    }
+    for (size_t i = 0; i < 5; ++i) {
+      assert_int(3, ==, q.next());
+    }
+    assert_int(7, ==, q.next());
+  }
+
+  // Over many rounds, the shares follow the weights.
+  std::array<size_t, NUM_URGENCY_LEVELS> counts{};
+
+  for (size_t i = 0; i < 14 * 2; ++i) {
+    auto urgency = q.next();
+    assert_int(0, <=, urgency);
+
+    ++counts[static_cast<size_t>(urgency)];
+  }
+
+  assert_size(16, ==, counts[0]);
+  assert_size(10, ==, counts[3]);
+  assert_size(2, ==, counts[7]);
+}
+
+void test_downstream_queue_drr_no_starvation(void) {
+  BlockedQueue q;
+
+  // A burst of the most urgent requests is blocked before a single
+  // least urgent one.
+  for (size_t i = 0; i < 100; ++i) {
+    q.block(0);
+  }
+
+  q.block(7);
+
+  size_t pos = 0;
+  for (;; ++pos) {
+    auto urgency = q.next();
+    assert_int(-1, !=, urgency);
+
+    if (urgency == 7) {
+      break;
+    }
+  }
+
+  // The least urgent request gets its turn after one quantum of the
+  // most urgent ones, instead of waiting for all 100 of them.
+  assert_size(8, ==, pos);
+
+  // Requests blocked later at the least urgency are not starved by a
+  // steady stream of the most urgent requests either.
+  size_t low = 0;
+  for (size_t i = 0; i < 10; ++i) {
+    q.block(7);
+  }
+
+  for (size_t i = 0; i < 9 * 10; ++i) {
+    q.block(0);
+
+    if (q.next() == 7) {
+      ++low;
+    }
+  }
+
+  assert_size(10, ==, low);
+}
+
+void test_downstream_queue_drr_remove_blocked(void) {
+  BlockedQueue q;
+
+  auto d0 = q.block(0);
+  q.block(5);
+  q.block(5);
+
+  // Removing a blocked Downstream takes it out of its urgency queue
+  // without activating anything.
+  assert_null(q.dq.remove_and_get_blocked(d0));
+  q.urgencies.erase(d0);
+
+  assert_int(5, ==, q.next());
+  assert_int(5, ==, q.next());
+  assert_int(-1, ==, q.next());
+}
+
+} // namespace shrpx
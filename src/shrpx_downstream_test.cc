@@ -24,9 +24,19 @@
  */
 #include "shrpx_downstream_test.h"
 
+#include <sys/socket.h>
+#include <unistd.h>
+
 #include "munitxx.h"
 
 #include "shrpx_downstream.h"
+#include "shrpx_downstream_connection.h"
+#include "shrpx_client_handler.h"
+#include "shrpx_connection_handler.h"
+#include "shrpx_worker.h"
+#include "shrpx_http2_session.h"
+#include "shrpx_collapsed_downstream_connection.h"
+#include "shrpx_config.h"
 
 using namespace std::literals;
 
@@ -41,6 +51,10 @@ const MunitTest tests[]{
   munit_void_test(test_downstream_rewrite_location_response_header),
   munit_void_test(test_downstream_supports_non_final_response),
   munit_void_test(test_downstream_find_affinity_cookie),
+  munit_void_test(test_downstream_inflight_tracking_http2),
+  munit_void_test(test_downstream_collapse_slow_follower),
+  munit_void_test(test_downstream_concurrency_limit_skip_saturated),
+  munit_void_test(test_downstream_hedge_exclude_addr),
   munit_test_end(),
 };
 } // namespace
@@ -216,4 +230,392 @@ void test_downstream_find_affinity_cookie(void) {
   assert_uint32(0, ==, aff);
 }
 
+void test_downstream_inflight_tracking_http2(void) {
+  auto loop = ev_loop_new(0);
+  auto gen = util::make_mt19937();
+
+  auto downstreamconf = std::make_shared<DownstreamConfig>();
+  downstreamconf->outlier.errors = 5;
+
+  auto &g = downstreamconf->addr_groups.emplace_back("/"sv);
+  g.lb = LoadBalancing::P2C;
+
+  for (auto [hostport, port] : {std::pair{"127.0.0.1:3000"sv, 3000},
+                                std::pair{"127.0.0.1:3001"sv, 3001}}) {
+    auto &addr = g.addrs.emplace_back();
+    addr.host = "127.0.0.1"sv;
+    addr.hostport = hostport;
+    addr.port = static_cast<uint16_t>(port);
+    addr.weight = 1;
+    addr.group_weight = 1;
+    addr.proto = Proto::HTTP2;
+  }
+
+  auto config = mod_config();
+  auto old_downstreamconf =
+    std::exchange(config->conn.downstream, downstreamconf);
+
+  {
+    ConnectionHandler conn_handler(loop, gen);
+    Worker worker(loop, nullptr, nullptr, nullptr,
+#ifdef ENABLE_HTTP3
+                  nullptr, nullptr, nullptr, WorkerID{},
+#endif // defined(ENABLE_HTTP3)
+                  0, nullptr, &conn_handler, downstreamconf);
+
+    std::array<int, 2> fds;
+
+    assert_int(0, ==, socketpair(AF_UNIX, SOCK_STREAM, 0, fds.data()));
+
+    UpstreamAddr faddr{};
+
+    {
+      ClientHandler handler(&worker, fds[0], nullptr, "127.0.0.1"sv, "3000"sv,
+                            AF_INET, &faddr);
+
+      auto &shared_addr = worker.get_downstream_addr_groups()[0]->shared_addr;
+
+      auto downstream = std::make_unique<Downstream>(handler.get_upstream(),
+                                                     worker.get_mcpool(), 1);
+
+      auto &req = downstream->request();
+      req.method = HTTP_GET;
+      req.path = "/"sv;
+      req.authority = "localhost"sv;
+
+      auto dconn = handler.get_downstream_connection(downstream.get());
+
+      assert_true(dconn.has_value());
+
+      // The address of a HTTP/2 backend is the one of its session.
+      auto addr = (*dconn)->get_addr();
+
+      assert_not_null(addr);
+      assert_true(
+        downstream->attach_downstream_connection(std::move(*dconn)).has_value());
+      assert_size(1, ==, addr->num_inflight);
+      assert_size(1, ==, shared_addr->num_inflight);
+
+      // The stream reset by a HTTP/2 backend is counted by passive
+      // outlier detection.
+      downstream->on_backend_failure();
+
+      assert_size(1, ==, addr->outlier_errors);
+
+      ev_sleep(0.01);
+      ev_now_update(loop);
+
+      downstream->on_backend_response_header();
+
+      assert_double(0., <, addr->rtt_ewma);
+      assert_size(0, ==, addr->outlier_errors);
+
+      downstream.reset();
+
+      assert_size(0, ==, addr->num_inflight);
+      assert_size(0, ==, shared_addr->num_inflight);
+
+      for (auto &addr : shared_addr->addrs) {
+        while (addr.http2_extra_freelist.head) {
+          delete addr.http2_extra_freelist.head;
+        }
+      }
+    }
+
+    close(fds[1]);
+  }
+
+  config->conn.downstream = std::move(old_downstreamconf);
+
+  ev_loop_destroy(loop);
+}
+
+void test_downstream_collapse_slow_follower(void) {
+  auto loop = ev_loop_new(0);
+  auto gen = util::make_mt19937();
+
+  auto downstreamconf = std::make_shared<DownstreamConfig>();
+  downstreamconf->response_buffer_size = 16_k;
+
+  auto &g = downstreamconf->addr_groups.emplace_back("/"sv);
+  g.collapse = true;
+
+  auto &addr = g.addrs.emplace_back();
+  addr.host = "127.0.0.1"sv;
+  addr.hostport = "127.0.0.1:3000"sv;
+  addr.port = 3000;
+  addr.weight = 1;
+  addr.group_weight = 1;
+  addr.proto = Proto::HTTP1;
+
+  auto config = mod_config();
+  auto old_downstreamconf =
+    std::exchange(config->conn.downstream, downstreamconf);
+
+  {
+    ConnectionHandler conn_handler(loop, gen);
+    Worker worker(loop, nullptr, nullptr, nullptr,
+#ifdef ENABLE_HTTP3
+                  nullptr, nullptr, nullptr, WorkerID{},
+#endif // defined(ENABLE_HTTP3)
+                  0, nullptr, &conn_handler, downstreamconf);
+
+    std::array<int, 2> fds;
+
+    assert_int(0, ==, socketpair(AF_UNIX, SOCK_STREAM, 0, fds.data()));
+
+    UpstreamAddr faddr{};
+
+    {
+      ClientHandler handler(&worker, fds[0], nullptr, "127.0.0.1"sv, "3000"sv,
+                            AF_INET, &faddr);
+
+      auto &group = worker.get_downstream_addr_groups()[0];
+
+      auto leader = std::make_unique<Downstream>(handler.get_upstream(),
+                                                 worker.get_mcpool(), 1);
+      leader->set_collapse_entry(
+        std::make_unique<CollapseEntry>(&worker, "key", leader.get()));
+
+      auto follower = std::make_unique<Downstream>(handler.get_upstream(),
+                                                   worker.get_mcpool(), 3);
+
+      auto &req = follower->request();
+      req.method = HTTP_GET;
+      req.path = "/"sv;
+      req.authority = "localhost"sv;
+      req.http_major = 1;
+      req.http_minor = 1;
+
+      assert_true(follower
+                    ->attach_downstream_connection(
+                      std::make_unique<CollapsedDownstreamConnection>(
+                        group, leader->get_collapse_entry(), loop))
+                    .has_value());
+
+      auto &resp = leader->response();
+      resp.http_status = 200;
+      resp.http_major = 1;
+      resp.http_minor = 1;
+
+      leader->get_collapse_entry()->on_response_header();
+
+      auto buf = follower->get_response_buf();
+
+      assert_size(0, <, buf->rleft());
+
+      std::array<uint8_t, 4_k> data{};
+
+      // The client of the follower reads nothing.  Once its buffer is
+      // full, the follower stops receiving the response.
+      for (size_t i = 0; i < 16; ++i) {
+        leader->get_collapse_entry()->on_response_body(data, false);
+      }
+
+      auto n = buf->rleft();
+
+      assert_size(16_k, <=, n);
+      assert_size(16_k + data.size() * 2, >, n);
+
+      leader->get_collapse_entry()->on_response_body(data, false);
+
+      assert_size(n, ==, buf->rleft());
+
+      follower.reset();
+      leader.reset();
+    }
+
+    close(fds[1]);
+  }
+
+  config->conn.downstream = std::move(old_downstreamconf);
+
+  ev_loop_destroy(loop);
+}
+
+void test_downstream_concurrency_limit_skip_saturated(void) {
+  auto loop = ev_loop_new(0);
+  auto gen = util::make_mt19937();
+
+  for (auto lb : {LoadBalancing::WRR, LoadBalancing::P2C}) {
+    auto downstreamconf = std::make_shared<DownstreamConfig>();
+    downstreamconf->concurrency_limit = 100;
+
+    auto &g = downstreamconf->addr_groups.emplace_back("/"sv);
+    g.lb = lb;
+
+    for (auto [hostport, port] : {std::pair{"127.0.0.1:3000"sv, 3000},
+                                  std::pair{"127.0.0.1:3001"sv, 3001}}) {
+      auto &addr = g.addrs.emplace_back();
+      addr.host = "127.0.0.1"sv;
+      addr.hostport = hostport;
+      addr.port = static_cast<uint16_t>(port);
+      addr.weight = 1;
+      addr.group_weight = 1;
+      addr.proto = Proto::HTTP1;
+    }
+
+    auto config = mod_config();
+    auto old_downstreamconf =
+      std::exchange(config->conn.downstream, downstreamconf);
+
+    {
+      ConnectionHandler conn_handler(loop, gen);
+      Worker worker(loop, nullptr, nullptr, nullptr,
+#ifdef ENABLE_HTTP3
+                    nullptr, nullptr, nullptr, WorkerID{},
+#endif // defined(ENABLE_HTTP3)
+                    0, nullptr, &conn_handler, downstreamconf);
+
+      std::array<int, 2> fds;
+
+      assert_int(0, ==, socketpair(AF_UNIX, SOCK_STREAM, 0, fds.data()));
+
+      UpstreamAddr faddr{};
+
+      {
+        ClientHandler handler(&worker, fds[0], nullptr, "127.0.0.1"sv,
+                              "3000"sv, AF_INET, &faddr);
+
+        auto &group = worker.get_downstream_addr_groups()[0];
+        auto &addrs = group->shared_addr->addrs;
+
+        for (auto &addr : addrs) {
+          addr.concurrency_limit = 1.;
+        }
+
+        Downstream downstream(handler.get_upstream(), worker.get_mcpool(), 1);
+
+        // The first address is at its limit.  It is skipped rather
+        // than rejecting the request.
+        addrs[0].num_inflight = 1;
+
+        for (size_t i = 0; i < 4; ++i) {
+          auto addr = handler.get_downstream_addr(group.get(), &downstream);
+
+          assert_true(addr.has_value());
+          assert_ptr_equal(&addrs[1], *addr);
+        }
+
+        // All addresses are at their limits.
+        addrs[1].num_inflight = 1;
+
+        auto addr = handler.get_downstream_addr(group.get(), &downstream);
+
+        assert_false(addr.has_value());
+        assert_int(static_cast<int>(Error::OVERLOADED), ==,
+                   static_cast<int>(addr.error()));
+        assert_uint64(1, ==, addrs[0].num_concurrency_rejected);
+        assert_uint64(1, ==, addrs[1].num_concurrency_rejected);
+
+        // The address skipped earlier is selected again once it has
+        // room.
+        addrs[0].num_inflight = 0;
+
+        addr = handler.get_downstream_addr(group.get(), &downstream);
+
+        assert_true(addr.has_value());
+        assert_ptr_equal(&addrs[0], *addr);
+
+        for (auto &addr : addrs) {
+          addr.num_inflight = 0;
+        }
+      }
+
+      close(fds[1]);
+    }
+
+    config->conn.downstream = std::move(old_downstreamconf);
+  }
+
+  ev_loop_destroy(loop);
+}
+
+void test_downstream_hedge_exclude_addr(void) {
+  auto loop = ev_loop_new(0);
+  auto gen = util::make_mt19937();
+
+  for (auto lb : {LoadBalancing::WRR, LoadBalancing::P2C}) {
+    auto downstreamconf = std::make_shared<DownstreamConfig>();
+
+    auto &g = downstreamconf->addr_groups.emplace_back("/"sv);
+    g.lb = lb;
+
+    for (auto [hostport, port] : {std::pair{"127.0.0.1:3000"sv, 3000},
+                                  std::pair{"127.0.0.1:3001"sv, 3001}}) {
+      auto &addr = g.addrs.emplace_back();
+      addr.host = "127.0.0.1"sv;
+      addr.hostport = hostport;
+      addr.port = static_cast<uint16_t>(port);
+      addr.weight = 1;
+      addr.group_weight = 1;
+      addr.proto = Proto::HTTP1;
+    }
+
+    auto config = mod_config();
+    auto old_downstreamconf =
+      std::exchange(config->conn.downstream, downstreamconf);
+
+    {
+      ConnectionHandler conn_handler(loop, gen);
+      Worker worker(loop, nullptr, nullptr, nullptr,
+#ifdef ENABLE_HTTP3
+                    nullptr, nullptr, nullptr, WorkerID{},
+#endif // defined(ENABLE_HTTP3)
+                    0, nullptr, &conn_handler, downstreamconf);
+
+      std::array<int, 2> fds;
+
+      assert_int(0, ==, socketpair(AF_UNIX, SOCK_STREAM, 0, fds.data()));
+
+      UpstreamAddr faddr{};
+
+      {
+        ClientHandler handler(&worker, fds[0], nullptr, "127.0.0.1"sv,
+                              "3000"sv, AF_INET, &faddr);
+
+        auto &group = worker.get_downstream_addr_groups()[0];
+        auto &addrs = group->shared_addr->addrs;
+
+        Downstream downstream(handler.get_upstream(), worker.get_mcpool(), 1);
+
+        // The hedged request never goes to the address which the
+        // original request is in flight to.
+        for (auto &exclude : addrs) {
+          for (size_t i = 0; i < 8; ++i) {
+            auto addr =
+              handler.get_downstream_addr(group.get(), &downstream, &exclude);
+
+            assert_true(addr.has_value());
+            assert_ptr_not_equal(&exclude, *addr);
+          }
+        }
+
+        // The other address is not available.
+        addrs[1].connect_blocker->offline();
+
+        auto addr =
+          handler.get_downstream_addr(group.get(), &downstream, &addrs[0]);
+
+        assert_false(addr.has_value());
+        assert_int(static_cast<int>(Error::NO_AVAIL_DOWNSTREAM), ==,
+                   static_cast<int>(addr.error()));
+
+        // The excluded address is still selected for the other
+        // requests.
+        addr = handler.get_downstream_addr(group.get(), &downstream);
+
+        assert_true(addr.has_value());
+        assert_ptr_equal(&addrs[0], *addr);
+      }
+
+      close(fds[1]);
+    }
+
+    config->conn.downstream = std::move(old_downstreamconf);
+  }
+
+  ev_loop_destroy(loop);
+}
+
 } // namespace shrpx
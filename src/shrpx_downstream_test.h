@@ -44,6 +44,10 @@ munit_void_test_decl(test_downstream_assemble_request_cookie)
 munit_void_test_decl(test_downstream_rewrite_location_response_header)
 munit_void_test_decl(test_downstream_supports_non_final_response)
 munit_void_test_decl(test_downstream_find_affinity_cookie)
+munit_void_test_decl(test_downstream_inflight_tracking_http2)
+munit_void_test_decl(test_downstream_collapse_slow_follower)
+munit_void_test_decl(test_downstream_concurrency_limit_skip_saturated)
+munit_void_test_decl(test_downstream_hedge_exclude_addr)
 
 } // namespace shrpx
 
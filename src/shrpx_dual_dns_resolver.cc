@@ -24,6 +24,9 @@
  */
 #include "shrpx_dual_dns_resolver.h"
 
+#include <algorithm>
+#include <iterator>
+
 namespace shrpx {
 
 DualDNSResolver::DualDNSResolver(struct ev_loop *loop, int family)
@@ -98,4 +101,18 @@ DNSResolverStatus DualDNSResolver::get_status(Address *result) const {
   return DNSResolverStatus::IDLE;
 }
 
+std::vector<Address> DualDNSResolver::get_results() const {
+  std::vector<Address> results;
+
+  auto &results6 = resolv6_.get_results();
+  auto &results4 = resolv4_.get_results();
+
+  results.reserve(results6.size() + results4.size());
+
+  std::ranges::copy(results6, std::back_inserter(results));
+  std::ranges::copy(results4, std::back_inserter(results));
+
+  return results;
+}
+
 } // namespace shrpx
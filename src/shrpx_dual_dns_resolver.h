@@ -27,6 +27,7 @@
 
 #include "shrpx.h"
 
+#include <vector>
 #include <expected>
 
 #include <ev.h>
@@ -56,6 +57,11 @@ public:
   CompleteCb get_complete_cb() const;
   void set_complete_cb(CompleteCb cb);
   DNSResolverStatus get_status(Address *result) const;
+  // Returns all addresses returned so far, AAAA records first.  If
+  // one lookup finishes earlier than the other, the complete callback
+  // is called without waiting for it, and the addresses from the
+  // unfinished lookup are not included.
+  std::vector<Address> get_results() const;
 
 private:
   // IP version preference.
@@ -279,6 +279,82 @@ bool check_http_scheme(std::string_view scheme, bool encrypted) {
   return encrypted ? scheme == "https"sv : scheme == "http"sv;
 }
 
+namespace {
+// Calls |f| with each element of comma separated list |s|.  The
+// leading and trailing white spaces are stripped from an element, and
+// empty elements are skipped.  It returns false if |f| returns false.
+template <typename F> bool for_each_list_element(std::string_view s, F f) {
+  auto lws = [](char c) { return c == ' ' || c == '\t'; };
+
+  for (auto first = std::ranges::begin(s), last = std::ranges::end(s);;) {
+    auto end = std::ranges::find(first, last, ',');
+    auto b = std::ranges::find_if_not(first, end, lws);
+    auto e = end;
+    for (; e != b && lws(*(e - 1)); --e)
+      ;
+
+    if (b != e && !f(std::string_view{b, e})) {
+      return false;
+    }
+
+    if (end == last) {
+      return true;
+    }
+
+    first = end + 1;
+  }
+}
+} // namespace
+
+bool shareable_response(unsigned int status_code, const HeaderRefs &headers) {
+  // RFC 9110 defines these status codes as heuristically cacheable.
+  switch (status_code) {
+  case 200:
+  case 203:
+  case 204:
+  case 300:
+  case 301:
+  case 308:
+  case 404:
+  case 405:
+  case 410:
+  case 414:
+  case 501:
+    break;
+  default:
+    return false;
+  }
+
+  for (auto &kv : headers) {
+    if (kv.name == "set-cookie"sv) {
+      return false;
+    }
+
+    if (kv.name == "cache-control"sv) {
+      if (!for_each_list_element(kv.value, [](auto directive) {
+            auto name = directive.substr(0, directive.find('='));
+            return !util::strieq("private"sv, name) &&
+                   !util::strieq("no-store"sv, name) &&
+                   !util::strieq("no-cache"sv, name);
+          })) {
+        return false;
+      }
+
+      continue;
+    }
+
+    if (kv.name == "vary"sv) {
+      if (!for_each_list_element(kv.value, [](auto field) {
+            return util::strieq("accept-encoding"sv, field);
+          })) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
 } // namespace http
 
 } // namespace shrpx
@@ -33,6 +33,7 @@
 #include <nghttp2/nghttp2.h>
 
 #include "shrpx_config.h"
+#include "http2.h"
 #include "util.h"
 #include "allocator.h"
 
@@ -107,6 +108,15 @@ std::string_view create_altsvc_header_value(BlockAllocator &balloc,
 // Otherwise returns false.
 bool check_http_scheme(std::string_view scheme, bool encrypted);
 
+// Returns true if a response with |status_code| and header fields
+// |headers| can be shared by the identical requests which are
+// collapsed into a single backend request.  The response must be
+// heuristically cacheable, must not set cookie, and must not be
+// marked as private, no-store, or no-cache.  It must not vary on any
+// request header field other than accept-encoding, which is a part
+// of the collapse key.
+bool shareable_response(unsigned int status_code, const HeaderRefs &headers);
+
 } // namespace http
 
 } // namespace shrpx
@@ -237,29 +237,12 @@ nghttp2_ssize http2_data_read_callback(nghttp2_session *session,
 }
 } // namespace
 
-std::expected<void, Error> Http2DownstreamConnection::push_request_headers() {
-  if (!downstream_) {
-    return {};
-  }
-  if (!http2session_->can_push_request(downstream_)) {
-    // The HTTP2 session to the backend has not been established or
-    // connection is now being checked.  This function will be called
-    // again just after it is established.
-    downstream_->set_request_pending(true);
-    http2session_->start_checking_connection();
-    return {};
-  }
-
-  downstream_->set_request_pending(false);
-
-  const auto &req = downstream_->request();
-
-  if (req.connect_proto != ConnectProto::NONE &&
-      !http2session_->get_allow_connect_proto()) {
-    return std::unexpected{Error::INTERNAL};
-  }
+std::vector<nghttp2_nv>
+build_downstream_request_headers(Downstream *downstream,
+                                 const DownstreamAddr *addr) {
+  const auto &req = downstream->request();
 
-  auto &balloc = downstream_->get_block_allocator();
+  auto &balloc = downstream->get_block_allocator();
 
   auto config = get_config();
   auto &httpconf = config->http;
@@ -268,22 +251,19 @@ std::expected<void, Error> Http2DownstreamConnection::push_request_headers() {
   auto no_host_rewrite = httpconf.no_host_rewrite || config->http2_proxy ||
                          req.regular_connect_method();
 
-  // http2session_ has already in CONNECTED state, so we can get
-  // addr_idx here.
-
   // For HTTP/1.0 request, there is no authority in request.  In that
   // case, we use backend server's host nonetheless.
-  auto authority = http2session_->get_addr()->hostport;
+  auto authority = addr->hostport;
 
   if (no_host_rewrite && !req.authority.empty()) {
     authority = req.authority;
   }
 
-  downstream_->set_request_downstream_host(authority);
+  downstream->set_request_downstream_host(authority);
 
   size_t num_cookies = 0;
   if (!http2conf.no_cookie_crumbling) {
-    num_cookies = downstream_->count_crumble_request_cookie();
+    num_cookies = downstream->count_crumble_request_cookie();
   }
 
   // 11 means:
@@ -313,8 +293,6 @@ std::expected<void, Error> Http2DownstreamConnection::push_request_headers() {
   if (!req.regular_connect_method()) {
     assert(!req.scheme.empty());
 
-    auto addr = http2session_->get_addr();
-    assert(addr);
     // We will handle more protocol scheme upgrade in the future.
     if (addr->tls && addr->upgrade_scheme && req.scheme == "http"sv) {
       nva.push_back(http2::make_field(":scheme"sv, "https"sv));
@@ -352,10 +330,10 @@ std::expected<void, Error> Http2DownstreamConnection::push_request_headers() {
   http2::copy_headers_to_nva_nocopy(nva, req.fs.headers(), build_flags);
 
   if (!http2conf.no_cookie_crumbling) {
-    downstream_->crumble_request_cookie(nva);
+    downstream->crumble_request_cookie(nva);
   }
 
-  auto upstream = downstream_->get_upstream();
+  auto upstream = downstream->get_upstream();
   auto handler = upstream->get_client_handler();
 
 #if defined(NGHTTP2_GENUINE_OPENSSL) ||                                        \
@@ -403,11 +381,11 @@ std::expected<void, Error> Http2DownstreamConnection::push_request_headers() {
 
   if (xffconf.add) {
     std::string_view xff_value;
-    const auto &addr = upstream->get_client_handler()->get_ipaddr();
+    const auto &ipaddr = upstream->get_client_handler()->get_ipaddr();
     if (xff) {
-      xff_value = concat_string_ref(balloc, xff->value, ", "sv, addr);
+      xff_value = concat_string_ref(balloc, xff->value, ", "sv, ipaddr);
     } else {
-      xff_value = addr;
+      xff_value = ipaddr;
     }
     nva.push_back(http2::make_field("x-forwarded-for"sv, xff_value));
   } else if (xff) {
@@ -470,6 +448,36 @@ std::expected<void, Error> Http2DownstreamConnection::push_request_headers() {
     nva.push_back(http2::make_field(p.name, p.value));
   }
 
+  return nva;
+}
+
+std::expected<void, Error> Http2DownstreamConnection::push_request_headers() {
+  if (!downstream_) {
+    return {};
+  }
+  if (!http2session_->can_push_request(downstream_)) {
+    // The HTTP2 session to the backend has not been established or
+    // connection is now being checked.  This function will be called
+    // again just after it is established.
+    downstream_->set_request_pending(true);
+    http2session_->start_checking_connection();
+    return {};
+  }
+
+  downstream_->set_request_pending(false);
+
+  const auto &req = downstream_->request();
+
+  if (req.connect_proto != ConnectProto::NONE &&
+      !http2session_->get_allow_connect_proto()) {
+    return std::unexpected{Error::INTERNAL};
+  }
+
+  // http2session_ has already in CONNECTED state, so we can get
+  // addr_idx here.
+  auto nva =
+    build_downstream_request_headers(downstream_, http2session_->get_addr());
+
   if (log_enabled(INFO)) {
     std::string ss;
     for (auto &nv : nva) {
@@ -631,6 +639,8 @@ Http2DownstreamConnection::get_downstream_addr_group() const {
   return http2session_->get_downstream_addr_group();
 }
 
-DownstreamAddr *Http2DownstreamConnection::get_addr() const { return nullptr; }
+DownstreamAddr *Http2DownstreamConnection::get_addr() const {
+  return http2session_->get_addr();
+}
 
 } // namespace shrpx
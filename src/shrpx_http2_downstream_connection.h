@@ -27,6 +27,8 @@
 
 #include "shrpx.h"
 
+#include <vector>
+
 #include "ssl_compat.h"
 
 #ifdef NGHTTP2_OPENSSL_IS_WOLFSSL
@@ -91,6 +93,13 @@ private:
   StreamData *sd_{};
 };
 
+// Builds the request header fields to forward the request of
+// |downstream| to |addr|.  The returned fields refer to the memory
+// owned by |downstream|.  HTTP/3 backend also uses this function.
+std::vector<nghttp2_nv>
+build_downstream_request_headers(Downstream *downstream,
+                                 const DownstreamAddr *addr);
+
 } // namespace shrpx
 
 #endif // !defined(SHRPX_HTTP2_DOWNSTREAM_CONNECTION_H)
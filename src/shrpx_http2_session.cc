@@ -298,6 +298,16 @@ std::expected<void, Error> Http2Session::resolve_name() {
         resolved_addr_->port(addr_->port);
       }
 
+      auto wait_time =
+        std::chrono::steady_clock::now() - dns_query_->wait_start;
+
+      for (auto dc = dconns_.head; dc; dc = dc->dlnext) {
+        auto downstream = dc->get_downstream();
+        if (downstream) {
+          downstream->add_dns_wait_time(wait_time);
+        }
+      }
+
       if (!this->initiate_connection()) {
         delete this;
       }
@@ -493,6 +503,12 @@ std::expected<void, Error> Http2Session::initiate_connection() {
 
         worker_blocker->on_success();
 
+        if (downstreamconf.tcp_fastopen &&
+            util::make_socket_fastopen_connect(conn_.fd) != 0 &&
+            log_enabled(INFO)) {
+          Log{INFO, this} << "Failed to enable TCP Fast Open";
+        }
+
         rv = connect(conn_.fd,
                      // TODO maybe not thread-safe?
                      raddr_->as_sockaddr(), raddr_->size());
@@ -558,6 +574,12 @@ std::expected<void, Error> Http2Session::initiate_connection() {
 
         worker_blocker->on_success();
 
+        if (downstreamconf.tcp_fastopen &&
+            util::make_socket_fastopen_connect(conn_.fd) != 0 &&
+            log_enabled(INFO)) {
+          Log{INFO, this} << "Failed to enable TCP Fast Open";
+        }
+
         rv = connect(conn_.fd, raddr_->as_sockaddr(), raddr_->size());
         if (rv != 0 && errno != EINPROGRESS) {
           auto error = errno;
@@ -849,6 +871,9 @@ int on_stream_close_callback(nghttp2_session *session, int32_t stream_id,
             NGHTTP2_NO_ERROR) {
         downstream->set_response_rst_stream_error_code(error_code);
       }
+      if (downstream->get_response_state() == DownstreamState::MSG_RESET) {
+        downstream->on_backend_failure();
+      }
       call_downstream_readcb(http2session, downstream);
     }
     // dconn may be deleted
@@ -1109,6 +1134,7 @@ std::expected<void, Error> on_response_headers(Http2Session *http2session,
   downstream->set_downstream_addr_group(
     http2session->get_downstream_addr_group());
   downstream->set_addr(http2session->get_addr());
+  downstream->on_backend_response_header();
 
   if (log_enabled(INFO)) {
     std::string ss;
@@ -1910,6 +1936,25 @@ void Http2Session::start_checking_connection() {
   signal_write();
 }
 
+void Http2Session::prewarm() {
+  switch (state_) {
+  case Http2SessionState::DISCONNECTED:
+    signal_write();
+
+    return;
+  case Http2SessionState::CONNECTED:
+    // If nothing has been read for a while, do the connection check
+    // now rather than delaying the next request with it.
+    if (dconns_.empty()) {
+      start_checking_connection();
+    }
+
+    return;
+  default:
+    return;
+  }
+}
+
 void Http2Session::reset_connection_check_timer(ev_tstamp t) {
   connchk_timer_.repeat = t;
   ev_timer_again(conn_.loop, &connchk_timer_);
@@ -2414,6 +2459,26 @@ void Http2Session::check_retire() {
 
 const Address *Http2Session::get_raddr() const { return raddr_; }
 
+void Http2Session::set_downstream_addr(
+  const std::shared_ptr<DownstreamAddrGroup> &group, DownstreamAddr *addr) {
+  assert(dconns_.empty());
+
+  remove_from_freelist();
+
+  if (raddr_ == &addr_->addr) {
+    raddr_ = &addr->addr;
+  }
+
+  if (conn_.tls.client_session_cache == &addr_->tls_session_cache) {
+    conn_.tls.client_session_cache = &addr->tls_session_cache;
+  }
+
+  group_ = group;
+  addr_ = addr;
+
+  add_to_extra_freelist();
+}
+
 std::expected<void, Error>
 Http2Session::on_settings_received(const nghttp2_frame *frame) {
   // TODO This effectively disallows nghttpx to change its behaviour
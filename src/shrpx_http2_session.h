@@ -188,6 +188,10 @@ public:
   // Initiates the connection checking if downstream connection has
   // been established and connection checking is required.
   void start_checking_connection();
+  // Starts connecting to the backend if it has not been done, or
+  // checks that the idle connection is still alive.  This is used to
+  // keep the connection ready before requests arrive.
+  void prewarm();
   // Resets connection check timer to timeout |t|.  After timeout, we
   // require connection checking.  If connection checking is already
   // enabled, this timeout is for PING ACK timeout.
@@ -252,6 +256,13 @@ public:
   // Returns address used to connect to backend.  Could be nullptr.
   const Address *get_raddr() const;
 
+  // Makes this idle session belong to |addr| in |group|, and moves it
+  // to http2_extra_freelist of |addr|.  |addr| must have the same
+  // backend address as the current one.  This is used to carry over
+  // the session to the new configuration.
+  void set_downstream_addr(const std::shared_ptr<DownstreamAddrGroup> &group,
+                           DownstreamAddr *addr);
+
   // This is called when SETTINGS frame without ACK flag set is
   // received.
   std::expected<void, Error> on_settings_received(const nghttp2_frame *frame);
@@ -36,6 +36,7 @@
 #include "shrpx_http.h"
 #include "shrpx_worker.h"
 #include "shrpx_http2_session.h"
+#include "shrpx_collapsed_downstream_connection.h"
 #include "shrpx_log.h"
 #ifdef HAVE_MRUBY
 #  include "shrpx_mruby.h"
@@ -438,7 +439,16 @@ Http2Upstream::start_downstream(Downstream *downstream) {
     return initiate_downstream(downstream);
   }
 
-  downstream_queue_.mark_blocked(downstream);
+  nghttp2_extpri extpri;
+  auto urgency = DEFAULT_URGENCY;
+
+  if (nghttp2_session_get_extpri_stream_priority(
+        session_, &extpri,
+        static_cast<int32_t>(downstream->get_stream_id())) == 0) {
+    urgency = extpri.urgency;
+  }
+
+  downstream_queue_.mark_blocked(downstream, urgency);
 
   return {};
 }
@@ -454,7 +464,9 @@ Http2Upstream::initiate_downstream(Downstream *downstream) {
     if (!maybe_dconn) {
       if (!(maybe_dconn.error() == Error::TLS_REQUIRED
               ? redirect_to_https(downstream)
-              : error_reply(downstream, 502))) {
+              : error_reply(downstream,
+                            maybe_dconn.error() == Error::OVERLOADED ? 503
+                                                                     : 502))) {
         if (auto rv = rst_stream(downstream, NGHTTP2_INTERNAL_ERROR); !rv) {
           return rv;
         }
@@ -1316,6 +1328,12 @@ std::expected<void, Error>
 Http2Upstream::downstream_eof(DownstreamConnection *dconn) {
   auto downstream = dconn->get_downstream();
 
+  // The backend may close the reused connection on its idle timeout
+  // before it sees the request.  It is not the failure of the backend.
+  if (!dconn->reused_and_idle()) {
+    downstream->on_backend_failure();
+  }
+
   if (log_enabled(INFO)) {
     Log{INFO, dconn} << "EOF. stream_id=" << downstream->get_stream_id();
   }
@@ -1357,6 +1375,8 @@ std::expected<void, Error>
 Http2Upstream::downstream_error(DownstreamConnection *dconn, int events) {
   auto downstream = dconn->get_downstream();
 
+  downstream->on_backend_failure();
+
   if (log_enabled(INFO)) {
     if (events & Downstream::EVENT_ERROR) {
       Log{INFO, dconn} << "Downstream network/general error";
@@ -1698,6 +1718,12 @@ Http2Upstream::on_downstream_header_complete(Downstream *downstream) {
     }
   }
 
+  if (!downstream->get_non_final_response()) {
+    if (auto centry = downstream->get_collapse_entry(); centry) {
+      centry->on_response_header();
+    }
+  }
+
   auto config = get_config();
   auto &httpconf = config->http;
 
@@ -1944,6 +1970,10 @@ Http2Upstream::on_downstream_header_complete(Downstream *downstream) {
 std::expected<void, Error>
 Http2Upstream::on_downstream_body(Downstream *downstream,
                                   std::span<const uint8_t> data, bool flush) {
+  if (auto centry = downstream->get_collapse_entry(); centry) {
+    centry->on_response_body(data, flush);
+  }
+
   auto body = downstream->get_response_buf();
   body->append(data);
 
@@ -1962,6 +1992,10 @@ Http2Upstream::on_downstream_body(Downstream *downstream,
 // nghttp2_session_recv. These calls may delete downstream.
 std::expected<void, Error>
 Http2Upstream::on_downstream_body_complete(Downstream *downstream) {
+  if (auto centry = downstream->get_collapse_entry(); centry) {
+    centry->on_response_complete();
+  }
+
   if (log_enabled(INFO)) {
     Log{INFO, downstream} << "HTTP response completed";
   }
@@ -2199,7 +2233,8 @@ Http2Upstream::on_downstream_reset(Downstream *downstream, bool no_retry) {
 fail:
   if (!(err == Error::TLS_REQUIRED
           ? on_downstream_abort_request_with_https_redirect(downstream)
-          : on_downstream_abort_request(downstream, 502))) {
+          : on_downstream_abort_request(
+              downstream, err == Error::OVERLOADED ? 503 : 502))) {
     // Ignore the error otherwise we might delete ClientHandler
     // twice.  See Http2Session.
     (void)rst_stream(downstream, NGHTTP2_INTERNAL_ERROR);
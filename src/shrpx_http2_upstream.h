@@ -141,7 +141,7 @@ public:
   std::expected<void, Error> on_request_headers(Downstream *downstream,
                                                 const nghttp2_frame *frame);
 
-  DefaultMemchunks *get_response_buf();
+  DefaultMemchunks *get_response_buf() override;
 
   size_t get_max_buffer_size() const;
 
@@ -0,0 +1,396 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2026 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_http3_downstream_connection.h"
+
+#include "shrpx_client_handler.h"
+#include "shrpx_upstream.h"
+#include "shrpx_downstream.h"
+#include "shrpx_config.h"
+#include "shrpx_http2_downstream_connection.h"
+#include "shrpx_http3_session.h"
+#include "shrpx_worker.h"
+#include "shrpx_log.h"
+#include "http2.h"
+#include "http3.h"
+#include "util.h"
+
+using namespace nghttp2;
+
+namespace shrpx {
+
+Http3DownstreamConnection::Http3DownstreamConnection(Http3Session *http3session)
+  : http3session_(http3session) {}
+
+Http3DownstreamConnection::~Http3DownstreamConnection() {
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "Deleting";
+  }
+  if (downstream_) {
+    downstream_->disable_downstream_rtimer();
+    downstream_->disable_downstream_wtimer();
+
+    uint64_t app_error_code;
+    if (downstream_->get_request_state() == DownstreamState::STREAM_CLOSED &&
+        downstream_->get_upgraded()) {
+      // For upgraded connection, send NO_ERROR.
+      app_error_code = NGHTTP3_H3_NO_ERROR;
+    } else {
+      app_error_code = NGHTTP3_H3_REQUEST_CANCELLED;
+    }
+
+    if (http3session_->get_state() != Http3SessionState::DISCONNECTED &&
+        downstream_->get_downstream_stream_id() != -1) {
+      (void)shutdown_stream(downstream_, app_error_code);
+
+      auto &resp = downstream_->response();
+
+      http3session_->consume(downstream_->get_downstream_stream_id(),
+                             resp.unconsumed_body_length);
+
+      resp.unconsumed_body_length = 0;
+
+      http3session_->signal_write();
+    }
+  }
+  http3session_->remove_downstream_connection(this);
+
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "Deleted";
+  }
+}
+
+std::expected<void, Error>
+Http3DownstreamConnection::attach_downstream(Downstream *downstream) {
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "Attaching to DOWNSTREAM:" << downstream;
+  }
+  http3session_->add_downstream_connection(this);
+  http3session_->signal_write();
+
+  downstream_ = downstream;
+  downstream_->reset_downstream_rtimer();
+
+  auto &req = downstream_->request();
+
+  // HTTP/3 disables HTTP Upgrade.
+  if (req.method != HTTP_CONNECT && req.connect_proto == ConnectProto::NONE) {
+    req.upgrade_request = false;
+  }
+
+  return {};
+}
+
+std::expected<void, Error>
+Http3DownstreamConnection::detach_downstream(Downstream *downstream) {
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "Detaching from DOWNSTREAM:" << downstream;
+  }
+
+  auto &resp = downstream_->response();
+
+  if (downstream_->get_downstream_stream_id() != -1) {
+    if (auto rv = shutdown_stream(downstream); !rv) {
+      return rv;
+    }
+
+    http3session_->consume(downstream_->get_downstream_stream_id(),
+                           resp.unconsumed_body_length);
+
+    resp.unconsumed_body_length = 0;
+
+    http3session_->signal_write();
+  }
+
+  downstream->disable_downstream_rtimer();
+  downstream->disable_downstream_wtimer();
+  downstream_ = nullptr;
+
+  return {};
+}
+
+std::expected<void, Error>
+Http3DownstreamConnection::shutdown_stream(Downstream *downstream,
+                                           uint64_t app_error_code) {
+  if (http3session_->get_state() == Http3SessionState::DISCONNECTED ||
+      downstream->get_downstream_stream_id() == -1) {
+    return std::unexpected{Error::INTERNAL};
+  }
+
+  switch (downstream->get_response_state()) {
+  case DownstreamState::MSG_RESET:
+  case DownstreamState::MSG_BAD_HEADER:
+    return std::unexpected{Error::INTERNAL};
+  default:
+    break;
+  }
+
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "Shutdown stream for DOWNSTREAM:" << downstream
+                    << ", stream_id=" << downstream->get_downstream_stream_id()
+                    << ", app_error_code=" << app_error_code;
+  }
+
+  return http3session_->shutdown_stream(downstream->get_downstream_stream_id(),
+                                        app_error_code);
+}
+
+namespace {
+nghttp3_ssize http3_data_read_callback(nghttp3_conn *conn, int64_t stream_id,
+                                       nghttp3_vec *vec, size_t veccnt,
+                                       uint32_t *pflags, void *conn_user_data,
+                                       void *stream_user_data) {
+  auto dconn = static_cast<Http3DownstreamConnection *>(stream_user_data);
+  if (!dconn) {
+    return NGHTTP3_ERR_WOULDBLOCK;
+  }
+  auto downstream = dconn->get_downstream();
+  if (!downstream) {
+    return NGHTTP3_ERR_WOULDBLOCK;
+  }
+  const auto &req = downstream->request();
+  auto input = downstream->get_request_buf();
+
+  auto eof =
+    downstream->get_request_state() == DownstreamState::MSG_COMPLETE &&
+    // If connection is upgraded, don't set EOF flag, since HTTP/1
+    // will set MSG_COMPLETE to request state after upgrade response
+    // header is seen.
+    (!req.upgrade_request ||
+     (downstream->get_response_state() == DownstreamState::HEADER_COMPLETE &&
+      !downstream->get_upgraded()));
+
+  if (!eof && input->rleft_mark() == 0) {
+    return NGHTTP3_ERR_WOULDBLOCK;
+  }
+
+  auto iov =
+    input->riovec_mark({reinterpret_cast<struct iovec *>(vec), veccnt});
+
+  if (eof && input->rleft_mark() == 0) {
+    *pflags |= NGHTTP3_DATA_FLAG_EOF;
+
+    const auto &trailers = req.fs.trailers();
+    if (!trailers.empty()) {
+      std::vector<nghttp3_nv> nva;
+      nva.reserve(trailers.size());
+      http3::copy_headers_to_nva_nocopy(nva, trailers, http2::HDOP_STRIP_ALL);
+      if (!nva.empty()) {
+        auto rv =
+          nghttp3_conn_submit_trailers(conn, stream_id, nva.data(), nva.size());
+        if (rv != 0) {
+          if (nghttp3_err_is_fatal(rv)) {
+            return NGHTTP3_ERR_CALLBACK_FAILURE;
+          }
+        } else {
+          *pflags |= NGHTTP3_DATA_FLAG_NO_END_STREAM;
+        }
+      }
+    }
+  }
+
+  assert((*pflags & NGHTTP3_DATA_FLAG_EOF) || !iov.empty());
+
+  return as_signed(iov.size());
+}
+} // namespace
+
+std::expected<void, Error> Http3DownstreamConnection::push_request_headers() {
+  if (!downstream_) {
+    return {};
+  }
+  if (!http3session_->can_push_request(downstream_)) {
+    // The HTTP/3 connection to the backend has not been established,
+    // or the request is not eligible for 0-RTT.  This function will
+    // be called again just after it is established.
+    downstream_->set_request_pending(true);
+    return {};
+  }
+
+  downstream_->set_request_pending(false);
+
+  const auto &req = downstream_->request();
+
+  // RFC 9220 extended CONNECT is not supported for HTTP/3 backend.
+  if (req.connect_proto != ConnectProto::NONE) {
+    return std::unexpected{Error::INTERNAL};
+  }
+
+  auto nva2 =
+    build_downstream_request_headers(downstream_, http3session_->get_addr());
+
+  auto nva = std::vector<nghttp3_nv>();
+  nva.reserve(nva2.size());
+
+  for (auto &nv : nva2) {
+    auto no_index = (nv.flags & NGHTTP2_NV_FLAG_NO_INDEX) != 0;
+    nva.push_back(http3::make_field(as_string_view(nv.name, nv.namelen),
+                                    as_string_view(nv.value, nv.valuelen),
+                                    http3::never_index(no_index)));
+  }
+
+  if (log_enabled(INFO)) {
+    std::string ss;
+    for (auto &nv : nva) {
+      auto name = as_string_view(nv.name, nv.namelen);
+
+      if ("authorization"sv == name) {
+        ss += tty_http_hd();
+        ss += name;
+        ss += tty_rst();
+        ss += ": <redacted>\n";
+        continue;
+      }
+      ss += tty_http_hd();
+      ss += name;
+      ss += tty_rst();
+      ss += ": ";
+      ss += as_string_view(nv.value, nv.valuelen);
+      ss += '\n';
+    }
+    Log{INFO, this} << "HTTP request headers\n" << ss;
+  }
+
+  auto transfer_encoding = req.fs.header(http2::HD_TRANSFER_ENCODING);
+
+  nghttp3_data_reader *drptr = nullptr;
+  nghttp3_data_reader dr;
+
+  // Add body as long as transfer-encoding is given even if
+  // req.fs.content_length == 0 to forward trailer fields.
+  if (req.method == HTTP_CONNECT || transfer_encoding ||
+      req.fs.content_length > 0 || req.http2_expect_body) {
+    // Request-body is expected.
+    dr.read_data = http3_data_read_callback;
+    drptr = &dr;
+  }
+
+  if (auto rv =
+        http3session_->submit_request(this, nva.data(), nva.size(), drptr);
+      !rv) {
+    Log{FATAL, this} << "nghttp3_conn_submit_request() failed";
+    return rv;
+  }
+
+  if (downstream_->get_buffered_request_body_length()) {
+    downstream_->reset_downstream_wtimer();
+  }
+
+  http3session_->signal_write();
+  return {};
+}
+
+std::expected<void, Error> Http3DownstreamConnection::push_upload_data_chunk(
+  std::span<const uint8_t> data) {
+  if (!downstream_->get_request_header_sent()) {
+    auto output = downstream_->get_blocked_request_buf();
+    auto &req = downstream_->request();
+    output->append(data);
+    req.unconsumed_body_length += data.size();
+    return {};
+  }
+
+  auto output = downstream_->get_request_buf();
+  output->append(data);
+  if (downstream_->get_downstream_stream_id() != -1) {
+    if (auto rv = http3session_->resume_stream(
+          downstream_->get_downstream_stream_id());
+        !rv) {
+      return rv;
+    }
+
+    downstream_->ensure_downstream_wtimer();
+
+    http3session_->signal_write();
+  }
+  return {};
+}
+
+std::expected<void, Error> Http3DownstreamConnection::end_upload_data() {
+  if (!downstream_->get_request_header_sent()) {
+    downstream_->set_blocked_request_data_eof(true);
+    return {};
+  }
+
+  if (downstream_->get_downstream_stream_id() != -1) {
+    if (auto rv = http3session_->resume_stream(
+          downstream_->get_downstream_stream_id());
+        !rv) {
+      return rv;
+    }
+
+    downstream_->ensure_downstream_wtimer();
+
+    http3session_->signal_write();
+  }
+  return {};
+}
+
+std::expected<void, Error>
+Http3DownstreamConnection::resume_read(IOCtrlReason reason, size_t consumed) {
+  if (http3session_->get_state() == Http3SessionState::DISCONNECTED) {
+    return {};
+  }
+
+  if (!downstream_ || downstream_->get_downstream_stream_id() == -1) {
+    return {};
+  }
+
+  if (consumed > 0) {
+    http3session_->consume(downstream_->get_downstream_stream_id(), consumed);
+
+    auto &resp = downstream_->response();
+
+    resp.unconsumed_body_length -= consumed;
+
+    http3session_->signal_write();
+  }
+
+  return {};
+}
+
+std::expected<void, Error> Http3DownstreamConnection::on_timeout() {
+  if (!downstream_) {
+    return {};
+  }
+
+  if (auto rv = shutdown_stream(downstream_, NGHTTP3_H3_NO_ERROR); !rv) {
+    return rv;
+  }
+
+  http3session_->signal_write();
+
+  return {};
+}
+
+const std::shared_ptr<DownstreamAddrGroup> &
+Http3DownstreamConnection::get_downstream_addr_group() const {
+  return http3session_->get_downstream_addr_group();
+}
+
+DownstreamAddr *Http3DownstreamConnection::get_addr() const {
+  return http3session_->get_addr();
+}
+
+} // namespace shrpx
@@ -0,0 +1,2145 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2026 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_http3_session.h"
+
+#include <sys/socket.h>
+#ifdef HAVE_UNISTD_H
+#  include <unistd.h>
+#endif // defined(HAVE_UNISTD_H)
+
+#include <ngtcp2/ngtcp2_crypto.h>
+
+#ifdef NGHTTP2_OPENSSL_IS_WOLFSSL
+#  include <wolfssl/options.h>
+#  include <wolfssl/openssl/rand.h>
+#else // !defined(NGHTTP2_OPENSSL_IS_WOLFSSL)
+#  include <openssl/rand.h>
+#endif // !defined(NGHTTP2_OPENSSL_IS_WOLFSSL)
+
+#include "shrpx_upstream.h"
+#include "shrpx_downstream.h"
+#include "shrpx_config.h"
+#include "shrpx_http3_downstream_connection.h"
+#include "shrpx_client_handler.h"
+#include "shrpx_tls.h"
+#include "shrpx_worker.h"
+#include "shrpx_connect_blocker.h"
+#include "shrpx_quic.h"
+#include "shrpx_log.h"
+#include "http2.h"
+#include "util.h"
+#include "tls.h"
+
+using namespace nghttp2;
+
+namespace shrpx {
+
+// The length of Connection ID which nghttpx uses as a QUIC client.
+constexpr size_t QUIC_CLIENT_CIDLEN = 18;
+
+namespace {
+void timeoutcb(struct ev_loop *loop, ev_timer *w, int revents) {
+  auto conn = static_cast<Connection *>(w->data);
+  auto http3session = static_cast<Http3Session *>(conn->data);
+
+  if (log_enabled(INFO)) {
+    Log{INFO, http3session} << "Timeout";
+  }
+
+  http3session->on_timeout();
+
+  delete http3session;
+}
+} // namespace
+
+namespace {
+void readcb(struct ev_loop *loop, ev_io *w, int revents) {
+  auto conn = static_cast<Connection *>(w->data);
+  auto http3session = static_cast<Http3Session *>(conn->data);
+  if (!http3session->do_read() || !http3session->do_write()) {
+    delete http3session;
+
+    return;
+  }
+}
+} // namespace
+
+namespace {
+void writecb(struct ev_loop *loop, ev_io *w, int revents) {
+  auto conn = static_cast<Connection *>(w->data);
+  auto http3session = static_cast<Http3Session *>(conn->data);
+  if (!http3session->do_write()) {
+    delete http3session;
+
+    return;
+  }
+}
+} // namespace
+
+namespace {
+void expirycb(struct ev_loop *loop, ev_timer *w, int revents) {
+  auto http3session = static_cast<Http3Session *>(w->data);
+  if (!http3session->handle_expiry() || !http3session->do_write()) {
+    delete http3session;
+
+    return;
+  }
+}
+} // namespace
+
+namespace {
+void initiate_connection_cb(struct ev_loop *loop, ev_timer *w, int revents) {
+  auto http3session = static_cast<Http3Session *>(w->data);
+  ev_timer_stop(loop, w);
+  if (!http3session->initiate_connection()) {
+    if (log_enabled(INFO)) {
+      Log{INFO, http3session} << "Could not initiate backend connection";
+    }
+
+    delete http3session;
+
+    return;
+  }
+}
+} // namespace
+
+namespace {
+void prepare_cb(struct ev_loop *loop, ev_prepare *w, int revents) {
+  auto http3session = static_cast<Http3Session *>(w->data);
+  if (!http3session->check_retire()) {
+    delete http3session;
+  }
+}
+} // namespace
+
+namespace {
+ngtcp2_conn *get_conn(ngtcp2_crypto_conn_ref *conn_ref) {
+  auto conn = static_cast<Connection *>(conn_ref->user_data);
+  auto http3session = static_cast<Http3Session *>(conn->data);
+  return http3session->get_conn();
+}
+} // namespace
+
+Http3Session::Http3Session(struct ev_loop *loop, SSL_CTX *ssl_ctx,
+                           Worker *worker,
+                           const std::shared_ptr<DownstreamAddrGroup> &group,
+                           DownstreamAddr *addr)
+  : conn_(loop, -1, nullptr, worker->get_mcpool(),
+          group->shared_addr->timeout.write, group->shared_addr->timeout.read,
+          {}, {}, writecb, readcb, timeoutcb, this,
+          get_config()->tls.dyn_rec.warmup_threshold,
+          get_config()->tls.dyn_rec.idle_timeout, Proto::HTTP3),
+    worker_(worker),
+    ssl_ctx_(ssl_ctx),
+    group_(group),
+    addr_(addr) {
+  conn_.conn_ref.get_conn = shrpx::get_conn;
+
+  ngtcp2_ccerr_default(&last_error_);
+
+  ev_timer_init(&timer_, expirycb, 0., 0.);
+  timer_.data = this;
+
+  ev_timer_init(&initiate_connection_timer_, initiate_connection_cb, 0., 0.);
+  initiate_connection_timer_.data = this;
+
+  ev_prepare_init(&prep_, prepare_cb);
+  prep_.data = this;
+  ev_prepare_start(loop, &prep_);
+}
+
+Http3Session::~Http3Session() {
+  exclude_from_scheduling();
+  disconnect();
+}
+
+void Http3Session::disconnect() {
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "Disconnecting";
+  }
+
+  if (qconn_ && !ngtcp2_conn_in_closing_period2(qconn_) &&
+      !ngtcp2_conn_in_draining_period2(qconn_)) {
+    send_connection_close();
+  }
+
+  nghttp3_conn_del(httpconn_);
+  httpconn_ = nullptr;
+
+#if OPENSSL_3_5_0_API
+  ngtcp2_crypto_ossl_ctx_del(ossl_ctx_);
+  ossl_ctx_ = nullptr;
+#endif // OPENSSL_3_5_0_API
+
+  ngtcp2_conn_del(qconn_);
+  qconn_ = nullptr;
+
+  if (dns_query_) {
+    auto dns_tracker = worker_->get_dns_tracker();
+    dns_tracker->cancel(dns_query_.get());
+  }
+
+  conn_.rlimit.stopw();
+  conn_.wlimit.stopw();
+
+  ev_prepare_stop(conn_.loop, &prep_);
+
+  ev_timer_stop(conn_.loop, &initiate_connection_timer_);
+  ev_timer_stop(conn_.loop, &timer_);
+
+  conn_.disconnect();
+
+  // Connection does not close the socket for QUIC.
+  if (conn_.fd != -1) {
+    close(conn_.fd);
+    conn_.fd = -1;
+  }
+
+  tx_ = {};
+
+  state_ = Http3SessionState::DISCONNECTED;
+
+  // Upstream::on_downstream_reset() deletes
+  // Http3DownstreamConnection which calls
+  // remove_downstream_connection() of this object.  It may create
+  // new Http3DownstreamConnection attached to another Http3Session.
+  for (auto dc = dconns_.head; dc;) {
+    auto next = dc->dlnext;
+    auto downstream = dc->get_downstream();
+    auto upstream = downstream->get_upstream();
+
+    // Failure is allowed only for HTTP/1 upstream where upstream is
+    // not shared by multiple Downstreams.
+    if (!upstream->on_downstream_reset(downstream, false)) {
+      delete upstream->get_client_handler();
+    }
+
+    // dc was deleted
+    dc = next;
+  }
+}
+
+std::expected<void, Error> Http3Session::resolve_name() {
+  auto dns_query = std::make_unique<DNSQuery>(
+    addr_->host, [this](DNSResolverStatus status, const Address *result) {
+      if (status == DNSResolverStatus::OK) {
+        *resolved_addr_ = *result;
+        resolved_addr_->port(addr_->port);
+      }
+
+      auto wait_time =
+        std::chrono::steady_clock::now() - dns_query_->wait_start;
+
+      for (auto dc = dconns_.head; dc; dc = dc->dlnext) {
+        auto downstream = dc->get_downstream();
+        if (downstream) {
+          downstream->add_dns_wait_time(wait_time);
+        }
+      }
+
+      if (!this->initiate_connection()) {
+        delete this;
+      }
+    });
+  resolved_addr_ = std::make_unique<Address>();
+  auto dns_tracker = worker_->get_dns_tracker();
+  switch (dns_tracker->resolve(resolved_addr_.get(), dns_query.get())) {
+  case DNSResolverStatus::ERROR:
+    return std::unexpected{Error::DNS};
+  case DNSResolverStatus::RUNNING:
+    dns_query_ = std::move(dns_query);
+    state_ = Http3SessionState::RESOLVING_NAME;
+    return {};
+  case DNSResolverStatus::OK:
+    resolved_addr_->port(addr_->port);
+    return {};
+  default:
+    assert(0);
+    abort();
+  }
+}
+
+std::expected<void, Error> Http3Session::initiate_connection() {
+  auto worker_blocker = worker_->get_connect_blocker();
+
+  if (state_ == Http3SessionState::DISCONNECTED) {
+    if (worker_blocker->blocked()) {
+      if (log_enabled(INFO)) {
+        Log{INFO, this}
+          << "Worker wide backend connection was blocked temporarily";
+      }
+      return std::unexpected{Error::INTERNAL};
+    }
+
+    if (log_enabled(INFO)) {
+      Log{INFO, this} << "Connecting to downstream server";
+    }
+
+    if (addr_->dns) {
+      if (auto rv = resolve_name(); !rv) {
+        downstream_failure(addr_, nullptr);
+        return rv;
+      }
+      if (state_ == Http3SessionState::RESOLVING_NAME) {
+        return {};
+      }
+      raddr_ = resolved_addr_.get();
+    } else {
+      raddr_ = &addr_->addr;
+    }
+  }
+
+  if (state_ == Http3SessionState::RESOLVING_NAME) {
+    if (dns_query_->status == DNSResolverStatus::ERROR) {
+      downstream_failure(addr_, nullptr);
+      return std::unexpected{Error::DNS};
+    }
+    assert(dns_query_->status == DNSResolverStatus::OK);
+    state_ = Http3SessionState::DISCONNECTED;
+    dns_query_.reset();
+    raddr_ = resolved_addr_.get();
+  }
+
+  assert(state_ == Http3SessionState::DISCONNECTED);
+  assert(conn_.fd == -1);
+
+  auto maybe_fd = util::create_nonblock_udp_socket(raddr_->family());
+  if (!maybe_fd) {
+    auto error = errno;
+    Log{WARN, this} << "socket() failed; addr=" << util::to_numeric_addr(raddr_)
+                    << ", errno=" << error;
+
+    worker_blocker->on_failure();
+    return std::unexpected{maybe_fd.error()};
+  }
+
+  conn_.fd = *maybe_fd;
+
+  worker_blocker->on_success();
+
+  // Connected UDP socket lets kernel filter out the datagrams from
+  // the other endpoints, and report ICMP errors to us.
+  if (connect(conn_.fd, raddr_->as_sockaddr(), raddr_->size()) != 0) {
+    auto error = errno;
+    Log{WARN, this} << "connect() failed; addr="
+                    << util::to_numeric_addr(raddr_) << ", errno=" << error;
+
+    downstream_failure(addr_, raddr_);
+    return std::unexpected{Error::SYSCALL};
+  }
+
+  sockaddr_storage ss;
+  socklen_t sslen = sizeof(ss);
+
+  if (getsockname(conn_.fd, reinterpret_cast<sockaddr *>(&ss), &sslen) != 0) {
+    auto error = errno;
+    Log{WARN, this} << "getsockname() failed; errno=" << error;
+
+    return std::unexpected{Error::SYSCALL};
+  }
+
+  local_addr_.set(reinterpret_cast<sockaddr *>(&ss));
+
+  ev_io_set(&conn_.rev, conn_.fd, EV_READ);
+  ev_io_set(&conn_.wev, conn_.fd, EV_WRITE);
+
+  auto maybe_ssl = tls::create_ssl(ssl_ctx_);
+  if (!maybe_ssl) {
+    return std::unexpected{maybe_ssl.error()};
+  }
+
+  auto ssl = *maybe_ssl;
+
+  tls::setup_downstream_http3_alpn(ssl);
+
+  conn_.set_ssl(ssl);
+  conn_.tls.client_session_cache = &addr_->tls_session_cache;
+  conn_.prepare_client_handshake();
+
+  auto sni_name = addr_->sni.empty() ? addr_->host : addr_->sni;
+
+  if (!util::numeric_host(sni_name.data())) {
+    SSL_set_tlsext_host_name(ssl, sni_name.data());
+  }
+
+#if OPENSSL_3_5_0_API
+  if (ngtcp2_crypto_ossl_configure_client_session(ssl) != 0) {
+    Log{ERROR, this} << "ngtcp2_crypto_ossl_configure_client_session failed";
+    return std::unexpected{Error::QUIC};
+  }
+
+  if (auto rv = ngtcp2_crypto_ossl_ctx_new(&ossl_ctx_, ssl); rv != 0) {
+    Log{ERROR, this} << "ngtcp2_crypto_ossl_ctx_new failed with error code "
+                     << rv;
+    return std::unexpected{Error::QUIC};
+  }
+#else  // !OPENSSL_3_5_0_API
+  SSL_set_quic_use_legacy_codepoint(ssl, 0);
+#endif // !OPENSSL_3_5_0_API
+
+  // 0-RTT requires both TLS session and the transport parameters
+  // which the server sent in the previous connection.
+  auto early_data = false;
+
+  auto maybe_tls_session = tls::reuse_tls_session(addr_->tls_session_cache);
+  if (maybe_tls_session) {
+    auto tls_session = *maybe_tls_session;
+    SSL_set_session(ssl, tls_session);
+    SSL_SESSION_free(tls_session);
+
+    if (!addr_->quic_transport_params.empty()) {
+#if OPENSSL_3_5_0_API
+      SSL_set_quic_tls_early_data_enabled(ssl, 1);
+#elif defined(NGHTTP2_GENUINE_OPENSSL) ||                                      \
+  (defined(NGHTTP2_OPENSSL_IS_WOLFSSL) && defined(WOLFSSL_EARLY_DATA))
+      SSL_set_quic_early_data_enabled(ssl, 1);
+#elif defined(NGHTTP2_OPENSSL_IS_BORINGSSL)
+      SSL_set_early_data_enabled(ssl, 1);
+#endif // defined(NGHTTP2_OPENSSL_IS_BORINGSSL)
+
+      early_data = true;
+    }
+  }
+
+  if (auto rv = init_quic(); !rv) {
+    return rv;
+  }
+
+  state_ = Http3SessionState::CONNECTING;
+
+  if (early_data) {
+    auto &params = addr_->quic_transport_params;
+
+    if (ngtcp2_conn_decode_and_set_0rtt_transport_params(
+          qconn_, params.data(), params.size()) != 0) {
+      if (log_enabled(INFO)) {
+        Log{INFO, this} << "Could not apply remembered transport parameters";
+      }
+
+      params.clear();
+    } else {
+      if (log_enabled(INFO)) {
+        Log{INFO, this} << "Attempt 0-RTT";
+      }
+
+      if (auto rv = setup_httpconn(); !rv) {
+        return rv;
+      }
+
+      if (auto rv = submit_pending_requests(); !rv) {
+        return rv;
+      }
+    }
+  }
+
+  conn_.rlimit.startw();
+
+  signal_write();
+
+  return {};
+}
+
+namespace {
+void rand_bytes(uint8_t *dest, size_t destlen) {
+  auto rv =
+    RAND_bytes(dest, static_cast<nghttp2_ssl_rand_length_type>(destlen));
+  if (rv != 1) {
+    assert(0);
+    abort();
+  }
+}
+} // namespace
+
+namespace {
+void rand(uint8_t *dest, size_t destlen, const ngtcp2_rand_ctx *rand_ctx) {
+  rand_bytes(dest, destlen);
+}
+} // namespace
+
+namespace {
+int get_new_connection_id(ngtcp2_conn *conn, ngtcp2_cid *cid,
+                          ngtcp2_stateless_reset_token *token, size_t cidlen,
+                          void *user_data) {
+  rand_bytes(cid->data, cidlen);
+  cid->datalen = cidlen;
+
+  rand_bytes(token->data, sizeof(token->data));
+
+  return 0;
+}
+} // namespace
+
+namespace {
+int recv_stream_data(ngtcp2_conn *conn, uint32_t flags, int64_t stream_id,
+                     uint64_t offset, const uint8_t *data, size_t datalen,
+                     void *user_data, void *stream_user_data) {
+  auto http3session = static_cast<Http3Session *>(user_data);
+
+  if (!http3session->recv_stream_data(flags, stream_id, {data, datalen})) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+std::expected<void, Error>
+Http3Session::recv_stream_data(uint32_t flags, int64_t stream_id,
+                               std::span<const uint8_t> data) {
+  if (!httpconn_) {
+    return {};
+  }
+
+  auto nconsumed = nghttp3_conn_read_stream2(
+    httpconn_, stream_id, data.data(), data.size(),
+    flags & NGTCP2_STREAM_DATA_FLAG_FIN, ngtcp2_conn_get_timestamp(qconn_));
+  if (nconsumed < 0) {
+    Log{ERROR, this} << "nghttp3_conn_read_stream2: "
+                     << nghttp3_strerror(static_cast<int>(nconsumed));
+    ngtcp2_ccerr_set_application_error(
+      &last_error_,
+      nghttp3_err_infer_quic_app_error_code(static_cast<int>(nconsumed)),
+      nullptr, 0);
+    return std::unexpected{Error::HTTP3};
+  }
+
+  consume(stream_id, as_unsigned(nconsumed));
+
+  return {};
+}
+
+namespace {
+int stream_close(ngtcp2_conn *conn, uint32_t flags, int64_t stream_id,
+                 uint64_t app_error_code, void *user_data,
+                 void *stream_user_data) {
+  auto http3session = static_cast<Http3Session *>(user_data);
+
+  if (!(flags & NGTCP2_STREAM_CLOSE_FLAG_APP_ERROR_CODE_SET)) {
+    app_error_code = NGHTTP3_H3_NO_ERROR;
+  }
+
+  if (!http3session->stream_close(stream_id, app_error_code)) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+std::expected<void, Error> Http3Session::stream_close(int64_t stream_id,
+                                                      uint64_t app_error_code) {
+  if (!httpconn_) {
+    return {};
+  }
+
+  auto rv = nghttp3_conn_close_stream(httpconn_, stream_id, app_error_code);
+  switch (rv) {
+  case 0:
+  case NGHTTP3_ERR_STREAM_NOT_FOUND:
+    break;
+  default:
+    Log{ERROR, this} << "nghttp3_conn_close_stream: " << nghttp3_strerror(rv);
+    ngtcp2_ccerr_set_application_error(
+      &last_error_, nghttp3_err_infer_quic_app_error_code(rv), nullptr, 0);
+    return std::unexpected{Error::HTTP3};
+  }
+
+  return {};
+}
+
+namespace {
+int acked_stream_data_offset(ngtcp2_conn *conn, int64_t stream_id,
+                             uint64_t offset, uint64_t datalen, void *user_data,
+                             void *stream_user_data) {
+  auto http3session = static_cast<Http3Session *>(user_data);
+
+  if (!http3session->acked_stream_data_offset(stream_id, datalen)) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+std::expected<void, Error>
+Http3Session::acked_stream_data_offset(int64_t stream_id, uint64_t datalen) {
+  if (!httpconn_) {
+    return {};
+  }
+
+  auto rv = nghttp3_conn_add_ack_offset(httpconn_, stream_id, datalen);
+  if (rv != 0) {
+    Log{ERROR, this} << "nghttp3_conn_add_ack_offset: " << nghttp3_strerror(rv);
+    return std::unexpected{Error::HTTP3};
+  }
+
+  return {};
+}
+
+namespace {
+int extend_max_stream_data(ngtcp2_conn *conn, int64_t stream_id,
+                           uint64_t max_data, void *user_data,
+                           void *stream_user_data) {
+  auto http3session = static_cast<Http3Session *>(user_data);
+
+  if (!http3session->extend_max_stream_data(stream_id)) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+std::expected<void, Error>
+Http3Session::extend_max_stream_data(int64_t stream_id) {
+  if (!httpconn_) {
+    return {};
+  }
+
+  auto rv = nghttp3_conn_unblock_stream(httpconn_, stream_id);
+  if (rv != 0) {
+    Log{ERROR, this} << "nghttp3_conn_unblock_stream: " << nghttp3_strerror(rv);
+    return std::unexpected{Error::HTTP3};
+  }
+
+  return {};
+}
+
+namespace {
+int extend_max_local_streams_bidi(ngtcp2_conn *conn, uint64_t max_streams,
+                                  void *user_data) {
+  auto http3session = static_cast<Http3Session *>(user_data);
+
+  http3session->extend_max_local_streams_bidi();
+
+  return 0;
+}
+} // namespace
+
+void Http3Session::extend_max_local_streams_bidi() {
+  if (freelist_zone_ == FreelistZone::NONE && !max_concurrency_reached()) {
+    add_to_extra_freelist();
+  }
+}
+
+namespace {
+int stream_reset(ngtcp2_conn *conn, int64_t stream_id, uint64_t final_size,
+                 uint64_t app_error_code, void *user_data,
+                 void *stream_user_data) {
+  auto http3session = static_cast<Http3Session *>(user_data);
+
+  if (!http3session->http_shutdown_stream_read(stream_id)) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+namespace {
+int stream_stop_sending(ngtcp2_conn *conn, int64_t stream_id,
+                        uint64_t app_error_code, void *user_data,
+                        void *stream_user_data) {
+  auto http3session = static_cast<Http3Session *>(user_data);
+
+  if (!http3session->http_shutdown_stream_read(stream_id)) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+std::expected<void, Error>
+Http3Session::http_shutdown_stream_read(int64_t stream_id) {
+  if (!httpconn_) {
+    return {};
+  }
+
+  auto rv = nghttp3_conn_shutdown_stream_read(httpconn_, stream_id);
+  if (rv != 0) {
+    Log{ERROR, this} << "nghttp3_conn_shutdown_stream_read: "
+                     << nghttp3_strerror(rv);
+    return std::unexpected{Error::HTTP3};
+  }
+
+  return {};
+}
+
+namespace {
+int handshake_completed(ngtcp2_conn *conn, void *user_data) {
+  auto http3session = static_cast<Http3Session *>(user_data);
+
+  if (!http3session->handshake_completed()) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+std::expected<void, Error> Http3Session::handshake_completed() {
+  const unsigned char *next_proto = nullptr;
+  unsigned int next_proto_len = 0;
+
+  SSL_get0_alpn_selected(conn_.tls.ssl, &next_proto, &next_proto_len);
+
+  if (!next_proto || as_string_view(next_proto, next_proto_len) != "h3"sv) {
+    downstream_failure(addr_, raddr_);
+    return std::unexpected{Error::ALPN};
+  }
+
+  if (!get_config()->tls.insecure) {
+    if (auto rv = tls::check_cert(conn_.tls.ssl, addr_, raddr_); !rv) {
+      downstream_failure(addr_, raddr_);
+      return rv;
+    }
+  }
+
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "QUIC handshake completed";
+  }
+
+  // Remember transport parameters for 0-RTT in the next connection.
+  std::array<uint8_t, 256> buf;
+
+  auto nwrite =
+    ngtcp2_conn_encode_0rtt_transport_params(qconn_, buf.data(), buf.size());
+  if (nwrite > 0) {
+    addr_->quic_transport_params.assign(
+      std::ranges::begin(buf), std::ranges::begin(buf) + nwrite);
+  }
+
+  state_ = Http3SessionState::CONNECTED;
+
+  addr_->connect_blocker->on_success();
+
+  if (auto rv = setup_httpconn(); !rv) {
+    return rv;
+  }
+
+  return submit_pending_requests();
+}
+
+namespace {
+int recv_rx_key(ngtcp2_conn *conn, ngtcp2_encryption_level level,
+                void *user_data) {
+  if (level != NGTCP2_ENCRYPTION_LEVEL_1RTT) {
+    return 0;
+  }
+
+  auto http3session = static_cast<Http3Session *>(user_data);
+
+  if (!http3session->setup_httpconn()) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+namespace {
+int tls_early_data_rejected(ngtcp2_conn *conn, void *user_data) {
+  auto http3session = static_cast<Http3Session *>(user_data);
+
+  if (!http3session->early_data_rejected()) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+std::expected<void, Error> Http3Session::early_data_rejected() {
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "0-RTT was rejected";
+  }
+
+  // ngtcp2 discards all streams opened in 0-RTT.  We have to submit
+  // the requests again after handshake completes.
+  nghttp3_conn_del(httpconn_);
+  httpconn_ = nullptr;
+
+  for (auto dconn = dconns_.head; dconn; dconn = dconn->dlnext) {
+    auto downstream = dconn->get_downstream();
+
+    if (downstream->get_downstream_stream_id() == -1) {
+      continue;
+    }
+
+    // Only the requests without request body are sent in 0-RTT.
+    downstream->set_downstream_stream_id(-1);
+    downstream->set_request_header_sent(false);
+    downstream->set_request_pending(true);
+  }
+
+  return {};
+}
+
+std::expected<void, Error> Http3Session::init_quic() {
+  static constexpr auto callbacks = ngtcp2_callbacks{
+    .client_initial = ngtcp2_crypto_client_initial_cb,
+    .recv_crypto_data = ngtcp2_crypto_recv_crypto_data_cb,
+    .handshake_completed = shrpx::handshake_completed,
+    .encrypt = ngtcp2_crypto_encrypt_cb,
+    .decrypt = ngtcp2_crypto_decrypt_cb,
+    .hp_mask = ngtcp2_crypto_hp_mask_cb,
+    .recv_stream_data = shrpx::recv_stream_data,
+    .acked_stream_data_offset = shrpx::acked_stream_data_offset,
+    .stream_close = shrpx::stream_close,
+    .recv_retry = ngtcp2_crypto_recv_retry_cb,
+    .extend_max_local_streams_bidi = shrpx::extend_max_local_streams_bidi,
+    .rand = rand,
+    .update_key = ngtcp2_crypto_update_key_cb,
+    .stream_reset = shrpx::stream_reset,
+    .extend_max_stream_data = shrpx::extend_max_stream_data,
+    .delete_crypto_aead_ctx = ngtcp2_crypto_delete_crypto_aead_ctx_cb,
+    .delete_crypto_cipher_ctx = ngtcp2_crypto_delete_crypto_cipher_ctx_cb,
+    .stream_stop_sending = shrpx::stream_stop_sending,
+    .recv_rx_key = shrpx::recv_rx_key,
+    .tls_early_data_rejected = shrpx::tls_early_data_rejected,
+    .get_new_connection_id2 = get_new_connection_id,
+    .get_path_challenge_data2 = ngtcp2_crypto_get_path_challenge_data2_cb,
+  };
+
+  auto config = get_config();
+  auto &downstreamconf = *config->conn.downstream;
+  auto &http2conf = config->http2;
+
+  ngtcp2_cid scid, dcid;
+
+  scid.datalen = QUIC_CLIENT_CIDLEN;
+  rand_bytes(scid.data, scid.datalen);
+  dcid.datalen = QUIC_CLIENT_CIDLEN;
+  rand_bytes(dcid.data, dcid.datalen);
+
+  ngtcp2_settings settings;
+  ngtcp2_settings_default(&settings);
+  settings.initial_ts = quic_timestamp();
+  settings.handshake_timeout = static_cast<ngtcp2_duration>(
+    downstreamconf.timeout.connect * NGTCP2_SECONDS);
+  settings.rand_ctx.native_handle = &worker_->get_randgen();
+
+  // HTTP/3 backend shares the flow control settings with HTTP/2
+  // backend.
+  ngtcp2_transport_params params;
+  ngtcp2_transport_params_default(&params);
+  params.initial_max_stream_data_bidi_local =
+    static_cast<uint64_t>(http2conf.downstream.window_size);
+  params.initial_max_stream_data_uni =
+    static_cast<uint64_t>(http2conf.downstream.window_size);
+  params.initial_max_data =
+    static_cast<uint64_t>(http2conf.downstream.connection_window_size);
+  params.initial_max_streams_bidi = 0;
+  // The minimum number of unidirectional streams required for HTTP/3.
+  params.initial_max_streams_uni = 3;
+  params.max_idle_timeout = static_cast<ngtcp2_duration>(
+    group_->shared_addr->timeout.read * NGTCP2_SECONDS);
+
+  auto path = ngtcp2_path{
+    .local{as_ngtcp2_addr(local_addr_)},
+    .remote{as_ngtcp2_addr(*raddr_)},
+  };
+
+  auto rv = ngtcp2_conn_client_new(&qconn_, &dcid, &scid, &path,
+                                   NGTCP2_PROTO_VER_V1, &callbacks, &settings,
+                                   &params, nullptr, this);
+  if (rv != 0) {
+    Log{ERROR, this} << "ngtcp2_conn_client_new: " << ngtcp2_strerror(rv);
+    return std::unexpected{Error::QUIC};
+  }
+
+#if OPENSSL_3_5_0_API
+  ngtcp2_conn_set_tls_native_handle(qconn_, ossl_ctx_);
+#else  // !OPENSSL_3_5_0_API
+  ngtcp2_conn_set_tls_native_handle(qconn_, conn_.tls.ssl);
+#endif // !OPENSSL_3_5_0_API
+
+  return {};
+}
+
+void Http3Session::add_downstream_connection(Http3DownstreamConnection *dconn) {
+  dconns_.append(dconn);
+  ++addr_->num_dconn;
+}
+
+void Http3Session::remove_downstream_connection(
+  Http3DownstreamConnection *dconn) {
+  --addr_->num_dconn;
+  dconns_.remove(dconn);
+
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "Remove downstream";
+  }
+
+  if (freelist_zone_ == FreelistZone::NONE && !max_concurrency_reached()) {
+    add_to_extra_freelist();
+  }
+}
+
+std::expected<void, Error>
+Http3Session::submit_request(Http3DownstreamConnection *dconn,
+                             const nghttp3_nv *nva, size_t nvlen,
+                             const nghttp3_data_reader *dr) {
+  assert(httpconn_);
+
+  int64_t stream_id;
+
+  auto rv = ngtcp2_conn_open_bidi_stream(qconn_, &stream_id, nullptr);
+  if (rv != 0) {
+    Log{ERROR, this} << "ngtcp2_conn_open_bidi_stream: "
+                     << ngtcp2_strerror(rv);
+    return std::unexpected{Error::QUIC};
+  }
+
+  rv = nghttp3_conn_submit_request(httpconn_, stream_id, nva, nvlen, dr, dconn);
+  if (rv != 0) {
+    Log{ERROR, this} << "nghttp3_conn_submit_request: "
+                     << nghttp3_strerror(rv);
+    return std::unexpected{Error::HTTP3};
+  }
+
+  auto downstream = dconn->get_downstream();
+
+  downstream->set_downstream_stream_id(stream_id);
+
+  // Unlike HTTP/2, there is no callback which tells us that HEADERS
+  // has been sent.  nghttp3 buffers request body after HEADERS, so it
+  // is safe to move the body which arrived before here.
+  downstream->set_request_header_sent(true);
+  auto src = downstream->get_blocked_request_buf();
+  if (src->rleft()) {
+    auto dest = downstream->get_request_buf();
+    src->remove(*dest);
+    downstream->ensure_downstream_wtimer();
+  }
+
+  return {};
+}
+
+std::expected<void, Error>
+Http3Session::shutdown_stream(int64_t stream_id, uint64_t app_error_code) {
+  if (!qconn_) {
+    return {};
+  }
+
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "Shutdown stream_id=" << stream_id
+                    << " with app_error_code=" << app_error_code;
+  }
+
+  if (httpconn_) {
+    // The stream might have already been closed.
+    nghttp3_conn_set_stream_user_data(httpconn_, stream_id, nullptr);
+  }
+
+  auto rv = ngtcp2_conn_shutdown_stream(qconn_, 0, stream_id, app_error_code);
+  if (ngtcp2_err_is_fatal(rv)) {
+    Log{FATAL, this} << "ngtcp2_conn_shutdown_stream() failed: "
+                     << ngtcp2_strerror(rv);
+    return std::unexpected{Error::QUIC};
+  }
+
+  return {};
+}
+
+std::expected<void, Error> Http3Session::resume_stream(int64_t stream_id) {
+  if (!httpconn_) {
+    return {};
+  }
+
+  auto rv = nghttp3_conn_resume_stream(httpconn_, stream_id);
+  if (rv != 0 && nghttp3_err_is_fatal(rv)) {
+    Log{FATAL, this} << "nghttp3_conn_resume_stream() failed: "
+                     << nghttp3_strerror(rv);
+    return std::unexpected{Error::HTTP3};
+  }
+
+  return {};
+}
+
+void Http3Session::consume(int64_t stream_id, size_t nconsumed) {
+  if (!qconn_) {
+    return;
+  }
+
+  ngtcp2_conn_extend_max_stream_offset(qconn_, stream_id, nconsumed);
+  ngtcp2_conn_extend_max_offset(qconn_, nconsumed);
+}
+
+namespace {
+void call_downstream_readcb(Downstream *downstream) {
+  auto upstream = downstream->get_upstream();
+  if (!upstream) {
+    return;
+  }
+  if (!upstream->downstream_read(downstream->get_downstream_connection())) {
+    delete upstream->get_client_handler();
+  }
+}
+} // namespace
+
+namespace {
+Downstream *get_downstream(void *stream_user_data) {
+  auto dconn = static_cast<Http3DownstreamConnection *>(stream_user_data);
+  if (!dconn) {
+    return nullptr;
+  }
+
+  return dconn->get_downstream();
+}
+} // namespace
+
+namespace {
+int http_recv_response_header(nghttp3_conn *conn, int64_t stream_id,
+                              int32_t token, nghttp3_rcbuf *name,
+                              nghttp3_rcbuf *value, uint8_t flags,
+                              void *user_data, void *stream_user_data) {
+  auto http3session = static_cast<Http3Session *>(user_data);
+  auto downstream = get_downstream(stream_user_data);
+  if (!downstream) {
+    return 0;
+  }
+
+  if (!http3session->http_recv_response_header(downstream, name, value, flags,
+                                               /* trailer = */ false)) {
+    return NGHTTP3_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+namespace {
+int http_recv_response_trailer(nghttp3_conn *conn, int64_t stream_id,
+                               int32_t token, nghttp3_rcbuf *name,
+                               nghttp3_rcbuf *value, uint8_t flags,
+                               void *user_data, void *stream_user_data) {
+  auto http3session = static_cast<Http3Session *>(user_data);
+  auto downstream = get_downstream(stream_user_data);
+  if (!downstream) {
+    return 0;
+  }
+
+  if (!http3session->http_recv_response_header(downstream, name, value, flags,
+                                               /* trailer = */ true)) {
+    return NGHTTP3_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+std::expected<void, Error> Http3Session::http_recv_response_header(
+  Downstream *downstream, nghttp3_rcbuf *name, nghttp3_rcbuf *value,
+  uint8_t flags, bool trailer) {
+  auto namebuf = nghttp3_rcbuf_get_buf(name);
+  auto valuebuf = nghttp3_rcbuf_get_buf(value);
+  auto &resp = downstream->response();
+  auto &httpconf = get_config()->http;
+
+  if (resp.fs.buffer_size() + namebuf.len + valuebuf.len >
+        httpconf.response_header_field_buffer ||
+      resp.fs.num_fields() >= httpconf.max_response_header_fields) {
+    if (log_enabled(INFO)) {
+      Log{INFO, downstream}
+        << "Too large or many header field size="
+        << resp.fs.buffer_size() + namebuf.len + valuebuf.len
+        << ", num=" << resp.fs.num_fields() + 1;
+    }
+
+    if (trailer) {
+      // We don't care trailer part exceeds header size limit; just
+      // discard it.
+      return {};
+    }
+
+    return shutdown_stream(downstream->get_downstream_stream_id(),
+                           NGHTTP3_H3_INTERNAL_ERROR);
+  }
+
+  auto nameref = as_string_view(namebuf.base, namebuf.len);
+  auto valueref = as_string_view(valuebuf.base, valuebuf.len);
+  auto token = http2::lookup_token(nameref);
+  auto no_index = flags & NGHTTP3_NV_FLAG_NEVER_INDEX;
+
+  downstream->add_rcbuf(name);
+  downstream->add_rcbuf(value);
+
+  if (trailer) {
+    resp.fs.add_trailer_token(nameref, valueref, no_index, token);
+    return {};
+  }
+
+  resp.fs.add_header_token(nameref, valueref, no_index, token);
+  return {};
+}
+
+namespace {
+int http_end_response_headers(nghttp3_conn *conn, int64_t stream_id, int fin,
+                              void *user_data, void *stream_user_data) {
+  auto http3session = static_cast<Http3Session *>(user_data);
+  auto downstream = get_downstream(stream_user_data);
+  if (!downstream) {
+    return 0;
+  }
+
+  if (!http3session->http_end_response_headers(downstream, stream_id, fin)) {
+    return NGHTTP3_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+std::expected<void, Error>
+Http3Session::http_end_response_headers(Downstream *downstream,
+                                        int64_t stream_id, int fin) {
+  auto upstream = downstream->get_upstream();
+  auto handler = upstream->get_client_handler();
+  const auto &req = downstream->request();
+  auto &resp = downstream->response();
+
+  auto config = get_config();
+  auto &loggingconf = config->logging;
+
+  downstream->set_expect_final_response(false);
+
+  auto status = resp.fs.header(http2::HD__STATUS);
+  // libnghttp3 guarantees this exists and can be parsed
+  assert(status);
+  auto status_code = *http2::parse_http_status_code(status->value);
+
+  resp.http_status = as_unsigned(status_code);
+  resp.http_major = 3;
+  resp.http_minor = 0;
+
+  downstream->set_downstream_addr_group(group_);
+  downstream->set_addr(addr_);
+  downstream->on_backend_response_header();
+
+  if (log_enabled(INFO)) {
+    std::string ss;
+    for (auto &nv : resp.fs.headers()) {
+      ss += tty_http_hd();
+      ss += nv.name;
+      ss += tty_rst();
+      ss += ": ";
+      ss += nv.value;
+      ss += '\n';
+    }
+    Log{INFO, this} << "HTTP response headers. stream_id=" << stream_id << "\n"
+                    << ss;
+  }
+
+  if (downstream->get_non_final_response()) {
+    if (log_enabled(INFO)) {
+      Log{INFO, this} << "This is non-final response.";
+    }
+
+    downstream->set_expect_final_response(true);
+    // After Upstream::on_downstream_header_complete, Dowstream's
+    // response headers are erased.
+    if (!upstream->on_downstream_header_complete(downstream)) {
+      if (auto rv =
+            shutdown_stream(stream_id, NGHTTP3_H3_GENERAL_PROTOCOL_ERROR);
+          !rv) {
+        return rv;
+      }
+
+      downstream->set_response_state(DownstreamState::MSG_RESET);
+    }
+
+    call_downstream_readcb(downstream);
+
+    return {};
+  }
+
+  downstream->set_response_state(DownstreamState::HEADER_COMPLETE);
+  downstream->check_upgrade_fulfilled_http2();
+
+  if (downstream->get_upgraded()) {
+    resp.connection_close = true;
+    // On upgrade success, both ends can send data
+    if (auto rv = upstream->resume_read(SHRPX_NO_BUFFER, downstream, 0); !rv) {
+      return rv;
+    }
+    downstream->set_request_state(DownstreamState::HEADER_COMPLETE);
+    if (log_enabled(INFO)) {
+      Log{INFO, this} << "HTTP upgrade success. stream_id=" << stream_id;
+    }
+  } else {
+    auto content_length = resp.fs.header(http2::HD_CONTENT_LENGTH);
+    if (content_length) {
+      // libnghttp3 guarantees this can be parsed
+      resp.fs.content_length =
+        static_cast<int64_t>(*util::parse_uint(content_length->value));
+    }
+
+    if (resp.fs.content_length == -1 && downstream->expect_response_body()) {
+      // Here we have response body but Content-Length is not known in
+      // advance.
+      if (req.http_major <= 0 || (req.http_major == 1 && req.http_minor == 0)) {
+        // We simply close connection for pre-HTTP/1.1 in this case.
+        resp.connection_close = true;
+      } else {
+        // Otherwise, use chunked encoding to keep upstream connection
+        // open.  In HTTP/3, we are supposed not to receive
+        // transfer-encoding.
+        resp.fs.add_header_token("transfer-encoding"sv, "chunked"sv, false,
+                                 http2::HD_TRANSFER_ENCODING);
+        downstream->set_chunked_response(true);
+      }
+    }
+  }
+
+  if (fin) {
+    resp.headers_only = true;
+  } else {
+    downstream->reset_downstream_rtimer();
+  }
+
+  if (loggingconf.access.write_early && downstream->accesslog_ready()) {
+    handler->write_accesslog(downstream);
+    downstream->set_accesslog_written(true);
+  }
+
+  if (!upstream->on_downstream_header_complete(downstream)) {
+    // Handling early return (in other words, response was hijacked by
+    // mruby scripting).
+    if (downstream->get_response_state() == DownstreamState::MSG_COMPLETE) {
+      if (auto rv = shutdown_stream(stream_id, NGHTTP3_H3_REQUEST_CANCELLED);
+          !rv) {
+        return rv;
+      }
+    } else {
+      if (auto rv = shutdown_stream(stream_id, NGHTTP3_H3_INTERNAL_ERROR);
+          !rv) {
+        return rv;
+      }
+
+      downstream->set_response_state(DownstreamState::MSG_RESET);
+    }
+  }
+
+  // This may delete downstream
+  call_downstream_readcb(downstream);
+
+  return {};
+}
+
+namespace {
+int http_recv_data(nghttp3_conn *conn, int64_t stream_id, const uint8_t *data,
+                   size_t datalen, void *user_data, void *stream_user_data) {
+  auto http3session = static_cast<Http3Session *>(user_data);
+  auto downstream = get_downstream(stream_user_data);
+  if (!downstream) {
+    http3session->consume(stream_id, datalen);
+
+    return 0;
+  }
+
+  if (!http3session->http_recv_data(downstream, stream_id, {data, datalen})) {
+    return NGHTTP3_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+std::expected<void, Error>
+Http3Session::http_recv_data(Downstream *downstream, int64_t stream_id,
+                             std::span<const uint8_t> data) {
+  // We don't want DATA after non-final response, which is illegal in
+  // HTTP.
+  if (!downstream->expect_response_body() ||
+      downstream->get_non_final_response()) {
+    consume(stream_id, data.size());
+
+    return shutdown_stream(stream_id, NGHTTP3_H3_GENERAL_PROTOCOL_ERROR);
+  }
+
+  downstream->reset_downstream_rtimer();
+
+  auto &resp = downstream->response();
+
+  resp.recv_body_length += data.size();
+  resp.unconsumed_body_length += data.size();
+
+  auto upstream = downstream->get_upstream();
+  if (auto rv = upstream->on_downstream_body(downstream, data, true); !rv) {
+    consume(stream_id, data.size());
+    resp.unconsumed_body_length -= data.size();
+
+    if (auto rv = shutdown_stream(stream_id, NGHTTP3_H3_INTERNAL_ERROR); !rv) {
+      return rv;
+    }
+
+    downstream->set_response_state(DownstreamState::MSG_RESET);
+  }
+
+  call_downstream_readcb(downstream);
+
+  return {};
+}
+
+namespace {
+int http_deferred_consume(nghttp3_conn *conn, int64_t stream_id,
+                          size_t nconsumed, void *user_data,
+                          void *stream_user_data) {
+  auto http3session = static_cast<Http3Session *>(user_data);
+
+  http3session->consume(stream_id, nconsumed);
+
+  return 0;
+}
+} // namespace
+
+namespace {
+int http_end_stream(nghttp3_conn *conn, int64_t stream_id, void *user_data,
+                    void *stream_user_data) {
+  auto http3session = static_cast<Http3Session *>(user_data);
+  auto downstream = get_downstream(stream_user_data);
+  if (!downstream) {
+    return 0;
+  }
+
+  if (!http3session->http_end_stream(downstream)) {
+    return NGHTTP3_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+std::expected<void, Error>
+Http3Session::http_end_stream(Downstream *downstream) {
+  downstream->disable_downstream_rtimer();
+
+  if (downstream->get_response_state() == DownstreamState::HEADER_COMPLETE) {
+    downstream->set_response_state(DownstreamState::MSG_COMPLETE);
+
+    auto upstream = downstream->get_upstream();
+
+    if (!upstream->on_downstream_body_complete(downstream)) {
+      downstream->set_response_state(DownstreamState::MSG_RESET);
+    }
+  }
+
+  // This may delete downstream
+  call_downstream_readcb(downstream);
+
+  return {};
+}
+
+namespace {
+int http_stream_close(nghttp3_conn *conn, int64_t stream_id,
+                      uint64_t app_error_code, void *user_data,
+                      void *stream_user_data) {
+  auto http3session = static_cast<Http3Session *>(user_data);
+  auto downstream = get_downstream(stream_user_data);
+  if (!downstream) {
+    return 0;
+  }
+
+  if (!http3session->http_stream_close(downstream, app_error_code)) {
+    return NGHTTP3_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+namespace {
+// Returns HTTP/2 error code which corresponds to HTTP/3 error code
+// |app_error_code|.  Upstream understands only HTTP/2 error code.
+uint32_t infer_downstream_rst_stream_error_code(uint64_t app_error_code) {
+  switch (app_error_code) {
+  case NGHTTP3_H3_NO_ERROR:
+    return NGHTTP2_NO_ERROR;
+  case NGHTTP3_H3_REQUEST_REJECTED:
+    return NGHTTP2_REFUSED_STREAM;
+  case NGHTTP3_H3_REQUEST_CANCELLED:
+    return NGHTTP2_CANCEL;
+  default:
+    return NGHTTP2_INTERNAL_ERROR;
+  }
+}
+} // namespace
+
+std::expected<void, Error>
+Http3Session::http_stream_close(Downstream *downstream,
+                                uint64_t app_error_code) {
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "Stream stream_id="
+                    << downstream->get_downstream_stream_id()
+                    << " is being closed with app_error_code="
+                    << app_error_code;
+  }
+
+  auto upstream = downstream->get_upstream();
+
+  if (downstream->get_upgraded() &&
+      downstream->get_response_state() == DownstreamState::HEADER_COMPLETE) {
+    // For tunneled connection, we have to shutdown upstream stream
+    // *after* whole response body is sent.  We just set MSG_COMPLETE
+    // here.  Upstream will take care of that.
+    if (!upstream->on_downstream_body_complete(downstream)) {
+      return std::unexpected{Error::INTERNAL};
+    }
+    downstream->set_response_state(DownstreamState::MSG_COMPLETE);
+  } else {
+    switch (downstream->get_response_state()) {
+    case DownstreamState::MSG_COMPLETE:
+    case DownstreamState::MSG_BAD_HEADER:
+      break;
+    default:
+      downstream->set_response_state(DownstreamState::MSG_RESET);
+    }
+  }
+
+  if (downstream->get_response_state() == DownstreamState::MSG_RESET &&
+      downstream->get_response_rst_stream_error_code() == NGHTTP2_NO_ERROR) {
+    downstream->set_response_rst_stream_error_code(
+      infer_downstream_rst_stream_error_code(app_error_code));
+  }
+
+  call_downstream_readcb(downstream);
+
+  return {};
+}
+
+namespace {
+int http_acked_stream_data(nghttp3_conn *conn, int64_t stream_id,
+                           uint64_t datalen, void *user_data,
+                           void *stream_user_data) {
+  auto http3session = static_cast<Http3Session *>(user_data);
+  auto downstream = get_downstream(stream_user_data);
+  if (!downstream) {
+    return 0;
+  }
+
+  if (!http3session->http_acked_stream_data(downstream, datalen)) {
+    return NGHTTP3_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+std::expected<void, Error>
+Http3Session::http_acked_stream_data(Downstream *downstream,
+                                     uint64_t datalen) {
+  auto input = downstream->get_request_buf();
+  auto drained = input->drain_mark(datalen);
+  (void)drained;
+
+  assert(datalen == drained);
+
+  // This is important because it will handle flow control stuff.
+  if (!downstream->get_upstream()->resume_read(SHRPX_NO_BUFFER, downstream,
+                                               datalen)) {
+    // In this case, downstream may be deleted.
+    return std::unexpected{Error::INTERNAL};
+  }
+
+  return {};
+}
+
+namespace {
+int http_stop_sending(nghttp3_conn *conn, int64_t stream_id,
+                      uint64_t app_error_code, void *user_data,
+                      void *stream_user_data) {
+  auto http3session = static_cast<Http3Session *>(user_data);
+
+  if (!http3session->http_stop_sending(stream_id, app_error_code)) {
+    return NGHTTP3_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+std::expected<void, Error>
+Http3Session::http_stop_sending(int64_t stream_id, uint64_t app_error_code) {
+  auto rv =
+    ngtcp2_conn_shutdown_stream_read(qconn_, 0, stream_id, app_error_code);
+  if (ngtcp2_err_is_fatal(rv)) {
+    Log{ERROR, this} << "ngtcp2_conn_shutdown_stream_read: "
+                     << ngtcp2_strerror(rv);
+    return std::unexpected{Error::QUIC};
+  }
+
+  return {};
+}
+
+namespace {
+int http_reset_stream(nghttp3_conn *conn, int64_t stream_id,
+                      uint64_t app_error_code, void *user_data,
+                      void *stream_user_data) {
+  auto http3session = static_cast<Http3Session *>(user_data);
+
+  if (!http3session->http_reset_stream(stream_id, app_error_code)) {
+    return NGHTTP3_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+std::expected<void, Error>
+Http3Session::http_reset_stream(int64_t stream_id, uint64_t app_error_code) {
+  auto rv =
+    ngtcp2_conn_shutdown_stream_write(qconn_, 0, stream_id, app_error_code);
+  if (ngtcp2_err_is_fatal(rv)) {
+    Log{ERROR, this} << "ngtcp2_conn_shutdown_stream_write: "
+                     << ngtcp2_strerror(rv);
+    return std::unexpected{Error::QUIC};
+  }
+
+  return {};
+}
+
+namespace {
+int http_shutdown(nghttp3_conn *conn, int64_t id, void *user_data) {
+  auto http3session = static_cast<Http3Session *>(user_data);
+
+  http3session->http_shutdown();
+
+  return 0;
+}
+} // namespace
+
+void Http3Session::http_shutdown() {
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "GOAWAY received";
+  }
+
+  // Server is going away.  Do not use this connection for new
+  // requests.
+  exclude_from_scheduling();
+}
+
+std::expected<void, Error> Http3Session::setup_httpconn() {
+  int rv;
+
+  if (httpconn_) {
+    return {};
+  }
+
+  if (ngtcp2_conn_get_streams_uni_left2(qconn_) < 3) {
+    return std::unexpected{Error::QUIC};
+  }
+
+  static constexpr auto callbacks = nghttp3_callbacks{
+    .acked_stream_data = shrpx::http_acked_stream_data,
+    .stream_close = shrpx::http_stream_close,
+    .recv_data = shrpx::http_recv_data,
+    .deferred_consume = http_deferred_consume,
+    .recv_header = shrpx::http_recv_response_header,
+    .end_headers = shrpx::http_end_response_headers,
+    .recv_trailer = shrpx::http_recv_response_trailer,
+    .stop_sending = shrpx::http_stop_sending,
+    .end_stream = shrpx::http_end_stream,
+    .reset_stream = shrpx::http_reset_stream,
+    .shutdown = shrpx::http_shutdown,
+    .rand = shrpx::rand_bytes,
+  };
+
+  nghttp3_settings settings;
+  nghttp3_settings_default(&settings);
+  settings.qpack_max_dtable_capacity = 4_k;
+
+  auto mem = nghttp3_mem_default();
+
+  rv = nghttp3_conn_client_new(&httpconn_, &callbacks, &settings, mem, this);
+  if (rv != 0) {
+    Log{ERROR, this} << "nghttp3_conn_client_new: " << nghttp3_strerror(rv);
+    return std::unexpected{Error::HTTP3};
+  }
+
+  int64_t ctrl_stream_id;
+
+  rv = ngtcp2_conn_open_uni_stream(qconn_, &ctrl_stream_id, nullptr);
+  if (rv != 0) {
+    Log{ERROR, this} << "ngtcp2_conn_open_uni_stream: " << ngtcp2_strerror(rv);
+    return std::unexpected{Error::QUIC};
+  }
+
+  rv = nghttp3_conn_bind_control_stream(httpconn_, ctrl_stream_id);
+  if (rv != 0) {
+    Log{ERROR, this} << "nghttp3_conn_bind_control_stream: "
+                     << nghttp3_strerror(rv);
+    return std::unexpected{Error::HTTP3};
+  }
+
+  int64_t qpack_enc_stream_id, qpack_dec_stream_id;
+
+  rv = ngtcp2_conn_open_uni_stream(qconn_, &qpack_enc_stream_id, nullptr);
+  if (rv != 0) {
+    Log{ERROR, this} << "ngtcp2_conn_open_uni_stream: " << ngtcp2_strerror(rv);
+    return std::unexpected{Error::QUIC};
+  }
+
+  rv = ngtcp2_conn_open_uni_stream(qconn_, &qpack_dec_stream_id, nullptr);
+  if (rv != 0) {
+    Log{ERROR, this} << "ngtcp2_conn_open_uni_stream: " << ngtcp2_strerror(rv);
+    return std::unexpected{Error::QUIC};
+  }
+
+  rv = nghttp3_conn_bind_qpack_streams(httpconn_, qpack_enc_stream_id,
+                                       qpack_dec_stream_id);
+  if (rv != 0) {
+    Log{ERROR, this} << "nghttp3_conn_bind_qpack_streams: "
+                     << nghttp3_strerror(rv);
+    return std::unexpected{Error::HTTP3};
+  }
+
+  return {};
+}
+
+std::expected<void, Error> Http3Session::do_read() {
+  if (!qconn_) {
+    return {};
+  }
+
+  std::array<uint8_t, 64_k> buf;
+
+  auto path = ngtcp2_path{
+    .local{as_ngtcp2_addr(local_addr_)},
+    .remote{as_ngtcp2_addr(*raddr_)},
+  };
+
+  ngtcp2_pkt_info pi{};
+
+  for (;;) {
+    ssize_t nread;
+
+    while ((nread = recv(conn_.fd, buf.data(), buf.size(), 0)) == -1 &&
+           errno == EINTR)
+      ;
+
+    if (nread == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return {};
+      }
+
+      auto error = errno;
+
+      // Connected UDP socket reports ICMP error, for example, if
+      // backend port is not open.
+      Log{WARN, this} << "recv() failed; addr=" << util::to_numeric_addr(raddr_)
+                      << ", errno=" << error;
+
+      if (state_ == Http3SessionState::CONNECTING) {
+        downstream_failure(addr_, raddr_);
+      }
+
+      return std::unexpected{Error::NETWORK};
+    }
+
+    auto rv = ngtcp2_conn_read_pkt(qconn_, &path, &pi, buf.data(),
+                                   as_unsigned(nread), quic_timestamp());
+    if (rv != 0) {
+      switch (rv) {
+      case NGTCP2_ERR_DRAINING:
+        return std::unexpected{Error::DONE};
+      case NGTCP2_ERR_CRYPTO:
+        if (!last_error_.error_code) {
+          ngtcp2_ccerr_set_tls_alert(
+            &last_error_, ngtcp2_conn_get_tls_alert(qconn_), nullptr, 0);
+        }
+        break;
+      default:
+        if (!last_error_.error_code) {
+          ngtcp2_ccerr_set_liberr(&last_error_, rv, nullptr, 0);
+        }
+      }
+
+      Log{ERROR, this} << "ngtcp2_conn_read_pkt: " << ngtcp2_strerror(rv);
+
+      return handle_error();
+    }
+  }
+}
+
+std::expected<void, Error> Http3Session::do_write() {
+  if (!qconn_) {
+    return {};
+  }
+
+  if (tx_.send_blocked) {
+    send_blocked_packet();
+
+    if (tx_.send_blocked) {
+      return {};
+    }
+  }
+
+  conn_.wlimit.stopw();
+
+  if (auto rv = write_streams(); !rv) {
+    return rv;
+  }
+
+  reset_timer();
+
+  return {};
+}
+
+namespace {
+ngtcp2_ssize write_pkt(ngtcp2_conn *conn, ngtcp2_path *path,
+                       ngtcp2_pkt_info *pi, uint8_t *dest, size_t destlen,
+                       ngtcp2_tstamp ts, void *user_data) {
+  auto http3session = static_cast<Http3Session *>(user_data);
+
+  return http3session->write_pkt(path, pi, dest, destlen, ts);
+}
+} // namespace
+
+ngtcp2_ssize Http3Session::write_pkt(ngtcp2_path *path, ngtcp2_pkt_info *pi,
+                                     uint8_t *dest, size_t destlen,
+                                     ngtcp2_tstamp ts) {
+  std::array<nghttp3_vec, 16> vec;
+
+  for (;;) {
+    int64_t stream_id = -1;
+    int fin = 0;
+    nghttp3_ssize sveccnt = 0;
+
+    if (httpconn_ && ngtcp2_conn_get_max_data_left2(qconn_)) {
+      sveccnt = nghttp3_conn_writev_stream(httpconn_, &stream_id, &fin,
+                                           vec.data(), vec.size());
+      if (sveccnt < 0) {
+        Log{ERROR, this} << "nghttp3_conn_writev_stream: "
+                         << nghttp3_strerror(static_cast<int>(sveccnt));
+        ngtcp2_ccerr_set_application_error(
+          &last_error_,
+          nghttp3_err_infer_quic_app_error_code(static_cast<int>(sveccnt)),
+          nullptr, 0);
+        return NGTCP2_ERR_CALLBACK_FAILURE;
+      }
+    }
+
+    ngtcp2_ssize ndatalen;
+    auto v = vec.data();
+    auto vcnt = static_cast<size_t>(sveccnt);
+
+    uint32_t flags =
+      NGTCP2_WRITE_STREAM_FLAG_MORE | NGTCP2_WRITE_STREAM_FLAG_PADDING;
+    if (fin) {
+      flags |= NGTCP2_WRITE_STREAM_FLAG_FIN;
+    }
+
+    auto nwrite = ngtcp2_conn_writev_stream(
+      qconn_, path, pi, dest, destlen, &ndatalen, flags, stream_id,
+      reinterpret_cast<const ngtcp2_vec *>(v), vcnt, ts);
+    if (nwrite < 0) {
+      switch (nwrite) {
+      case NGTCP2_ERR_STREAM_DATA_BLOCKED:
+        assert(ndatalen == -1);
+        nghttp3_conn_block_stream(httpconn_, stream_id);
+        continue;
+      case NGTCP2_ERR_STREAM_SHUT_WR:
+        assert(ndatalen == -1);
+        nghttp3_conn_shutdown_stream_write(httpconn_, stream_id);
+        continue;
+      case NGTCP2_ERR_WRITE_MORE:
+        assert(ndatalen >= 0);
+
+        if (!on_stream_write(stream_id, as_unsigned(ndatalen))) {
+          return NGTCP2_ERR_CALLBACK_FAILURE;
+        }
+
+        continue;
+      }
+
+      assert(ndatalen == -1);
+
+      Log{ERROR, this} << "ngtcp2_conn_writev_stream: "
+                       << ngtcp2_strerror(static_cast<int>(nwrite));
+
+      ngtcp2_ccerr_set_liberr(&last_error_, static_cast<int>(nwrite), nullptr,
+                              0);
+
+      return NGTCP2_ERR_CALLBACK_FAILURE;
+    }
+
+    if (ndatalen >= 0 && !on_stream_write(stream_id, as_unsigned(ndatalen))) {
+      return NGTCP2_ERR_CALLBACK_FAILURE;
+    }
+
+    return nwrite;
+  }
+}
+
+std::expected<void, Error> Http3Session::on_stream_write(int64_t stream_id,
+                                                         size_t datalen) {
+  auto rv = nghttp3_conn_add_write_offset(httpconn_, stream_id, datalen);
+  if (rv != 0) {
+    Log{ERROR, this} << "nghttp3_conn_add_write_offset: "
+                     << nghttp3_strerror(rv);
+    ngtcp2_ccerr_set_application_error(
+      &last_error_, nghttp3_err_infer_quic_app_error_code(rv), nullptr, 0);
+    return std::unexpected{Error::HTTP3};
+  }
+
+  auto downstream =
+    get_downstream(nghttp3_conn_get_stream_user_data(httpconn_, stream_id));
+  if (!downstream) {
+    return {};
+  }
+
+  if (downstream->get_request_buf()->rleft_mark() == 0) {
+    downstream->disable_downstream_wtimer();
+  } else {
+    downstream->reset_downstream_wtimer();
+  }
+
+  return {};
+}
+
+std::expected<void, Error> Http3Session::write_streams() {
+  ngtcp2_path_storage ps;
+  ngtcp2_pkt_info pi;
+  auto txbuf = std::span{txbuf_};
+  size_t gso_size = 0;
+
+  ngtcp2_path_storage_zero(&ps);
+
+  for (;;) {
+    auto nwrite = ngtcp2_conn_write_aggregate_pkt(
+      qconn_, &ps.path, &pi, txbuf.data(), txbuf.size(), &gso_size,
+      shrpx::write_pkt, quic_timestamp());
+    if (nwrite < 0) {
+      return handle_error();
+    }
+
+    if (nwrite == 0) {
+      return {};
+    }
+
+    send_packet(txbuf.first(static_cast<size_t>(nwrite)), gso_size);
+
+    if (tx_.send_blocked) {
+      return {};
+    }
+  }
+}
+
+void Http3Session::send_packet(std::span<const uint8_t> data,
+                               size_t gso_size) {
+  if (gso_size == 0) {
+    gso_size = data.size();
+  }
+
+  while (!data.empty()) {
+    auto len = std::min(gso_size, data.size());
+
+    ssize_t nwrite;
+
+    while ((nwrite = send(conn_.fd, data.data(), len, 0)) == -1 &&
+           errno == EINTR)
+      ;
+
+    if (nwrite == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        tx_.send_blocked = true;
+        tx_.data = data;
+        tx_.gso_size = gso_size;
+
+        conn_.wlimit.startw();
+
+        return;
+      }
+
+      // Other errors are not fatal.  Lost packets are recovered by
+      // QUIC.
+      if (log_enabled(INFO)) {
+        auto error = errno;
+        Log{INFO, this} << "send() failed; errno=" << error;
+      }
+    }
+
+    data = data.subspan(len);
+  }
+}
+
+void Http3Session::send_blocked_packet() {
+  assert(tx_.send_blocked);
+
+  tx_.send_blocked = false;
+
+  send_packet(tx_.data, tx_.gso_size);
+}
+
+std::expected<void, Error> Http3Session::handle_error() {
+  if (ngtcp2_conn_in_closing_period2(qconn_) ||
+      ngtcp2_conn_in_draining_period2(qconn_)) {
+    return std::unexpected{Error::DONE};
+  }
+
+  send_connection_close();
+
+  return std::unexpected{Error::DONE};
+}
+
+void Http3Session::send_connection_close() {
+  ngtcp2_path_storage ps;
+  ngtcp2_pkt_info pi;
+
+  ngtcp2_path_storage_zero(&ps);
+
+  std::array<uint8_t, NGTCP2_MAX_UDP_PAYLOAD_SIZE> buf;
+
+  auto nwrite = ngtcp2_conn_write_connection_close(
+    qconn_, &ps.path, &pi, buf.data(), buf.size(), &last_error_,
+    quic_timestamp());
+  if (nwrite <= 0) {
+    if (nwrite < 0 && nwrite != NGTCP2_ERR_INVALID_STATE) {
+      Log{ERROR, this} << "ngtcp2_conn_write_connection_close: "
+                       << ngtcp2_strerror(static_cast<int>(nwrite));
+    }
+
+    return;
+  }
+
+  // This is the last packet.  Ignore error.
+  (void)send(conn_.fd, buf.data(), as_unsigned(nwrite), 0);
+}
+
+std::expected<void, Error> Http3Session::handle_expiry() {
+  if (!qconn_) {
+    return {};
+  }
+
+  auto rv = ngtcp2_conn_handle_expiry(qconn_, quic_timestamp());
+  if (rv != 0) {
+    switch (rv) {
+    case NGTCP2_ERR_IDLE_CLOSE:
+      if (log_enabled(INFO)) {
+        Log{INFO, this} << "Idle connection timeout";
+      }
+      break;
+    case NGTCP2_ERR_HANDSHAKE_TIMEOUT:
+      on_timeout();
+      break;
+    default:
+      Log{ERROR, this} << "ngtcp2_conn_handle_expiry: " << ngtcp2_strerror(rv);
+    }
+
+    ngtcp2_ccerr_set_liberr(&last_error_, rv, nullptr, 0);
+
+    return handle_error();
+  }
+
+  return {};
+}
+
+void Http3Session::reset_timer() {
+  auto ts = quic_timestamp();
+  auto expiry_ts = ngtcp2_conn_get_expiry2(qconn_);
+
+  if (expiry_ts <= ts) {
+    ev_feed_event(conn_.loop, &timer_, EV_TIMER);
+    return;
+  }
+
+  timer_.repeat = static_cast<ev_tstamp>(expiry_ts - ts) / NGTCP2_SECONDS;
+
+  ev_timer_again(conn_.loop, &timer_);
+}
+
+void Http3Session::signal_write() {
+  switch (state_) {
+  case Http3SessionState::DISCONNECTED:
+    if (!ev_is_active(&initiate_connection_timer_)) {
+      if (log_enabled(INFO)) {
+        Log{INFO} << "Start connecting to backend server";
+      }
+      // Since the timer is set to 0., these will feed 2 events.  We
+      // will stop the timer in the initiate_connection_timer_ to void
+      // 2nd event.
+      ev_timer_start(conn_.loop, &initiate_connection_timer_);
+      ev_feed_event(conn_.loop, &initiate_connection_timer_, 0);
+    }
+    break;
+  case Http3SessionState::CONNECTING:
+  case Http3SessionState::CONNECTED:
+    conn_.wlimit.startw();
+    break;
+  default:
+    break;
+  }
+}
+
+Http3SessionState Http3Session::get_state() const { return state_; }
+
+bool Http3Session::can_push_request(const Downstream *downstream) const {
+  switch (state_) {
+  case Http3SessionState::CONNECTED:
+    return httpconn_ != nullptr;
+  case Http3SessionState::CONNECTING: {
+    if (!httpconn_) {
+      return false;
+    }
+
+    // Only safe requests without request body are sent in 0-RTT
+    // because 0-RTT data might be replayed.
+    auto &req = downstream->request();
+    return (req.method == HTTP_GET || req.method == HTTP_HEAD) &&
+           req.fs.content_length <= 0 && !req.http2_expect_body &&
+           !req.fs.header(http2::HD_TRANSFER_ENCODING);
+  }
+  default:
+    return false;
+  }
+}
+
+std::expected<void, Error> Http3Session::submit_pending_requests() {
+  for (auto dconn = dconns_.head; dconn; dconn = dconn->dlnext) {
+    auto downstream = dconn->get_downstream();
+
+    if (!downstream->get_request_pending() ||
+        !downstream->request_submission_ready() ||
+        !can_push_request(downstream)) {
+      continue;
+    }
+
+    auto upstream = downstream->get_upstream();
+
+    if (!dconn->push_request_headers()) {
+      if (log_enabled(INFO)) {
+        Log{INFO, this} << "backend request failed";
+      }
+
+      if (auto rv = upstream->on_downstream_abort_request(downstream, 400);
+          !rv) {
+        return rv;
+      }
+
+      continue;
+    }
+
+    if (auto rv = upstream->resume_read(SHRPX_NO_BUFFER, downstream, 0); !rv) {
+      return rv;
+    }
+  }
+
+  return {};
+}
+
+DownstreamAddr *Http3Session::get_addr() const { return addr_; }
+
+const std::shared_ptr<DownstreamAddrGroup> &
+Http3Session::get_downstream_addr_group() const {
+  return group_;
+}
+
+const Address *Http3Session::get_raddr() const { return raddr_; }
+
+bool Http3Session::max_concurrency_reached(size_t extra) const {
+  auto &http2conf = get_config()->http2;
+
+  if (dconns_.size() + extra >= http2conf.downstream.max_concurrent_streams) {
+    return true;
+  }
+
+  if (!qconn_ || state_ != Http3SessionState::CONNECTED) {
+    return false;
+  }
+
+  // Streams which are not opened yet are counted in dconns_.
+  return ngtcp2_conn_get_streams_bidi_left(qconn_) <= extra;
+}
+
+void Http3Session::add_to_extra_freelist() {
+  if (freelist_zone_ != FreelistZone::NONE) {
+    return;
+  }
+
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "Append to http3_extra_freelist, addr=" << addr_
+                    << ", freelist.size=" << addr_->http3_extra_freelist.size();
+  }
+
+  freelist_zone_ = FreelistZone::EXTRA;
+  addr_->http3_extra_freelist.append(this);
+}
+
+void Http3Session::remove_from_freelist() {
+  switch (freelist_zone_) {
+  case FreelistZone::NONE:
+    return;
+  case FreelistZone::EXTRA:
+    if (log_enabled(INFO)) {
+      Log{INFO, this} << "Remove from http3_extra_freelist, addr=" << addr_
+                      << ", freelist.size="
+                      << addr_->http3_extra_freelist.size();
+    }
+    addr_->http3_extra_freelist.remove(this);
+    break;
+  case FreelistZone::GONE:
+    return;
+  }
+
+  freelist_zone_ = FreelistZone::NONE;
+}
+
+void Http3Session::exclude_from_scheduling() {
+  remove_from_freelist();
+  freelist_zone_ = FreelistZone::GONE;
+}
+
+void Http3Session::on_timeout() {
+  if (state_ == Http3SessionState::CONNECTING) {
+    Log{WARN, this} << "Connect time out; addr="
+                    << util::to_numeric_addr(raddr_);
+
+    downstream_failure(addr_, raddr_);
+  }
+}
+
+std::expected<void, Error> Http3Session::check_retire() {
+  if (!group_->retired) {
+    return {};
+  }
+
+  exclude_from_scheduling();
+
+  if (!dconns_.empty()) {
+    return {};
+  }
+
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "Backend has been retired";
+  }
+
+  return std::unexpected{Error::DONE};
+}
+
+ngtcp2_conn *Http3Session::get_conn() const { return qconn_; }
+
+} // namespace shrpx
@@ -0,0 +1,250 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2026 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef SHRPX_HTTP3_SESSION_H
+#define SHRPX_HTTP3_SESSION_H
+
+#include "shrpx.h"
+
+#include <memory>
+#include <expected>
+#include <array>
+
+#include <ev.h>
+
+#include <ngtcp2/ngtcp2.h>
+#include <nghttp3/nghttp3.h>
+
+#include "shrpx_connection.h"
+#include "shrpx_http2_session.h"
+#include "network.h"
+#include "ssl_compat.h"
+#include "template.h"
+#include "errors.h"
+
+#if OPENSSL_3_5_0_API
+#  include <ngtcp2/ngtcp2_crypto_ossl.h>
+#endif // OPENSSL_3_5_0_API
+
+using namespace nghttp2;
+
+namespace shrpx {
+
+class Http3DownstreamConnection;
+class Worker;
+class Downstream;
+struct DownstreamAddrGroup;
+struct DownstreamAddr;
+struct DNSQuery;
+
+enum class Http3SessionState {
+  // Disconnected
+  DISCONNECTED,
+  // Resolving host name
+  RESOLVING_NAME,
+  // Performing QUIC handshake.  Safe requests might be sent in 0-RTT
+  // in this state.
+  CONNECTING,
+  // Connected to downstream
+  CONNECTED,
+};
+
+// Http3Session is a QUIC connection to a backend server which speaks
+// HTTP/3.  Like Http2Session, it multiplexes requests from several
+// frontend connections.
+class Http3Session {
+public:
+  Http3Session(struct ev_loop *loop, SSL_CTX *ssl_ctx, Worker *worker,
+               const std::shared_ptr<DownstreamAddrGroup> &group,
+               DownstreamAddr *addr);
+  ~Http3Session();
+
+  void disconnect();
+  std::expected<void, Error> initiate_connection();
+  std::expected<void, Error> resolve_name();
+
+  void add_downstream_connection(Http3DownstreamConnection *dconn);
+  void remove_downstream_connection(Http3DownstreamConnection *dconn);
+
+  std::expected<void, Error>
+  submit_request(Http3DownstreamConnection *dconn, const nghttp3_nv *nva,
+                 size_t nvlen, const nghttp3_data_reader *dr);
+
+  // Cancels the stream |stream_id| in both directions with
+  // |app_error_code|, and detaches it from its
+  // Http3DownstreamConnection.
+  std::expected<void, Error> shutdown_stream(int64_t stream_id,
+                                             uint64_t app_error_code);
+
+  std::expected<void, Error> resume_stream(int64_t stream_id);
+
+  // Tells QUIC stack that application has consumed |nconsumed| bytes
+  // of response body received in the stream |stream_id|.
+  void consume(int64_t stream_id, size_t nconsumed);
+
+  std::expected<void, Error> do_read();
+  std::expected<void, Error> do_write();
+
+  std::expected<void, Error> handle_expiry();
+  void reset_timer();
+
+  void signal_write();
+
+  Http3SessionState get_state() const;
+
+  // Returns true if request can be issued on downstream connection.
+  // During QUIC handshake, only the requests that are safe to send in
+  // 0-RTT are allowed.
+  bool can_push_request(const Downstream *downstream) const;
+
+  std::expected<void, Error> submit_pending_requests();
+
+  DownstreamAddr *get_addr() const;
+
+  const std::shared_ptr<DownstreamAddrGroup> &get_downstream_addr_group() const;
+
+  // Returns address used to connect to backend.  Could be nullptr.
+  const Address *get_raddr() const;
+
+  // Adds to address scope http3_extra_freelist.
+  void add_to_extra_freelist();
+
+  // Removes this object from any freelist.  If this object is not
+  // linked from any freelist, this function does nothing.
+  void remove_from_freelist();
+
+  // Removes this object form any freelist, and marks this object as
+  // not schedulable.
+  void exclude_from_scheduling();
+
+  // Returns true if the maximum concurrency is reached.  If |extra|
+  // is nonzero, it is added to the number of current concurrent
+  // streams.
+  bool max_concurrency_reached(size_t extra = 0) const;
+
+  // This is called periodically using ev_prepare watcher.  If group_
+  // is retired (backend has been replaced), this object no longer
+  // accepts new requests, and it returns error once all requests have
+  // been completed so that the connection is closed.
+  std::expected<void, Error> check_retire();
+
+  void on_timeout();
+
+  ngtcp2_conn *get_conn() const;
+
+  // QUIC callbacks
+  std::expected<void, Error>
+  recv_stream_data(uint32_t flags, int64_t stream_id,
+                   std::span<const uint8_t> data);
+  std::expected<void, Error> stream_close(int64_t stream_id,
+                                          uint64_t app_error_code);
+  std::expected<void, Error> acked_stream_data_offset(int64_t stream_id,
+                                                      uint64_t datalen);
+  std::expected<void, Error> extend_max_stream_data(int64_t stream_id);
+  void extend_max_local_streams_bidi();
+  std::expected<void, Error> http_shutdown_stream_read(int64_t stream_id);
+  std::expected<void, Error> handshake_completed();
+  std::expected<void, Error> setup_httpconn();
+  std::expected<void, Error> early_data_rejected();
+
+  // HTTP/3 callbacks
+  std::expected<void, Error>
+  http_recv_response_header(Downstream *downstream, nghttp3_rcbuf *name,
+                            nghttp3_rcbuf *value, uint8_t flags, bool trailer);
+  std::expected<void, Error>
+  http_end_response_headers(Downstream *downstream, int64_t stream_id,
+                            int fin);
+  std::expected<void, Error> http_recv_data(Downstream *downstream,
+                                            int64_t stream_id,
+                                            std::span<const uint8_t> data);
+  std::expected<void, Error> http_end_stream(Downstream *downstream);
+  std::expected<void, Error> http_stream_close(Downstream *downstream,
+                                               uint64_t app_error_code);
+  std::expected<void, Error> http_acked_stream_data(Downstream *downstream,
+                                                    uint64_t datalen);
+  std::expected<void, Error> http_stop_sending(int64_t stream_id,
+                                               uint64_t app_error_code);
+  std::expected<void, Error> http_reset_stream(int64_t stream_id,
+                                               uint64_t app_error_code);
+  void http_shutdown();
+
+  Http3Session *dlnext{}, *dlprev{};
+
+private:
+  std::expected<void, Error> init_quic();
+  std::expected<void, Error> write_streams();
+  ngtcp2_ssize write_pkt(ngtcp2_path *path, ngtcp2_pkt_info *pi,
+                         uint8_t *dest, size_t destlen, ngtcp2_tstamp ts);
+  std::expected<void, Error> on_stream_write(int64_t stream_id,
+                                             size_t datalen);
+  // Sends |data| which contains UDP datagrams of |gso_size| bytes
+  // each except for the last one.  If socket is blocked, the
+  // remaining data is remembered in tx_ and write event is enabled.
+  void send_packet(std::span<const uint8_t> data, size_t gso_size);
+  void send_blocked_packet();
+  std::expected<void, Error> handle_error();
+  void send_connection_close();
+
+  Connection conn_;
+  // QUIC expiry timer
+  ev_timer timer_;
+  // timer to initiate connection.  usually, this fires immediately.
+  ev_timer initiate_connection_timer_;
+  ev_prepare prep_;
+  DList<Http3DownstreamConnection> dconns_;
+  Worker *worker_;
+  SSL_CTX *ssl_ctx_;
+  std::shared_ptr<DownstreamAddrGroup> group_;
+  // Address of remote endpoint
+  DownstreamAddr *addr_;
+  // Actual remote address used to contact backend.  This is initially
+  // nullptr, and may point to either &addr_->addr, or
+  // resolved_addr_.get().
+  const Address *raddr_{};
+  // Local address of the connected UDP socket.
+  Address local_addr_;
+  // Resolved IP address if dns parameter is used
+  std::unique_ptr<Address> resolved_addr_;
+  std::unique_ptr<DNSQuery> dns_query_;
+  ngtcp2_conn *qconn_{};
+#if OPENSSL_3_5_0_API
+  ngtcp2_crypto_ossl_ctx *ossl_ctx_{};
+#endif // OPENSSL_3_5_0_API
+  nghttp3_conn *httpconn_{};
+  ngtcp2_ccerr last_error_;
+  Http3SessionState state_{Http3SessionState::DISCONNECTED};
+  FreelistZone freelist_zone_{FreelistZone::NONE};
+  struct {
+    bool send_blocked;
+    // data and gso_size are effective only when send_blocked is
+    // true.  data points to the unsent portion of txbuf_.
+    std::span<const uint8_t> data;
+    size_t gso_size;
+  } tx_{};
+  std::array<uint8_t, 64_k> txbuf_;
+};
+
+} // namespace shrpx
+
+#endif // !defined(SHRPX_HTTP3_SESSION_H)
@@ -36,6 +36,7 @@
 #include "shrpx_client_handler.h"
 #include "shrpx_downstream.h"
 #include "shrpx_downstream_connection.h"
+#include "shrpx_collapsed_downstream_connection.h"
 #include "shrpx_log.h"
 #include "shrpx_quic.h"
 #include "shrpx_worker.h"
@@ -944,6 +945,19 @@ void Http3Upstream::send_packet(const ngtcp2_path &path,
                                 size_t gso_size) {
   auto faddr = static_cast<UpstreamAddr *>(path.user_data);
 
+#ifdef HAVE_SENDMMSG
+  // Datagrams are sent together with the ones from the other
+  // connections at the end of this event loop iteration.
+  if (!handler_->get_worker()->get_quic_send_queue()->add(
+        faddr, path.remote.addr, path.local.addr, pi, data, gso_size)) {
+    // The queue is blocked by EAGAIN or full.  Keep |data| in this
+    // connection, and stop writing until the socket becomes
+    // writable, just like the direct send path does.
+    on_send_blocked(path, pi, data, gso_size);
+
+    signal_write_upstream_addr(faddr);
+  }
+#else  // !defined(HAVE_SENDMMSG)
   auto rest =
     send_packet(faddr, path.remote.addr, path.remote.addrlen, path.local.addr,
                 path.local.addrlen, pi, data, gso_size);
@@ -952,6 +966,7 @@ void Http3Upstream::send_packet(const ngtcp2_path &path,
 
     signal_write_upstream_addr(faddr);
   }
+#endif // !defined(HAVE_SENDMMSG)
 }
 
 std::expected<void, Error> Http3Upstream::on_timeout(Downstream *downstream) {
@@ -1086,6 +1101,12 @@ std::expected<void, Error>
 Http3Upstream::downstream_eof(DownstreamConnection *dconn) {
   auto downstream = dconn->get_downstream();
 
+  // The backend may close the reused connection on its idle timeout
+  // before it sees the request.  It is not the failure of the backend.
+  if (!dconn->reused_and_idle()) {
+    downstream->on_backend_failure();
+  }
+
   if (log_enabled(INFO)) {
     Log{INFO, dconn} << "EOF. stream_id=" << downstream->get_stream_id();
   }
@@ -1127,6 +1148,8 @@ std::expected<void, Error>
 Http3Upstream::downstream_error(DownstreamConnection *dconn, int events) {
   auto downstream = dconn->get_downstream();
 
+  downstream->on_backend_failure();
+
   if (log_enabled(INFO)) {
     if (events & Downstream::EVENT_ERROR) {
       Log{INFO, dconn} << "Downstream network/general error";
@@ -1245,6 +1268,12 @@ Http3Upstream::on_downstream_header_complete(Downstream *downstream) {
     }
   }
 
+  if (!downstream->get_non_final_response()) {
+    if (auto centry = downstream->get_collapse_entry(); centry) {
+      centry->on_response_header();
+    }
+  }
+
   auto config = get_config();
   auto &httpconf = config->http;
 
@@ -1449,6 +1478,10 @@ Http3Upstream::on_downstream_header_complete(Downstream *downstream) {
 std::expected<void, Error>
 Http3Upstream::on_downstream_body(Downstream *downstream,
                                   std::span<const uint8_t> data, bool flush) {
+  if (auto centry = downstream->get_collapse_entry(); centry) {
+    centry->on_response_body(data, flush);
+  }
+
   auto body = downstream->get_response_buf();
   body->append(data);
 
@@ -1464,6 +1497,10 @@ Http3Upstream::on_downstream_body(Downstream *downstream,
 
 std::expected<void, Error>
 Http3Upstream::on_downstream_body_complete(Downstream *downstream) {
+  if (auto centry = downstream->get_collapse_entry(); centry) {
+    centry->on_response_complete();
+  }
+
   if (log_enabled(INFO)) {
     Log{INFO, downstream} << "HTTP response completed";
   }
@@ -1635,7 +1672,8 @@ fail:
     abort();
   }
 
-  if (!on_downstream_abort_request(downstream, 502)) {
+  if (!on_downstream_abort_request(downstream,
+                                   err == Error::OVERLOADED ? 503 : 502)) {
     // Ignore the error otherwise we might delete ClientHandler
     // twice.  See Http2Session.
     (void)shutdown_stream(downstream, NGHTTP3_H3_INTERNAL_ERROR);
@@ -1748,6 +1786,8 @@ void Http3Upstream::response_drain(size_t n) {}
 
 bool Http3Upstream::response_empty() const { return false; }
 
+DefaultMemchunks *Http3Upstream::get_response_buf() { return nullptr; }
+
 Downstream *
 Http3Upstream::on_downstream_push_promise(Downstream *downstream,
                                           int32_t promised_stream_id) {
@@ -2341,7 +2381,15 @@ Http3Upstream::start_downstream(Downstream *downstream) {
     return initiate_downstream(downstream);
   }
 
-  downstream_queue_.mark_blocked(downstream);
+  nghttp3_pri pri;
+  auto urgency = DEFAULT_URGENCY;
+
+  if (nghttp3_conn_get_stream_priority2(httpconn_, &pri,
+                                        downstream->get_stream_id()) == 0) {
+    urgency = pri.urgency;
+  }
+
+  downstream_queue_.mark_blocked(downstream, urgency);
 
   return {};
 }
@@ -2360,7 +2408,9 @@ Http3Upstream::initiate_downstream(Downstream *downstream) {
         abort();
       }
 
-      if (!error_reply(downstream, 502)) {
+      if (!error_reply(downstream, maybe_dconn.error() == Error::OVERLOADED
+                                     ? 503
+                                     : 502)) {
         if (auto rv = shutdown_stream(downstream, NGHTTP3_H3_INTERNAL_ERROR);
             !rv) {
           return rv;
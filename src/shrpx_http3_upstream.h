@@ -97,6 +97,7 @@ public:
   std::span<const uint8_t> response_peek() const override;
   void response_drain(size_t n) override;
   bool response_empty() const override;
+  DefaultMemchunks *get_response_buf() override;
 
   Downstream *on_downstream_push_promise(Downstream *downstream,
                                          int32_t promised_stream_id) override;
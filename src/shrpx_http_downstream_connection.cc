@@ -53,6 +53,21 @@ using namespace nghttp2;
 
 namespace shrpx {
 
+namespace {
+// Cancels the hedged copy of the request if |dconn| carries it.  It
+// returns true if it is cancelled.  In that case, |dconn| is deleted.
+bool cancel_hedge(HttpDownstreamConnection *dconn) {
+  auto downstream = dconn->get_downstream();
+  if (downstream->get_hedge_connection() != dconn) {
+    return false;
+  }
+
+  downstream->cancel_hedge();
+
+  return true;
+}
+} // namespace
+
 namespace {
 void timeoutcb(struct ev_loop *loop, ev_timer *w, int revents) {
   auto conn = static_cast<Connection *>(w->data);
@@ -66,6 +81,10 @@ void timeoutcb(struct ev_loop *loop, ev_timer *w, int revents) {
     Log{INFO, dconn} << "Time out";
   }
 
+  if (cancel_hedge(dconn)) {
+    return;
+  }
+
   auto downstream = dconn->get_downstream();
   auto upstream = downstream->get_upstream();
   auto handler = upstream->get_client_handler();
@@ -107,8 +126,10 @@ void retry_downstream_connection(Downstream *downstream,
       if (!(maybe_dconn.error() == Error::TLS_REQUIRED
               ? upstream->on_downstream_abort_request_with_https_redirect(
                   downstream)
-              : upstream->on_downstream_abort_request(downstream,
-                                                      status_code))) {
+              : upstream->on_downstream_abort_request(
+                  downstream, maybe_dconn.error() == Error::OVERLOADED
+                                ? 503
+                                : status_code))) {
         delete handler;
       }
 
@@ -135,6 +156,10 @@ void connect_timeoutcb(struct ev_loop *loop, ev_timer *w, int revents) {
 
   downstream_failure(addr, raddr);
 
+  if (cancel_hedge(dconn)) {
+    return;
+  }
+
   auto downstream = dconn->get_downstream();
 
   retry_downstream_connection(downstream, 504);
@@ -155,6 +180,21 @@ void readcb(struct ev_loop *loop, ev_io *w, int revents) {
   auto upstream = downstream->get_upstream();
   auto handler = upstream->get_client_handler();
 
+  if (downstream->get_hedge_connection() == dconn) {
+    auto rv = dconn->peek_response();
+    if (!rv) {
+      downstream->cancel_hedge();
+      return;
+    }
+
+    if (!*rv) {
+      return;
+    }
+
+    // The response to the hedged copy of the request arrives first.
+    downstream->promote_hedge();
+  }
+
   if (auto rv = upstream->downstream_read(dconn); !rv) {
     if (rv.error() == Error::DCONN_RETRY) {
       backend_retry(downstream);
@@ -174,6 +214,14 @@ void writecb(struct ev_loop *loop, ev_io *w, int revents) {
   auto upstream = downstream->get_upstream();
   auto handler = upstream->get_client_handler();
 
+  if (downstream->get_hedge_connection() == dconn) {
+    if (!dconn->on_write()) {
+      downstream->cancel_hedge();
+    }
+
+    return;
+  }
+
   if (auto rv = upstream->downstream_write(dconn); !rv) {
     if (rv.error() == Error::DCONN_RETRY) {
       backend_retry(downstream);
@@ -191,6 +239,10 @@ void connectcb(struct ev_loop *loop, ev_io *w, int revents) {
   auto dconn = static_cast<HttpDownstreamConnection *>(conn->data);
   auto downstream = dconn->get_downstream();
   if (!dconn->connected()) {
+    if (cancel_hedge(dconn)) {
+      return;
+    }
+
     backend_retry(downstream);
     return;
   }
@@ -298,8 +350,15 @@ std::expected<void, Error> HttpDownstreamConnection::initiate_connection() {
               *this->resolved_addr_ = *result;
             }
 
+            this->downstream_->add_dns_wait_time(
+              std::chrono::steady_clock::now() - this->dns_query_->wait_start);
+
             if (!this->initiate_connection()) {
               // This callback destroys |this|.
+              if (cancel_hedge(this)) {
+                return;
+              }
+
               auto downstream = this->downstream_;
               backend_retry(downstream);
             }
@@ -357,6 +416,12 @@ std::expected<void, Error> HttpDownstreamConnection::initiate_connection() {
 
     worker_blocker->on_success();
 
+    if (downstreamconf.tcp_fastopen &&
+        util::make_socket_fastopen_connect(conn_.fd) != 0 &&
+        log_enabled(INFO)) {
+      Log{INFO, this} << "Failed to enable TCP Fast Open";
+    }
+
     rv = connect(conn_.fd, raddr->as_sockaddr(), raddr->size());
     if (rv != 0 && errno != EINPROGRESS) {
       auto error = errno;
@@ -412,6 +477,8 @@ std::expected<void, Error> HttpDownstreamConnection::initiate_connection() {
     conn_.wt.repeat = downstreamconf.timeout.connect;
     ev_timer_again(conn_.loop, &conn_.wt);
   } else {
+    reused_ = true;
+
     // we may set read timer cb to idle_timeoutcb.  Reset again.
     ev_set_cb(&conn_.rt, timeoutcb);
     if (conn_.read_timeout < group_->shared_addr->timeout.read) {
@@ -431,6 +498,8 @@ std::expected<void, Error> HttpDownstreamConnection::initiate_connection() {
   llhttp_init(&response_htp_, HTTP_RESPONSE, &htp_hooks);
   response_htp_.data = downstream_;
 
+  response_received_ = false;
+
   return {};
 }
 
@@ -463,7 +532,7 @@ std::expected<void, Error> HttpDownstreamConnection::push_request_headers() {
 
   downstream_->set_request_downstream_host(authority);
 
-  auto buf = downstream_->get_request_buf();
+  auto buf = get_request_buf();
 
   // Assume that method and request path do not contain \r\n.
   auto meth = http2::to_method_string(
@@ -726,7 +795,7 @@ void HttpDownstreamConnection::process_blocked_request_buf() {
   auto src = downstream_->get_blocked_request_buf();
 
   if (src->rleft()) {
-    auto dest = downstream_->get_request_buf();
+    auto dest = get_request_buf();
     auto chunked = downstream_->get_chunked_request();
     if (chunked) {
       dest->append(sizeof(size_t) * 2,
@@ -761,7 +830,7 @@ std::expected<void, Error> HttpDownstreamConnection::push_upload_data_chunk(
   }
 
   auto chunked = downstream_->get_chunked_request();
-  auto output = downstream_->get_request_buf();
+  auto output = get_request_buf();
 
   if (chunked) {
     output->append(sizeof(data.size()) * 2,
@@ -803,7 +872,7 @@ std::expected<void, Error> HttpDownstreamConnection::end_upload_data() {
 void HttpDownstreamConnection::end_upload_data_chunk() {
   const auto &req = downstream_->request();
 
-  auto output = downstream_->get_request_buf();
+  auto output = get_request_buf();
   const auto &trailers = req.fs.trailers();
   if (trailers.empty()) {
     output->append("0\r\n\r\n"sv);
@@ -908,6 +977,9 @@ int htp_msg_begincb(llhttp_t *htp) {
     return -1;
   }
 
+  // The response to the original request arrives first.
+  downstream->cancel_hedge();
+
   return 0;
 }
 } // namespace
@@ -943,10 +1015,25 @@ int htp_hdrs_completecb(llhttp_t *htp) {
     return -1;
   }
 
+  if (resp.http_status == 425 &&
+      downstream->get_backend_early_data() == BackendEarlyData::ACCEPTED) {
+    // The backend does not want to process the request in early
+    // data.  Send it again through a new connection without early
+    // data.  See process_input().
+    downstream->set_backend_early_data(BackendEarlyData::REJECTED);
+    downstream->set_request_header_sent(false);
+    downstream->reset_response();
+    resp.fs.clear_headers();
+    resp.connection_close = true;
+
+    return -1;
+  }
+
   auto dconn = downstream->get_downstream_connection();
 
   downstream->set_downstream_addr_group(dconn->get_downstream_addr_group());
   downstream->set_addr(dconn->get_addr());
+  downstream->on_backend_response_header();
 
   // Server MUST NOT send Transfer-Encoding with a status code 1xx or
   // 204.  Also server MUST NOT send Transfer-Encoding with a status
@@ -1252,7 +1339,7 @@ std::expected<void, Error> HttpDownstreamConnection::write_first() {
   // write_tls()/write_clear(), but before blocked_request_buf_ is
   // reset.  So upstream read might still be blocked.  Let's do it
   // again here.
-  auto input = downstream_->get_request_buf();
+  auto input = get_request_buf();
   if (input->rleft() == 0) {
     auto upstream = downstream_->get_upstream();
     auto &req = downstream_->request();
@@ -1311,7 +1398,7 @@ std::expected<void, Error> HttpDownstreamConnection::write_clear() {
   conn_.last_read = std::chrono::steady_clock::now();
 
   auto upstream = downstream_->get_upstream();
-  auto input = downstream_->get_request_buf();
+  auto input = get_request_buf();
 
   std::array<struct iovec, MAX_WR_IOVCNT> iovbuf;
 
@@ -1359,11 +1446,169 @@ std::expected<void, Error> HttpDownstreamConnection::write_clear() {
   return {};
 }
 
+#ifdef HAVE_SPLICE
+std::expected<void, Error> HttpDownstreamConnection::read_splice() {
+  conn_.last_read = std::chrono::steady_clock::now();
+
+  for (;;) {
+    auto maybe_nread = conn_.splice_read(*response_pipe_);
+    if (!maybe_nread) {
+      return std::unexpected{maybe_nread.error()};
+    }
+
+    auto nread = *maybe_nread;
+    if (nread == 0) {
+      if (response_pipe_->len) {
+        // The pipe might be full.  Upstream resumes reading when it
+        // drains the pipe.
+        pause_read(SHRPX_NO_BUFFER);
+      }
+
+      return {};
+    }
+
+    downstream_->response_sent_body_length += nread;
+
+    if (!ev_is_active(&conn_.rev)) {
+      return {};
+    }
+  }
+}
+
+std::expected<void, Error> HttpDownstreamConnection::write_splice() {
+  conn_.last_read = std::chrono::steady_clock::now();
+
+  auto upstream = downstream_->get_upstream();
+  auto input = get_request_buf();
+
+  std::array<struct iovec, MAX_WR_IOVCNT> iovbuf;
+  auto blocked = false;
+  auto pipe_drained = false;
+
+  for (;;) {
+    // The bytes buffered before splice was started must be written
+    // first.
+    auto iov = input->riovec(iovbuf);
+
+    std::expected<size_t, Error> maybe_nwrite;
+    if (!iov.empty()) {
+      maybe_nwrite = conn_.writev_clear(iov);
+    } else if (request_pipe_->len) {
+      maybe_nwrite = conn_.splice_write(*request_pipe_);
+    } else {
+      break;
+    }
+
+    if (!maybe_nwrite) {
+      // We may have pending data in the response pipe.  Invoke read
+      // event to get read error just in case.
+      ev_feed_event(conn_.loop, &conn_.rev, EV_READ);
+      on_write_ = &HttpDownstreamConnection::noop;
+      reusable_ = false;
+      break;
+    }
+
+    auto nwrite = *maybe_nwrite;
+    if (nwrite == 0) {
+      blocked = true;
+      break;
+    }
+
+    if (iov.empty()) {
+      pipe_drained = true;
+    } else {
+      input->drain(nwrite);
+    }
+  }
+
+  if (!blocked) {
+    conn_.wlimit.stopw();
+    ev_timer_stop(conn_.loop, &conn_.wt);
+  }
+
+  if (input->rleft() == 0 && (pipe_drained || !blocked)) {
+    auto &req = downstream_->request();
+
+    if (auto rv = upstream->resume_read(SHRPX_NO_BUFFER, downstream_,
+                                        req.unconsumed_body_length);
+        !rv) {
+      return rv;
+    }
+  }
+
+  return {};
+}
+#endif // defined(HAVE_SPLICE)
+
+#ifdef NGHTTP2_GENUINE_OPENSSL
+std::expected<void, Error> HttpDownstreamConnection::write_early_data() {
+  if (early_data_done_) {
+    return {};
+  }
+
+  early_data_done_ = true;
+
+  auto session = SSL_get_session(conn_.tls.ssl);
+  if (!worker_->get_downstream_config()->tls_early_data ||
+      !request_header_written_ || !session ||
+      downstream_->get_backend_early_data() != BackendEarlyData::NONE ||
+      !downstream_->replayable() ||
+      downstream_->get_hedge_connection() == this) {
+    return {};
+  }
+
+  auto data = get_request_buf()->peek();
+  data = data.first(
+    std::min(data.size(), static_cast<size_t>(
+                            SSL_SESSION_get_max_early_data(session))));
+  if (data.empty()) {
+    return {};
+  }
+
+  auto maybe_nwrite = conn_.write_tls(data);
+  if (!maybe_nwrite) {
+    return std::unexpected{maybe_nwrite.error()};
+  }
+
+  auto nwrite = *maybe_nwrite;
+  if (nwrite == 0) {
+    if (conn_.tls.last_writelen) {
+      // SSL_write_early_data must be called again with the same
+      // data.
+      early_data_done_ = false;
+    }
+
+    return {};
+  }
+
+  early_datalen_ = nwrite;
+
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "Wrote " << nwrite << " bytes in TLS early data";
+  }
+
+  return {};
+}
+#endif // defined(NGHTTP2_GENUINE_OPENSSL)
+
 std::expected<void, Error> HttpDownstreamConnection::tls_handshake() {
   ERR_clear_error();
 
   conn_.last_read = std::chrono::steady_clock::now();
 
+#ifdef NGHTTP2_GENUINE_OPENSSL
+  if (auto rv = write_early_data(); !rv) {
+    downstream_failure(addr_, raddr_);
+
+    return rv;
+  }
+
+  if (!early_data_done_) {
+    // Writing early data is blocked.
+    return {};
+  }
+#endif // defined(NGHTTP2_GENUINE_OPENSSL)
+
   if (auto rv = conn_.tls_handshake(); !rv) {
     if (rv.error() == Error::TLS_HANDSHAKE_INPROGRESS) {
       return {};
@@ -1386,6 +1631,17 @@ std::expected<void, Error> HttpDownstreamConnection::tls_handshake() {
     }
   }
 
+#ifdef NGHTTP2_GENUINE_OPENSSL
+  if (early_datalen_) {
+    if (SSL_get_early_data_status(conn_.tls.ssl) == SSL_EARLY_DATA_ACCEPTED) {
+      get_request_buf()->drain(early_datalen_);
+      downstream_->set_backend_early_data(BackendEarlyData::ACCEPTED);
+    } else if (log_enabled(INFO)) {
+      Log{INFO, this} << "TLS early data was rejected; send it again";
+    }
+  }
+#endif // defined(NGHTTP2_GENUINE_OPENSSL)
+
   auto &connect_blocker = addr_->connect_blocker;
 
   signal_write_ = &HttpDownstreamConnection::actual_signal_write;
@@ -1451,7 +1707,7 @@ std::expected<void, Error> HttpDownstreamConnection::write_tls() {
   ERR_clear_error();
 
   auto upstream = downstream_->get_upstream();
-  auto input = downstream_->get_request_buf();
+  auto input = get_request_buf();
 
   for (;;) {
     auto data = input->peek();
@@ -1501,6 +1757,8 @@ std::expected<void, Error> HttpDownstreamConnection::write_tls() {
 
 std::expected<void, Error>
 HttpDownstreamConnection::process_input(std::span<const uint8_t> data) {
+  response_received_ = true;
+
   if (downstream_->get_upgraded()) {
     // For upgraded connection, just pass data to the upstream.
     if (auto rv = downstream_->get_upstream()->on_downstream_body(downstream_,
@@ -1527,6 +1785,14 @@ HttpDownstreamConnection::process_input(std::span<const uint8_t> data) {
 
   if (htperr != HPE_OK &&
       (!downstream_->get_upgraded() || htperr != HPE_PAUSED_UPGRADE)) {
+    if (downstream_->get_backend_early_data() == BackendEarlyData::REJECTED &&
+        !downstream_->get_request_header_sent()) {
+      // The backend responded with 425 to the request sent in early
+      // data.  Pretend that the connection was closed before the
+      // request was sent, so that the request is retried.
+      return std::unexpected{Error::RECV_EOF};
+    }
+
     // Handling early return (in other words, response was hijacked by
     // mruby scripting).
     if (downstream_->get_response_state() == DownstreamState::MSG_COMPLETE) {
@@ -1620,12 +1886,89 @@ std::expected<void, Error> HttpDownstreamConnection::on_read() {
   return on_read_(*this);
 }
 
+DefaultMemchunks *HttpDownstreamConnection::get_request_buf() {
+  if (downstream_->get_hedge_connection() == this) {
+    return downstream_->get_hedge_request_buf();
+  }
+
+  return downstream_->get_request_buf();
+}
+
+std::expected<bool, Error> HttpDownstreamConnection::peek_response() {
+  std::array<uint8_t, 1> b;
+
+  if (conn_.tls.ssl) {
+    if (!SSL_is_init_finished(conn_.tls.ssl)) {
+      if (auto rv = on_read(); !rv) {
+        return std::unexpected{rv.error()};
+      }
+
+      return false;
+    }
+
+    ERR_clear_error();
+
+    auto rv = SSL_peek(conn_.tls.ssl, b.data(), b.size());
+    if (rv > 0) {
+      return true;
+    }
+
+    switch (SSL_get_error(conn_.tls.ssl, rv)) {
+    case SSL_ERROR_WANT_READ:
+      return false;
+    case SSL_ERROR_ZERO_RETURN:
+      return std::unexpected{Error::RECV_EOF};
+    default:
+      return std::unexpected{Error::NETWORK};
+    }
+  }
+
+  ssize_t nread;
+
+  while ((nread = recv(conn_.fd, b.data(), b.size(), MSG_PEEK)) == -1 &&
+         errno == EINTR)
+    ;
+
+  if (nread == -1) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return false;
+    }
+
+    return std::unexpected{Error::NETWORK};
+  }
+
+  if (nread == 0) {
+    return std::unexpected{Error::RECV_EOF};
+  }
+
+  return true;
+}
+
 std::expected<void, Error> HttpDownstreamConnection::on_write() {
   return on_write_(*this);
 }
 
 void HttpDownstreamConnection::on_upstream_change(Upstream *upstream) {}
 
+#ifdef HAVE_SPLICE
+bool HttpDownstreamConnection::start_splice(SplicePipe *request_pipe,
+                                            SplicePipe *response_pipe) {
+  if (conn_.tls.ssl || !first_write_done_) {
+    return false;
+  }
+
+  request_pipe_ = request_pipe;
+  response_pipe_ = response_pipe;
+
+  on_read_ = &HttpDownstreamConnection::read_splice;
+  on_write_ = &HttpDownstreamConnection::write_splice;
+
+  return true;
+}
+
+void HttpDownstreamConnection::signal_splice_write() { signal_write(); }
+#endif // defined(HAVE_SPLICE)
+
 void HttpDownstreamConnection::signal_write() { signal_write_(*this); }
 
 void HttpDownstreamConnection::actual_signal_write() {
@@ -1643,6 +1986,24 @@ bool HttpDownstreamConnection::poolable() const {
   return !group_->retired && reusable_;
 }
 
+bool HttpDownstreamConnection::reused_and_idle() const {
+  return reused_ && !response_received_;
+}
+
 const Address *HttpDownstreamConnection::get_raddr() const { return raddr_; }
 
+void HttpDownstreamConnection::set_downstream_addr(
+  const std::shared_ptr<DownstreamAddrGroup> &group, DownstreamAddr *addr) {
+  if (raddr_ == &addr_->addr) {
+    raddr_ = &addr->addr;
+  }
+
+  if (conn_.tls.client_session_cache == &addr_->tls_session_cache) {
+    conn_.tls.client_session_cache = &addr->tls_session_cache;
+  }
+
+  group_ = group;
+  addr_ = addr;
+}
+
 } // namespace shrpx
@@ -66,7 +66,14 @@ public:
 
   void on_upstream_change(Upstream *upstream) override;
 
+#ifdef HAVE_SPLICE
+  bool start_splice(SplicePipe *request_pipe,
+                    SplicePipe *response_pipe) override;
+  void signal_splice_write() override;
+#endif // defined(HAVE_SPLICE)
+
   bool poolable() const override;
+  bool reused_and_idle() const override;
 
   const std::shared_ptr<DownstreamAddrGroup> &
   get_downstream_addr_group() const override;
@@ -79,9 +86,18 @@ public:
   std::expected<void, Error> write_clear();
   std::expected<void, Error> read_tls();
   std::expected<void, Error> write_tls();
+#ifdef HAVE_SPLICE
+  std::expected<void, Error> read_splice();
+  std::expected<void, Error> write_splice();
+#endif // defined(HAVE_SPLICE)
 
   std::expected<void, Error> process_input(std::span<const uint8_t> data);
   std::expected<void, Error> tls_handshake();
+  // Sends the request header in TLS early data if the resumed session
+  // allows it.  The data stays in the request buffer until the
+  // backend accepts early data, so that it is sent again after the
+  // handshake if the backend rejects it.
+  std::expected<void, Error> write_early_data();
 
   std::expected<void, Error> connected();
   void signal_write();
@@ -90,6 +106,12 @@ public:
   // Returns address used to connect to backend.  Could be nullptr.
   const Address *get_raddr() const;
 
+  // Makes this pooled connection belong to |addr| in |group|.  |addr|
+  // must have the same backend address as the current one.  This is
+  // used to carry over the connection to the new configuration.
+  void set_downstream_addr(const std::shared_ptr<DownstreamAddrGroup> &group,
+                           DownstreamAddr *addr);
+
   std::expected<void, Error> noop() { return {}; }
   void void_noop() {}
 
@@ -98,7 +120,17 @@ public:
   bool should_unblock_request_body_before_response() const;
   bool should_block_request_body() const;
 
+  // Checks whether the response to the hedged copy of the request has
+  // started to arrive without consuming it.  It returns true if some
+  // data is available to read, or false if nothing has arrived yet.
+  // It drives the TLS handshake if it has not finished.
+  std::expected<bool, Error> peek_response();
+
 private:
+  // Returns the buffer of the request sent over this connection.  It
+  // is the buffer of the hedged copy if this connection carries it.
+  DefaultMemchunks *get_request_buf();
+
   Connection conn_;
   std::function<std::expected<void, Error>(HttpDownstreamConnection &)>
     on_read_{&HttpDownstreamConnection::noop},
@@ -119,15 +151,29 @@ private:
   std::unique_ptr<Address> resolved_addr_;
   std::unique_ptr<DNSQuery> dns_query_;
   IOControl ioctrl_{&conn_.rlimit};
+#ifdef HAVE_SPLICE
+  // Pipes owned by the upstream to forward the upgraded tunnel with
+  // splice(2).  They are nullptr unless splice is used.
+  SplicePipe *request_pipe_{}, *response_pipe_{};
+#endif // defined(HAVE_SPLICE)
   llhttp_t response_htp_{};
   // true if first write succeeded.
   bool first_write_done_{};
   // true if this object can be reused
   bool reusable_{true};
+  // true if this object has been taken from the connection pool.
+  bool reused_{};
+  // true if any byte of the response has been received.
+  bool response_received_{};
   // true if request header is written to request buffer.
   bool request_header_written_{};
   // true if blocked request buffer has been processed.
   bool blocked_request_buf_processed_{};
+  // The number of bytes of the request buffer written in TLS early
+  // data.
+  size_t early_datalen_{};
+  // true if writing TLS early data has been done or given up.
+  bool early_data_done_{};
 };
 
 } // namespace shrpx
@@ -47,6 +47,7 @@ const MunitTest tests[]{
   munit_void_test(test_shrpx_http_create_affinity_cookie),
   munit_void_test(test_shrpx_http_create_altsvc_header_value),
   munit_void_test(test_shrpx_http_check_http_scheme),
+  munit_void_test(test_shrpx_http_shareable_response),
   munit_test_end(),
 };
 } // namespace
@@ -175,4 +176,71 @@ void test_shrpx_http_check_http_scheme(void) {
   assert_false(http::check_http_scheme(""sv, false));
 }
 
+void test_shrpx_http_shareable_response(void) {
+  assert_true(http::shareable_response(200, {}));
+  assert_true(http::shareable_response(404, {}));
+  assert_false(http::shareable_response(206, {}));
+  assert_false(http::shareable_response(302, {}));
+  assert_false(http::shareable_response(500, {}));
+
+  {
+    HeaderRefs headers{
+      {"cache-control"sv, "public, max-age=60"sv},
+      {"vary"sv, " Accept-Encoding "sv},
+      {"content-type"sv, "text/html"sv},
+    };
+
+    assert_true(http::shareable_response(200, headers));
+  }
+
+  {
+    HeaderRefs headers{
+      {"set-cookie"sv, "id=1"sv},
+    };
+
+    assert_false(http::shareable_response(200, headers));
+  }
+
+  {
+    HeaderRefs headers{
+      {"cache-control"sv, "max-age=60"sv},
+      {"cache-control"sv, "Private"sv},
+    };
+
+    assert_false(http::shareable_response(200, headers));
+  }
+
+  {
+    HeaderRefs headers{
+      {"cache-control"sv, "max-age=0,no-cache=\"set-cookie\""sv},
+    };
+
+    assert_false(http::shareable_response(200, headers));
+  }
+
+  {
+    HeaderRefs headers{
+      {"cache-control"sv, "no-store"sv},
+    };
+
+    assert_false(http::shareable_response(200, headers));
+  }
+
+  {
+    HeaderRefs headers{
+      {"vary"sv, "accept-encoding, user-agent"sv},
+    };
+
+    assert_false(http::shareable_response(200, headers));
+  }
+
+  {
+    HeaderRefs headers{
+      {"vary"sv, "*"sv},
+    };
+
+    assert_false(http::shareable_response(200, headers));
+  }
+}
+
 } // namespace shrpx
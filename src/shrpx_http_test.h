@@ -42,6 +42,7 @@ munit_void_test_decl(test_shrpx_http_create_via_header_value)
 munit_void_test_decl(test_shrpx_http_create_affinity_cookie)
 munit_void_test_decl(test_shrpx_http_create_altsvc_header_value)
 munit_void_test_decl(test_shrpx_http_check_http_scheme)
+munit_void_test_decl(test_shrpx_http_shareable_response)
 
 } // namespace shrpx
 
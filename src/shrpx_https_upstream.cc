@@ -35,7 +35,9 @@
 #include "shrpx_log_config.h"
 #include "shrpx_worker.h"
 #include "shrpx_http2_session.h"
+#include "shrpx_collapsed_downstream_connection.h"
 #include "shrpx_log.h"
+#include "shrpx_connection.h"
 #ifdef HAVE_MRUBY
 #  include "shrpx_mruby.h"
 #endif // defined(HAVE_MRUBY)
@@ -518,6 +520,9 @@ int htp_hdrs_completecb(llhttp_t *htp) {
           !upstream->redirect_to_https(downstream)) {
         return -1;
       }
+      if (maybe_dconn.error() == Error::OVERLOADED) {
+        downstream->response().http_status = 503;
+      }
       downstream->set_request_state(DownstreamState::CONNECT_FAIL);
       return -1;
     }
@@ -799,6 +804,12 @@ std::expected<void, Error> HttpsUpstream::on_write() {
     return {};
   }
 
+#ifdef HAVE_SPLICE
+  if (response_pipe_ && response_pipe_->len) {
+    return {};
+  }
+#endif // defined(HAVE_SPLICE)
+
   // We need to postpone detachment until all data are sent so that
   // we can notify nghttp2 library all data consumed.
   if (downstream->get_response_state() == DownstreamState::MSG_COMPLETE) {
@@ -932,6 +943,12 @@ std::expected<void, Error>
 HttpsUpstream::downstream_eof(DownstreamConnection *dconn) {
   auto downstream = dconn->get_downstream();
 
+  // The backend may close the reused connection on its idle timeout
+  // before it sees the request.  It is not the failure of the backend.
+  if (!dconn->reused_and_idle()) {
+    downstream->on_backend_failure();
+  }
+
   if (log_enabled(INFO)) {
     Log{INFO, dconn} << "EOF";
   }
@@ -979,6 +996,9 @@ end:
 std::expected<void, Error>
 HttpsUpstream::downstream_error(DownstreamConnection *dconn, int events) {
   auto downstream = dconn->get_downstream();
+
+  downstream->on_backend_failure();
+
   if (log_enabled(INFO)) {
     if (events & Downstream::EVENT_ERROR) {
       Log{INFO, dconn} << "Network error/general error";
@@ -1167,6 +1187,12 @@ HttpsUpstream::on_downstream_header_complete(Downstream *downstream) {
     }
   }
 
+  if (!downstream->get_non_final_response()) {
+    if (auto centry = downstream->get_collapse_entry(); centry) {
+      centry->on_response_header();
+    }
+  }
+
   const auto &req = downstream->request();
   auto &resp = downstream->response();
   auto &balloc = downstream->get_block_allocator();
@@ -1384,12 +1410,22 @@ HttpsUpstream::on_downstream_header_complete(Downstream *downstream) {
 
   downstream->register_upstream_write_rate_timer();
 
+#ifdef HAVE_SPLICE
+  if (downstream->get_upgraded()) {
+    start_splice(downstream);
+  }
+#endif // defined(HAVE_SPLICE)
+
   return {};
 }
 
 std::expected<void, Error>
 HttpsUpstream::on_downstream_body(Downstream *downstream,
                                   std::span<const uint8_t> data, bool flush) {
+  if (auto centry = downstream->get_collapse_entry(); centry) {
+    centry->on_response_body(data, flush);
+  }
+
   if (data.empty()) {
     return {};
   }
@@ -1414,6 +1450,10 @@ HttpsUpstream::on_downstream_body(Downstream *downstream,
 
 std::expected<void, Error>
 HttpsUpstream::on_downstream_body_complete(Downstream *downstream) {
+  if (auto centry = downstream->get_collapse_entry(); centry) {
+    centry->on_response_complete();
+  }
+
   const auto &req = downstream->request();
   auto &resp = downstream->response();
 
@@ -1575,7 +1615,8 @@ HttpsUpstream::on_downstream_reset(Downstream *downstream, bool no_retry) {
 fail:
   if (auto rv = err == Error::TLS_REQUIRED
                   ? on_downstream_abort_request_with_https_redirect(downstream)
-                  : on_downstream_abort_request(downstream_.get(), 502);
+                  : on_downstream_abort_request(
+                      downstream_.get(), err == Error::OVERLOADED ? 503 : 502);
       !rv) {
     return rv;
   }
@@ -1621,7 +1662,21 @@ void HttpsUpstream::response_drain(size_t n) {
   }
 }
 
+DefaultMemchunks *HttpsUpstream::get_response_buf() {
+  if (!downstream_) {
+    return nullptr;
+  }
+
+  return downstream_->get_response_buf();
+}
+
 bool HttpsUpstream::response_empty() const {
+#ifdef HAVE_SPLICE
+  if (response_pipe_ && response_pipe_->len) {
+    return false;
+  }
+#endif // defined(HAVE_SPLICE)
+
   if (!downstream_) {
     return true;
   }
@@ -1631,6 +1686,101 @@ bool HttpsUpstream::response_empty() const {
   return buf->rleft() == 0;
 }
 
+#ifdef HAVE_SPLICE
+void HttpsUpstream::start_splice(Downstream *downstream) {
+  auto conn = handler_->get_connection();
+  auto dconn = downstream->get_downstream_connection();
+
+  if (!get_config()->tunnel_splice || request_pipe_ || conn->tls.ssl ||
+      !dconn || !downstream->request().http1_msg_complete) {
+    return;
+  }
+
+#ifdef HAVE_LIBURING
+  // io_uring might hold the bytes which have not been read yet.
+  if (conn->io_uring_recv) {
+    return;
+  }
+#endif // defined(HAVE_LIBURING)
+
+  auto request_pipe = std::make_unique<SplicePipe>();
+  auto response_pipe = std::make_unique<SplicePipe>();
+
+  if (!request_pipe->init() || !response_pipe->init() ||
+      !dconn->start_splice(request_pipe.get(), response_pipe.get())) {
+    return;
+  }
+
+  request_pipe_ = std::move(request_pipe);
+  response_pipe_ = std::move(response_pipe);
+
+  handler_->setup_splice_io_callback();
+
+  if (log_enabled(INFO)) {
+    Log{INFO, this} << "Forwarding upgraded connection with splice";
+  }
+}
+
+std::expected<void, Error> HttpsUpstream::splice_read() {
+  auto conn = handler_->get_connection();
+  auto dconn =
+    downstream_ ? downstream_->get_downstream_connection() : nullptr;
+
+  if (!dconn) {
+    // Backend connection has gone.  Stop reading until the remaining
+    // response is written, and the connection is closed.
+    pause_read(SHRPX_NO_BUFFER);
+    return {};
+  }
+
+  for (;;) {
+    auto maybe_nread = conn->splice_read(*request_pipe_);
+    if (!maybe_nread) {
+      return std::unexpected{maybe_nread.error()};
+    }
+
+    auto nread = *maybe_nread;
+    if (nread == 0) {
+      if (request_pipe_->len) {
+        // The pipe might be full.  Backend resumes reading when it
+        // drains the pipe.
+        pause_read(SHRPX_NO_BUFFER);
+      }
+
+      return {};
+    }
+
+    downstream_->request().recv_body_length += nread;
+
+    dconn->signal_splice_write();
+
+    if (!ev_is_active(&conn->rev)) {
+      return {};
+    }
+  }
+}
+
+std::expected<void, Error> HttpsUpstream::response_splice_drain(size_t n) {
+  handler_->extend_write_rate_timer(n);
+
+  if (!downstream_) {
+    return {};
+  }
+
+  if (response_pipe_->len == 0 &&
+      downstream_->get_response_buf()->rleft() == 0) {
+    downstream_->unregister_upstream_write_rate_timer();
+  }
+
+  // The pipe has room now.
+  return downstream_->resume_read(SHRPX_NO_BUFFER, 0);
+}
+
+SplicePipe *HttpsUpstream::get_response_pipe() const {
+  return response_pipe_.get();
+}
+#endif // defined(HAVE_SPLICE)
+
 Downstream *
 HttpsUpstream::on_downstream_push_promise(Downstream *downstream,
                                           int32_t promised_stream_id) {
@@ -40,6 +40,9 @@ using namespace nghttp2;
 namespace shrpx {
 
 class ClientHandler;
+#ifdef HAVE_SPLICE
+struct SplicePipe;
+#endif // defined(HAVE_SPLICE)
 
 class HttpsUpstream : public Upstream {
 public:
@@ -96,6 +99,7 @@ public:
   std::span<const uint8_t> response_peek() const override;
   void response_drain(size_t n) override;
   bool response_empty() const override;
+  DefaultMemchunks *get_response_buf() override;
 
   Downstream *on_downstream_push_promise(Downstream *downstream,
                                          int32_t promised_stream_id) override;
@@ -113,10 +117,30 @@ public:
   // Called when new request has started.
   void on_start_request();
 
+#ifdef HAVE_SPLICE
+  // Starts forwarding the upgraded tunnel of |downstream| with
+  // splice(2) if it is enabled, and both frontend and backend
+  // connections are cleartext.
+  void start_splice(Downstream *downstream);
+  // Moves the bytes from the frontend into the request pipe.
+  std::expected<void, Error> splice_read();
+  // Tells that |n| bytes in the response pipe have been written to
+  // the frontend.
+  std::expected<void, Error> response_splice_drain(size_t n);
+  SplicePipe *get_response_pipe() const;
+#endif // defined(HAVE_SPLICE)
+
 private:
   ClientHandler *handler_;
   llhttp_t htp_;
   size_t current_header_length_{};
+#ifdef HAVE_SPLICE
+  // Pipes to forward the upgraded tunnel with splice(2).
+  // request_pipe_ carries the bytes from the frontend to the backend,
+  // and response_pipe_ the other way around.  They must outlive
+  // downstream_.
+  std::unique_ptr<SplicePipe> request_pipe_, response_pipe_;
+#endif // defined(HAVE_SPLICE)
   std::unique_ptr<Downstream> downstream_;
   IOControl ioctrl_;
   // The number of requests seen so far.
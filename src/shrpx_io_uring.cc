@@ -0,0 +1,525 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2026 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_io_uring.h"
+
+#include <sys/eventfd.h>
+#ifdef HAVE_UNISTD_H
+#  include <unistd.h>
+#endif // defined(HAVE_UNISTD_H)
+
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+#include "shrpx_log.h"
+
+using namespace nghttp2;
+
+namespace shrpx {
+
+namespace {
+// The buffer group ID of the provided buffer ring.
+constexpr uint16_t IO_URING_RECV_BGID = 0;
+} // namespace
+
+namespace {
+void eventfd_readcb(struct ev_loop *loop, ev_io *w, int revents) {
+  auto ring = static_cast<IOUring *>(w->data);
+
+  ring->process_cqes();
+}
+} // namespace
+
+namespace {
+void prepare_cb(struct ev_loop *loop, ev_prepare *w, int revents) {
+  auto ring = static_cast<IOUring *>(w->data);
+
+  ring->submit();
+}
+} // namespace
+
+IOUring::IOUring(struct ev_loop *loop)
+  : buf_ring_(nullptr), ring_{}, loop_(loop), efd_(-1), initialized_(false) {}
+
+IOUring::~IOUring() {
+  if (initialized_) {
+    ev_prepare_stop(loop_, &prep_);
+    ev_io_stop(loop_, &rev_);
+
+    if (buf_ring_) {
+      io_uring_free_buf_ring(&ring_, buf_ring_, IO_URING_RECV_BUFFER_COUNT,
+                             IO_URING_RECV_BGID);
+    }
+
+    io_uring_queue_exit(&ring_);
+  }
+
+  if (efd_ != -1) {
+    close(efd_);
+  }
+
+  dlist_delete_all(ops_);
+}
+
+std::expected<void, Error> IOUring::init(uint32_t entries) {
+  assert(!initialized_);
+
+  auto rv = io_uring_queue_init(entries, &ring_, 0);
+  if (rv < 0) {
+    Log{WARN} << "io_uring_queue_init() failed: " << strerror(-rv);
+    return std::unexpected{Error::SYSCALL};
+  }
+
+  efd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (efd_ == -1) {
+    auto error = errno;
+    Log{WARN} << "eventfd() failed: errno=" << error;
+
+    io_uring_queue_exit(&ring_);
+
+    return std::unexpected{Error::SYSCALL};
+  }
+
+  rv = io_uring_register_eventfd(&ring_, efd_);
+  if (rv < 0) {
+    Log{WARN} << "io_uring_register_eventfd() failed: " << strerror(-rv);
+
+    io_uring_queue_exit(&ring_);
+
+    return std::unexpected{Error::SYSCALL};
+  }
+
+  ev_io_init(&rev_, eventfd_readcb, efd_, EV_READ);
+  rev_.data = this;
+  ev_io_start(loop_, &rev_);
+
+  ev_prepare_init(&prep_, prepare_cb);
+  prep_.data = this;
+  ev_prepare_start(loop_, &prep_);
+
+  initialized_ = true;
+
+  int err;
+
+  // The provided buffer ring requires Linux 5.19 or later.
+  buf_ring_ = io_uring_setup_buf_ring(&ring_, IO_URING_RECV_BUFFER_COUNT,
+                                      IO_URING_RECV_BGID, 0, &err);
+  if (!buf_ring_) {
+    Log{WARN} << "io_uring_setup_buf_ring() failed: " << strerror(-err)
+              << "; receive data without io_uring";
+
+    return {};
+  }
+
+  recv_bufs_ = std::make_unique<uint8_t[]>(IO_URING_RECV_BUFFER_SIZE *
+                                           IO_URING_RECV_BUFFER_COUNT);
+
+  auto mask = io_uring_buf_ring_mask(IO_URING_RECV_BUFFER_COUNT);
+
+  for (uint16_t bid = 0; bid < IO_URING_RECV_BUFFER_COUNT; ++bid) {
+    io_uring_buf_ring_add(buf_ring_,
+                          recv_bufs_.get() + bid * IO_URING_RECV_BUFFER_SIZE,
+                          IO_URING_RECV_BUFFER_SIZE, bid, mask, bid);
+  }
+
+  io_uring_buf_ring_advance(buf_ring_, IO_URING_RECV_BUFFER_COUNT);
+
+  return {};
+}
+
+IOUringOp *IOUring::create_op(IOUringCb cb, void *data) {
+  auto op = new IOUringOp{
+    .cb = cb,
+    .data = data,
+  };
+
+  ops_.append(op);
+
+  return op;
+}
+
+void IOUring::delete_op(IOUringOp *op) {
+  if (!op->active) {
+    ops_.remove(op);
+    delete op;
+
+    return;
+  }
+
+  op->data = nullptr;
+
+  if (op->canceled) {
+    return;
+  }
+
+  op->canceled = true;
+
+  auto sqe = get_sqe();
+  if (!sqe) {
+    // The operation is canceled by io_uring_queue_exit() at the
+    // latest.
+    return;
+  }
+
+  io_uring_prep_cancel(sqe, op, 0);
+  io_uring_sqe_set_data(sqe, nullptr);
+}
+
+void IOUring::cancel_op(IOUringOp *op) {
+  if (!op->active) {
+    return;
+  }
+
+  auto sqe = get_sqe();
+  if (!sqe) {
+    return;
+  }
+
+  io_uring_prep_cancel(sqe, op, 0);
+  io_uring_sqe_set_data(sqe, nullptr);
+}
+
+std::expected<void, Error> IOUring::accept(IOUringOp *op, int fd) {
+  assert(!op->active);
+
+  auto sqe = get_sqe();
+  if (!sqe) {
+    return std::unexpected{Error::INTERNAL};
+  }
+
+  op->addrlen = sizeof(op->addr);
+
+  io_uring_prep_accept(sqe, fd, reinterpret_cast<sockaddr *>(&op->addr),
+                       &op->addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  io_uring_sqe_set_data(sqe, op);
+
+  op->active = true;
+
+  return {};
+}
+
+std::expected<void, Error> IOUring::recv_multishot(IOUringOp *op, int fd) {
+  assert(!op->active);
+  assert(buf_ring_);
+
+  auto sqe = get_sqe();
+  if (!sqe) {
+    return std::unexpected{Error::INTERNAL};
+  }
+
+  io_uring_prep_recv_multishot(sqe, fd, nullptr, 0, 0);
+  sqe->flags |= IOSQE_BUFFER_SELECT;
+  sqe->buf_group = IO_URING_RECV_BGID;
+  io_uring_sqe_set_data(sqe, op);
+
+  op->active = true;
+
+  return {};
+}
+
+std::span<const uint8_t> IOUring::get_recv_buffer(uint16_t bid,
+                                                  size_t len) const {
+  return {recv_bufs_.get() + bid * IO_URING_RECV_BUFFER_SIZE, len};
+}
+
+void IOUring::release_recv_buffer(uint16_t bid) {
+  io_uring_buf_ring_add(
+    buf_ring_, recv_bufs_.get() + bid * IO_URING_RECV_BUFFER_SIZE,
+    IO_URING_RECV_BUFFER_SIZE, bid,
+    io_uring_buf_ring_mask(IO_URING_RECV_BUFFER_COUNT), 0);
+  io_uring_buf_ring_advance(buf_ring_, 1);
+
+  auto recv = starved_recvs_.head;
+  if (!recv) {
+    return;
+  }
+
+  starved_recvs_.remove(recv);
+
+  recv->on_buffer_available();
+}
+
+void IOUring::add_starved_recv(IOUringRecv *recv) {
+  starved_recvs_.append(recv);
+}
+
+void IOUring::remove_starved_recv(IOUringRecv *recv) {
+  starved_recvs_.remove(recv);
+}
+
+io_uring_sqe *IOUring::get_sqe() {
+  auto sqe = io_uring_get_sqe(&ring_);
+  if (sqe) {
+    return sqe;
+  }
+
+  // Submission queue is full.  Flush it, and try again.
+  submit();
+
+  return io_uring_get_sqe(&ring_);
+}
+
+void IOUring::submit() {
+  if (io_uring_sq_ready(&ring_) == 0) {
+    return;
+  }
+
+  auto rv = io_uring_submit(&ring_);
+  if (rv < 0) {
+    Log{ERROR} << "io_uring_submit() failed: " << strerror(-rv);
+  }
+}
+
+void IOUring::process_cqes() {
+  uint64_t n;
+
+  // Reset eventfd counter.  The value itself is not important.
+  while (read(efd_, &n, sizeof(n)) == -1 && errno == EINTR)
+    ;
+
+  for (;;) {
+    io_uring_cqe *p;
+
+    if (io_uring_peek_cqe(&ring_, &p) != 0) {
+      return;
+    }
+
+    // Callback might submit new operation, or delete operation.
+    // Copy the completion and mark it seen first.
+    auto cqe = *p;
+    io_uring_cqe_seen(&ring_, p);
+
+    auto op = static_cast<IOUringOp *>(io_uring_cqe_get_data(&cqe));
+    if (!op) {
+      // Completion of cancel request.
+      continue;
+    }
+
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+      op->active = false;
+    }
+
+    if (op->canceled) {
+      // The buffer selected for the deleted operation is not read by
+      // anyone.
+      if (cqe.flags & IORING_CQE_F_BUFFER) {
+        release_recv_buffer(
+          static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+      }
+
+      // op->data is nullptr, and callback does not delete op.
+      op->cb(op, &cqe);
+
+      if (!op->active) {
+        ops_.remove(op);
+        delete op;
+      }
+
+      continue;
+    }
+
+    // This may delete op.
+    op->cb(op, &cqe);
+  }
+}
+
+namespace {
+void io_uring_recvcb(IOUringOp *op, const io_uring_cqe *cqe) {
+  auto recv = static_cast<IOUringRecv *>(op->data);
+  if (!recv) {
+    // IOUringRecv has gone.  IOUring has already given the buffer
+    // back.
+    return;
+  }
+
+  recv->on_cqe(cqe);
+}
+} // namespace
+
+IOUringRecv::IOUringRecv(IOUring *ring, struct ev_loop *loop, ev_io *rev,
+                         int fd)
+  : ring_(ring),
+    op_(ring->create_op(io_uring_recvcb, this)),
+    loop_(loop),
+    rev_(rev),
+    fd_(fd),
+    error_(0),
+    eof_(false),
+    starved_(false),
+    canceled_(false) {}
+
+IOUringRecv::~IOUringRecv() {
+  if (starved_) {
+    ring_->remove_starved_recv(this);
+  }
+
+  for (auto &buf : bufs_) {
+    ring_->release_recv_buffer(buf.bid);
+  }
+
+  ring_->delete_op(op_);
+}
+
+std::expected<void, Error> IOUringRecv::start() {
+  return ring_->recv_multishot(op_, fd_);
+}
+
+std::expected<std::span<uint8_t>, Error>
+IOUringRecv::read(std::span<uint8_t> data) {
+  size_t nread = 0;
+
+  while (nread < data.size() && !bufs_.empty()) {
+    auto &buf = bufs_.front();
+    auto src = ring_->get_recv_buffer(buf.bid, buf.len).subspan(buf.pos);
+    auto n = std::min(src.size(), data.size() - nread);
+
+    std::ranges::copy(src.first(n), std::ranges::begin(data) + nread);
+
+    nread += n;
+    buf.pos += static_cast<uint32_t>(n);
+
+    if (buf.pos == buf.len) {
+      auto bid = buf.bid;
+
+      bufs_.pop_front();
+
+      ring_->release_recv_buffer(bid);
+    }
+  }
+
+  restart();
+
+  if (nread) {
+    // Unlike level-triggered readiness of socket, nothing tells the
+    // application that data is still left.
+    if (!bufs_.empty()) {
+      signal_read();
+    }
+
+    return data.first(nread);
+  }
+
+  if (error_) {
+    return std::unexpected{Error::NETWORK};
+  }
+
+  if (eof_) {
+    return std::unexpected{Error::RECV_EOF};
+  }
+
+  return {};
+}
+
+bool IOUringRecv::pending() const {
+  return !bufs_.empty() || eof_ || error_;
+}
+
+void IOUringRecv::on_cqe(const io_uring_cqe *cqe) {
+  if (cqe->res > 0) {
+    assert(cqe->flags & IORING_CQE_F_BUFFER);
+
+    bufs_.push_back(Buffer{
+      .bid = static_cast<uint16_t>(cqe->flags >> IORING_CQE_BUFFER_SHIFT),
+      .pos = 0,
+      .len = static_cast<uint32_t>(cqe->res),
+    });
+
+    if (op_->active && !canceled_ &&
+        bufs_.size() >= IO_URING_RECV_MAX_BUFFERS) {
+      // The data which has already been received is still delivered
+      // to this object.
+      ring_->cancel_op(op_);
+      canceled_ = true;
+    }
+
+    // Multishot recv might be terminated without error, for example,
+    // if completion queue overflowed.
+    restart();
+
+    signal_read();
+
+    return;
+  }
+
+  if (cqe->res == 0) {
+    eof_ = true;
+
+    signal_read();
+
+    return;
+  }
+
+  switch (-cqe->res) {
+  case ENOBUFS:
+    starved_ = true;
+    ring_->add_starved_recv(this);
+
+    return;
+  case ECANCELED:
+    // Canceled because too many buffers were held.  They might have
+    // been read already.
+    restart();
+
+    return;
+  default:
+    error_ = -cqe->res;
+
+    signal_read();
+
+    return;
+  }
+}
+
+void IOUringRecv::on_buffer_available() {
+  starved_ = false;
+
+  restart();
+}
+
+void IOUringRecv::restart() {
+  if (op_->active || eof_ || error_ || starved_ ||
+      bufs_.size() >= IO_URING_RECV_MAX_BUFFERS) {
+    return;
+  }
+
+  canceled_ = false;
+
+  if (!start()) {
+    error_ = EIO;
+
+    signal_read();
+  }
+}
+
+void IOUringRecv::signal_read() {
+  // Like handling TLS pending data, the event is only fed while the
+  // application wants to read.  Otherwise, RateLimit::startw() feeds
+  // it later.
+  if (ev_is_active(rev_)) {
+    ev_feed_event(loop_, rev_, EV_READ);
+  }
+}
+
+} // namespace shrpx
@@ -0,0 +1,218 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2026 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef SHRPX_IO_URING_H
+#define SHRPX_IO_URING_H
+
+#include "shrpx.h"
+
+#include <sys/socket.h>
+
+#include <expected>
+#include <deque>
+#include <memory>
+#include <span>
+
+#include <liburing.h>
+
+#include <ev.h>
+
+#include "template.h"
+#include "errors.h"
+
+using namespace nghttp2;
+
+namespace shrpx {
+
+struct IOUringOp;
+class IOUringRecv;
+
+// IOUringCb is called for each completion of the operation |op|.  If
+// |op| is deleted by IOUring::delete_op() while it is in flight, the
+// remaining completions are still passed to this callback with
+// op->data == nullptr so that the resources produced by them (e.g.,
+// accepted socket) can be released.
+using IOUringCb = void (*)(IOUringOp *op, const io_uring_cqe *cqe);
+
+// IOUringOp is an operation submitted to IOUring.  Multishot
+// operation produces multiple completions from a single submission.
+struct IOUringOp {
+  IOUringCb cb;
+  void *data;
+  // The remote address of the socket accepted by IOUring::accept().
+  // It is owned by this object so that the kernel can write to it
+  // even after the operation is deleted.
+  sockaddr_storage addr;
+  socklen_t addrlen;
+  // true if the operation has been submitted, and its final
+  // completion has not arrived yet.
+  bool active;
+  // true if the operation has been canceled by
+  // IOUring::delete_op().  It is deleted when its final completion
+  // arrives.
+  bool canceled;
+  IOUringOp *dlnext, *dlprev;
+};
+
+// The size of a buffer in the provided buffer ring.
+constexpr size_t IO_URING_RECV_BUFFER_SIZE = 16_k;
+// The number of buffers in the provided buffer ring per worker.  It
+// must be a power of 2.
+constexpr uint16_t IO_URING_RECV_BUFFER_COUNT = 256;
+
+// IOUring is a per worker io_uring instance which is driven by the
+// libev event loop.  Submissions are batched, and passed to the
+// kernel once at the end of each event loop iteration.  Completions
+// are notified through eventfd which is watched by libev.
+class IOUring {
+public:
+  IOUring(struct ev_loop *loop);
+  ~IOUring();
+
+  // Initializes io_uring with |entries| submission queue entries.
+  // This function fails if io_uring is not available in the running
+  // kernel, or is prohibited.  If the provided buffer ring is not
+  // available, this function succeeds, but recv_available() returns
+  // false.
+  std::expected<void, Error> init(uint32_t entries);
+
+  // Creates new operation.  |cb| is called with |op| for each
+  // completion.  The returned object is owned by this object.
+  IOUringOp *create_op(IOUringCb cb, void *data);
+  // Cancels |op| if it is in flight, and deletes it.  The caller must
+  // not use |op| after this call.
+  void delete_op(IOUringOp *op);
+  // Cancels |op| if it is in flight.  Unlike delete_op(), the
+  // remaining completions are passed to the callback as usual.
+  void cancel_op(IOUringOp *op);
+
+  // Submits accept on the listening socket |fd|.  The accepted socket
+  // is non-blocking, and close-on-exec.  The remote address is
+  // written to op->addr.  |op| must not be in flight.
+  std::expected<void, Error> accept(IOUringOp *op, int fd);
+  // Submits multishot recv on the socket |fd|.  The data is received
+  // into a buffer selected from the provided buffer ring.  |op| must
+  // not be in flight.
+  std::expected<void, Error> recv_multishot(IOUringOp *op, int fd);
+
+  // Returns true if the provided buffer ring is available.
+  bool recv_available() const { return buf_ring_ != nullptr; }
+  // Returns the first |len| bytes of the buffer |bid|.
+  std::span<const uint8_t> get_recv_buffer(uint16_t bid, size_t len) const;
+  // Gives the buffer |bid| back to the provided buffer ring.
+  void release_recv_buffer(uint16_t bid);
+  // Makes |recv| restart multishot recv when a buffer is given back.
+  void add_starved_recv(IOUringRecv *recv);
+  void remove_starved_recv(IOUringRecv *recv);
+
+  // Passes queued submission queue entries to the kernel.
+  void submit();
+  // Processes completion queue entries.
+  void process_cqes();
+
+private:
+  io_uring_sqe *get_sqe();
+
+  DList<IOUringOp> ops_;
+  // IOUringRecv objects whose multishot recv was terminated because
+  // the provided buffer ring ran out of buffers.
+  DList<IOUringRecv> starved_recvs_;
+  std::unique_ptr<uint8_t[]> recv_bufs_;
+  io_uring_buf_ring *buf_ring_;
+  io_uring ring_;
+  ev_io rev_;
+  ev_prepare prep_;
+  struct ev_loop *loop_;
+  int efd_;
+  bool initialized_;
+};
+
+// The maximum number of received buffers which IOUringRecv holds.
+// If it is reached, multishot recv is canceled until the application
+// reads them, so that a connection which does not read cannot take
+// all buffers in the provided buffer ring.
+constexpr size_t IO_URING_RECV_MAX_BUFFERS = 8;
+
+// IOUringRecv receives data from a socket with multishot recv, and
+// keeps the received buffers until the application reads them.  When
+// new data or EOF arrives, it feeds EV_READ to |rev| if |rev| is
+// active.
+class IOUringRecv {
+public:
+  IOUringRecv(IOUring *ring, struct ev_loop *loop, ev_io *rev, int fd);
+  ~IOUringRecv();
+
+  // Starts multishot recv.
+  std::expected<void, Error> start();
+
+  // Copies the received data into |data|, and returns the portion of
+  // |data| filled.  It returns empty span if there is no data to
+  // read.  Error::RECV_EOF is returned if EOF has been received, and
+  // no data is left.  Error::NETWORK is returned in case of error.
+  std::expected<std::span<uint8_t>, Error> read(std::span<uint8_t> data);
+  // Returns true if read() has something to return.
+  bool pending() const;
+
+  // Handles the completion of multishot recv.
+  void on_cqe(const io_uring_cqe *cqe);
+  // Restarts multishot recv after the provided buffer ring ran out of
+  // buffers.
+  void on_buffer_available();
+
+  IOUringRecv *dlnext{}, *dlprev{};
+
+private:
+  struct Buffer {
+    uint16_t bid;
+    uint32_t pos;
+    uint32_t len;
+  };
+
+  // Starts multishot recv again if it has been terminated, and more
+  // buffers can be held.
+  void restart();
+  // Feeds EV_READ to rev_ if it is active.
+  void signal_read();
+
+  std::deque<Buffer> bufs_;
+  IOUring *ring_;
+  IOUringOp *op_;
+  struct ev_loop *loop_;
+  ev_io *rev_;
+  int fd_;
+  // errno received from multishot recv.  It is 0 if no error has
+  // occurred.
+  int error_;
+  bool eof_;
+  // true if this object is in the list of starved receivers of
+  // ring_.
+  bool starved_;
+  // true if multishot recv has been canceled because too many
+  // buffers are held.
+  bool canceled_;
+};
+
+} // namespace shrpx
+
+#endif // !defined(SHRPX_IO_URING_H)
@@ -184,6 +184,9 @@ std::expected<void, Error> LiveCheck::initiate_connection() {
     return std::unexpected{Error::INTERNAL};
   }
 
+  // fall and rise are rejected for a HTTP/3 backend.
+  assert(addr_->proto != Proto::HTTP3);
+
   if (!dns_query_ && addr_->tls) {
     assert(ssl_ctx_);
 
@@ -659,6 +662,18 @@ void LiveCheck::on_success() {
   disconnect();
 }
 
+void LiveCheck::set_downstream_addr(DownstreamAddr *addr) {
+  if (raddr_ == &addr_->addr) {
+    raddr_ = &addr->addr;
+  }
+
+  if (conn_.tls.client_session_cache == &addr_->tls_session_cache) {
+    conn_.tls.client_session_cache = &addr->tls_session_cache;
+  }
+
+  addr_ = addr;
+}
+
 void LiveCheck::start_settings_timer() {
   auto &downstreamconf = get_config()->http2.downstream;
 
@@ -64,6 +64,11 @@ public:
   void on_success();
   void on_failure();
 
+  // Makes this object check |addr| instead.  |addr| must have the
+  // same backend address as the current one.  This is used to carry
+  // over this object to the new configuration.
+  void set_downstream_addr(DownstreamAddr *addr);
+
   std::expected<void, Error> initiate_connection();
 
   // Schedules next connection attempt
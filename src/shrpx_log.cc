@@ -308,6 +308,22 @@ std::span<char> copy(T n, std::span<char> dest) {
 }
 } // namespace
 
+namespace {
+// Writes |d| in seconds with millisecond resolution.
+std::span<char> copy_seconds(std::chrono::steady_clock::duration d,
+                             std::span<char> dest) {
+  auto t = std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+  dest = copy(as_unsigned(t / 1000), dest);
+  dest = copy('.', dest);
+  auto frac = t % 1000;
+  if (frac < 100) {
+    auto n = static_cast<size_t>(frac < 10 ? 2 : 1);
+    dest = copy(std::string_view{"000", n}, dest);
+  }
+  return copy(as_unsigned(frac), dest);
+}
+} // namespace
+
 // true means that character must be escaped as "\xNN", where NN is
 // ascii code of the character in hex notation.
 constexpr auto ESCAPE_TBL = [] {
@@ -501,20 +517,13 @@ void upstream_accesslog(const std::vector<LogFragment> &lfv,
     case LogFragmentType::SERVER_PORT:
       p = copy(lgsp.server_port, p);
       break;
-    case LogFragmentType::REQUEST_TIME: {
-      auto t = std::chrono::duration_cast<std::chrono::milliseconds>(
-                 lgsp.request_end_time - downstream->get_request_start_time())
-                 .count();
-      p = copy(as_unsigned(t / 1000), p);
-      p = copy('.', p);
-      auto frac = t % 1000;
-      if (frac < 100) {
-        auto n = static_cast<size_t>(frac < 10 ? 2 : 1);
-        p = copy(std::string_view{"000", n}, p);
-      }
-      p = copy(as_unsigned(frac), p);
+    case LogFragmentType::REQUEST_TIME:
+      p = copy_seconds(
+        lgsp.request_end_time - downstream->get_request_start_time(), p);
+      break;
+    case LogFragmentType::DNS_TIME:
+      p = copy_seconds(downstream->get_dns_wait_time(), p);
       break;
-    }
     case LogFragmentType::PID:
       p = copy(as_unsigned(lgsp.pid), p);
       break;
@@ -60,6 +60,7 @@ class ClientHandler;
 class Upstream;
 class DownstreamConnection;
 class Http2Session;
+class Http3Session;
 class MemcachedConnection;
 
 enum SeverityLevel { INFO, NOTICE, WARN, ERROR, FATAL };
@@ -106,6 +107,11 @@ public:
     : Log{severity, loc} {
     *this << "[DHTTP2:" << obj << "] ";
   }
+  Log(SeverityLevel severity, const Http3Session *obj,
+      const std::source_location loc = std::source_location::current())
+    : Log{severity, loc} {
+    *this << "[DHTTP3:" << obj << "] ";
+  }
   Log(SeverityLevel severity, const MemcachedConnection *obj,
       const std::source_location loc = std::source_location::current())
     : Log{severity, loc} {
@@ -311,6 +317,7 @@ enum class LogFragmentType {
   PATH,
   PATH_WITHOUT_QUERY,
   PROTOCOL_VERSION,
+  DNS_TIME,
 };
 
 struct LogFragment {
@@ -31,6 +31,9 @@
 #include "shrpx_config.h"
 #include "shrpx_mruby_module.h"
 #include "shrpx_downstream_connection.h"
+#include "shrpx_upstream.h"
+#include "shrpx_client_handler.h"
+#include "shrpx_worker.h"
 #include "shrpx_log.h"
 
 namespace shrpx {
@@ -83,9 +86,14 @@ std::expected<void, Error> MRubyContext::run_app(Downstream *downstream,
 
   auto ud_d = defer([mrb = mrb_] { mrb->ud = nullptr; });
 
+  auto worker = downstream->get_upstream()->get_client_handler()->get_worker();
+  auto t = ev_time();
+
   auto res = mrb_funcall(mrb_, app_, method, 1, env_);
   (void)res;
 
+  worker->add_loop_time(LoopCategory::MRUBY, ev_time() - t);
+
   if (mrb_->exc) {
     auto exc = mrb_obj_value(mrb_->exc);
     auto inspect = mrb_inspect(mrb_, exc);
@@ -77,31 +77,23 @@ std::expected<void, Error> quic_send_packet(const UpstreamAddr *faddr,
   return {};
 }
 
-int quic_send_packet(const UpstreamAddr *faddr, const sockaddr *remote_sa,
-                     socklen_t remote_salen, const sockaddr *local_sa,
-                     socklen_t local_salen, const ngtcp2_pkt_info &pi,
-                     std::span<const uint8_t> data, size_t gso_size) {
-  assert(gso_size);
-
-  iovec msg_iov = {
-    .iov_base = const_cast<uint8_t *>(data.data()),
-    .iov_len = data.size(),
-  };
-
-  uint8_t msg_ctrl[CMSG_SPACE(sizeof(int)) +
+namespace {
+constexpr size_t QUIC_MSG_CTRLLEN = CMSG_SPACE(sizeof(int)) +
 #ifdef UDP_SEGMENT
-                   CMSG_SPACE(sizeof(uint16_t)) +
+                                    CMSG_SPACE(sizeof(uint16_t)) +
 #endif // defined(UDP_SEGMENT)
-                   CMSG_SPACE(sizeof(in6_pktinfo))]{};
-
-  msghdr msg{
-    .msg_name = const_cast<sockaddr *>(remote_sa),
-    .msg_namelen = remote_salen,
-    .msg_iov = &msg_iov,
-    .msg_iovlen = 1,
-    .msg_control = msg_ctrl,
-    .msg_controllen = sizeof(msg_ctrl),
-  };
+                                    CMSG_SPACE(sizeof(in6_pktinfo));
+} // namespace
+
+namespace {
+// set_msg_control writes the ancillary data to send |datalen| bytes
+// of UDP payload from |local_sa| to msg.msg_control, and sets
+// msg.msg_controllen.  msg.msg_control must point to the zero filled
+// buffer of at least QUIC_MSG_CTRLLEN bytes.
+void set_msg_control(msghdr &msg, const sockaddr *local_sa,
+                     const ngtcp2_pkt_info &pi, size_t datalen,
+                     size_t gso_size) {
+  msg.msg_controllen = QUIC_MSG_CTRLLEN;
 
   size_t controllen = 0;
 
@@ -141,7 +133,7 @@ int quic_send_packet(const UpstreamAddr *faddr, const sockaddr *remote_sa,
   }
 
 #ifdef UDP_SEGMENT
-  if (data.size() > gso_size) {
+  if (datalen > gso_size) {
     controllen += CMSG_SPACE(sizeof(uint16_t));
     cm = CMSG_NXTHDR(&msg, cm);
     cm->cmsg_level = SOL_UDP;
@@ -180,6 +172,31 @@ int quic_send_packet(const UpstreamAddr *faddr, const sockaddr *remote_sa,
     static_cast<socklen_t>(controllen)
 #endif // defined(__APPLE__)
     ;
+}
+} // namespace
+
+int quic_send_packet(const UpstreamAddr *faddr, const sockaddr *remote_sa,
+                     socklen_t remote_salen, const sockaddr *local_sa,
+                     socklen_t local_salen, const ngtcp2_pkt_info &pi,
+                     std::span<const uint8_t> data, size_t gso_size) {
+  assert(gso_size);
+
+  iovec msg_iov = {
+    .iov_base = const_cast<uint8_t *>(data.data()),
+    .iov_len = data.size(),
+  };
+
+  uint8_t msg_ctrl[QUIC_MSG_CTRLLEN]{};
+
+  msghdr msg{
+    .msg_name = const_cast<sockaddr *>(remote_sa),
+    .msg_namelen = remote_salen,
+    .msg_iov = &msg_iov,
+    .msg_iovlen = 1,
+    .msg_control = msg_ctrl,
+  };
+
+  set_msg_control(msg, local_sa, pi, data.size(), gso_size);
 
   ssize_t nwrite;
 
@@ -209,6 +226,203 @@ int quic_send_packet(const UpstreamAddr *faddr, const sockaddr *remote_sa,
   return 0;
 }
 
+#ifdef HAVE_SENDMMSG
+namespace {
+// QUIC_SEND_BATCH is the maximum number of datagrams that a single
+// sendmmsg(2) call sends.
+constexpr size_t QUIC_SEND_BATCH = 64;
+// QUIC_SEND_QUEUE_MAX_BYTES is the maximum number of bytes that
+// QUICSendQueue buffers.  Datagrams beyond this limit are pushed
+// back to the connection which produced them.
+constexpr size_t QUIC_SEND_QUEUE_MAX_BYTES = 16_m;
+} // namespace
+
+namespace {
+void sendq_prepcb(struct ev_loop *loop, ev_prepare *w, int revents) {
+  auto sendq = static_cast<QUICSendQueue *>(w->data);
+
+  sendq->flush();
+}
+} // namespace
+
+namespace {
+void sendq_writecb(struct ev_loop *loop, ev_io *w, int revents) {
+  auto sendq = static_cast<QUICSendQueue *>(w->data);
+
+  sendq->flush();
+}
+} // namespace
+
+QUICSendQueue::QUICSendQueue(struct ev_loop *loop) : loop_{loop} {
+  ev_prepare_init(&prep_, sendq_prepcb);
+  prep_.data = this;
+
+  ev_io_init(&wev_, sendq_writecb, -1, EV_WRITE);
+  wev_.data = this;
+}
+
+QUICSendQueue::~QUICSendQueue() {
+  ev_prepare_stop(loop_, &prep_);
+  ev_io_stop(loop_, &wev_);
+}
+
+bool QUICSendQueue::add(const UpstreamAddr *faddr, const sockaddr *remote_sa,
+                        const sockaddr *local_sa, const ngtcp2_pkt_info &pi,
+                        std::span<const uint8_t> data, size_t gso_size) {
+  assert(gso_size);
+
+  if (blocked()) {
+    return false;
+  }
+
+  if (buf_.size() + data.size() > QUIC_SEND_QUEUE_MAX_BYTES) {
+    if (log_enabled(INFO)) {
+      Log{INFO} << "QUIC send queue is full; push back " << data.size()
+                << " bytes";
+    }
+
+    return false;
+  }
+
+  entries_.emplace_back(Entry{
+    .faddr = faddr,
+    .remote_addr = Address{remote_sa},
+    .local_addr = Address{local_sa},
+    .pi = pi,
+    .offset = buf_.size(),
+    .datalen = data.size(),
+    .gso_size = gso_size,
+  });
+
+  buf_.insert(std::ranges::end(buf_), std::ranges::begin(data),
+              std::ranges::end(data));
+
+  if (entries_.size() - head_ >= QUIC_SEND_BATCH) {
+    flush();
+
+    return true;
+  }
+
+  ev_prepare_start(loop_, &prep_);
+
+  return true;
+}
+
+bool QUICSendQueue::blocked() const { return ev_is_active(&wev_); }
+
+void QUICSendQueue::flush() {
+  ev_prepare_stop(loop_, &prep_);
+  ev_io_stop(loop_, &wev_);
+
+  std::array<mmsghdr, QUIC_SEND_BATCH> msgs;
+  std::array<iovec, QUIC_SEND_BATCH> iovs;
+  std::array<std::array<uint8_t, QUIC_MSG_CTRLLEN>, QUIC_SEND_BATCH> ctrls;
+
+  while (head_ < entries_.size()) {
+    // sendmmsg sends messages through a single socket.  Collect the
+    // consecutive entries which share the same socket.
+    auto fd = entries_[head_].faddr->fd;
+    auto idx = head_;
+    auto offset = head_offset_;
+    size_t nmsgs = 0;
+
+    for (; nmsgs < msgs.size() && idx < entries_.size() &&
+           entries_[idx].faddr->fd == fd;
+         ++nmsgs) {
+      auto &ent = entries_[idx];
+      auto datalen = ent.datalen - offset;
+      if (no_gso_) {
+        datalen = std::min(datalen, ent.gso_size);
+      }
+
+      auto &iov = iovs[nmsgs];
+      iov.iov_base = buf_.data() + ent.offset + offset;
+      iov.iov_len = datalen;
+
+      auto &ctrl = ctrls[nmsgs];
+      std::ranges::fill(ctrl, 0);
+
+      auto &msg = msgs[nmsgs];
+      msg.msg_hdr = msghdr{
+        .msg_name = const_cast<sockaddr *>(ent.remote_addr.as_sockaddr()),
+        .msg_namelen = ent.remote_addr.size(),
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = ctrl.data(),
+      };
+      msg.msg_len = 0;
+
+      set_msg_control(msg.msg_hdr, ent.local_addr.as_sockaddr(), ent.pi,
+                      datalen, ent.gso_size);
+
+      offset += datalen;
+      if (offset == ent.datalen) {
+        ++idx;
+        offset = 0;
+      }
+    }
+
+    int nsent;
+
+    do {
+      nsent = sendmmsg(fd, msgs.data(), static_cast<unsigned int>(nmsgs), 0);
+    } while (nsent == -1 && errno == EINTR);
+
+    if (nsent == -1) {
+      auto error = errno;
+
+      switch (error) {
+      case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+      case EWOULDBLOCK:
+#endif // EAGAIN != EWOULDBLOCK
+        ev_io_set(&wev_, fd, EV_WRITE);
+        ev_io_start(loop_, &wev_);
+
+        return;
+      case EIO:
+        if (!no_gso_) {
+          // The kernel does not support UDP_SEGMENT.  Resend the
+          // entries as individual datagrams.
+          no_gso_ = true;
+
+          continue;
+        }
+
+        break;
+      }
+
+      if (log_enabled(INFO)) {
+        Log{INFO} << "sendmmsg failed: errno=" << error;
+      }
+
+      // In case of errors other than EAGAIN, let the packet lost.
+      ++head_;
+      head_offset_ = 0;
+
+      continue;
+    }
+
+    if (log_enabled(INFO)) {
+      Log{INFO} << "QUIC sent " << nsent << " message(s) in a batch";
+    }
+
+    for (size_t i = 0; i < static_cast<size_t>(nsent); ++i) {
+      head_offset_ += iovs[i].iov_len;
+      if (head_offset_ == entries_[head_].datalen) {
+        ++head_;
+        head_offset_ = 0;
+      }
+    }
+  }
+
+  entries_.clear();
+  buf_.clear();
+  head_ = 0;
+  head_offset_ = 0;
+}
+#endif // defined(HAVE_SENDMMSG)
+
 std::expected<void, Error>
 generate_quic_retry_connection_id(ngtcp2_cid &cid, uint32_t server_id,
                                   uint8_t km_id, EVP_CIPHER_CTX *ctx) {
@@ -32,6 +32,9 @@
 #include <functional>
 #include <span>
 #include <expected>
+#include <vector>
+
+#include <ev.h>
 
 #include "ssl_compat.h"
 
@@ -124,6 +127,64 @@ int quic_send_packet(const UpstreamAddr *faddr, const sockaddr *remote_sa,
                      socklen_t local_salen, const ngtcp2_pkt_info &pi,
                      std::span<const uint8_t> data, size_t gso_size);
 
+#ifdef HAVE_SENDMMSG
+// QUICSendQueue collects UDP datagrams produced by all QUIC
+// connections of a worker during a single event loop iteration, and
+// sends them with sendmmsg(2) right before the event loop blocks for
+// I/O.  Each queued entry keeps its own GSO segment size, so that a
+// batch of datagrams to a single destination still goes out as one
+// message.
+class QUICSendQueue {
+public:
+  QUICSendQueue(struct ev_loop *loop);
+  ~QUICSendQueue();
+  // add queues |data| which is sent to |remote_sa| from |local_sa|
+  // via |faddr|.  |data| is copied.  If the kernel does not accept
+  // UDP_SEGMENT, |data| is sent as individual |gso_size| datagrams.
+  // This function returns false without queueing |data| if the queue
+  // is waiting for the socket to become writable, or it is full.  In
+  // that case, the caller must stop writing, and retry when the
+  // socket becomes writable.
+  [[nodiscard]] bool add(const UpstreamAddr *faddr, const sockaddr *remote_sa,
+           const sockaddr *local_sa, const ngtcp2_pkt_info &pi,
+           std::span<const uint8_t> data, size_t gso_size);
+  // flush sends queued datagrams until the queue becomes empty or
+  // socket buffer is full.  In the latter case, it resumes when the
+  // socket becomes writable.
+  void flush();
+  // blocked returns true if flush is waiting for the socket to
+  // become writable.
+  [[nodiscard]] bool blocked() const;
+
+private:
+  struct Entry {
+    const UpstreamAddr *faddr;
+    Address remote_addr;
+    Address local_addr;
+    ngtcp2_pkt_info pi;
+    // offset is the offset of the payload in buf_.
+    size_t offset;
+    size_t datalen;
+    size_t gso_size;
+  };
+
+  std::vector<Entry> entries_;
+  // buf_ stores the payload of entries_.
+  std::vector<uint8_t> buf_;
+  // head_ is the index of the first entry in entries_ which is not
+  // sent yet, and head_offset_ is the number of bytes of the entry
+  // which have already been sent.  head_offset_ is only non-zero if
+  // no_gso_ is true.
+  size_t head_{};
+  size_t head_offset_{};
+  ev_prepare prep_;
+  ev_io wev_;
+  struct ev_loop *loop_;
+  // no_gso_ is true if UDP_SEGMENT is not usable.
+  bool no_gso_{};
+};
+#endif // defined(HAVE_SENDMMSG)
+
 std::expected<void, Error>
 generate_quic_retry_connection_id(ngtcp2_cid &cid, uint32_t server_id,
                                   uint8_t km_id, EVP_CIPHER_CTX *ctx);
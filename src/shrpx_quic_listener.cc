@@ -29,6 +29,64 @@
 
 namespace shrpx {
 
+namespace {
+// The maximum number of packets processed in a single on_read call.
+constexpr size_t MAX_RECV_PKTCNT = 64;
+} // namespace
+
+namespace {
+#ifdef HAVE_RECVMMSG
+// The maximum number of datagrams received by a single recvmmsg call.
+constexpr size_t MAX_RECV_BATCH = 8;
+#else  // !defined(HAVE_RECVMMSG)
+constexpr size_t MAX_RECV_BATCH = 1;
+#endif // !defined(HAVE_RECVMMSG)
+} // namespace
+
+#ifndef HAVE_RECVMMSG
+namespace {
+struct mmsghdr {
+  msghdr msg_hdr;
+};
+} // namespace
+#endif // !defined(HAVE_RECVMMSG)
+
+// QUICRecvBatch is a set of buffers to receive datagrams.  Each
+// buffer is large enough to hold a datagram coalesced by UDP GRO.
+struct QUICRecvBatch {
+  QUICRecvBatch();
+
+  struct Entry {
+    std::array<uint8_t, 64_k> buf;
+    sockaddr_storage ss;
+    uint8_t msg_ctrl[CMSG_SPACE(sizeof(int)) +
+                     CMSG_SPACE(sizeof(in6_pktinfo)) +
+                     CMSG_SPACE(sizeof(int))];
+    iovec iov;
+  };
+
+  std::array<Entry, MAX_RECV_BATCH> ents;
+  std::array<mmsghdr, MAX_RECV_BATCH> msgs;
+};
+
+QUICRecvBatch::QUICRecvBatch() {
+  for (size_t i = 0; i < MAX_RECV_BATCH; ++i) {
+    auto &ent = ents[i];
+
+    ent.iov = {
+      .iov_base = ent.buf.data(),
+      .iov_len = ent.buf.size(),
+    };
+
+    msgs[i].msg_hdr = {
+      .msg_name = &ent.ss,
+      .msg_iov = &ent.iov,
+      .msg_iovlen = 1,
+      .msg_control = ent.msg_ctrl,
+    };
+  }
+}
+
 namespace {
 void readcb(struct ev_loop *loop, ev_io *w, int revent) {
   auto l = static_cast<QUICListener *>(w->data);
@@ -37,7 +95,9 @@ void readcb(struct ev_loop *loop, ev_io *w, int revent) {
 } // namespace
 
 QUICListener::QUICListener(const UpstreamAddr *faddr, Worker *worker)
-  : faddr_{faddr}, worker_{worker} {
+  : faddr_{faddr},
+    worker_{worker},
+    rx_{std::make_unique<QUICRecvBatch>()} {
   ev_io_init(&rev_, readcb, faddr_->fd, EV_READ);
   ev_set_priority(&rev_, EV_MAXPRI);
   rev_.data = this;
@@ -50,101 +110,103 @@ QUICListener::~QUICListener() {
 }
 
 void QUICListener::on_read() {
-  Address remote_addr;
-  std::array<uint8_t, 64_k> buf;
-  size_t pktcnt = 0;
-  iovec msg_iov{
-    .iov_base = buf.data(),
-    .iov_len = buf.size(),
-  };
-
-  uint8_t msg_ctrl[CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(in6_pktinfo)) +
-                   CMSG_SPACE(sizeof(int))];
+  auto &msgs = rx_->msgs;
 
-  sockaddr_storage ss;
+  for (size_t pktcnt = 0; pktcnt < MAX_RECV_PKTCNT;) {
+    for (size_t i = 0; i < msgs.size(); ++i) {
+      auto &msg = msgs[i].msg_hdr;
 
-  msghdr msg{
-    .msg_name = &ss,
-    .msg_iov = &msg_iov,
-    .msg_iovlen = 1,
-    .msg_control = msg_ctrl,
-  };
-
-  auto quic_conn_handler = worker_->get_quic_connection_handler();
+      msg.msg_namelen = sizeof(rx_->ents[i].ss);
+      msg.msg_controllen = sizeof(rx_->ents[i].msg_ctrl);
+    }
 
-  for (; pktcnt < 64;) {
-    msg.msg_namelen = sizeof(ss);
-    msg.msg_controllen = sizeof(msg_ctrl);
+#ifdef HAVE_RECVMMSG
+    auto nmsgs = recvmmsg(faddr_->fd, msgs.data(),
+                          static_cast<unsigned int>(msgs.size()),
+                          MSG_WAITFORONE, nullptr);
+    if (nmsgs == -1) {
+      return;
+    }
 
-    auto nread = recvmsg(faddr_->fd, &msg, 0);
+    for (size_t i = 0; i < static_cast<size_t>(nmsgs); ++i) {
+      pktcnt += handle_msg(msgs[i].msg_hdr, msgs[i].msg_len);
+    }
+#else  // !defined(HAVE_RECVMMSG)
+    auto nread = recvmsg(faddr_->fd, &msgs[0].msg_hdr, 0);
     if (nread == -1) {
       return;
     }
 
-    // Packets less than 21 bytes never be a valid QUIC packet.
-    if (nread < 21) {
-      ++pktcnt;
-
-      continue;
-    }
+    pktcnt += handle_msg(msgs[0].msg_hdr, static_cast<size_t>(nread));
+#endif // !defined(HAVE_RECVMMSG)
+  }
+}
 
-    remote_addr.set(reinterpret_cast<const sockaddr *>(&ss));
+size_t QUICListener::handle_msg(msghdr &msg, size_t nread) {
+  // Packets less than 21 bytes never be a valid QUIC packet.
+  if (nread < 21) {
+    return 1;
+  }
 
-    if (util::quic_prohibited_port(remote_addr.port())) {
-      ++pktcnt;
+  auto &ss = *static_cast<sockaddr_storage *>(msg.msg_name);
 
-      continue;
-    }
+  Address remote_addr;
+  remote_addr.set(reinterpret_cast<const sockaddr *>(&ss));
 
-    auto maybe_local_addr = util::msghdr_get_local_addr(&msg, ss.ss_family);
-    if (!maybe_local_addr) {
-      ++pktcnt;
+  if (util::quic_prohibited_port(remote_addr.port())) {
+    return 1;
+  }
 
-      continue;
-    }
+  auto maybe_local_addr = util::msghdr_get_local_addr(&msg, ss.ss_family);
+  if (!maybe_local_addr) {
+    return 1;
+  }
 
-    auto &local_addr = *maybe_local_addr;
+  auto &local_addr = *maybe_local_addr;
 
-    local_addr.port(faddr_->port);
+  local_addr.port(faddr_->port);
 
-    ngtcp2_pkt_info pi{
-      .ecn = util::msghdr_get_ecn(&msg, ss.ss_family),
-    };
+  ngtcp2_pkt_info pi{
+    .ecn = util::msghdr_get_ecn(&msg, ss.ss_family),
+  };
 
-    auto gso_size = util::msghdr_get_udp_gro(&msg);
-    if (gso_size == 0) {
-      gso_size = static_cast<size_t>(nread);
-    }
+  auto gso_size = util::msghdr_get_udp_gro(&msg);
+  if (gso_size == 0) {
+    gso_size = nread;
+  }
 
-    auto data = std::span{buf}.first(as_unsigned(nread));
+  auto data = std::span{static_cast<uint8_t *>(msg.msg_iov->iov_base), nread};
+  auto quic_conn_handler = worker_->get_quic_connection_handler();
+  size_t pktcnt = 0;
 
-    for (;;) {
-      auto datalen = std::min(data.size(), gso_size);
+  for (;;) {
+    auto datalen = std::min(data.size(), gso_size);
 
-      ++pktcnt;
+    ++pktcnt;
 
-      if (log_enabled(INFO)) {
-        Log{INFO} << "QUIC received packet: local="
-                  << util::to_numeric_addr(&local_addr)
-                  << " remote=" << util::to_numeric_addr(&remote_addr)
-                  << " ecn=" << log::hex << pi.ecn << log::dec << " " << datalen
-                  << " bytes";
-      }
+    if (log_enabled(INFO)) {
+      Log{INFO} << "QUIC received packet: local="
+                << util::to_numeric_addr(&local_addr)
+                << " remote=" << util::to_numeric_addr(&remote_addr)
+                << " ecn=" << log::hex << pi.ecn << log::dec << " " << datalen
+                << " bytes";
+    }
 
-      // Packets less than 21 bytes never be a valid QUIC packet.
-      if (datalen < 21) {
-        break;
-      }
+    // Packets less than 21 bytes never be a valid QUIC packet.
+    if (datalen < 21) {
+      break;
+    }
 
-      quic_conn_handler->handle_packet(faddr_, remote_addr, local_addr, pi,
-                                       data.first(datalen));
+    quic_conn_handler->handle_packet(faddr_, remote_addr, local_addr, pi,
+                                     data.first(datalen));
 
-      data = data.subspan(datalen);
-      if (data.empty()) {
-        break;
-      }
+    data = data.subspan(datalen);
+    if (data.empty()) {
+      break;
     }
   }
+
+  return pktcnt;
 }
 
 } // namespace shrpx
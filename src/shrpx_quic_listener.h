@@ -27,12 +27,15 @@
 
 #include "shrpx.h"
 
+#include <memory>
+
 #include <ev.h>
 
 namespace shrpx {
 
 struct UpstreamAddr;
 class Worker;
+struct QUICRecvBatch;
 
 class QUICListener {
 public:
@@ -41,8 +44,14 @@ public:
   void on_read();
 
 private:
+  // Processes a datagram of |nread| bytes received with |msg|.  A
+  // datagram may contain several packets coalesced by UDP GRO.  It
+  // returns the number of packets processed.
+  size_t handle_msg(msghdr &msg, size_t nread);
+
   const UpstreamAddr *faddr_;
   Worker *worker_;
+  std::unique_ptr<QUICRecvBatch> rx_;
   ev_io rev_;
 };
 
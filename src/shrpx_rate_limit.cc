@@ -27,6 +27,9 @@
 #include <limits>
 
 #include "shrpx_connection.h"
+#ifdef HAVE_LIBURING
+#  include "shrpx_io_uring.h"
+#endif // defined(HAVE_LIBURING)
 #include "shrpx_log.h"
 
 namespace shrpx {
@@ -102,6 +105,15 @@ void RateLimit::stopw() {
 }
 
 void RateLimit::handle_tls_pending_read() {
+#ifdef HAVE_LIBURING
+  // io_uring might have received data while the watcher was stopped.
+  if (conn_ && conn_->io_uring_recv && conn_->io_uring_recv->pending()) {
+    ev_feed_event(loop_, w_, EV_READ);
+
+    return;
+  }
+#endif // defined(HAVE_LIBURING)
+
   if (!conn_ || !conn_->tls.ssl ||
       (SSL_pending(conn_->tls.ssl) == 0 &&
        (!conn_->tls.initial_handshake_done ||
@@ -54,9 +54,10 @@ public:
   void regen();
   void startw();
   void stopw();
-  // Feeds event if conn_->tls object has unread bytes.  This is
-  // required since it is buffered in conn_->tls object, io event is
-  // not generated unless new incoming data is received.
+  // Feeds event if conn_->tls object has unread bytes, or io_uring
+  // has received data for conn_.  This is required since it is
+  // buffered in conn_->tls object or io_uring, io event is not
+  // generated unless new incoming data is received.
   void handle_tls_pending_read();
 
 private:
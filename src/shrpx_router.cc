@@ -25,97 +25,193 @@
 #include "shrpx_router.h"
 
 #include <algorithm>
+#include <bit>
+#include <cstring>
+#include <limits>
 #include <print>
 
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif // defined(__SSE2__)
+
 #include "shrpx_config.h"
 #include "shrpx_log.h"
 
 namespace shrpx {
 
-RNode::RNode(std::string_view s, ssize_t index, ssize_t wildcard_index)
-  : s(s), index(index), wildcard_index(wildcard_index) {}
-
-Router::~Router() {}
-
 namespace {
-char first_byte(const std::unique_ptr<RNode> &node) { return node->s[0]; }
+// Router::next_bytes_ has this number of bytes after the last
+// element so that find_byte can always read 16 bytes.
+constexpr size_t NEXT_BYTES_PADDING = 16;
 } // namespace
 
 namespace {
-RNode *find_next_node(const RNode *node, char c) {
-  auto itr = std::ranges::lower_bound(node->next, c, {}, first_byte);
-  if (itr == std::ranges::end(node->next) || (*itr)->s[0] != c) {
-    return nullptr;
+// Returns the position of the first occurrence of |c| in [|p|, |p| +
+// |len|).  If |c| is not found, returns |len|.  If __SSE2__ is
+// defined, it reads 16 bytes at a time, and might read up to 15
+// bytes past |p| + |len|.
+size_t find_byte(const char *p, size_t len, char c) {
+#ifdef __SSE2__
+  auto v = _mm_set1_epi8(c);
+
+  for (size_t i = 0; i < len; i += 16) {
+    auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+    auto m = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, v)));
+    if (m) {
+      return std::min(i + static_cast<size_t>(std::countr_zero(m)), len);
+    }
   }
 
-  return (*itr).get();
+  return len;
+#else  // !defined(__SSE2__)
+  return static_cast<size_t>(std::ranges::find(p, p + len, c) - p);
+#endif // !defined(__SSE2__)
 }
 } // namespace
 
 namespace {
-void add_next_node(RNode *node, std::unique_ptr<RNode> new_node) {
-  auto itr =
-    std::ranges::lower_bound(node->next, new_node->s[0], {}, first_byte);
-  node->next.insert(itr, std::move(new_node));
+// Returns true if [|a|, |a| + |n|) equals [|b|, |b| + |n|).
+bool label_equal(const char *a, const char *b, size_t n) {
+#ifdef __SSE2__
+  for (; n >= 16; a += 16, b += 16, n -= 16) {
+    auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a));
+    auto y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xffff) {
+      return false;
+    }
+  }
+#endif // defined(__SSE2__)
+
+  return memcmp(a, b, n) == 0;
 }
 } // namespace
 
-void Router::add_node(RNode *node, std::string_view pattern, ssize_t index,
-                      ssize_t wildcard_index) {
-  auto pat = make_string_ref(balloc_, pattern);
-  auto new_node = std::make_unique<RNode>(pat, index, wildcard_index);
-  add_next_node(node, std::move(new_node));
+Router::Router() : nodes_(1), next_bytes_(NEXT_BYTES_PADDING) {}
+
+Router::~Router() {}
+
+const RNode *Router::find_next_node(const RNode &node, char c) const {
+  auto i = find_byte(next_bytes_.data() + node.next_offset, node.next_len, c);
+  if (i == node.next_len) {
+    return nullptr;
+  }
+
+  return &nodes_[next_[node.next_offset + i]];
+}
+
+void Router::add_next_node(uint32_t node, uint32_t next_node) {
+  auto c = labels_[nodes_[next_node].label_offset];
+  auto &nd = nodes_[node];
+
+  if (nd.next_len == nd.next_cap) {
+    // No room left.  Move the child nodes to the end.
+    auto cap = std::max(nd.next_cap * 2, 2u);
+    auto offset = static_cast<uint32_t>(next_.size());
+
+    next_.resize(next_.size() + cap);
+    std::ranges::copy_n(std::ranges::begin(next_) + nd.next_offset,
+                        nd.next_len, std::ranges::begin(next_) + offset);
+
+    next_bytes_.resize(next_.size() + NEXT_BYTES_PADDING);
+    std::ranges::copy_n(std::ranges::begin(next_bytes_) + nd.next_offset,
+                        nd.next_len, std::ranges::begin(next_bytes_) + offset);
+
+    nd.next_offset = offset;
+    nd.next_cap = cap;
+  }
+
+  auto first = std::ranges::begin(next_bytes_) + nd.next_offset;
+  auto last = first + nd.next_len;
+  auto pos =
+    static_cast<size_t>(std::ranges::upper_bound(first, last, c) - first);
+
+  std::ranges::copy_backward(first + pos, last, last + 1);
+  *(first + pos) = c;
+
+  auto nfirst = std::ranges::begin(next_) + nd.next_offset;
+  std::ranges::copy_backward(nfirst + pos, nfirst + nd.next_len,
+                             nfirst + nd.next_len + 1);
+  *(nfirst + pos) = next_node;
+
+  ++nd.next_len;
+}
+
+uint32_t Router::add_node(uint32_t node, std::string_view pattern,
+                          int32_t index, int32_t wildcard_index) {
+  auto new_node = static_cast<uint32_t>(nodes_.size());
+
+  nodes_.push_back(RNode{
+    .label_offset = static_cast<uint32_t>(labels_.size()),
+    .label_len = static_cast<uint32_t>(pattern.size()),
+    .index = index,
+    .wildcard_index = wildcard_index,
+  });
+  labels_ += pattern;
+
+  add_next_node(node, new_node);
+
+  return new_node;
 }
 
 size_t Router::add_route(std::string_view pattern, size_t idx, bool wildcard) {
-  ssize_t index = -1, wildcard_index = -1;
+  assert(idx <= static_cast<size_t>(std::numeric_limits<int32_t>::max()));
+
+  int32_t index = -1, wildcard_index = -1;
   if (wildcard) {
-    wildcard_index = as_signed(idx);
+    wildcard_index = static_cast<int32_t>(idx);
   } else {
-    index = as_signed(idx);
+    index = static_cast<int32_t>(idx);
+  }
+
+  auto host = pattern.substr(0, pattern.find('/'));
+  if (!hosts_.contains(host)) {
+    hosts_.emplace(make_string_ref(balloc_, host), HostNode{});
   }
 
-  auto node = &root_;
+  compiled_ = false;
+
+  uint32_t node = 0;
   size_t i = 0;
 
   for (;;) {
-    auto next_node = find_next_node(node, pattern[i]);
+    auto next_node = find_next_node(nodes_[node], pattern[i]);
     if (next_node == nullptr) {
       add_node(node, pattern.substr(i), index, wildcard_index);
       return idx;
     }
 
-    node = next_node;
+    node = static_cast<uint32_t>(next_node - nodes_.data());
 
+    auto &nd = nodes_[node];
+    auto s = label(nd);
     auto slen = pattern.size() - i;
-    auto s = pattern.data() + i;
-    auto n = std::min(node->s.size(), slen);
+    auto n = std::min(s.size(), slen);
     size_t j;
-    for (j = 0; j < n && node->s[j] == s[j]; ++j)
+    for (j = 0; j < n && s[j] == pattern[i + j]; ++j)
       ;
     if (j == n) {
       // The common prefix was matched
-      if (slen == node->s.size()) {
+      if (slen == s.size()) {
         // Complete match
         if (index != -1) {
-          if (node->index != -1) {
+          if (nd.index != -1) {
             // Return the existing index for duplicates.
-            return as_unsigned(node->index);
+            return static_cast<size_t>(nd.index);
           }
-          node->index = index;
+          nd.index = index;
           return idx;
         }
 
         assert(wildcard_index != -1);
 
-        if (node->wildcard_index != -1) {
-          return as_unsigned(node->wildcard_index);
+        if (nd.wildcard_index != -1) {
+          return static_cast<size_t>(nd.wildcard_index);
         }
-        node->wildcard_index = wildcard_index;
+        nd.wildcard_index = wildcard_index;
         return idx;
       }
 
-      if (slen > node->s.size()) {
+      if (slen > s.size()) {
         // We still have pattern to add
         i += j;
 
@@ -123,22 +219,36 @@ size_t Router::add_route(std::string_view pattern, size_t idx, bool wildcard) {
       }
     }
 
-    if (node->s.size() > j) {
+    if (s.size() > j) {
       // node must be split into 2 nodes.  new_node is now the child
       // of node.
-      auto new_node = std::make_unique<RNode>(node->s.substr(j), node->index,
-                                              node->wildcard_index);
-      std::swap(node->next, new_node->next);
+      auto new_node = RNode{
+        .label_offset = nd.label_offset + static_cast<uint32_t>(j),
+        .label_len = nd.label_len - static_cast<uint32_t>(j),
+        .index = nd.index,
+        .wildcard_index = nd.wildcard_index,
+        .next_offset = nd.next_offset,
+        .next_len = nd.next_len,
+        .next_cap = nd.next_cap,
+      };
+
+      nd.label_len = static_cast<uint32_t>(j);
+      nd.index = -1;
+      nd.wildcard_index = -1;
+      nd.next_offset = 0;
+      nd.next_len = 0;
+      nd.next_cap = 0;
 
-      node->s = node->s.substr(0, j);
-      node->index = -1;
-      node->wildcard_index = -1;
+      if (slen == j) {
+        nd.index = index;
+        nd.wildcard_index = wildcard_index;
+      }
 
-      add_next_node(node, std::move(new_node));
+      // nd is invalidated because nodes_ might be reallocated.
+      nodes_.push_back(new_node);
+      add_next_node(node, static_cast<uint32_t>(nodes_.size() - 1));
 
       if (slen == j) {
-        node->index = index;
-        node->wildcard_index = wildcard_index;
         return idx;
       }
     }
@@ -152,9 +262,78 @@ size_t Router::add_route(std::string_view pattern, size_t idx, bool wildcard) {
   }
 }
 
-namespace {
-const RNode *match_complete(size_t *offset, const RNode *node,
-                            const char *first, const char *last) {
+void Router::compile() {
+  // Assign nodes in breadth-first order.  The child nodes of a node
+  // are assigned consecutively.
+  std::vector<uint32_t> order{0};
+  order.reserve(nodes_.size());
+
+  for (size_t i = 0; i < order.size(); ++i) {
+    auto &nd = nodes_[order[i]];
+    for (size_t j = 0; j < nd.next_len; ++j) {
+      order.push_back(next_[nd.next_offset + j]);
+    }
+  }
+
+  std::vector<RNode> nodes;
+  nodes.reserve(order.size());
+
+  std::string labels;
+  labels.reserve(labels_.size());
+
+  std::vector<uint32_t> next;
+  next.reserve(order.size() - 1);
+
+  std::vector<char> next_bytes;
+  next_bytes.reserve(order.size() - 1 + NEXT_BYTES_PADDING);
+
+  auto next_index = uint32_t{1};
+
+  for (auto i : order) {
+    auto &nd = nodes_[i];
+
+    nodes.push_back(RNode{
+      .label_offset = static_cast<uint32_t>(labels.size()),
+      .label_len = nd.label_len,
+      .index = nd.index,
+      .wildcard_index = nd.wildcard_index,
+      .next_offset = static_cast<uint32_t>(next.size()),
+      .next_len = nd.next_len,
+      .next_cap = nd.next_len,
+    });
+    labels += label(nd);
+
+    for (size_t j = 0; j < nd.next_len; ++j) {
+      next.push_back(next_index++);
+      next_bytes.push_back(next_bytes_[nd.next_offset + j]);
+    }
+  }
+
+  next_bytes.resize(next.size() + NEXT_BYTES_PADDING);
+
+  nodes_ = std::move(nodes);
+  labels_ = std::move(labels);
+  next_ = std::move(next);
+  next_bytes_ = std::move(next_bytes);
+
+  for (auto &[host, hn] : hosts_) {
+    size_t offset;
+
+    auto node = match_complete(&offset, &nodes_[0], std::ranges::begin(host),
+                               std::ranges::end(host));
+
+    assert(node);
+
+    hn.node = static_cast<uint32_t>(node - nodes_.data());
+    hn.offset = static_cast<uint32_t>(offset);
+  }
+
+  compiled_ = true;
+}
+
+const RNode *Router::match_complete(size_t *offset, const RNode *node,
+                                    const char *first,
+                                    const char *last) const {
   *offset = 0;
 
   if (first == last) {
@@ -164,15 +343,16 @@ const RNode *match_complete(size_t *offset, const RNode *node,
   auto p = first;
 
   for (;;) {
-    auto next_node = find_next_node(node, *p);
+    auto next_node = find_next_node(*node, *p);
     if (next_node == nullptr) {
       return nullptr;
     }
 
     node = next_node;
 
-    auto n = std::min(node->s.size(), static_cast<size_t>(last - p));
-    if (memcmp(node->s.data(), p, n) != 0) {
+    auto s = label(*node);
+    auto n = std::min(s.size(), static_cast<size_t>(last - p));
+    if (!label_equal(s.data(), p, n)) {
       return nullptr;
     }
     p += n;
@@ -182,15 +362,14 @@ const RNode *match_complete(size_t *offset, const RNode *node,
     }
   }
 }
-} // namespace
 
-namespace {
-const RNode *match_partial(bool *pattern_is_wildcard, const RNode *node,
-                           size_t offset, const char *first, const char *last) {
+const RNode *Router::match_partial(bool *pattern_is_wildcard,
+                                   const RNode *node, size_t offset,
+                                   const char *first, const char *last) const {
   *pattern_is_wildcard = false;
 
   if (first == last) {
-    if (node->s.size() == offset) {
+    if (node->label_len == offset) {
       return node;
     }
     return nullptr;
@@ -201,23 +380,23 @@ const RNode *match_partial(bool *pattern_is_wildcard, const RNode *node,
   const RNode *found_node = nullptr;
 
   if (offset > 0) {
-    auto n =
-      std::min(node->s.size() - offset, static_cast<size_t>(last - first));
-    if (memcmp(node->s.data() + offset, first, n) != 0) {
+    auto s = label(*node);
+    auto n = std::min(s.size() - offset, static_cast<size_t>(last - first));
+    if (!label_equal(s.data() + offset, first, n)) {
       return nullptr;
     }
 
     p += n;
 
     if (p == last) {
-      if (node->s.size() == offset + n) {
+      if (s.size() == offset + n) {
         if (node->index != -1) {
           return node;
         }
 
         // The last '/' handling, see below.
-        node = find_next_node(node, '/');
-        if (node != nullptr && node->index != -1 && node->s.size() == 1) {
+        node = find_next_node(*node, '/');
+        if (node != nullptr && node->index != -1 && node->label_len == 1) {
           return node;
         }
 
@@ -225,8 +404,8 @@ const RNode *match_partial(bool *pattern_is_wildcard, const RNode *node,
       }
 
       // The last '/' handling, see below.
-      if (node->index != -1 && offset + n + 1 == node->s.size() &&
-          node->s[node->s.size() - 1] == '/') {
+      if (node->index != -1 && offset + n + 1 == s.size() &&
+          s[s.size() - 1] == '/') {
         return node;
       }
 
@@ -236,31 +415,32 @@ const RNode *match_partial(bool *pattern_is_wildcard, const RNode *node,
     if (node->wildcard_index != -1) {
       found_node = node;
       *pattern_is_wildcard = true;
-    } else if (node->index != -1 && node->s[node->s.size() - 1] == '/') {
+    } else if (node->index != -1 && s[s.size() - 1] == '/') {
       found_node = node;
       *pattern_is_wildcard = false;
     }
 
-    assert(node->s.size() == offset + n);
+    assert(s.size() == offset + n);
   }
 
   for (;;) {
-    auto next_node = find_next_node(node, *p);
+    auto next_node = find_next_node(*node, *p);
     if (next_node == nullptr) {
       return found_node;
     }
 
     node = next_node;
 
-    auto n = std::min(node->s.size(), static_cast<size_t>(last - p));
-    if (memcmp(node->s.data(), p, n) != 0) {
+    auto s = label(*node);
+    auto n = std::min(s.size(), static_cast<size_t>(last - p));
+    if (!label_equal(s.data(), p, n)) {
       return found_node;
     }
 
     p += n;
 
     if (p == last) {
-      if (node->s.size() == n) {
+      if (s.size() == n) {
         // Complete match with this node
         if (node->index != -1) {
           *pattern_is_wildcard = false;
@@ -268,8 +448,8 @@ const RNode *match_partial(bool *pattern_is_wildcard, const RNode *node,
         }
 
         // The last '/' handling, see below.
-        node = find_next_node(node, '/');
-        if (node != nullptr && node->index != -1 && node->s.size() == 1) {
+        node = find_next_node(*node, '/');
+        if (node != nullptr && node->index != -1 && node->label_len == 1) {
           *pattern_is_wildcard = false;
           return node;
         }
@@ -283,7 +463,7 @@ const RNode *match_partial(bool *pattern_is_wildcard, const RNode *node,
       // request to the directory without trailing slash.  That is if
       // pattern is "/foo/" and path is "/foo", we consider they
       // match.
-      if (node->index != -1 && n + 1 == node->s.size() && node->s[n] == '/') {
+      if (node->index != -1 && n + 1 == s.size() && s[n] == '/') {
         *pattern_is_wildcard = false;
         return node;
       }
@@ -294,33 +474,46 @@ const RNode *match_partial(bool *pattern_is_wildcard, const RNode *node,
     if (node->wildcard_index != -1) {
       found_node = node;
       *pattern_is_wildcard = true;
-    } else if (node->index != -1 && node->s[node->s.size() - 1] == '/') {
+    } else if (node->index != -1 && s[s.size() - 1] == '/') {
       // This is the case when pattern which ends with "/" is included
       // in query.
       found_node = node;
       *pattern_is_wildcard = false;
     }
 
-    assert(node->s.size() == n);
+    assert(s.size() == n);
   }
 }
-} // namespace
 
 std::expected<size_t, Error> Router::match(std::string_view host,
                                            std::string_view path) const {
   const RNode *node;
   size_t offset;
 
-  node = match_complete(&offset, &root_, std::ranges::begin(host),
-                        std::ranges::end(host));
-  if (node == nullptr) {
-    return std::unexpected{Error::ENTITY_NOT_FOUND};
+  // If path starts with '/', a pattern matches only if its host part
+  // is exactly |host|.  Look up the hash table instead of traversing
+  // the tree in this case.
+  if (compiled_ && !host.empty() && (path.empty() || path[0] == '/') &&
+      host.find('/') == std::string_view::npos) {
+    auto it = hosts_.find(host);
+    if (it == std::ranges::end(hosts_)) {
+      return std::unexpected{Error::ENTITY_NOT_FOUND};
+    }
+
+    node = &nodes_[(*it).second.node];
+    offset = (*it).second.offset;
+  } else {
+    node = match_complete(&offset, &nodes_[0], std::ranges::begin(host),
+                          std::ranges::end(host));
+    if (node == nullptr) {
+      return std::unexpected{Error::ENTITY_NOT_FOUND};
+    }
   }
 
   bool pattern_is_wildcard;
   node = match_partial(&pattern_is_wildcard, node, offset,
                        std::ranges::begin(path), std::ranges::end(path));
-  if (node == nullptr || node == &root_) {
+  if (node == nullptr || node == &nodes_[0]) {
     return std::unexpected{Error::ENTITY_NOT_FOUND};
   }
 
@@ -329,29 +522,38 @@ std::expected<size_t, Error> Router::match(std::string_view host,
     return std::unexpected{Error::ENTITY_NOT_FOUND};
   }
 
-  return as_unsigned(idx);
+  return static_cast<size_t>(idx);
 }
 
 std::expected<size_t, Error> Router::match(std::string_view s) const {
   const RNode *node;
   size_t offset;
 
-  node =
-    match_complete(&offset, &root_, std::ranges::begin(s), std::ranges::end(s));
-  if (node == nullptr) {
-    return std::unexpected{Error::ENTITY_NOT_FOUND};
+  if (compiled_ && s.find('/') == std::string_view::npos) {
+    auto it = hosts_.find(s);
+    if (it == std::ranges::end(hosts_)) {
+      return std::unexpected{Error::ENTITY_NOT_FOUND};
+    }
+
+    node = &nodes_[(*it).second.node];
+    offset = (*it).second.offset;
+  } else {
+    node = match_complete(&offset, &nodes_[0], std::ranges::begin(s),
+                          std::ranges::end(s));
+    if (node == nullptr) {
+      return std::unexpected{Error::ENTITY_NOT_FOUND};
+    }
   }
 
-  if (node->s.size() != offset || node->index == -1) {
+  if (node->label_len != offset || node->index == -1) {
     return std::unexpected{Error::ENTITY_NOT_FOUND};
   }
 
-  return as_unsigned(node->index);
+  return static_cast<size_t>(node->index);
 }
 
-namespace {
-const RNode *match_prefix(size_t *nread, const RNode *node, const char *first,
-                          const char *last) {
+const RNode *Router::match_prefix(size_t *nread, const RNode *node,
+                                  const char *first, const char *last) const {
   if (first == last) {
     return nullptr;
   }
@@ -359,15 +561,16 @@ const RNode *match_prefix(size_t *nread, const RNode *node, const char *first,
   auto p = first;
 
   for (;;) {
-    auto next_node = find_next_node(node, *p);
+    auto next_node = find_next_node(*node, *p);
     if (next_node == nullptr) {
       return nullptr;
     }
 
     node = next_node;
 
-    auto n = std::min(node->s.size(), static_cast<size_t>(last - p));
-    if (memcmp(node->s.data(), p, n) != 0) {
+    auto s = label(*node);
+    auto n = std::min(s.size(), static_cast<size_t>(last - p));
+    if (!label_equal(s.data(), p, n)) {
       return nullptr;
     }
 
@@ -381,7 +584,7 @@ const RNode *match_prefix(size_t *nread, const RNode *node, const char *first,
       continue;
     }
 
-    if (node->s.size() == n) {
+    if (s.size() == n) {
       *nread = as_unsigned(p - first);
       return node;
     }
@@ -389,17 +592,16 @@ const RNode *match_prefix(size_t *nread, const RNode *node, const char *first,
     return nullptr;
   }
 }
-} // namespace
 
 std::expected<size_t, Error> Router::match_prefix(size_t *nread,
                                                   const RNode **last_node,
                                                   std::string_view s) const {
   if (*last_node == nullptr) {
-    *last_node = &root_;
+    *last_node = &nodes_[0];
   }
 
-  auto node = ::shrpx::match_prefix(nread, *last_node, std::ranges::begin(s),
-                                    std::ranges::end(s));
+  auto node = match_prefix(nread, *last_node, std::ranges::begin(s),
+                           std::ranges::end(s));
   if (node == nullptr) {
     return std::unexpected{Error::ENTITY_NOT_FOUND};
   }
@@ -410,19 +612,17 @@ std::expected<size_t, Error> Router::match_prefix(size_t *nread,
     return std::unexpected{Error::ENTITY_NOT_FOUND};
   }
 
-  return as_unsigned(node->index);
+  return static_cast<size_t>(node->index);
 }
 
-namespace {
-void dump_node(const RNode *node, int depth) {
-  std::println(stderr, "{:{}}s='{}', len={}, index={}", "", depth, node->s,
-               node->s.size(), node->index);
-  for (auto &nd : node->next) {
-    dump_node(nd.get(), depth + 4);
+void Router::dump_node(const RNode &node, int depth) const {
+  std::println(stderr, "{:{}}s='{}', len={}, index={}", "", depth, label(node),
+               node.label_len, node.index);
+  for (size_t i = 0; i < node.next_len; ++i) {
+    dump_node(nodes_[next_[node.next_offset + i]], depth + 4);
   }
 }
-} // namespace
 
-void Router::dump() const { dump_node(&root_, 0); }
+void Router::dump() const { dump_node(nodes_[0], 0); }
 
 } // namespace shrpx
@@ -30,6 +30,8 @@
 #include <vector>
 #include <memory>
 #include <expected>
+#include <string>
+#include <unordered_map>
 
 #include "allocator.h"
 #include "errors.h"
@@ -38,31 +40,35 @@ using namespace nghttp2;
 
 namespace shrpx {
 
-struct RNode {
-  RNode() noexcept = default;
-  RNode(std::string_view s, ssize_t index, ssize_t wildcard_index);
-  RNode(RNode &&) noexcept = default;
-  RNode(const RNode &) = delete;
-  RNode &operator=(RNode &&) noexcept = default;
-  RNode &operator=(const RNode &) = delete;
-
-  // Next RNode, sorted by s[0].
-  std::vector<std::unique_ptr<RNode>> next;
-  // Stores pointer to the string this node represents.  Not
-  // NULL-terminated.
-  std::string_view s;
+// RNode is a node of Patricia tree.  All nodes of Router are stored
+// in a single array, and they refer to each other by index so that
+// the tree is laid out contiguously in memory.  The size of RNode is
+// chosen so that 2 nodes fit in a cache line.
+struct alignas(32) RNode {
+  // Offset of the string this node represents in Router::labels_.
+  uint32_t label_offset{};
+  // Length of the string this node represents.
+  uint32_t label_len{};
   // Index of pattern if match ends in this node.  Note that we don't
   // store duplicated pattern.
-  ssize_t index{-1};
+  int32_t index{-1};
   // Index of wildcard pattern if query includes this node as prefix
   // and it still has suffix to match.  Note that we don't store
   // duplicated pattern.
-  ssize_t wildcard_index{-1};
+  int32_t wildcard_index{-1};
+  // Offset of the child nodes in Router::next_ and
+  // Router::next_bytes_.  Child nodes are sorted by the first byte of
+  // their strings.
+  uint32_t next_offset{};
+  // The number of child nodes.
+  uint32_t next_len{};
+  // The number of slots reserved for child nodes at next_offset.
+  uint32_t next_cap{};
 };
 
 class Router {
 public:
-  Router() noexcept = default;
+  Router();
   ~Router();
   Router(Router &&) noexcept = default;
   Router(const Router &) = delete;
@@ -77,6 +83,12 @@ public:
   // with match(std::string_view, std::string_view).
   size_t add_route(std::string_view pattern, size_t index,
                    bool wildcard = false);
+  // Lays out the nodes in breadth-first order so that the child
+  // nodes are adjacent in memory, and builds the hash table to look
+  // up exact host.  This function should be called after all routes
+  // are added.  Adding a route after this call is allowed, but it
+  // disables the hash table until this function is called again.
+  void compile();
   // Returns the matched index of pattern.
   std::expected<size_t, Error> match(std::string_view host,
                                      std::string_view path) const;
@@ -94,16 +106,54 @@ public:
                                             const RNode **last_node,
                                             std::string_view s) const;
 
-  void add_node(RNode *node, std::string_view pattern, ssize_t index,
-                ssize_t wildcard_index);
-
   void dump() const;
 
 private:
+  // Node which is found by looking up exact host.
+  struct HostNode {
+    // Index of the node in nodes_.
+    uint32_t node;
+    // The number of bytes of the node's string which host consumes.
+    uint32_t offset;
+  };
+
+  std::string_view label(const RNode &node) const {
+    return {labels_.data() + node.label_offset, node.label_len};
+  }
+
+  const RNode *find_next_node(const RNode &node, char c) const;
+  void add_next_node(uint32_t node, uint32_t next_node);
+  uint32_t add_node(uint32_t node, std::string_view pattern, int32_t index,
+                    int32_t wildcard_index);
+
+  const RNode *match_complete(size_t *offset, const RNode *node,
+                              const char *first, const char *last) const;
+  const RNode *match_partial(bool *pattern_is_wildcard, const RNode *node,
+                             size_t offset, const char *first,
+                             const char *last) const;
+  const RNode *match_prefix(size_t *nread, const RNode *node,
+                            const char *first, const char *last) const;
+
+  void dump_node(const RNode &node, int depth) const;
+
   BlockAllocator balloc_{1024, 1024};
-  // The root node of Patricia tree.  This is special node and its s
-  // field is nulptr, and len field is 0.
-  RNode root_{};
+  // All nodes.  The first node is the root node of Patricia tree.  It
+  // is special node and its string is empty.
+  std::vector<RNode> nodes_;
+  // Strings of all nodes.
+  std::string labels_;
+  // Index of the child nodes in nodes_.
+  std::vector<uint32_t> next_;
+  // The first byte of the string of the child nodes.  It has
+  // additional padding at the end so that it can be read in 16 bytes
+  // chunk.
+  std::vector<char> next_bytes_;
+  // Maps host part of patterns to the node where it ends.  The value
+  // is only valid if compiled_ is true.
+  std::unordered_map<std::string_view, HostNode> hosts_;
+  // true if compile() has been called since the last addition of a
+  // route.
+  bool compiled_{};
 };
 
 } // namespace shrpx
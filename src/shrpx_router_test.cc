@@ -24,6 +24,9 @@
  */
 #include "shrpx_router_test.h"
 
+#include <chrono>
+#include <format>
+
 #include "munitxx.h"
 
 #include "shrpx_router.h"
@@ -37,6 +40,7 @@ const MunitTest tests[]{
   munit_void_test(test_shrpx_router_match),
   munit_void_test(test_shrpx_router_match_wildcard),
   munit_void_test(test_shrpx_router_match_prefix),
+  munit_void_test(test_shrpx_router_match_10k),
   munit_test_end(),
 };
 } // namespace
@@ -188,4 +192,124 @@ void test_shrpx_router_match_prefix(void) {
   assert_false(router.match_prefix(&nread, &node, "c.b.c"sv).has_value());
 }
 
+namespace {
+// Matches all |queries| against |router| |rounds| times, and returns
+// the average time per match in nanoseconds.
+double bench_router_match(
+  const Router &router,
+  const std::vector<std::pair<std::string_view, std::string_view>> &queries,
+  size_t rounds) {
+  size_t nmatch = 0;
+
+  auto t = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < rounds; ++i) {
+    for (auto &[host, path] : queries) {
+      if (router.match(host, path)) {
+        ++nmatch;
+      }
+    }
+  }
+
+  auto d = std::chrono::steady_clock::now() - t;
+
+  assert_size(0, <, nmatch);
+
+  return static_cast<double>(
+           std::chrono::duration_cast<std::chrono::nanoseconds>(d).count()) /
+         static_cast<double>(rounds * queries.size());
+}
+} // namespace
+
+void test_shrpx_router_match_10k(void) {
+  constexpr size_t npatterns = 10000;
+
+  std::vector<std::string> patterns;
+  patterns.reserve(npatterns);
+
+  for (size_t i = 0; i < npatterns; ++i) {
+    if (i % 100 == 0) {
+      patterns.push_back(std::format("/static{}/", i));
+    } else {
+      patterns.push_back(
+        std::format("www{}.example.com/api/v{}/", i / 10, i % 10));
+    }
+  }
+
+  std::vector<std::string> hosts, paths;
+  hosts.reserve(npatterns * 2);
+  paths.reserve(npatterns * 2);
+
+  for (size_t i = 0; i < npatterns; ++i) {
+    if (i % 100 == 0) {
+      hosts.emplace_back();
+      paths.push_back(std::format("/static{}/index.html", i));
+    } else {
+      hosts.push_back(std::format("www{}.example.com", i / 10));
+      paths.push_back(std::format("/api/v{}/resource", i % 10));
+    }
+
+    // Not found
+    hosts.push_back(std::format("www{}.example.org", i));
+    paths.emplace_back("/api/v1/");
+  }
+
+  std::vector<std::pair<std::string_view, std::string_view>> queries;
+  queries.reserve(hosts.size());
+
+  for (size_t i = 0; i < hosts.size(); ++i) {
+    queries.emplace_back(hosts[i], paths[i]);
+  }
+
+  Router router;
+
+  for (size_t i = 0; i < npatterns; ++i) {
+    router.add_route(patterns[i], i);
+  }
+
+  constexpr auto badval = std::numeric_limits<size_t>::max();
+
+  std::vector<size_t> expected;
+  expected.reserve(queries.size());
+
+  for (size_t i = 0; i < queries.size(); ++i) {
+    auto &[host, path] = queries[i];
+
+    expected.push_back(router.match(host, path).value_or(badval));
+
+    assert_size(i % 2 == 0 ? i / 2 : badval, ==, expected.back());
+  }
+
+  auto tree_ns = bench_router_match(router, queries, 10);
+
+  router.compile();
+
+  for (size_t i = 0; i < queries.size(); ++i) {
+    auto &[host, path] = queries[i];
+
+    assert_size(expected[i], ==, router.match(host, path).value_or(badval));
+  }
+
+  // A route added after compilation is also found.
+  router.add_route("www.example.net/"sv, npatterns);
+
+  assert_size(npatterns, ==,
+              router.match("www.example.net"sv, "/"sv).value_or(badval));
+  assert_size(1, ==,
+              router.match("www0.example.com"sv, "/api/v1/"sv)
+                .value_or(badval));
+
+  router.compile();
+
+  assert_size(npatterns, ==,
+              router.match("www.example.net"sv, "/"sv).value_or(badval));
+
+  auto compiled_ns = bench_router_match(router, queries, 10);
+
+  munit_logf(MUNIT_LOG_INFO,
+             "%zu patterns: %.1f ns/match before compile, %.1f ns/match "
+             "after compile",
+             npatterns, tree_ns, compiled_ns);
+}
+
 } // namespace shrpx
@@ -40,6 +40,7 @@ extern const MunitSuite router_suite;
 munit_void_test_decl(test_shrpx_router_match)
 munit_void_test_decl(test_shrpx_router_match_wildcard)
 munit_void_test_decl(test_shrpx_router_match_prefix)
+munit_void_test_decl(test_shrpx_router_match_10k)
 
 } // namespace shrpx
 
@@ -0,0 +1,168 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2015 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_timer_wheel.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace shrpx {
+
+namespace {
+void timeoutcb(struct ev_loop *loop, ev_timer *w, int revents) {
+  auto wheel = static_cast<TimerWheel *>(w->data);
+
+  wheel->expire(ev_now(loop));
+}
+} // namespace
+
+namespace {
+// Appends |ent| to the list headed by |head|.
+void link_entry(TimerWheelEntry *head, TimerWheelEntry *ent) {
+  ent->prev = head->prev;
+  ent->next = head;
+  head->prev->next = ent;
+  head->prev = ent;
+}
+} // namespace
+
+namespace {
+void unlink_entry(TimerWheelEntry *ent) {
+  ent->prev->next = ent->next;
+  ent->next->prev = ent->prev;
+  ent->prev = nullptr;
+  ent->next = nullptr;
+}
+} // namespace
+
+TimerWheel::TimerWheel(struct ev_loop *loop)
+  : loop_{loop}, origin_{ev_now(loop)} {
+  for (auto &slot : slots_) {
+    slot.prev = &slot;
+    slot.next = &slot;
+  }
+
+  ev_timer_init(&timer_, timeoutcb, 0., TIMER_WHEEL_TICK);
+  timer_.data = this;
+}
+
+TimerWheel::~TimerWheel() { ev_timer_stop(loop_, &timer_); }
+
+uint64_t TimerWheel::get_tick(ev_tstamp now) const {
+  if (now <= origin_) {
+    return 0;
+  }
+
+  return static_cast<uint64_t>((now - origin_) / TIMER_WHEEL_TICK);
+}
+
+void TimerWheel::start(TimerWheelEntry *ent, ev_tstamp timeout) {
+  start(ent, timeout, ev_now(loop_));
+}
+
+void TimerWheel::start(TimerWheelEntry *ent, ev_tstamp timeout,
+                       ev_tstamp now) {
+  if (ent->active()) {
+    unlink_entry(ent);
+  } else {
+    if (num_entries_ == 0) {
+      // Nothing to catch up with.
+      last_tick_ = std::max(last_tick_, get_tick(now));
+    }
+
+    ++num_entries_;
+  }
+
+  auto ticks = static_cast<uint64_t>(
+    std::ceil(std::max(timeout, 0.) / TIMER_WHEEL_TICK));
+
+  // The current tick has partially elapsed.  Add one more tick so
+  // that the timer never expires early.
+  ent->expiry = std::max(last_tick_, get_tick(now)) + ticks + 1;
+
+  link_entry(&slots_[ent->expiry % TIMER_WHEEL_NUM_SLOTS], ent);
+
+  if (!ev_is_active(&timer_)) {
+    ev_timer_again(loop_, &timer_);
+  }
+}
+
+void TimerWheel::stop(TimerWheelEntry *ent) {
+  if (!ent->active()) {
+    return;
+  }
+
+  unlink_entry(ent);
+
+  --num_entries_;
+}
+
+void TimerWheel::expire(ev_tstamp now) {
+  auto tick = get_tick(now);
+
+  if (tick > last_tick_) {
+    TimerWheelEntry expired;
+    expired.prev = &expired;
+    expired.next = &expired;
+
+    // If the loop has fallen behind more than one rotation, every
+    // slot is visited just once.
+    auto n = std::min(tick - last_tick_, uint64_t{TIMER_WHEEL_NUM_SLOTS});
+
+    for (auto t = tick - n + 1; t <= tick; ++t) {
+      auto &slot = slots_[t % TIMER_WHEEL_NUM_SLOTS];
+
+      for (auto ent = slot.next; ent != &slot;) {
+        auto next = ent->next;
+
+        if (ent->expiry <= tick) {
+          unlink_entry(ent);
+          link_entry(&expired, ent);
+        }
+
+        ent = next;
+      }
+    }
+
+    last_tick_ = tick;
+
+    // A callback may stop or restart the other expired timers, so
+    // take them one by one.
+    while (expired.next != &expired) {
+      auto ent = expired.next;
+
+      unlink_entry(ent);
+
+      --num_entries_;
+
+      ent->cb(ent);
+    }
+  }
+
+  if (num_entries_ == 0) {
+    ev_timer_stop(loop_, &timer_);
+  }
+}
+
+} // namespace shrpx
@@ -0,0 +1,112 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2015 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef SHRPX_TIMER_WHEEL_H
+#define SHRPX_TIMER_WHEEL_H
+
+#include "shrpx.h"
+
+#include <array>
+#include <cstdint>
+
+#include <ev.h>
+
+namespace shrpx {
+
+struct TimerWheelEntry;
+
+using TimerWheelCb = void (*)(TimerWheelEntry *ent);
+
+// TimerWheelEntry is a timer managed by TimerWheel.  It is embedded
+// in the object which owns the timer, and must not be moved while it
+// is active.
+struct TimerWheelEntry {
+  TimerWheelEntry() = default;
+  TimerWheelEntry(TimerWheelCb cb, void *data) : cb{cb}, data{data} {}
+  TimerWheelEntry(const TimerWheelEntry &) = delete;
+  TimerWheelEntry &operator=(const TimerWheelEntry &) = delete;
+
+  // Returns true if this timer is started and has not expired yet.
+  bool active() const { return next != nullptr; }
+
+  // Links in the circular doubly linked list of a slot.  Both are
+  // nullptr if this timer is not active.
+  TimerWheelEntry *prev{};
+  TimerWheelEntry *next{};
+  // The tick at or after which this timer expires.
+  uint64_t expiry{};
+  TimerWheelCb cb{};
+  void *data{};
+};
+
+// The duration of a tick in seconds.  A timer expires at most one
+// tick later than requested.
+constexpr ev_tstamp TIMER_WHEEL_TICK = 0.1;
+// The number of slots.  TIMER_WHEEL_TICK * TIMER_WHEEL_NUM_SLOTS
+// seconds is one rotation.  Timers longer than that stay in their
+// slot for several rotations.
+constexpr size_t TIMER_WHEEL_NUM_SLOTS = 1024;
+
+// TimerWheel is a hashed timing wheel for coarse timeouts, such as
+// idle and read timeouts, which are restarted very frequently but
+// rarely expire.  Starting, restarting and stopping a timer are O(1)
+// and do not touch the timer heap of libev.  A single ev_timer drives
+// the wheel, and it is stopped while no timer is active.  Precise
+// deadlines should use ev_timer directly.
+class TimerWheel {
+public:
+  TimerWheel(struct ev_loop *loop);
+  ~TimerWheel();
+  TimerWheel(const TimerWheel &) = delete;
+  TimerWheel &operator=(const TimerWheel &) = delete;
+
+  // Starts |ent| which expires after |timeout| seconds.  If |ent| is
+  // already active, it is restarted.
+  void start(TimerWheelEntry *ent, ev_tstamp timeout);
+  void start(TimerWheelEntry *ent, ev_tstamp timeout, ev_tstamp now);
+  // Stops |ent|.  It does nothing if |ent| is not active.
+  void stop(TimerWheelEntry *ent);
+  // Calls the callback of each timer which expires at or before
+  // |now|.  A callback may start or stop any timer, including the one
+  // passed to it, and may delete the owner of the timer.
+  void expire(ev_tstamp now);
+  // Returns the number of active timers.
+  size_t size() const { return num_entries_; }
+
+private:
+  uint64_t get_tick(ev_tstamp now) const;
+
+  std::array<TimerWheelEntry, TIMER_WHEEL_NUM_SLOTS> slots_;
+  ev_timer timer_;
+  struct ev_loop *loop_;
+  // The origin of the ticks.
+  ev_tstamp origin_;
+  // The last tick that has been processed by expire().
+  uint64_t last_tick_{};
+  size_t num_entries_{};
+};
+
+} // namespace shrpx
+
+#endif // !defined(SHRPX_TIMER_WHEEL_H)
@@ -192,44 +192,9 @@ std::expected<std::string_view, Error> get_servername(SSL *ssl) {
 } // namespace
 
 namespace {
-void select_ssl_ctx(SSL *ssl, std::string_view servername) {
-  auto conn = static_cast<Connection *>(SSL_get_app_data(ssl));
-  auto handler = static_cast<ClientHandler *>(conn->data);
-  auto worker = handler->get_worker();
-
-  std::array<char, NI_MAXHOST> buf;
-
-  auto end_buf = util::tolower(servername, std::ranges::begin(buf));
-
-  auto hostname = std::string_view{std::ranges::begin(buf), end_buf};
-
-#ifdef ENABLE_HTTP3
-  auto cert_tree = conn->proto == Proto::HTTP3
-                     ? worker->get_quic_cert_lookup_tree()
-                     : worker->get_cert_lookup_tree();
-#else  // !defined(ENABLE_HTTP3)
-  auto cert_tree = worker->get_cert_lookup_tree();
-#endif // !defined(ENABLE_HTTP3)
-
-  auto maybe_idx = cert_tree->lookup(hostname);
-  if (!maybe_idx) {
-    return;
-  }
-
-  auto idx = *maybe_idx;
-
-  handler->set_tls_sni(hostname);
-
-  auto conn_handler = worker->get_connection_handler();
-
-#ifdef ENABLE_HTTP3
-  const auto &ssl_ctx_list = conn->proto == Proto::HTTP3
-                               ? conn_handler->get_quic_indexed_ssl_ctx(idx)
-                               : conn_handler->get_indexed_ssl_ctx(idx);
-#else  // !defined(ENABLE_HTTP3)
-  const auto &ssl_ctx_list = conn_handler->get_indexed_ssl_ctx(idx);
-#endif // !defined(ENABLE_HTTP3)
-
+// Sets one of |ssl_ctx_list| to |ssl| considering the signature
+// algorithms that client supports.
+void set_ssl_ctx(SSL *ssl, std::span<SSL_CTX *const> ssl_ctx_list) {
   assert(!ssl_ctx_list.empty());
 
   // fast path
@@ -354,6 +319,86 @@ void select_ssl_ctx(SSL *ssl, std::string_view servername) {
 }
 } // namespace
 
+namespace {
+void select_ssl_ctx(SSL *ssl, std::string_view servername) {
+  auto conn = static_cast<Connection *>(SSL_get_app_data(ssl));
+  auto handler = static_cast<ClientHandler *>(conn->data);
+  auto worker = handler->get_worker();
+
+  std::array<char, NI_MAXHOST> buf;
+
+  auto end_buf = util::tolower(servername, std::ranges::begin(buf));
+
+  auto hostname = std::string_view{std::ranges::begin(buf), end_buf};
+
+#ifdef ENABLE_HTTP3
+  auto cert_tree = conn->proto == Proto::HTTP3
+                     ? worker->get_quic_cert_lookup_tree()
+                     : worker->get_cert_lookup_tree();
+#else  // !defined(ENABLE_HTTP3)
+  auto cert_tree = worker->get_cert_lookup_tree();
+#endif // !defined(ENABLE_HTTP3)
+
+  auto maybe_idx = cert_tree->lookup(hostname);
+  if (!maybe_idx) {
+    return;
+  }
+
+  auto idx = *maybe_idx;
+
+  handler->set_tls_sni(hostname);
+
+  auto conn_handler = worker->get_connection_handler();
+
+#ifdef ENABLE_HTTP3
+  const auto &ssl_ctx_list = conn->proto == Proto::HTTP3
+                               ? conn_handler->get_quic_indexed_ssl_ctx(idx)
+                               : conn_handler->get_indexed_ssl_ctx(idx);
+  auto subcert_cache = conn->proto == Proto::HTTP3
+                         ? conn_handler->get_quic_subcert_cache()
+                         : conn_handler->get_subcert_cache();
+#else  // !defined(ENABLE_HTTP3)
+  const auto &ssl_ctx_list = conn_handler->get_indexed_ssl_ctx(idx);
+  auto subcert_cache = conn_handler->get_subcert_cache();
+#endif // !defined(ENABLE_HTTP3)
+
+  if (!subcert_cache) {
+    set_ssl_ctx(ssl, ssl_ctx_list);
+    return;
+  }
+
+  auto subcerts = subcert_cache->lookup(idx);
+  if (subcerts.empty()) {
+    set_ssl_ctx(ssl, ssl_ctx_list);
+    return;
+  }
+
+  std::vector<SSL_CTX *> lazy_ssl_ctx_list(ssl_ctx_list);
+  auto nshared = lazy_ssl_ctx_list.size();
+
+  auto lazy_ssl_ctx_list_d = defer([&lazy_ssl_ctx_list, nshared] {
+    for (size_t i = nshared; i < lazy_ssl_ctx_list.size(); ++i) {
+      SSL_CTX_free(lazy_ssl_ctx_list[i]);
+    }
+  });
+
+  for (auto subcert_idx : subcerts) {
+    auto ssl_ctx = subcert_cache->get(subcert_idx);
+    if (!ssl_ctx) {
+      continue;
+    }
+
+    lazy_ssl_ctx_list.push_back(ssl_ctx);
+  }
+
+  if (lazy_ssl_ctx_list.empty()) {
+    return;
+  }
+
+  set_ssl_ctx(ssl, lazy_ssl_ctx_list);
+}
+} // namespace
+
 namespace {
 // *al is set to SSL_AD_UNRECOGNIZED_NAME by openssl, so we don't have
 // to set it explicitly.
@@ -386,6 +431,80 @@ int cert_cb(SSL *ssl, void *arg) {
 #endif // defined(NGHTTP2_OPENSSL_IS_BORINGSSL) ||
        // defined(NGHTTP2_OPENSSL_IS_WOLFSSL)
 
+namespace {
+std::vector<uint8_t> serialize_ssl_session(SSL_SESSION *session) {
+  auto len = static_cast<size_t>(i2d_SSL_SESSION(session, nullptr));
+  auto buf = std::vector<uint8_t>(len);
+  auto p = buf.data();
+  i2d_SSL_SESSION(session, &p);
+
+  return buf;
+}
+} // namespace
+
+namespace {
+std::expected<SSL_SESSION *, Error>
+deserialize_ssl_session(std::span<const uint8_t> data) {
+  auto p = data.data();
+
+  auto session = d2i_SSL_SESSION(nullptr, &p, as_signed(data.size()));
+  if (!session) {
+    return std::unexpected{Error::CRYPTO};
+  }
+
+  return session;
+}
+} // namespace
+
+namespace {
+SharedTLSSessionCache *get_shared_tls_session_cache(SSL *ssl) {
+  auto conn = static_cast<Connection *>(SSL_get_app_data(ssl));
+  auto handler = static_cast<ClientHandler *>(conn->data);
+  auto worker = handler->get_worker();
+
+  return worker->get_connection_handler()->get_tls_session_cache();
+}
+} // namespace
+
+namespace {
+int tls_session_new_cb(SSL *ssl, SSL_SESSION *session) {
+  auto cache = get_shared_tls_session_cache(ssl);
+
+  unsigned int idlen;
+  auto id = SSL_SESSION_get_id(session, &idlen);
+
+  auto timeout = std::chrono::seconds{SSL_SESSION_get_timeout(session)};
+
+  cache->add(as_string_view(id, idlen), serialize_ssl_session(session),
+             std::chrono::steady_clock::now() + timeout);
+
+  return 0;
+}
+} // namespace
+
+namespace {
+SSL_SESSION *tls_session_get_cb(SSL *ssl, const unsigned char *id, int idlen,
+                                int *copy) {
+  auto cache = get_shared_tls_session_cache(ssl);
+
+  *copy = 0;
+
+  auto maybe_session =
+    cache->get(as_string_view(id, as_unsigned(idlen)),
+               std::chrono::steady_clock::now())
+      .and_then([](auto &&data) { return deserialize_ssl_session(data); });
+  if (!maybe_session) {
+    if (log_enabled(INFO)) {
+      Log{INFO} << "TLS session is not found in the shared cache";
+    }
+
+    return nullptr;
+  }
+
+  return *maybe_session;
+}
+} // namespace
+
 namespace {
 int tls_session_client_new_cb(SSL *ssl, SSL_SESSION *session) {
   auto conn = static_cast<Connection *>(SSL_get_app_data(ssl));
@@ -952,11 +1071,58 @@ void setup_ech(SSL_CTX *ssl_ctx, const TLSConfig &tlsconf) {}
 } // namespace
 #endif // !defined(NGHTTP2_OPENSSL_IS_BORINGSSL) && !OPENSSL_4_0_0_API
 
-SSL_CTX *create_ssl_context(const char *private_key_file, const char *cert_file,
-                            const std::vector<uint8_t> &sct_data
+namespace {
+// Loads the private key from |private_key_file| and the certificate
+// chain from |cert_file| into |ssl_ctx|.
+std::expected<void, Error> use_server_certificate(SSL_CTX *ssl_ctx,
+                                                  const char *private_key_file,
+                                                  const char *cert_file
 #ifdef HAVE_NEVERBLEED
-                            ,
-                            neverbleed_t *nb
+                                                  ,
+                                                  neverbleed_t *nb
+#endif // defined(HAVE_NEVERBLEED)
+) {
+#ifndef HAVE_NEVERBLEED
+  if (SSL_CTX_use_PrivateKey_file(ssl_ctx, private_key_file,
+                                  SSL_FILETYPE_PEM) != 1) {
+    Log{ERROR} << "SSL_CTX_use_PrivateKey_file failed: "
+               << ERR_error_string(ERR_get_error(), nullptr);
+    return std::unexpected{Error::CRYPTO};
+  }
+#else  // defined(HAVE_NEVERBLEED)
+  std::array<char, NEVERBLEED_ERRBUF_SIZE> errbuf;
+  if (neverbleed_load_private_key_file(nb, ssl_ctx, private_key_file,
+                                       errbuf.data()) != 1) {
+    Log{ERROR} << "neverbleed_load_private_key_file failed: " << errbuf.data();
+    return std::unexpected{Error::CRYPTO};
+  }
+#endif // defined(HAVE_NEVERBLEED)
+
+  if (SSL_CTX_use_certificate_chain_file(ssl_ctx, cert_file) != 1) {
+    Log{ERROR} << "SSL_CTX_use_certificate_file failed: "
+               << ERR_error_string(ERR_get_error(), nullptr);
+    return std::unexpected{Error::CRYPTO};
+  }
+
+  if (SSL_CTX_check_private_key(ssl_ctx) != 1) {
+    Log{ERROR} << "SSL_CTX_check_private_key failed: "
+               << ERR_error_string(ERR_get_error(), nullptr);
+    return std::unexpected{Error::CRYPTO};
+  }
+
+  return {};
+}
+} // namespace
+
+namespace {
+// Creates server side SSL_CTX.  Unlike create_ssl_context, this
+// function returns nullptr if the private key or the certificate
+// cannot be loaded.
+SSL_CTX *new_ssl_context(const char *private_key_file, const char *cert_file,
+                         const std::vector<uint8_t> &sct_data
+#ifdef HAVE_NEVERBLEED
+                         ,
+                         neverbleed_t *nb
 #endif // defined(HAVE_NEVERBLEED)
 ) {
   auto ssl_ctx = SSL_CTX_new(TLS_server_method());
@@ -1001,7 +1167,14 @@ SSL_CTX *create_ssl_context(const char *private_key_file, const char *cert_file,
 
   const unsigned char sid_ctx[] = "shrpx";
   SSL_CTX_set_session_id_context(ssl_ctx, sid_ctx, sizeof(sid_ctx) - 1);
-  SSL_CTX_set_session_cache_mode(ssl_ctx, SSL_SESS_CACHE_SERVER);
+  if (tlsconf.session_cache.max_size) {
+    SSL_CTX_set_session_cache_mode(
+      ssl_ctx, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+    SSL_CTX_sess_set_new_cb(ssl_ctx, tls_session_new_cb);
+    SSL_CTX_sess_set_get_cb(ssl_ctx, tls_session_get_cb);
+  } else {
+    SSL_CTX_set_session_cache_mode(ssl_ctx, SSL_SESS_CACHE_SERVER);
+  }
 
   SSL_CTX_set_timeout(ssl_ctx, static_cast<nghttp2_ssl_timeout_type>(
                                  tlsconf.session_timeout.count()));
@@ -1088,31 +1261,14 @@ SSL_CTX *create_ssl_context(const char *private_key_file, const char *cert_file,
     SSL_CTX_set_default_passwd_cb_userdata(ssl_ctx, config);
   }
 
-#ifndef HAVE_NEVERBLEED
-  if (SSL_CTX_use_PrivateKey_file(ssl_ctx, private_key_file,
-                                  SSL_FILETYPE_PEM) != 1) {
-    Log{FATAL} << "SSL_CTX_use_PrivateKey_file failed: "
-               << ERR_error_string(ERR_get_error(), nullptr);
-    DIE();
-  }
-#else  // defined(HAVE_NEVERBLEED)
-  std::array<char, NEVERBLEED_ERRBUF_SIZE> errbuf;
-  if (neverbleed_load_private_key_file(nb, ssl_ctx, private_key_file,
-                                       errbuf.data()) != 1) {
-    Log{FATAL} << "neverbleed_load_private_key_file failed: " << errbuf.data();
-    DIE();
-  }
+  if (!use_server_certificate(ssl_ctx, private_key_file, cert_file
+#ifdef HAVE_NEVERBLEED
+                              ,
+                              nb
 #endif // defined(HAVE_NEVERBLEED)
-
-  if (SSL_CTX_use_certificate_chain_file(ssl_ctx, cert_file) != 1) {
-    Log{FATAL} << "SSL_CTX_use_certificate_file failed: "
-               << ERR_error_string(ERR_get_error(), nullptr);
-    DIE();
-  }
-  if (SSL_CTX_check_private_key(ssl_ctx) != 1) {
-    Log{FATAL} << "SSL_CTX_check_private_key failed: "
-               << ERR_error_string(ERR_get_error(), nullptr);
-    DIE();
+                              )) {
+    SSL_CTX_free(ssl_ctx);
+    return nullptr;
   }
   if (tlsconf.client_verify.enabled) {
     if (!tlsconf.client_verify.cacert.empty()) {
@@ -1234,14 +1390,40 @@ SSL_CTX *create_ssl_context(const char *private_key_file, const char *cert_file,
 
   return ssl_ctx;
 }
+} // namespace
+
+SSL_CTX *create_ssl_context(const char *private_key_file, const char *cert_file,
+                            const std::vector<uint8_t> &sct_data
+#ifdef HAVE_NEVERBLEED
+                            ,
+                            neverbleed_t *nb
+#endif // defined(HAVE_NEVERBLEED)
+) {
+  auto ssl_ctx = new_ssl_context(private_key_file, cert_file, sct_data
+#ifdef HAVE_NEVERBLEED
+                                 ,
+                                 nb
+#endif // defined(HAVE_NEVERBLEED)
+  );
+  if (!ssl_ctx) {
+    Log{FATAL} << "Could not load certificate " << cert_file;
+    DIE();
+  }
+
+  return ssl_ctx;
+}
 
 #ifdef ENABLE_HTTP3
-SSL_CTX *create_quic_ssl_context(const char *private_key_file,
-                                 const char *cert_file,
-                                 const std::vector<uint8_t> &sct_data
+namespace {
+// Creates server side SSL_CTX for QUIC.  Unlike
+// create_quic_ssl_context, this function returns nullptr if the
+// private key or the certificate cannot be loaded.
+SSL_CTX *new_quic_ssl_context(const char *private_key_file,
+                              const char *cert_file,
+                              const std::vector<uint8_t> &sct_data
 #  ifdef HAVE_NEVERBLEED
-                                 ,
-                                 neverbleed_t *nb
+                              ,
+                              neverbleed_t *nb
 #  endif // defined(HAVE_NEVERBLEED)
 ) {
   auto ssl_ctx = SSL_CTX_new(TLS_server_method());
@@ -1381,31 +1563,14 @@ SSL_CTX *create_quic_ssl_context(const char *private_key_file,
     SSL_CTX_set_default_passwd_cb_userdata(ssl_ctx, config);
   }
 
-#  ifndef HAVE_NEVERBLEED
-  if (SSL_CTX_use_PrivateKey_file(ssl_ctx, private_key_file,
-                                  SSL_FILETYPE_PEM) != 1) {
-    Log{FATAL} << "SSL_CTX_use_PrivateKey_file failed: "
-               << ERR_error_string(ERR_get_error(), nullptr);
-    DIE();
-  }
-#  else  // defined(HAVE_NEVERBLEED)
-  std::array<char, NEVERBLEED_ERRBUF_SIZE> errbuf;
-  if (neverbleed_load_private_key_file(nb, ssl_ctx, private_key_file,
-                                       errbuf.data()) != 1) {
-    Log{FATAL} << "neverbleed_load_private_key_file failed: " << errbuf.data();
-    DIE();
-  }
+  if (!use_server_certificate(ssl_ctx, private_key_file, cert_file
+#  ifdef HAVE_NEVERBLEED
+                              ,
+                              nb
 #  endif // defined(HAVE_NEVERBLEED)
-
-  if (SSL_CTX_use_certificate_chain_file(ssl_ctx, cert_file) != 1) {
-    Log{FATAL} << "SSL_CTX_use_certificate_file failed: "
-               << ERR_error_string(ERR_get_error(), nullptr);
-    DIE();
-  }
-  if (SSL_CTX_check_private_key(ssl_ctx) != 1) {
-    Log{FATAL} << "SSL_CTX_check_private_key failed: "
-               << ERR_error_string(ERR_get_error(), nullptr);
-    DIE();
+                              )) {
+    SSL_CTX_free(ssl_ctx);
+    return nullptr;
   }
   if (tlsconf.client_verify.enabled) {
     if (!tlsconf.client_verify.cacert.empty()) {
@@ -1520,6 +1685,29 @@ SSL_CTX *create_quic_ssl_context(const char *private_key_file,
 
   return ssl_ctx;
 }
+} // namespace
+
+SSL_CTX *create_quic_ssl_context(const char *private_key_file,
+                                 const char *cert_file,
+                                 const std::vector<uint8_t> &sct_data
+#  ifdef HAVE_NEVERBLEED
+                                 ,
+                                 neverbleed_t *nb
+#  endif // defined(HAVE_NEVERBLEED)
+) {
+  auto ssl_ctx = new_quic_ssl_context(private_key_file, cert_file, sct_data
+#  ifdef HAVE_NEVERBLEED
+                                      ,
+                                      nb
+#  endif // defined(HAVE_NEVERBLEED)
+  );
+  if (!ssl_ctx) {
+    Log{FATAL} << "Could not load certificate " << cert_file;
+    DIE();
+  }
+
+  return ssl_ctx;
+}
 #endif // defined(ENABLE_HTTP3)
 
 SSL_CTX *create_ssl_client_context(
@@ -2117,12 +2305,180 @@ void CertLookupTree::dump() const {
   rev_wildcard_router_.dump();
 }
 
-void cert_lookup_tree_add_ssl_ctx(
-  CertLookupTree *lt, std::vector<std::vector<SSL_CTX *>> &indexed_ssl_ctx,
-  SSL_CTX *ssl_ctx) {
+namespace {
+void free_tls_ctx_data(void *parent, void *ptr, CRYPTO_EX_DATA *ad, int idx,
+                       long argl, void *argp) {
+  delete static_cast<TLSContextData *>(ptr);
+}
+} // namespace
+
+namespace {
+// Returns the index of SSL_CTX ex_data which owns TLSContextData of
+// SSL_CTX created by SubcertCache.  SSL_CTX evicted from the cache
+// may still be used by the ongoing handshakes, so TLSContextData is
+// deleted when the last reference to SSL_CTX is released.
+int get_tls_ctx_data_ex_data_index() {
+  static auto idx =
+    SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, free_tls_ctx_data);
+
+  return idx;
+}
+} // namespace
+
+SubcertCache::SubcertCache(size_t max_size, bool quic
+#ifdef HAVE_NEVERBLEED
+                           ,
+                           neverbleed_t *nb
+#endif // defined(HAVE_NEVERBLEED)
+                           )
+  : failed_(get_config()->tls.subcerts.size()),
+    max_size_(max_size),
+    quic_(quic)
+#ifdef HAVE_NEVERBLEED
+    ,
+    nb_(nb)
+#endif // defined(HAVE_NEVERBLEED)
+{
+  get_tls_ctx_data_ex_data_index();
+}
+
+SubcertCache::~SubcertCache() {
+  for (auto &ent : lru_) {
+    SSL_CTX_free(ent.ssl_ctx);
+  }
+}
+
+void SubcertCache::add(size_t idx, size_t subcert_idx) {
+  if (indexed_subcerts_.size() <= idx) {
+    indexed_subcerts_.resize(idx + 1);
+  }
+
+  indexed_subcerts_[idx].push_back(subcert_idx);
+}
+
+std::span<const size_t> SubcertCache::lookup(size_t idx) const {
+  if (indexed_subcerts_.size() <= idx) {
+    return {};
+  }
+
+  return indexed_subcerts_[idx];
+}
+
+SSL_CTX *SubcertCache::create_ssl_ctx(size_t subcert_idx) {
+  auto &c = get_config()->tls.subcerts[subcert_idx];
+
+#ifdef ENABLE_HTTP3
+  auto ssl_ctx = quic_ ? new_quic_ssl_context(c.private_key_file.data(),
+                                              c.cert_file.data(), c.sct_data
+#  ifdef HAVE_NEVERBLEED
+                                              ,
+                                              nb_
+#  endif // defined(HAVE_NEVERBLEED)
+                                              )
+                       : new_ssl_context(c.private_key_file.data(),
+                                         c.cert_file.data(), c.sct_data
+#  ifdef HAVE_NEVERBLEED
+                                         ,
+                                         nb_
+#  endif // defined(HAVE_NEVERBLEED)
+                         );
+#else  // !defined(ENABLE_HTTP3)
+  auto ssl_ctx = new_ssl_context(c.private_key_file.data(),
+                                 c.cert_file.data(), c.sct_data
+#  ifdef HAVE_NEVERBLEED
+                                 ,
+                                 nb_
+#  endif // defined(HAVE_NEVERBLEED)
+  );
+#endif // !defined(ENABLE_HTTP3)
+  if (!ssl_ctx) {
+    Log{ERROR} << "Could not load certificate " << c.cert_file;
+    return nullptr;
+  }
+
+  SSL_CTX_set_ex_data(ssl_ctx, get_tls_ctx_data_ex_data_index(),
+                      SSL_CTX_get_app_data(ssl_ctx));
+
+  if (log_enabled(INFO)) {
+    Log{INFO} << "Loaded certificate " << c.cert_file;
+  }
+
+  return ssl_ctx;
+}
+
+SSL_CTX *SubcertCache::get(size_t subcert_idx) {
+  {
+    std::lock_guard<std::mutex> g(mu_);
+
+    if (failed_[subcert_idx]) {
+      return nullptr;
+    }
+
+    if (auto it = index_.find(subcert_idx); it != std::ranges::end(index_)) {
+      lru_.splice(std::ranges::begin(lru_), lru_, (*it).second);
+
+      auto ssl_ctx = (*it).second->ssl_ctx;
+      SSL_CTX_up_ref(ssl_ctx);
+
+      return ssl_ctx;
+    }
+  }
+
+  // Loading private key is expensive.  Do it without holding lock.
+  // Another thread might create the same SSL_CTX concurrently.  In
+  // that case, the one inserted first wins.
+  auto ssl_ctx = create_ssl_ctx(subcert_idx);
+
+  std::lock_guard<std::mutex> g(mu_);
+
+  if (!ssl_ctx) {
+    failed_[subcert_idx] = true;
+
+    return nullptr;
+  }
+
+  if (auto it = index_.find(subcert_idx); it != std::ranges::end(index_)) {
+    SSL_CTX_free(ssl_ctx);
+
+    ssl_ctx = (*it).second->ssl_ctx;
+    SSL_CTX_up_ref(ssl_ctx);
+
+    return ssl_ctx;
+  }
+
+  if (lru_.size() >= max_size_) {
+    auto &ent = lru_.back();
+
+    index_.erase(ent.subcert_idx);
+    SSL_CTX_free(ent.ssl_ctx);
+    lru_.pop_back();
+  }
+
+  lru_.push_front(Entry{
+    .subcert_idx = subcert_idx,
+    .ssl_ctx = ssl_ctx,
+  });
+  index_.emplace(subcert_idx, std::ranges::begin(lru_));
+
+  SSL_CTX_up_ref(ssl_ctx);
+
+  return ssl_ctx;
+}
+
+size_t SubcertCache::size() {
+  std::lock_guard<std::mutex> g(mu_);
+
+  return lru_.size();
+}
+
+namespace {
+// Calls |f| with each lower-cased hostname in |cert| which is
+// eligible for SNI lookup.  The subjectAltNames and commonName are
+// considered as eligible hostname.  If there is at least one dNSName
+// in subjectAltNames, commonName is not considered.
+template <typename F> void for_each_cert_hostname(X509 *cert, F f) {
   std::array<char, NI_MAXHOST> buf;
 
-  auto cert = SSL_CTX_get0_certificate(ssl_ctx);
   auto altnames = static_cast<GENERAL_NAMES *>(
     X509_get_ext_d2i(cert, NID_subject_alt_name, nullptr, nullptr));
   if (altnames) {
@@ -2165,21 +2521,7 @@ void cert_lookup_tree_add_ssl_ctx(
 
       auto end_buf = util::tolower(name, name + len, std::ranges::begin(buf));
 
-      auto maybe_idx =
-        lt->add_cert(std::string_view{std::ranges::begin(buf), end_buf},
-                     indexed_ssl_ctx.size());
-      if (!maybe_idx) {
-        continue;
-      }
-
-      auto idx = *maybe_idx;
-
-      if (idx < indexed_ssl_ctx.size()) {
-        indexed_ssl_ctx[idx].push_back(ssl_ctx);
-      } else {
-        assert(idx == indexed_ssl_ctx.size());
-        indexed_ssl_ctx.emplace_back(std::vector<SSL_CTX *>{ssl_ctx});
-      }
+      f(std::string_view{std::ranges::begin(buf), end_buf});
     }
 
     // Don't bother CN if we have dNSName.
@@ -2212,20 +2554,79 @@ void cert_lookup_tree_add_ssl_ctx(
 
   auto end_buf = util::tolower(cn, std::ranges::begin(buf));
 
-  auto maybe_idx = lt->add_cert(
-    std::string_view{std::ranges::begin(buf), end_buf}, indexed_ssl_ctx.size());
-  if (!maybe_idx) {
-    return;
+  f(std::string_view{std::ranges::begin(buf), end_buf});
+}
+} // namespace
+
+void cert_lookup_tree_add_ssl_ctx(
+  CertLookupTree *lt, std::vector<std::vector<SSL_CTX *>> &indexed_ssl_ctx,
+  SSL_CTX *ssl_ctx) {
+  for_each_cert_hostname(
+    SSL_CTX_get0_certificate(ssl_ctx), [&](std::string_view hostname) {
+      auto maybe_idx = lt->add_cert(hostname, indexed_ssl_ctx.size());
+      if (!maybe_idx) {
+        return;
+      }
+
+      auto idx = *maybe_idx;
+
+      if (idx < indexed_ssl_ctx.size()) {
+        indexed_ssl_ctx[idx].push_back(ssl_ctx);
+      } else {
+        assert(idx == indexed_ssl_ctx.size());
+        indexed_ssl_ctx.emplace_back(std::vector<SSL_CTX *>{ssl_ctx});
+      }
+    });
+}
+
+namespace {
+X509 *load_certificate(const char *cert_file) {
+  auto bio = BIO_new_file(cert_file, "rb");
+  if (!bio) {
+    Log{ERROR} << "BIO_new_file() failed: "
+               << ERR_error_string(ERR_get_error(), nullptr);
+    return nullptr;
   }
 
-  auto idx = *maybe_idx;
+  auto bio_d = defer([bio] { BIO_free(bio); });
 
-  if (idx < indexed_ssl_ctx.size()) {
-    indexed_ssl_ctx[idx].push_back(ssl_ctx);
-  } else {
-    assert(idx == indexed_ssl_ctx.size());
-    indexed_ssl_ctx.emplace_back(std::vector<SSL_CTX *>{ssl_ctx});
+  auto cert = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr);
+  if (!cert) {
+    Log{ERROR} << "Could not read certificate from " << cert_file << ": "
+               << ERR_error_string(ERR_get_error(), nullptr);
+    return nullptr;
   }
+
+  return cert;
+}
+} // namespace
+
+std::expected<void, Error> cert_lookup_tree_add_subcert(
+  CertLookupTree *lt, std::vector<std::vector<SSL_CTX *>> &indexed_ssl_ctx,
+  SubcertCache *subcert_cache, size_t subcert_idx, const char *cert_file) {
+  auto cert = load_certificate(cert_file);
+  if (!cert) {
+    return std::unexpected{Error::CRYPTO};
+  }
+
+  auto cert_d = defer([cert] { X509_free(cert); });
+
+  for_each_cert_hostname(cert, [&](std::string_view hostname) {
+    auto maybe_idx = lt->add_cert(hostname, indexed_ssl_ctx.size());
+    if (!maybe_idx) {
+      return;
+    }
+
+    auto idx = *maybe_idx;
+
+    if (idx == indexed_ssl_ctx.size()) {
+      indexed_ssl_ctx.emplace_back();
+    }
+
+    subcert_cache->add(idx, subcert_idx);
+  });
+
+  return {};
 }
 
 bool in_proto_list(const std::vector<std::string_view> &protos,
@@ -2253,7 +2654,7 @@ bool upstream_tls_enabled(const ConnectionConfig &connconf) {
 SSL_CTX *
 setup_server_ssl_context(std::vector<SSL_CTX *> &all_ssl_ctx,
                          std::vector<std::vector<SSL_CTX *>> &indexed_ssl_ctx,
-                         CertLookupTree *cert_tree
+                         CertLookupTree *cert_tree, SubcertCache *subcert_cache
 #ifdef HAVE_NEVERBLEED
                          ,
                          neverbleed_t *nb
@@ -2281,6 +2682,20 @@ setup_server_ssl_context(std::vector<SSL_CTX *> &all_ssl_ctx,
 
   cert_lookup_tree_add_ssl_ctx(cert_tree, indexed_ssl_ctx, ssl_ctx);
 
+  if (subcert_cache) {
+    for (size_t i = 0; i < tlsconf.subcerts.size(); ++i) {
+      auto &c = tlsconf.subcerts[i];
+
+      if (!cert_lookup_tree_add_subcert(cert_tree, indexed_ssl_ctx,
+                                        subcert_cache, i, c.cert_file.data())) {
+        Log{FATAL} << "Could not load certificate " << c.cert_file;
+        DIE();
+      }
+    }
+
+    return ssl_ctx;
+  }
+
   for (auto &c : tlsconf.subcerts) {
     auto ssl_ctx = create_ssl_context(c.private_key_file.data(),
                                       c.cert_file.data(), c.sct_data
@@ -2301,7 +2716,7 @@ setup_server_ssl_context(std::vector<SSL_CTX *> &all_ssl_ctx,
 SSL_CTX *setup_quic_server_ssl_context(
   std::vector<SSL_CTX *> &all_ssl_ctx,
   std::vector<std::vector<SSL_CTX *>> &indexed_ssl_ctx,
-  CertLookupTree *cert_tree
+  CertLookupTree *cert_tree, SubcertCache *subcert_cache
 #  ifdef HAVE_NEVERBLEED
   ,
   neverbleed_t *nb
@@ -2329,6 +2744,20 @@ SSL_CTX *setup_quic_server_ssl_context(
 
   cert_lookup_tree_add_ssl_ctx(cert_tree, indexed_ssl_ctx, ssl_ctx);
 
+  if (subcert_cache) {
+    for (size_t i = 0; i < tlsconf.subcerts.size(); ++i) {
+      auto &c = tlsconf.subcerts[i];
+
+      if (!cert_lookup_tree_add_subcert(cert_tree, indexed_ssl_ctx,
+                                        subcert_cache, i, c.cert_file.data())) {
+        Log{FATAL} << "Could not load certificate " << c.cert_file;
+        DIE();
+      }
+    }
+
+    return ssl_ctx;
+  }
+
   for (auto &c : tlsconf.subcerts) {
     auto ssl_ctx = create_quic_ssl_context(c.private_key_file.data(),
                                            c.cert_file.data(), c.sct_data
@@ -2360,6 +2789,55 @@ SSL_CTX *setup_downstream_client_ssl_context(
     tlsconf.cacert, tlsconf.client.cert_file, tlsconf.client.private_key_file);
 }
 
+#ifdef ENABLE_HTTP3
+SSL_CTX *setup_quic_downstream_client_ssl_context(
+#  ifdef HAVE_NEVERBLEED
+  neverbleed_t *nb
+#  endif // defined(HAVE_NEVERBLEED)
+) {
+  auto &tlsconf = get_config()->tls;
+
+  auto ssl_ctx = create_ssl_client_context(
+#  ifdef HAVE_NEVERBLEED
+    nb,
+#  endif // defined(HAVE_NEVERBLEED)
+    tlsconf.cacert, tlsconf.client.cert_file, tlsconf.client.private_key_file);
+
+#  ifdef SSL_OP_ENABLE_KTLS
+  SSL_CTX_clear_options(ssl_ctx, SSL_OP_ENABLE_KTLS);
+#  endif // defined(SSL_OP_ENABLE_KTLS)
+
+  if (!nghttp2::tls::ssl_ctx_set_proto_versions(ssl_ctx, TLS1_3_VERSION,
+                                                TLS1_3_VERSION)) {
+    Log{FATAL} << "Could not set TLS protocol version";
+    DIE();
+  }
+
+#  if defined(HAVE_LIBNGTCP2_CRYPTO_QUICTLS) ||                                \
+    defined(HAVE_LIBNGTCP2_CRYPTO_LIBRESSL)
+  if (ngtcp2_crypto_quictls_configure_client_context(ssl_ctx) != 0) {
+    Log{FATAL} << "ngtcp2_crypto_quictls_configure_client_context failed";
+    DIE();
+  }
+#  endif // defined(HAVE_LIBNGTCP2_CRYPTO_QUICTLS) ||
+         // defined(HAVE_LIBNGTCP2_CRYPTO_LIBRESSL)
+#  ifdef HAVE_LIBNGTCP2_CRYPTO_BORINGSSL
+  if (ngtcp2_crypto_boringssl_configure_client_context(ssl_ctx) != 0) {
+    Log{FATAL} << "ngtcp2_crypto_boringssl_configure_client_context failed";
+    DIE();
+  }
+#  endif // defined(HAVE_LIBNGTCP2_CRYPTO_BORINGSSL)
+#  ifdef HAVE_LIBNGTCP2_CRYPTO_WOLFSSL
+  if (ngtcp2_crypto_wolfssl_configure_client_context(ssl_ctx) != 0) {
+    Log{FATAL} << "ngtcp2_crypto_wolfssl_configure_client_context failed";
+    DIE();
+  }
+#  endif // defined(HAVE_LIBNGTCP2_CRYPTO_WOLFSSL)
+
+  return ssl_ctx;
+}
+#endif // defined(ENABLE_HTTP3)
+
 void setup_downstream_http2_alpn(SSL *ssl) {
   // ALPN advertisement
   SSL_set_alpn_protos(ssl,
@@ -2374,6 +2852,16 @@ void setup_downstream_http1_alpn(SSL *ssl) {
     NGHTTP2_H1_1_ALPN.size());
 }
 
+#ifdef ENABLE_HTTP3
+void setup_downstream_http3_alpn(SSL *ssl) {
+  static constexpr auto h3_alpn = "\x2h3"sv;
+
+  // ALPN advertisement
+  SSL_set_alpn_protos(ssl, reinterpret_cast<const uint8_t *>(h3_alpn.data()),
+                      h3_alpn.size());
+}
+#endif // defined(ENABLE_HTTP3)
+
 std::unique_ptr<CertLookupTree> create_cert_lookup_tree() {
   auto config = get_config();
   if (!upstream_tls_enabled(config->conn)) {
@@ -2382,17 +2870,6 @@ std::unique_ptr<CertLookupTree> create_cert_lookup_tree() {
   return std::make_unique<CertLookupTree>();
 }
 
-namespace {
-std::vector<uint8_t> serialize_ssl_session(SSL_SESSION *session) {
-  auto len = static_cast<size_t>(i2d_SSL_SESSION(session, nullptr));
-  auto buf = std::vector<uint8_t>(len);
-  auto p = buf.data();
-  i2d_SSL_SESSION(session, &p);
-
-  return buf;
-}
-} // namespace
-
 void try_cache_tls_session(TLSSessionCache *cache, SSL_SESSION *session,
                            std::chrono::steady_clock::time_point t) {
   if (cache->last_updated + 1min > t) {
@@ -2409,23 +2886,27 @@ void try_cache_tls_session(TLSSessionCache *cache, SSL_SESSION *session,
 
   cache->session_data = serialize_ssl_session(session);
   cache->last_updated = t;
+
+  if (cache->shared) {
+    auto timeout = std::chrono::seconds{SSL_SESSION_get_timeout(session)};
+
+    cache->shared->add(cache->shared_key, cache->session_data, t + timeout);
+  }
 }
 
 std::expected<SSL_SESSION *, Error>
 reuse_tls_session(const TLSSessionCache &cache) {
-  if (cache.session_data.empty()) {
-    return std::unexpected{Error::ENTITY_NOT_FOUND};
+  if (!cache.session_data.empty()) {
+    return deserialize_ssl_session(cache.session_data);
   }
 
-  auto p = cache.session_data.data();
-
-  auto session =
-    d2i_SSL_SESSION(nullptr, &p, as_signed(cache.session_data.size()));
-  if (!session) {
-    return std::unexpected{Error::CRYPTO};
+  if (!cache.shared) {
+    return std::unexpected{Error::ENTITY_NOT_FOUND};
   }
 
-  return session;
+  return cache.shared
+    ->get(cache.shared_key, std::chrono::steady_clock::now())
+    .and_then([](auto &&data) { return deserialize_ssl_session(data); });
 }
 
 std::expected<int, Error> proto_version_from_string(std::string_view v) {
@@ -29,6 +29,9 @@
 
 #include <vector>
 #include <mutex>
+#include <list>
+#include <unordered_map>
+#include <span>
 #include <expected>
 
 #include "ssl_compat.h"
@@ -51,6 +54,7 @@
 #include "network.h"
 #include "shrpx_config.h"
 #include "shrpx_router.h"
+#include "shrpx_tls_session_cache.h"
 #include "errors.h"
 
 using namespace nghttp2;
@@ -71,6 +75,10 @@ struct TLSSessionCache {
   std::vector<uint8_t> session_data;
   // The last time stamp when this cache entry is created or updated.
   std::chrono::steady_clock::time_point last_updated;
+  // If non-null, the session is also stored in this cache under
+  // shared_key so that the other workers can resume it.
+  SharedTLSSessionCache *shared{};
+  std::string shared_key;
 };
 
 // This struct stores the additional information per SSL_CTX.  This is
@@ -189,6 +197,61 @@ private:
   std::vector<WildcardPattern> wildcard_patterns_;
 };
 
+// SubcertCache creates SSL_CTX for the certificates given by
+// --subcert on the first TLS handshake which needs it, rather than at
+// startup, and keeps at most |max_size| of them in LRU order.  It is
+// shared by all worker threads.
+class SubcertCache {
+public:
+  SubcertCache(size_t max_size, bool quic
+#ifdef HAVE_NEVERBLEED
+               ,
+               neverbleed_t *nb
+#endif // defined(HAVE_NEVERBLEED)
+  );
+  ~SubcertCache();
+
+  // Associates the index |idx| returned from CertLookupTree with
+  // tlsconf.subcerts[|subcert_idx|].  This function must be called
+  // before worker threads start.
+  void add(size_t idx, size_t subcert_idx);
+  // Returns the indices into tlsconf.subcerts associated with the
+  // index |idx| returned from CertLookupTree.
+  std::span<const size_t> lookup(size_t idx) const;
+  // Returns SSL_CTX for tlsconf.subcerts[|subcert_idx|], creating it
+  // if it is not cached.  The caller owns a reference to the returned
+  // SSL_CTX, and must call SSL_CTX_free when it is no longer needed.
+  // This function returns nullptr if SSL_CTX cannot be created.
+  SSL_CTX *get(size_t subcert_idx);
+  // Returns the number of cached SSL_CTX.
+  size_t size();
+
+private:
+  struct Entry {
+    size_t subcert_idx;
+    SSL_CTX *ssl_ctx;
+  };
+
+  // Creates SSL_CTX for tlsconf.subcerts[|subcert_idx|].
+  SSL_CTX *create_ssl_ctx(size_t subcert_idx);
+
+  std::mutex mu_;
+  // The most recently used entry comes first.
+  std::list<Entry> lru_;
+  std::unordered_map<size_t, std::list<Entry>::iterator> index_;
+  // indexed_subcerts_[idx] contains the indices into tlsconf.subcerts
+  // associated with the index |idx| returned from CertLookupTree.
+  std::vector<std::vector<size_t>> indexed_subcerts_;
+  // failed_[i] is true if SSL_CTX for tlsconf.subcerts[i] could not
+  // be created.  We do not try it again.
+  std::vector<bool> failed_;
+  size_t max_size_;
+  bool quic_;
+#ifdef HAVE_NEVERBLEED
+  neverbleed_t *nb_;
+#endif // defined(HAVE_NEVERBLEED)
+};
+
 // Adds hostnames in certificate in |ssl_ctx| to lookup tree |lt|.
 // The subjectAltNames and commonName are considered as eligible
 // hostname.  If there is at least one dNSName in subjectAltNames,
@@ -198,6 +261,16 @@ void cert_lookup_tree_add_ssl_ctx(
   CertLookupTree *lt, std::vector<std::vector<SSL_CTX *>> &indexed_ssl_ctx,
   SSL_CTX *ssl_ctx);
 
+// Adds hostnames in certificate read from |cert_file| to lookup tree
+// |lt| in the same way as cert_lookup_tree_add_ssl_ctx, but without
+// creating SSL_CTX.  The index of each hostname is associated with
+// tlsconf.subcerts[|subcert_idx|] in |subcert_cache|.  An empty list
+// is added to |indexed_ssl_ctx| for a new index so that the indices
+// of |indexed_ssl_ctx| and |subcert_cache| stay in sync.
+std::expected<void, Error> cert_lookup_tree_add_subcert(
+  CertLookupTree *lt, std::vector<std::vector<SSL_CTX *>> &indexed_ssl_ctx,
+  SubcertCache *subcert_cache, size_t subcert_idx, const char *cert_file);
+
 // Returns true if |proto| is included in the
 // protocol list |protos|.
 bool in_proto_list(const std::vector<std::string_view> &protos,
@@ -223,11 +296,14 @@ set_alpn_prefs(std::vector<unsigned char> &out,
 // object as |cert_tree| parameter, otherwise SNI does not work.  All
 // the created SSL_CTX is stored into |all_ssl_ctx|.  They are also
 // added to |indexed_ssl_ctx|.  |cert_tree| uses its index to
-// associate hostname to the SSL_CTX.
+// associate hostname to the SSL_CTX.  If |subcert_cache| is not
+// nullptr, SSL_CTX for subcerts are not created here.  Instead, their
+// hostnames are added to |cert_tree|, and |subcert_cache| creates
+// SSL_CTX on demand.
 SSL_CTX *
 setup_server_ssl_context(std::vector<SSL_CTX *> &all_ssl_ctx,
                          std::vector<std::vector<SSL_CTX *>> &indexed_ssl_ctx,
-                         CertLookupTree *cert_tree
+                         CertLookupTree *cert_tree, SubcertCache *subcert_cache
 #ifdef HAVE_NEVERBLEED
                          ,
                          neverbleed_t *nb
@@ -238,7 +314,7 @@ setup_server_ssl_context(std::vector<SSL_CTX *> &all_ssl_ctx,
 SSL_CTX *setup_quic_server_ssl_context(
   std::vector<SSL_CTX *> &all_ssl_ctx,
   std::vector<std::vector<SSL_CTX *>> &indexed_ssl_ctx,
-  CertLookupTree *cert_tree
+  CertLookupTree *cert_tree, SubcertCache *subcert_cache
 #  ifdef HAVE_NEVERBLEED
   ,
   neverbleed_t *nb
@@ -253,10 +329,27 @@ SSL_CTX *setup_downstream_client_ssl_context(
 #endif // defined(HAVE_NEVERBLEED)
 );
 
+#ifdef ENABLE_HTTP3
+// Setups client side SSL_CTX for QUIC backend connections.  This is
+// separate from the one returned by
+// setup_downstream_client_ssl_context() because QUIC requires TLS
+// 1.3 and TLS stack specific QUIC configuration which cannot be
+// shared with TCP connections.
+SSL_CTX *setup_quic_downstream_client_ssl_context(
+#  ifdef HAVE_NEVERBLEED
+  neverbleed_t *nb
+#  endif // defined(HAVE_NEVERBLEED)
+);
+#endif // defined(ENABLE_HTTP3)
+
 // Sets ALPN settings in |SSL| suitable for HTTP/2 use.
 void setup_downstream_http2_alpn(SSL *ssl);
 // Sets ALPN settings in |SSL| suitable for HTTP/1.1 use.
 void setup_downstream_http1_alpn(SSL *ssl);
+#ifdef ENABLE_HTTP3
+// Sets ALPN settings in |SSL| suitable for HTTP/3 use.
+void setup_downstream_http3_alpn(SSL *ssl);
+#endif // defined(ENABLE_HTTP3)
 
 // Creates CertLookupTree.  If frontend is configured not to use TLS,
 // this function returns nullptr.
@@ -276,11 +369,13 @@ bool tls_hostname_match(std::string_view pattern, std::string_view hostname);
 // Caches |session|.  |session| is serialized into ASN1
 // representation, and stored.  |t| is used as a time stamp.
 // Depending on the existing cache's time stamp, |session| might not
-// be cached.
+// be cached.  If cache->shared is not null, |session| is also stored
+// there.
 void try_cache_tls_session(TLSSessionCache *cache, SSL_SESSION *session,
                            std::chrono::steady_clock::time_point t);
 
-// Returns cached session associated |addr|.
+// Returns cached session associated |addr|.  If |addr| has no
+// session, the session stored in addr.shared is returned.
 std::expected<SSL_SESSION *, Error>
 reuse_tls_session(const TLSSessionCache &addr);
 
@@ -0,0 +1,152 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2026 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_tls_session_cache.h"
+
+#include <cassert>
+
+namespace shrpx {
+
+namespace tls {
+
+namespace {
+// ENTRY_OVERHEAD is the approximate number of bytes used by an entry
+// in addition to its key and data.
+constexpr size_t ENTRY_OVERHEAD = 128;
+} // namespace
+
+namespace {
+size_t entry_size(std::string_view key, std::span<const uint8_t> data) {
+  return ENTRY_OVERHEAD + key.size() + data.size();
+}
+} // namespace
+
+SharedTLSSessionCache::SharedTLSSessionCache(size_t max_size, size_t nshards)
+  : shards_{std::make_unique<Shard[]>(nshards)},
+    nshards_{nshards},
+    max_shard_size_{max_size / nshards} {
+  assert(nshards);
+}
+
+SharedTLSSessionCache::Shard &
+SharedTLSSessionCache::get_shard(std::string_view key) {
+  return shards_[std::hash<std::string_view>{}(key) % nshards_];
+}
+
+void SharedTLSSessionCache::erase(Shard &shard,
+                                  std::list<Entry>::iterator it) {
+  shard.size -= entry_size(it->key, it->data);
+  shard.index.erase(it->key);
+  shard.lru.erase(it);
+}
+
+void SharedTLSSessionCache::add(std::string_view key,
+                                std::span<const uint8_t> data,
+                                std::chrono::steady_clock::time_point expiry) {
+  auto len = entry_size(key, data);
+  if (len > max_shard_size_) {
+    return;
+  }
+
+  auto &shard = get_shard(key);
+
+  std::lock_guard<std::mutex> g(shard.mu);
+
+  if (auto it = shard.index.find(key); it != std::ranges::end(shard.index)) {
+    erase(shard, (*it).second);
+  }
+
+  while (shard.size + len > max_shard_size_) {
+    assert(!shard.lru.empty());
+
+    erase(shard, std::ranges::prev(std::ranges::end(shard.lru)));
+  }
+
+  shard.lru.emplace_front(Entry{
+    .key = std::string{key},
+    .data = {std::ranges::begin(data), std::ranges::end(data)},
+    .expiry = expiry,
+  });
+
+  auto it = std::ranges::begin(shard.lru);
+
+  shard.index.emplace((*it).key, it);
+  shard.size += len;
+}
+
+std::expected<std::vector<uint8_t>, Error>
+SharedTLSSessionCache::get(std::string_view key,
+                           std::chrono::steady_clock::time_point now) {
+  auto &shard = get_shard(key);
+
+  std::lock_guard<std::mutex> g(shard.mu);
+
+  auto it = shard.index.find(key);
+  if (it == std::ranges::end(shard.index)) {
+    return std::unexpected{Error::ENTITY_NOT_FOUND};
+  }
+
+  auto ent = (*it).second;
+
+  if (ent->expiry <= now) {
+    erase(shard, ent);
+
+    return std::unexpected{Error::ENTITY_NOT_FOUND};
+  }
+
+  shard.lru.splice(std::ranges::begin(shard.lru), shard.lru, ent);
+
+  return ent->data;
+}
+
+void SharedTLSSessionCache::remove(std::string_view key) {
+  auto &shard = get_shard(key);
+
+  std::lock_guard<std::mutex> g(shard.mu);
+
+  auto it = shard.index.find(key);
+  if (it == std::ranges::end(shard.index)) {
+    return;
+  }
+
+  erase(shard, (*it).second);
+}
+
+size_t SharedTLSSessionCache::size() {
+  size_t n = 0;
+
+  for (size_t i = 0; i < nshards_; ++i) {
+    auto &shard = shards_[i];
+
+    std::lock_guard<std::mutex> g(shard.mu);
+
+    n += shard.size;
+  }
+
+  return n;
+}
+
+} // namespace tls
+
+} // namespace shrpx
@@ -0,0 +1,103 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2026 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef SHRPX_TLS_SESSION_CACHE_H
+#define SHRPX_TLS_SESSION_CACHE_H
+
+#include "shrpx.h"
+
+#include <mutex>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <span>
+#include <chrono>
+#include <expected>
+
+#include "errors.h"
+
+using namespace nghttp2;
+
+namespace shrpx {
+
+namespace tls {
+
+// SharedTLSSessionCache stores serialized TLS sessions, and is shared
+// by all worker threads in a process.  The entries are distributed
+// over the fixed number of shards by the hash of their keys, and each
+// shard has its own lock and evicts the least recently used entries
+// to stay within its share of the memory budget.
+class SharedTLSSessionCache {
+public:
+  // |max_size| is the memory budget in bytes which is divided evenly
+  // among |nshards| shards.
+  SharedTLSSessionCache(size_t max_size, size_t nshards = 16);
+
+  // add stores |data| under |key|, replacing the existing entry.  The
+  // entry expires at |expiry|.  If |data| does not fit in the budget
+  // of a shard, it is not stored.
+  void add(std::string_view key, std::span<const uint8_t> data,
+           std::chrono::steady_clock::time_point expiry);
+  // get returns a copy of the data stored under |key|.  It returns
+  // Error::ENTITY_NOT_FOUND if there is no such entry, or it has
+  // expired at |now|.
+  std::expected<std::vector<uint8_t>, Error>
+  get(std::string_view key, std::chrono::steady_clock::time_point now);
+  // remove removes the entry stored under |key| if any.
+  void remove(std::string_view key);
+  // size returns the number of bytes used by the entries, which
+  // includes the fixed overhead per entry.
+  [[nodiscard]] size_t size();
+
+private:
+  struct Entry {
+    std::string key;
+    std::vector<uint8_t> data;
+    std::chrono::steady_clock::time_point expiry;
+  };
+
+  struct Shard {
+    std::mutex mu;
+    // lru is ordered from the most recently used entry to the least
+    // recently used one.
+    std::list<Entry> lru;
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+    size_t size{};
+  };
+
+  Shard &get_shard(std::string_view key);
+  static void erase(Shard &shard, std::list<Entry>::iterator it);
+
+  std::unique_ptr<Shard[]> shards_;
+  size_t nshards_;
+  size_t max_shard_size_;
+};
+
+} // namespace tls
+
+} // namespace shrpx
+
+#endif // !defined(SHRPX_TLS_SESSION_CACHE_H)
@@ -27,6 +27,7 @@
 #include "munitxx.h"
 
 #include "shrpx_tls.h"
+#include "shrpx_tls_session_cache.h"
 #include "shrpx_log.h"
 #include "util.h"
 #include "template.h"
@@ -40,9 +41,11 @@ namespace {
 const MunitTest tests[]{
   munit_void_test(test_shrpx_tls_create_lookup_tree),
   munit_void_test(test_shrpx_tls_cert_lookup_tree_add_ssl_ctx),
+  munit_void_test(test_shrpx_tls_cert_lookup_tree_add_subcert),
   munit_void_test(test_shrpx_tls_tls_hostname_match),
   munit_void_test(test_shrpx_tls_verify_numeric_hostname),
   munit_void_test(test_shrpx_tls_verify_dns_hostname),
+  munit_void_test(test_shrpx_tls_shared_session_cache),
   munit_test_end(),
 };
 } // namespace
@@ -182,6 +185,67 @@ void test_shrpx_tls_cert_lookup_tree_add_ssl_ctx(void) {
   assert_size(3, ==, tree.lookup("test.example.com"sv).value_or(badval));
 }
 
+void test_shrpx_tls_cert_lookup_tree_add_subcert(void) {
+  static constexpr char nghttp2_certfile[] =
+    NGHTTP2_SRC_DIR "/test.nghttp2.org.pem";
+  auto nghttp2_ssl_ctx = SSL_CTX_new(TLS_server_method());
+  auto nghttp2_ssl_ctx_del =
+    defer([nghttp2_ssl_ctx] { SSL_CTX_free(nghttp2_ssl_ctx); });
+  auto nghttp2_tls_ctx_data = std::make_unique<tls::TLSContextData>();
+  SSL_CTX_set_app_data(nghttp2_ssl_ctx, nghttp2_tls_ctx_data.get());
+  auto rv =
+    SSL_CTX_use_certificate_chain_file(nghttp2_ssl_ctx, nghttp2_certfile);
+
+  assert_int(1, ==, rv);
+
+  tls::CertLookupTree tree;
+  std::vector<std::vector<SSL_CTX *>> indexed_ssl_ctx;
+  tls::SubcertCache subcert_cache(1, false
+#ifdef HAVE_NEVERBLEED
+                                  ,
+                                  nullptr
+#endif // defined(HAVE_NEVERBLEED)
+  );
+
+  tls::cert_lookup_tree_add_ssl_ctx(&tree, indexed_ssl_ctx, nghttp2_ssl_ctx);
+
+  assert_true(tls::cert_lookup_tree_add_subcert(
+                &tree, indexed_ssl_ctx, &subcert_cache, 0,
+                NGHTTP2_SRC_DIR "/test.example.com.pem")
+                .has_value());
+  // The same hostnames share the index.
+  assert_true(tls::cert_lookup_tree_add_subcert(
+                &tree, indexed_ssl_ctx, &subcert_cache, 1,
+                NGHTTP2_SRC_DIR "/test.nghttp2.org.pem")
+                .has_value());
+  assert_false(tls::cert_lookup_tree_add_subcert(
+                 &tree, indexed_ssl_ctx, &subcert_cache, 2,
+                 NGHTTP2_SRC_DIR "/no-such-file.pem")
+                 .has_value());
+
+  assert_size(4, ==, indexed_ssl_ctx.size());
+  assert_size(0, ==, subcert_cache.size());
+
+  constexpr auto badval = std::numeric_limits<size_t>::max();
+
+  auto idx = tree.lookup("test.example.com"sv).value_or(badval);
+
+  assert_size(3, ==, idx);
+  assert_true(indexed_ssl_ctx[idx].empty());
+  assert_size(1, ==, subcert_cache.lookup(idx).size());
+  assert_size(0, ==, subcert_cache.lookup(idx)[0]);
+
+  idx = tree.lookup("w.test.nghttp2.org"sv).value_or(badval);
+
+  assert_size(1, ==, idx);
+  assert_size(1, ==, indexed_ssl_ctx[idx].size());
+  assert_ptr_equal(nghttp2_ssl_ctx, indexed_ssl_ctx[idx][0]);
+  assert_size(1, ==, subcert_cache.lookup(idx).size());
+  assert_size(1, ==, subcert_cache.lookup(idx)[0]);
+
+  assert_true(subcert_cache.lookup(1000).empty());
+}
+
 template <size_t N, size_t M>
 bool tls_hostname_match_wrapper(const char (&pattern)[N],
                                 const char (&hostname)[M]) {
@@ -355,4 +419,77 @@ void test_shrpx_tls_verify_dns_hostname(void) {
   }
 }
 
+void test_shrpx_tls_shared_session_cache(void) {
+  auto now = std::chrono::steady_clock::now();
+  auto expiry = now + 1h;
+  auto data = std::array<uint8_t, 100>{};
+
+  {
+    tls::SharedTLSSessionCache cache{4096, 1};
+
+    cache.add("alpha"sv, data, expiry);
+
+    auto rv = cache.get("alpha"sv, now);
+
+    assert_true(rv.has_value());
+    assert_size(data.size(), ==, (*rv).size());
+    assert_false(cache.get("bravo"sv, now).has_value());
+
+    cache.remove("alpha"sv);
+
+    assert_false(cache.get("alpha"sv, now).has_value());
+    assert_size(0, ==, cache.size());
+  }
+
+  {
+    // Expired entry is not returned.
+    tls::SharedTLSSessionCache cache{4096, 1};
+
+    cache.add("alpha"sv, data, now);
+
+    assert_false(cache.get("alpha"sv, now).has_value());
+    assert_size(0, ==, cache.size());
+  }
+
+  {
+    // The least recently used entry is evicted.  Each entry takes
+    // more than 1/3 of the budget.
+    tls::SharedTLSSessionCache cache{700, 1};
+
+    cache.add("alpha"sv, data, expiry);
+    cache.add("bravo"sv, data, expiry);
+
+    assert_true(cache.get("alpha"sv, now).has_value());
+
+    cache.add("charlie"sv, data, expiry);
+
+    assert_true(cache.get("alpha"sv, now).has_value());
+    assert_false(cache.get("bravo"sv, now).has_value());
+    assert_true(cache.get("charlie"sv, now).has_value());
+    assert_size(700, >=, cache.size());
+  }
+
+  {
+    // Replacing an entry does not grow the cache.
+    tls::SharedTLSSessionCache cache{4096, 1};
+
+    cache.add("alpha"sv, data, expiry);
+
+    auto size = cache.size();
+
+    cache.add("alpha"sv, data, expiry);
+
+    assert_size(size, ==, cache.size());
+  }
+
+  {
+    // The entry larger than the budget of a shard is not stored.
+    tls::SharedTLSSessionCache cache{4096, 64};
+
+    cache.add("alpha"sv, data, expiry);
+
+    assert_false(cache.get("alpha"sv, now).has_value());
+  }
+}
+
 } // namespace shrpx
@@ -39,9 +39,11 @@ extern const MunitSuite tls_suite;
 
 munit_void_test_decl(test_shrpx_tls_create_lookup_tree)
 munit_void_test_decl(test_shrpx_tls_cert_lookup_tree_add_ssl_ctx)
+munit_void_test_decl(test_shrpx_tls_cert_lookup_tree_add_subcert)
 munit_void_test_decl(test_shrpx_tls_tls_hostname_match)
 munit_void_test_decl(test_shrpx_tls_verify_numeric_hostname)
 munit_void_test_decl(test_shrpx_tls_verify_dns_hostname)
+munit_void_test_decl(test_shrpx_tls_shared_session_cache)
 
 } // namespace shrpx
 
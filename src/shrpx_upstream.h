@@ -100,6 +100,9 @@ public:
   virtual std::span<const uint8_t> response_peek() const = 0;
   virtual void response_drain(size_t n) = 0;
   virtual bool response_empty() const = 0;
+  // Returns the buffer which response_riovec, response_peek, and
+  // response_drain operate on, or nullptr if there is no such buffer.
+  virtual DefaultMemchunks *get_response_buf() = 0;
 
   // Called when PUSH_PROMISE was started in downstream.  The
   // associated downstream is given as |downstream|.  The promised
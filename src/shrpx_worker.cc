@@ -33,6 +33,8 @@
 #include <cstdio>
 #include <memory>
 #include <map>
+#include <cmath>
+#include <algorithm>
 
 #include "ssl_compat.h"
 
@@ -52,6 +54,9 @@
 #include "shrpx_log.h"
 #include "shrpx_client_handler.h"
 #include "shrpx_http2_session.h"
+#include "shrpx_http_downstream_connection.h"
+#include "shrpx_live_check.h"
+#include "shrpx_collapsed_downstream_connection.h"
 #include "shrpx_log_config.h"
 #ifdef HAVE_MRUBY
 #  include "shrpx_mruby.h"
@@ -61,12 +66,20 @@
 #endif // defined(ENABLE_HTTP3)
 #include "shrpx_connection_handler.h"
 #include "shrpx_accept_handler.h"
+#ifdef HAVE_LIBURING
+#  include "shrpx_io_uring.h"
+#endif // defined(HAVE_LIBURING)
 #include "util.h"
 #include "template.h"
 #include "xsi_strerror.h"
 
 namespace shrpx {
 
+#ifdef HAVE_LIBURING
+// The number of submission queue entries of io_uring per worker.
+constexpr uint32_t IO_URING_ENTRIES = 256;
+#endif // defined(HAVE_LIBURING)
+
 #ifndef _KERNEL_FASTOPEN
 #  define _KERNEL_FASTOPEN
 // conditional define for TCP_FASTOPEN mostly on ubuntu
@@ -78,6 +91,9 @@ namespace shrpx {
 namespace {
 void eventcb(struct ev_loop *loop, ev_async *w, int revents) {
   auto worker = static_cast<Worker *>(w->data);
+#ifdef ENABLE_HTTP3
+  worker->process_quic_forward_ring();
+#endif // defined(ENABLE_HTTP3)
   worker->process_events();
 }
 } // namespace
@@ -95,6 +111,18 @@ void mcpool_clear_cb(struct ev_loop *loop, ev_timer *w, int revents) {
 }
 } // namespace
 
+namespace {
+// The interval to top up and check the prewarmed backend connections.
+constexpr auto PREWARM_INTERVAL = 5.;
+} // namespace
+
+namespace {
+void prewarm_cb(struct ev_loop *loop, ev_timer *w, int revents) {
+  auto worker = static_cast<Worker *>(w->data);
+  worker->prewarm_downstream_connections();
+}
+} // namespace
+
 namespace {
 void proc_wev_cb(struct ev_loop *loop, ev_timer *w, int revents) {
   auto worker = static_cast<Worker *>(w->data);
@@ -107,8 +135,10 @@ void disable_listener_cb(struct ev_loop *loop, ev_timer *w, int revent) {
   auto worker = static_cast<Worker *>(w->data);
 
   // If we are in graceful shutdown period, we must not enable
-  // acceptors again.
-  if (worker->get_graceful_shutdown()) {
+  // acceptors again.  If the event loop is lagging,
+  // update_loop_stat() enables them when it recovers.
+  if (worker->get_graceful_shutdown() ||
+      worker->get_loop_stat().throttled.load(std::memory_order_relaxed)) {
     return;
   }
 
@@ -116,6 +146,27 @@ void disable_listener_cb(struct ev_loop *loop, ev_timer *w, int revent) {
 }
 } // namespace
 
+namespace {
+void loop_check_cb(struct ev_loop *loop, ev_check *w, int revents) {
+  auto worker = static_cast<Worker *>(w->data);
+  worker->on_loop_check();
+}
+} // namespace
+
+namespace {
+void loop_prepare_cb(struct ev_loop *loop, ev_prepare *w, int revents) {
+  auto worker = static_cast<Worker *>(w->data);
+  worker->on_loop_prepare();
+}
+} // namespace
+
+namespace {
+void loop_stat_cb(struct ev_loop *loop, ev_timer *w, int revents) {
+  auto worker = static_cast<Worker *>(w->data);
+  worker->update_loop_stat();
+}
+} // namespace
+
 DownstreamAddrGroup::~DownstreamAddrGroup() {}
 
 // DownstreamKey is used to index SharedDownstreamAddr in order to
@@ -126,7 +177,8 @@ using DownstreamKey = std::tuple<
                          bool, bool, bool, bool>>,
   bool, SessionAffinity, std::string_view, std::string_view,
   SessionAffinityCookieSecure, SessionAffinityCookieStickiness, ev_tstamp,
-  ev_tstamp, std::string_view, bool>;
+  ev_tstamp, std::string_view, bool, LoadBalancing, std::string_view,
+  AffinityHashMethod, uint32_t, bool, uint32_t>;
 
 namespace {
 DownstreamKey
@@ -168,16 +220,44 @@ create_downstream_key(const std::shared_ptr<SharedDownstreamAddr> &shared_addr,
   std::get<8>(dkey) = timeout.write;
   std::get<9>(dkey) = mruby_file;
   std::get<10>(dkey) = shared_addr->dnf;
+  std::get<11>(dkey) = shared_addr->lb;
+  std::get<12>(dkey) = affinity.header;
+  std::get<13>(dkey) = affinity.hash;
+  std::get<14>(dkey) = affinity.max_load;
+  std::get<15>(dkey) = shared_addr->collapse;
+  std::get<16>(dkey) = shared_addr->hedge_percentile;
 
   return dkey;
 }
 } // namespace
 
+// DownstreamAddrKey is used to find the backend address in the
+// previous configuration which the connections can be carried over
+// from.
+using DownstreamAddrKey =
+  std::tuple<std::string_view, uint16_t, bool, Proto, bool, std::string_view,
+             bool, size_t, size_t, std::string_view>;
+
+namespace {
+DownstreamAddrKey create_downstream_addr_key(const DownstreamAddr &addr) {
+  // The statically resolved address must be the same.
+  auto raw_addr = addr.dns || addr.addr.empty()
+                    ? std::string_view{}
+                    : std::string_view{reinterpret_cast<const char *>(
+                                         addr.addr.as_sockaddr()),
+                                       addr.addr.size()};
+
+  return {addr.host, addr.port, addr.host_unix, addr.proto,
+          addr.tls,  addr.sni,  addr.dns,       addr.fall,
+          addr.rise, raw_addr};
+}
+} // namespace
+
 Worker::Worker(struct ev_loop *loop, SSL_CTX *sv_ssl_ctx, SSL_CTX *cl_ssl_ctx,
                tls::CertLookupTree *cert_tree,
 #ifdef ENABLE_HTTP3
                SSL_CTX *quic_sv_ssl_ctx, tls::CertLookupTree *quic_cert_tree,
-               WorkerID wid,
+               SSL_CTX *quic_cl_ssl_ctx, WorkerID wid,
 #endif // defined(ENABLE_HTTP3)
                size_t index, const std::shared_ptr<TicketKeys> &ticket_keys,
                ConnectionHandler *conn_handler,
@@ -185,11 +265,16 @@ Worker::Worker(struct ev_loop *loop, SSL_CTX *sv_ssl_ctx, SSL_CTX *cl_ssl_ctx,
   : index_{index},
     randgen_(util::make_mt19937()),
     worker_stat_{},
-    dns_tracker_(loop, get_config()->conn.downstream->family),
+    dns_tracker_(loop, get_config()->conn.downstream->family,
+                 conn_handler->get_dns_cache()),
+    timer_wheel_(loop),
     upstream_addrs_{get_config()->conn.listener.addrs},
 #ifdef ENABLE_HTTP3
     worker_id_{std::move(wid)},
     quic_upstream_addrs_{get_config()->conn.quic_listener.addrs},
+#  ifdef HAVE_SENDMMSG
+    quic_send_queue_{loop},
+#  endif // defined(HAVE_SENDMMSG)
 #endif // defined(ENABLE_HTTP3)
     loop_(loop),
     sv_ssl_ctx_(sv_ssl_ctx),
@@ -199,6 +284,7 @@ Worker::Worker(struct ev_loop *loop, SSL_CTX *sv_ssl_ctx, SSL_CTX *cl_ssl_ctx,
 #ifdef ENABLE_HTTP3
     quic_sv_ssl_ctx_{quic_sv_ssl_ctx},
     quic_cert_tree_{quic_cert_tree},
+    quic_cl_ssl_ctx_{quic_cl_ssl_ctx},
     quic_conn_handler_{this},
 #endif // defined(ENABLE_HTTP3)
     ticket_keys_(ticket_keys),
@@ -211,12 +297,53 @@ Worker::Worker(struct ev_loop *loop, SSL_CTX *sv_ssl_ctx, SSL_CTX *cl_ssl_ctx,
   ev_timer_init(&mcpool_clear_timer_, mcpool_clear_cb, 0., 0.);
   mcpool_clear_timer_.data = this;
 
+  ev_timer_init(&prewarm_timer_, prewarm_cb, 0., 0.);
+  prewarm_timer_.data = this;
+
   ev_timer_init(&proc_wev_timer_, proc_wev_cb, 0., 0.);
   proc_wev_timer_.data = this;
 
   ev_timer_init(&disable_listener_timer_, disable_listener_cb, 0., 0.);
   disable_listener_timer_.data = this;
 
+  // The check watcher runs first after poll, and the prepare watcher
+  // runs last before poll, so that a loop iteration covers all
+  // callbacks.
+  ev_check_init(&loop_check_, loop_check_cb);
+  loop_check_.data = this;
+  ev_set_priority(&loop_check_, EV_MAXPRI);
+  ev_check_start(loop_, &loop_check_);
+
+  ev_prepare_init(&loop_prepare_, loop_prepare_cb);
+  loop_prepare_.data = this;
+  ev_set_priority(&loop_prepare_, EV_MINPRI);
+  ev_prepare_start(loop_, &loop_prepare_);
+
+  ev_timer_init(&loop_stat_timer_, loop_stat_cb, LOOP_STAT_INTERVAL,
+                LOOP_STAT_INTERVAL);
+  loop_stat_timer_.data = this;
+  ev_timer_start(loop_, &loop_stat_timer_);
+
+  loop_interval_start_ = ev_time();
+
+#ifdef ENABLE_HTTP3
+  if (!quic_upstream_addrs_.empty()) {
+    quic_forward_ring_ = std::make_unique<QUICForwardRing>();
+  }
+#endif // defined(ENABLE_HTTP3)
+
+#ifdef HAVE_LIBURING
+  if (get_config()->io_uring) {
+    auto ring = std::make_unique<IOUring>(loop_);
+    if (auto rv = ring->init(IO_URING_ENTRIES); !rv) {
+      Log{WARN} << "io_uring is not available; fall back to the default "
+                   "event backend";
+    } else {
+      io_uring_ = std::move(ring);
+    }
+  }
+#endif // defined(HAVE_LIBURING)
+
   replace_downstream_config(std::move(downstreamconf));
 }
 
@@ -256,12 +383,14 @@ void ensure_enqueue_addr(
 
 void Worker::replace_downstream_config(
   std::shared_ptr<DownstreamConfig> downstreamconf) {
-  for (auto &g : downstream_addr_groups_) {
-    g->retired = true;
+  // The backend addresses in the previous configuration.  The same
+  // backend address in the new configuration takes over the
+  // connections, health and load balancing state of it.
+  std::map<DownstreamAddrKey, DownstreamAddr *> old_addrs;
 
-    auto &shared_addr = g->shared_addr;
-    for (auto &addr : shared_addr->addrs) {
-      addr.dconn_pool->remove_all();
+  for (auto &g : downstream_addr_groups_) {
+    for (auto &addr : g->shared_addr->addrs) {
+      old_addrs.emplace(create_downstream_addr_key(addr), &addr);
     }
   }
 
@@ -302,7 +431,8 @@ void Worker::replace_downstream_config(
 
     shared_addr->addrs.resize(src.addrs.size());
     shared_addr->affinity.type = src.affinity.type;
-    if (src.affinity.type == SessionAffinity::COOKIE) {
+    if (src.affinity.type == SessionAffinity::COOKIE ||
+        src.affinity.type == SessionAffinity::APP_COOKIE) {
       shared_addr->affinity.cookie.name =
         make_string_ref(shared_addr->balloc, src.affinity.cookie.name);
       if (!src.affinity.cookie.path.empty()) {
@@ -312,10 +442,25 @@ void Worker::replace_downstream_config(
       shared_addr->affinity.cookie.secure = src.affinity.cookie.secure;
       shared_addr->affinity.cookie.stickiness = src.affinity.cookie.stickiness;
     }
+    if (src.affinity.type == SessionAffinity::HEADER) {
+      shared_addr->affinity.header =
+        make_string_ref(shared_addr->balloc, src.affinity.header);
+    }
+    shared_addr->affinity.hash = src.affinity.hash;
+    shared_addr->affinity.max_load = src.affinity.max_load;
     shared_addr->affinity_hash = src.affinity_hash;
     shared_addr->affinity_hash_map = src.affinity_hash_map;
+    shared_addr->maglev_table = src.maglev_table;
+    shared_addr->app_cookie_table = src.app_cookie_table;
+    shared_addr->lb = src.lb;
+    shared_addr->concurrency_limit = downstreamconf->concurrency_limit;
+    shared_addr->hedge_percentile = src.hedge;
+    shared_addr->hedge_budget =
+      static_cast<double>(downstreamconf->hedge_budget) / 100.;
+    shared_addr->outlier = downstreamconf->outlier;
     shared_addr->redirect_if_not_tls = src.redirect_if_not_tls;
     shared_addr->dnf = src.dnf;
+    shared_addr->collapse = src.collapse;
     shared_addr->timeout.read = src.timeout.read;
     shared_addr->timeout.write = src.timeout.write;
 
@@ -336,10 +481,24 @@ void Worker::replace_downstream_config(
       dst_addr.proto = src_addr.proto;
       dst_addr.tls = src_addr.tls;
       dst_addr.sni = make_string_ref(shared_addr->balloc, src_addr.sni);
+      if (dst_addr.tls) {
+        if (auto cache = conn_handler_->get_tls_session_cache(); cache) {
+          // Workers share the backend sessions which are keyed by the
+          // address and SNI.
+          dst_addr.tls_session_cache.shared = cache;
+          dst_addr.tls_session_cache.shared_key =
+            std::format("{}/{}", dst_addr.hostport, dst_addr.sni);
+        }
+      }
       dst_addr.fall = src_addr.fall;
       dst_addr.rise = src_addr.rise;
       dst_addr.dns = src_addr.dns;
       dst_addr.upgrade_scheme = src_addr.upgrade_scheme;
+      if (shared_addr->concurrency_limit) {
+        dst_addr.concurrency_limit =
+          std::min(DOWNSTREAM_ADDR_INITIAL_CONCURRENCY_LIMIT,
+                   static_cast<double>(shared_addr->concurrency_limit));
+      }
     }
 
 #ifdef HAVE_MRUBY
@@ -365,30 +524,46 @@ void Worker::replace_downstream_config(
       auto shared_addr_ptr = shared_addr.get();
 
       for (auto &addr : shared_addr->addrs) {
-        addr.connect_blocker = std::make_unique<ConnectBlocker>(
-          randgen_, loop_, nullptr, [shared_addr_ptr, &addr] {
-            if (!addr.queued) {
-              if (!addr.wg) {
-                return;
-              }
-              ensure_enqueue_addr(shared_addr_ptr->pq, addr.wg, &addr);
+        auto unblock_func = [shared_addr_ptr, &addr] {
+          if (!addr.queued) {
+            if (!addr.wg) {
+              return;
             }
-          });
+            ensure_enqueue_addr(shared_addr_ptr->pq, addr.wg, &addr);
+          }
+        };
+
+        auto old_it = old_addrs.find(create_downstream_addr_key(addr));
+        if (old_it != std::ranges::end(old_addrs)) {
+          carry_over_downstream_addr(dst, *shared_addr, addr,
+                                     *(*old_it).second);
+          addr.connect_blocker->set_unblock_func(std::move(unblock_func));
+
+          // The backend address is carried over at most once.
+          old_addrs.erase(old_it);
+
+          continue;
+        }
+
+        addr.connect_blocker = std::make_unique<ConnectBlocker>(
+          randgen_, loop_, nullptr, std::move(unblock_func));
 
         addr.live_check = std::make_unique<LiveCheck>(loop_, cl_ssl_ctx_, this,
                                                       &addr, randgen_);
+
+        addr.dconn_pool = std::make_unique<DownstreamConnectionPool>();
       }
 
       size_t seq = 0;
       for (auto &addr : shared_addr->addrs) {
-        addr.dconn_pool = std::make_unique<DownstreamConnectionPool>();
         addr.seq = seq++;
       }
 
       util::shuffle(shared_addr->addrs, randgen_,
                     [](auto i, auto j) { std::swap((*i).seq, (*j).seq); });
 
-      if (shared_addr->affinity.type == SessionAffinity::NONE) {
+      if (shared_addr->affinity.type == SessionAffinity::NONE &&
+          shared_addr->lb == LoadBalancing::WRR) {
         std::unordered_map<std::string_view, WeightGroup *> wgs;
         size_t num_wgs = 0;
         for (auto &addr : shared_addr->addrs) {
@@ -421,6 +596,7 @@ void Worker::replace_downstream_config(
           (*old_addr_group_it)->pattern == dst->pattern &&
           (*old_addr_group_it)->shared_addr->affinity.type ==
             SessionAffinity::NONE &&
+          (*old_addr_group_it)->shared_addr->lb == LoadBalancing::WRR &&
           std::ranges::equal(shared_addr->wgs,
                              (*old_addr_group_it)->shared_addr->wgs,
                              [](const auto &a, const auto &b) {
@@ -439,6 +615,14 @@ void Worker::replace_downstream_config(
         }
       }
 
+      // Keep the observed latency distribution for hedging.
+      if (old_addr_group_it != std::ranges::end(old_addr_groups) &&
+          (*old_addr_group_it)->pattern == dst->pattern &&
+          (*old_addr_group_it)->shared_addr->hedge_percentile ==
+            shared_addr->hedge_percentile) {
+        shared_addr->hedge = (*old_addr_group_it)->shared_addr->hedge;
+      }
+
       dst->shared_addr = std::move(shared_addr);
 
       addr_groups_indexer.emplace(std::move(dkey), i);
@@ -452,13 +636,101 @@ void Worker::replace_downstream_config(
       dst->shared_addr = g->shared_addr;
     }
   }
+
+  for (auto &g : old_addr_groups) {
+    g->retired = true;
+
+    auto &shared_addr = g->shared_addr;
+    for (auto &addr : shared_addr->addrs) {
+      addr.dconn_pool->remove_all();
+    }
+  }
+
+  // Fire immediately so that the connections to the new backends are
+  // made as soon as possible.  The periodic run refills the pool
+  // after connections are taken, closed, or the backend comes back.
+  ev_timer_stop(loop_, &prewarm_timer_);
+  if (downstreamconf_->http2_min_idle_connections) {
+    ev_timer_set(&prewarm_timer_, 0., PREWARM_INTERVAL);
+    ev_timer_start(loop_, &prewarm_timer_);
+  }
+}
+
+void Worker::carry_over_downstream_addr(
+  const std::shared_ptr<DownstreamAddrGroup> &group,
+  const SharedDownstreamAddr &shared_addr, DownstreamAddr &addr,
+  DownstreamAddr &old_addr) {
+  if (log_enabled(INFO)) {
+    Log{INFO} << group->pattern << " carries over the backend "
+              << addr.hostport << " of the previous configuration";
+  }
+
+  // The previous backend address still serves the requests in flight
+  // until they finish.  It gets the fresh objects instead.
+  addr.connect_blocker = std::exchange(
+    old_addr.connect_blocker,
+    std::make_unique<ConnectBlocker>(randgen_, loop_, nullptr, nullptr));
+
+  addr.live_check = std::exchange(
+    old_addr.live_check, std::make_unique<LiveCheck>(loop_, cl_ssl_ctx_, this,
+                                                     &old_addr, randgen_));
+  addr.live_check->set_downstream_addr(&addr);
+
+  addr.dconn_pool = std::exchange(old_addr.dconn_pool,
+                                  std::make_unique<DownstreamConnectionPool>());
+  // Only HTTP/1 connections are pooled.
+  for (auto dconn : addr.dconn_pool->get_downstream_connections()) {
+    static_cast<HttpDownstreamConnection *>(dconn)->set_downstream_addr(
+      group, &addr);
+  }
+
+  // The sessions which have streams in flight stay in the previous
+  // group, and are retired with it.
+  std::vector<Http2Session *> idle_sessions;
+  for (auto session = old_addr.http2_extra_freelist.head; session;
+       session = session->dlnext) {
+    if (session->get_num_dconns() == 0) {
+      idle_sessions.push_back(session);
+    }
+  }
+
+  for (auto session : idle_sessions) {
+    session->set_downstream_addr(group, &addr);
+  }
+
+  addr.tls_session_cache.session_data =
+    old_addr.tls_session_cache.session_data;
+  addr.tls_session_cache.last_updated =
+    old_addr.tls_session_cache.last_updated;
+#ifdef ENABLE_HTTP3
+  addr.quic_transport_params = old_addr.quic_transport_params;
+#endif // defined(ENABLE_HTTP3)
+
+  // The requests in flight are still counted by old_addr.
+  addr.rtt_ewma = old_addr.rtt_ewma;
+  addr.rtt_ewma_last = old_addr.rtt_ewma_last;
+  if (shared_addr.concurrency_limit && old_addr.concurrency_limit > 0.) {
+    addr.concurrency_limit =
+      std::min(old_addr.concurrency_limit,
+               static_cast<double>(shared_addr.concurrency_limit));
+  }
+  addr.min_rtt = old_addr.min_rtt;
+  addr.min_rtt_window_start = old_addr.min_rtt_window_start;
+  addr.num_concurrency_rejected = old_addr.num_concurrency_rejected;
+  addr.outlier_errors = old_addr.outlier_errors;
+  addr.num_ejections = old_addr.num_ejections;
+  addr.ejected_at = old_addr.ejected_at;
 }
 
 Worker::~Worker() {
   ev_async_stop(loop_, &w_);
   ev_timer_stop(loop_, &mcpool_clear_timer_);
+  ev_timer_stop(loop_, &prewarm_timer_);
   ev_timer_stop(loop_, &proc_wev_timer_);
   ev_timer_stop(loop_, &disable_listener_timer_);
+  ev_check_stop(loop_, &loop_check_);
+  ev_prepare_stop(loop_, &loop_prepare_);
+  ev_timer_stop(loop_, &loop_stat_timer_);
 }
 
 void Worker::schedule_clear_mcpool() {
@@ -468,6 +740,48 @@ void Worker::schedule_clear_mcpool() {
   ev_timer_start(loop_, &mcpool_clear_timer_);
 }
 
+void Worker::prewarm_downstream_connections() {
+  auto min_idle = downstreamconf_->http2_min_idle_connections;
+
+  for (auto &group : downstream_addr_groups_) {
+    auto &shared_addr = group->shared_addr;
+    if (shared_addr->dnf) {
+      continue;
+    }
+
+    for (auto &addr : shared_addr->addrs) {
+      if (addr.proto != Proto::HTTP2) {
+        continue;
+      }
+
+      for (auto session = addr.http2_extra_freelist.head; session;
+           session = session->dlnext) {
+        session->prewarm();
+      }
+
+      // Do not hammer the backend which is known to be down.  The
+      // connections are made again after it recovers.
+      if (connect_blocker_->blocked() || addr.connect_blocker->blocked() ||
+          addr.connect_blocker->in_offline()) {
+        continue;
+      }
+
+      for (auto n = addr.http2_extra_freelist.size(); n < min_idle; ++n) {
+        auto session =
+          new Http2Session(loop_, cl_ssl_ctx_, this, group, &addr);
+
+        if (log_enabled(INFO)) {
+          Log{INFO, this} << "Prewarm Http2Session " << session
+                          << " for backend " << addr.hostport;
+        }
+
+        session->add_to_extra_freelist();
+        session->prewarm();
+      }
+    }
+  }
+}
+
 void Worker::wait() {
 #ifndef NOTHREADS
   fut_.get();
@@ -497,6 +811,103 @@ void Worker::send(WorkerEvent event) {
   ev_async_send(loop_, &w_);
 }
 
+#ifdef ENABLE_HTTP3
+namespace {
+// QUIC_FORWARD_BATCH is the maximum number of forwarded QUIC packets
+// processed in a single event loop iteration.
+constexpr size_t QUIC_FORWARD_BATCH = 64;
+} // namespace
+
+void Worker::forward_quic_packet(size_t upstream_addr_index,
+                                 const Address &remote_addr,
+                                 const Address &local_addr,
+                                 const ngtcp2_pkt_info &pi,
+                                 std::span<const uint8_t> data) {
+  if (!quic_forward_ring_ || data.size() > QUIC_FORWARD_PKTLEN) {
+    send(WorkerEvent{
+      .type = WorkerEventType::QUIC_PKT_FORWARD,
+      .quic_pkt = std::make_unique<QUICPacket>(upstream_addr_index,
+                                               remote_addr, local_addr, pi,
+                                               data),
+    });
+
+    return;
+  }
+
+  if (!quic_forward_ring_->push([&](QUICForwardPacket &pkt) {
+        pkt.upstream_addr_index = upstream_addr_index;
+        pkt.remote_addr = remote_addr;
+        pkt.local_addr = local_addr;
+        pkt.pi = pi;
+        pkt.datalen = data.size();
+        std::ranges::copy(data, std::ranges::begin(pkt.data));
+      })) {
+    if (log_enabled(INFO)) {
+      Log{INFO} << "QUIC forward queue is full; drop packet";
+    }
+
+    return;
+  }
+
+  // Signal w_ only once until the consumer catches up.
+  if (!quic_forward_pending_.exchange(true, std::memory_order_acq_rel)) {
+    ev_async_send(loop_, &w_);
+  }
+}
+
+void Worker::process_quic_forward_ring() {
+  if (!quic_forward_ring_) {
+    return;
+  }
+
+  quic_forward_pending_.exchange(false, std::memory_order_acq_rel);
+
+  for (size_t i = 0; i < QUIC_FORWARD_BATCH; ++i) {
+    if (!quic_forward_ring_->pop([this](QUICForwardPacket &pkt) {
+          handle_forwarded_quic_packet(pkt.upstream_addr_index,
+                                       pkt.remote_addr, pkt.local_addr, pkt.pi,
+                                       {pkt.data.data(), pkt.datalen});
+        })) {
+      return;
+    }
+  }
+
+  if (!quic_forward_ring_->empty() &&
+      !quic_forward_pending_.exchange(true, std::memory_order_acq_rel)) {
+    // Yield to the other events, and continue in the next
+    // iteration.
+    ev_async_send(loop_, &w_);
+  }
+}
+
+void Worker::handle_forwarded_quic_packet(size_t upstream_addr_index,
+                                          const Address &remote_addr,
+                                          const Address &local_addr,
+                                          const ngtcp2_pkt_info &pi,
+                                          std::span<const uint8_t> data) {
+  const UpstreamAddr *faddr;
+
+  if (upstream_addr_index == static_cast<size_t>(-1)) {
+    auto maybe_faddr = find_quic_upstream_addr(local_addr);
+    if (!maybe_faddr) {
+      Log{ERROR} << "No suitable upstream address found";
+
+      return;
+    }
+
+    faddr = *maybe_faddr;
+  } else if (quic_upstream_addrs_.size() <= upstream_addr_index) {
+    Log{ERROR} << "upstream_addr_index is too large";
+
+    return;
+  } else {
+    faddr = &quic_upstream_addrs_[upstream_addr_index];
+  }
+
+  quic_conn_handler_.handle_packet(faddr, remote_addr, local_addr, pi, data);
+}
+#endif // defined(ENABLE_HTTP3)
+
 void Worker::process_events() {
   WorkerEvent wev;
   {
@@ -530,6 +941,8 @@ void Worker::process_events() {
 
     graceful_shutdown_ = true;
 
+    ev_timer_stop(loop_, &prewarm_timer_);
+
     drain_and_delete_listener();
 
     if (worker_stat_.num_connections == 0 &&
@@ -547,33 +960,12 @@ void Worker::process_events() {
 
     break;
 #ifdef ENABLE_HTTP3
-  case WorkerEventType::QUIC_PKT_FORWARD: {
-    const UpstreamAddr *faddr;
-
-    if (wev.quic_pkt->upstream_addr_index == static_cast<size_t>(-1)) {
-      auto maybe_faddr = find_quic_upstream_addr(wev.quic_pkt->local_addr);
-      if (!maybe_faddr) {
-        Log{ERROR} << "No suitable upstream address found";
-
-        break;
-      }
-
-      faddr = *maybe_faddr;
-    } else if (quic_upstream_addrs_.size() <=
-               wev.quic_pkt->upstream_addr_index) {
-      Log{ERROR} << "upstream_addr_index is too large";
-
-      break;
-    } else {
-      faddr = &quic_upstream_addrs_[wev.quic_pkt->upstream_addr_index];
-    }
-
-    quic_conn_handler_.handle_packet(faddr, wev.quic_pkt->remote_addr,
-                                     wev.quic_pkt->local_addr, wev.quic_pkt->pi,
-                                     wev.quic_pkt->data);
+  case WorkerEventType::QUIC_PKT_FORWARD:
+    handle_forwarded_quic_packet(
+      wev.quic_pkt->upstream_addr_index, wev.quic_pkt->remote_addr,
+      wev.quic_pkt->local_addr, wev.quic_pkt->pi, wev.quic_pkt->data);
 
     break;
-  }
 #endif // defined(ENABLE_HTTP3)
   default:
     if (log_enabled(INFO)) {
@@ -613,6 +1005,108 @@ void Worker::sleep_listener(ev_tstamp t) {
   ev_timer_start(loop_, &disable_listener_timer_);
 }
 
+void Worker::on_loop_check() { loop_iteration_start_ = ev_time(); }
+
+void Worker::on_loop_prepare() {
+  if (loop_iteration_start_ == 0.) {
+    return;
+  }
+
+  auto t = ev_time() - loop_iteration_start_;
+
+  loop_iteration_start_ = 0.;
+
+  loop_busy_time_ += t;
+  loop_max_iteration_time_ = std::max(loop_max_iteration_time_, t);
+  ++loop_num_iterations_;
+}
+
+void Worker::update_loop_stat() {
+  auto now = ev_time();
+  auto interval = now - loop_interval_start_;
+
+  loop_interval_start_ = now;
+
+  auto max_iteration_time = loop_max_iteration_time_;
+  auto busy_ratio = interval > 0. ? loop_busy_time_ / interval : 0.;
+
+  loop_stat_.max_iteration_time.store(max_iteration_time,
+                                      std::memory_order_relaxed);
+  loop_stat_.busy_ratio.store(busy_ratio, std::memory_order_relaxed);
+  loop_stat_.num_iterations.store(loop_num_iterations_,
+                                  std::memory_order_relaxed);
+
+  for (size_t i = 0; i < NUM_LOOP_CATEGORIES; ++i) {
+    loop_stat_.category_time[i].store(loop_category_time_[i],
+                                      std::memory_order_relaxed);
+  }
+
+  if (log_enabled(INFO)) {
+    auto tls_handshake_time =
+      loop_category_time_[static_cast<size_t>(LoopCategory::TLS_HANDSHAKE)];
+    auto mruby_time =
+      loop_category_time_[static_cast<size_t>(LoopCategory::MRUBY)];
+
+    Log{INFO, this} << "Event loop: iterations=" << loop_num_iterations_
+                    << ", max_iteration="
+                    << util::format_duration(max_iteration_time)
+                    << ", busy=" << busy_ratio
+                    << ", tls_handshake="
+                    << util::format_duration(tls_handshake_time)
+                    << ", mruby=" << util::format_duration(mruby_time);
+  }
+
+  loop_busy_time_ = 0.;
+  loop_max_iteration_time_ = 0.;
+  loop_num_iterations_ = 0;
+  loop_category_time_ = {};
+
+  auto threshold = get_config()->conn.listener.loop_lag_threshold;
+
+  if (threshold == 0. || graceful_shutdown_) {
+    return;
+  }
+
+  auto throttled = loop_stat_.throttled.load(std::memory_order_relaxed);
+
+  if (!throttled) {
+    if (max_iteration_time <= threshold) {
+      return;
+    }
+
+    Log{WARN, this} << "Event loop iteration took "
+                    << util::format_duration(max_iteration_time)
+                    << ", stop accepting new connections";
+
+    loop_stat_.throttled.store(true, std::memory_order_relaxed);
+
+    disable_listener();
+
+    return;
+  }
+
+  if (max_iteration_time > threshold) {
+    return;
+  }
+
+  Log{NOTICE, this} << "Event loop lag recovered, accept new connections";
+
+  loop_stat_.throttled.store(false, std::memory_order_relaxed);
+
+  // sleep_listener() may have disabled listeners.
+  if (!ev_is_active(&disable_listener_timer_)) {
+    enable_listener();
+  }
+}
+
+void Worker::add_loop_time(LoopCategory cat, ev_tstamp t) {
+  loop_category_time_[static_cast<size_t>(cat)] += t;
+}
+
+const WorkerLoopStat &Worker::get_loop_stat() const { return loop_stat_; }
+
+size_t Worker::get_index() const { return index_; }
+
 tls::CertLookupTree *Worker::get_cert_lookup_tree() const { return cert_tree_; }
 
 #ifdef ENABLE_HTTP3
@@ -650,6 +1144,8 @@ SSL_CTX *Worker::get_cl_ssl_ctx() const { return cl_ssl_ctx_; }
 
 #ifdef ENABLE_HTTP3
 SSL_CTX *Worker::get_quic_sv_ssl_ctx() const { return quic_sv_ssl_ctx_; }
+
+SSL_CTX *Worker::get_quic_cl_ssl_ctx() const { return quic_cl_ssl_ctx_; }
 #endif // defined(ENABLE_HTTP3)
 
 void Worker::set_graceful_shutdown(bool f) { graceful_shutdown_ = f; }
@@ -686,6 +1182,10 @@ ConnectBlocker *Worker::get_connect_blocker() const {
   return connect_blocker_.get();
 }
 
+#ifdef HAVE_LIBURING
+IOUring *Worker::get_io_uring() const { return io_uring_.get(); }
+#endif // defined(HAVE_LIBURING)
+
 const DownstreamConfig *Worker::get_downstream_config() const {
   return downstreamconf_.get();
 }
@@ -902,10 +1402,33 @@ Worker::create_tcp_server_socket(UpstreamAddr &faddr) {
 QUICConnectionHandler *Worker::get_quic_connection_handler() {
   return &quic_conn_handler_;
 }
+
+#  ifdef HAVE_SENDMMSG
+QUICSendQueue *Worker::get_quic_send_queue() { return &quic_send_queue_; }
+#  endif // defined(HAVE_SENDMMSG)
 #endif // defined(ENABLE_HTTP3)
 
 DNSTracker *Worker::get_dns_tracker() { return &dns_tracker_; }
 
+TimerWheel *Worker::get_timer_wheel() { return &timer_wheel_; }
+
+CollapseEntry *Worker::find_collapse_entry(std::string_view key) const {
+  auto it = collapse_entries_.find(key);
+  if (it == std::ranges::end(collapse_entries_)) {
+    return nullptr;
+  }
+
+  return (*it).second;
+}
+
+void Worker::add_collapse_entry(CollapseEntry *entry) {
+  collapse_entries_.emplace(entry->get_key(), entry);
+}
+
+void Worker::remove_collapse_entry(CollapseEntry *entry) {
+  collapse_entries_.erase(entry->get_key());
+}
+
 #ifdef ENABLE_HTTP3
 #  ifdef HAVE_LIBBPF
 bool Worker::should_attach_bpf() const {
@@ -1668,6 +2191,239 @@ size_t match_downstream_addr_group(
                                           catch_all, balloc);
 }
 
+void downstream_addr_observe_rtt(DownstreamAddr &addr, ev_tstamp rtt,
+                                 ev_tstamp now) {
+  if (rtt > addr.rtt_ewma) {
+    addr.rtt_ewma = rtt;
+  } else {
+    auto w = exp(-std::max(now - addr.rtt_ewma_last, 0.) /
+                 DOWNSTREAM_ADDR_RTT_DECAY);
+    addr.rtt_ewma = addr.rtt_ewma * w + rtt * (1. - w);
+  }
+
+  addr.rtt_ewma_last = now;
+}
+
+double downstream_addr_load(const DownstreamAddr &addr, ev_tstamp now) {
+  // Penalty for an address which has requests in flight, but no
+  // latency has been observed yet.  Such address is avoided until the
+  // first response arrives.
+  constexpr double penalty = 1e5;
+
+  if (addr.rtt_ewma == 0.) {
+    if (addr.num_inflight == 0) {
+      return 0.;
+    }
+
+    return (penalty + static_cast<double>(addr.num_inflight)) / addr.weight;
+  }
+
+  // Decay the estimate toward 0 so that an address which was slow in
+  // the past gets the chance to be chosen again.
+  auto rtt =
+    addr.rtt_ewma * exp(-std::max(now - addr.rtt_ewma_last, 0.) /
+                        DOWNSTREAM_ADDR_RTT_DECAY);
+
+  return rtt * static_cast<double>(addr.num_inflight + 1) / addr.weight;
+}
+
+void downstream_addr_update_concurrency_limit(DownstreamAddr &addr,
+                                              ev_tstamp rtt, ev_tstamp now,
+                                              size_t max_limit) {
+  // The smoothing factor of the limit.
+  constexpr double alpha = 0.2;
+
+  if (addr.min_rtt == 0. ||
+      now - addr.min_rtt_window_start >= DOWNSTREAM_ADDR_MIN_RTT_WINDOW) {
+    addr.min_rtt = rtt;
+    addr.min_rtt_window_start = now;
+  } else if (rtt < addr.min_rtt) {
+    addr.min_rtt = rtt;
+  }
+
+  auto limit = addr.concurrency_limit;
+  auto gradient = rtt > 0. ? std::clamp(addr.min_rtt / rtt, 0.5, 1.) : 1.;
+
+  // Do not grow the limit if it is not the bottleneck.  Otherwise,
+  // the limit keeps growing while the backend is lightly loaded.
+  if (gradient == 1. && static_cast<double>(addr.num_inflight) * 2 < limit) {
+    return;
+  }
+
+  // sqrt(limit) is the headroom which allows the limit to probe the
+  // larger concurrency.
+  auto new_limit = limit * gradient + sqrt(limit);
+
+  addr.concurrency_limit =
+    std::clamp(limit * (1. - alpha) + new_limit * alpha, 1.,
+               static_cast<double>(max_limit));
+}
+
+void downstream_addr_decrease_concurrency_limit(DownstreamAddr &addr) {
+  addr.concurrency_limit = std::max(addr.concurrency_limit * 0.9, 1.);
+}
+
+bool downstream_addr_concurrency_available(const DownstreamAddr &addr) {
+  return static_cast<double>(addr.num_inflight) <
+         std::max(floor(addr.concurrency_limit), 1.);
+}
+
+void hedge_add_sample(HedgeState &hedge, ev_tstamp rtt, uint32_t percentile) {
+  // Recompute the delay every this number of samples.
+  constexpr size_t update_interval = 16;
+
+  hedge.samples[hedge.num_samples % HEDGE_NUM_SAMPLES] = rtt;
+  ++hedge.num_samples;
+
+  if (hedge.num_samples < HEDGE_MIN_SAMPLES ||
+      hedge.num_samples % update_interval) {
+    return;
+  }
+
+  auto n = std::min(hedge.num_samples, HEDGE_NUM_SAMPLES);
+
+  std::array<ev_tstamp, HEDGE_NUM_SAMPLES> samples;
+  auto first = std::ranges::begin(samples);
+  auto last = std::ranges::copy_n(std::ranges::begin(hedge.samples),
+                                  static_cast<ptrdiff_t>(n), first)
+                .out;
+  auto nth = first + static_cast<ptrdiff_t>(n * percentile / 100);
+
+  std::ranges::nth_element(first, nth, last);
+
+  hedge.delay = *nth;
+}
+
+void hedge_add_budget(HedgeState &hedge, double ratio) {
+  hedge.tokens = std::min(hedge.tokens + ratio, HEDGE_MAX_TOKENS);
+}
+
+bool hedge_consume_budget(HedgeState &hedge) {
+  if (hedge.tokens < 1.) {
+    return false;
+  }
+
+  hedge.tokens -= 1.;
+
+  return true;
+}
+
+bool outlier_detection_enabled(const OutlierConfig &outlier) {
+  return outlier.errors || outlier.latency;
+}
+
+ev_tstamp outlier_ejection_time(ev_tstamp base, size_t num_ejections,
+                                ev_tstamp max) {
+  auto n = std::min(num_ejections, size_t{16});
+
+  return std::min(max, base * util::int_pow(2., n));
+}
+
+bool downstream_addr_eject(SharedDownstreamAddr &shared_addr,
+                           DownstreamAddr &addr, ev_tstamp now,
+                           std::string_view reason) {
+  if (addr.connect_blocker->blocked()) {
+    return false;
+  }
+
+  size_t num_ejected = 0;
+  size_t num_blocked = 0;
+
+  for (auto &a : shared_addr.addrs) {
+    if (a.connect_blocker->ejected()) {
+      ++num_ejected;
+    }
+    if (a.connect_blocker->blocked()) {
+      ++num_blocked;
+    }
+  }
+
+  auto naddrs = shared_addr.addrs.size();
+
+  if (num_blocked + 1 >= naddrs ||
+      num_ejected >=
+        std::max(size_t{1},
+                 naddrs * shared_addr.outlier.max_ejection_percent / 100)) {
+    return false;
+  }
+
+  auto t = outlier_ejection_time(
+    shared_addr.outlier.ejection_time, addr.num_ejections,
+    get_config()->conn.downstream->timeout.max_backoff);
+
+  Log{WARN} << "Eject backend " << addr.hostport << " for " << t
+            << " seconds: " << reason;
+
+  ++addr.num_ejections;
+  addr.ejected_at = now;
+  addr.outlier_errors = 0;
+  // The latency is measured again from scratch after the ejection.
+  addr.rtt_ewma = 0.;
+  addr.rtt_ewma_last = 0.;
+
+  addr.connect_blocker->eject(t);
+
+  return true;
+}
+
+namespace {
+void eject_latency_outliers(SharedDownstreamAddr &shared_addr,
+                            ev_tstamp now) {
+  std::vector<ev_tstamp> rtts;
+
+  for (auto &addr : shared_addr.addrs) {
+    if (addr.rtt_ewma > 0. && !addr.connect_blocker->blocked()) {
+      rtts.push_back(addr.rtt_ewma);
+    }
+  }
+
+  if (rtts.size() < 3) {
+    return;
+  }
+
+  auto mid = std::ranges::begin(rtts) + as_signed(rtts.size() / 2);
+  std::ranges::nth_element(rtts, mid);
+
+  auto threshold = *mid * static_cast<double>(shared_addr.outlier.latency);
+
+  for (auto &addr : shared_addr.addrs) {
+    if (addr.rtt_ewma > threshold) {
+      downstream_addr_eject(shared_addr, addr, now, "latency outlier"sv);
+    }
+  }
+}
+} // namespace
+
+void downstream_addr_record_outcome(SharedDownstreamAddr &shared_addr,
+                                    DownstreamAddr &addr, bool failure,
+                                    ev_tstamp now) {
+  auto &outlier = shared_addr.outlier;
+
+  if (failure) {
+    ++addr.outlier_errors;
+
+    if (outlier.errors && addr.outlier_errors >= outlier.errors) {
+      downstream_addr_eject(shared_addr, addr, now,
+                            "too many consecutive failures"sv);
+    }
+  } else {
+    addr.outlier_errors = 0;
+
+    if (addr.num_ejections &&
+        now - addr.ejected_at >=
+          get_config()->conn.downstream->timeout.max_backoff) {
+      addr.num_ejections = 0;
+    }
+  }
+
+  if (outlier.latency &&
+      ++shared_addr.num_outlier_samples >= OUTLIER_LATENCY_INTERVAL) {
+    shared_addr.num_outlier_samples = 0;
+
+    eject_latency_outliers(shared_addr, now);
+  }
+}
+
 void downstream_failure(DownstreamAddr *addr, const Address *raddr) {
   const auto &connect_blocker = addr->connect_blocker;
 
@@ -34,6 +34,8 @@
 #include <deque>
 #include <thread>
 #include <queue>
+#include <atomic>
+#include <array>
 #ifndef NOTHREADS
 #  include <future>
 #endif // !defined(NOTHREADS)
@@ -59,11 +61,13 @@
 #include "shrpx_live_check.h"
 #include "shrpx_connect_blocker.h"
 #include "shrpx_dns_tracker.h"
+#include "shrpx_timer_wheel.h"
 #ifdef ENABLE_HTTP3
 #  include "shrpx_quic_connection_handler.h"
 #  include "shrpx_quic.h"
 #endif // defined(ENABLE_HTTP3)
 #include "allocator.h"
+#include "ring.h"
 #include "errors.h"
 
 using namespace nghttp2;
@@ -71,10 +75,17 @@ using namespace nghttp2;
 namespace shrpx {
 
 class Http2Session;
+#ifdef ENABLE_HTTP3
+class Http3Session;
+#endif // defined(ENABLE_HTTP3)
 class ConnectBlocker;
 struct UpstreamAddr;
 class ConnectionHandler;
 class AcceptHandler;
+#ifdef HAVE_LIBURING
+class IOUring;
+#endif // defined(HAVE_LIBURING)
+class CollapseEntry;
 #ifdef ENABLE_HTTP3
 class QUICListener;
 #endif // defined(ENABLE_HTTP3)
@@ -121,10 +132,48 @@ struct DownstreamAddr {
   // coalesce as much stream as possible in one Http2Session to fully
   // utilize TCP connection.
   DList<Http2Session> http2_extra_freelist;
+#ifdef ENABLE_HTTP3
+  // List of Http3Session which is not fully utilized.  This is the
+  // HTTP/3 counterpart of http2_extra_freelist.
+  DList<Http3Session> http3_extra_freelist;
+  // QUIC transport parameters remembered from the last successful
+  // connection to this address.  They are required to send 0-RTT
+  // data along with the resumed TLS session.
+  std::vector<uint8_t> quic_transport_params;
+#endif // defined(ENABLE_HTTP3)
   WeightGroup *wg;
   // total number of streams created in HTTP/2 connections for this
   // address.
   size_t num_dconn;
+  // The number of requests in flight to this address.  It is only
+  // maintained if LoadBalancing::P2C or bounded load affinity is
+  // used.
+  size_t num_inflight;
+  // Peak EWMA of the time to the first response header from this
+  // address in seconds.  It is only maintained if the requests in
+  // flight are tracked (see SharedDownstreamAddr::num_inflight).
+  ev_tstamp rtt_ewma;
+  // The timestamp when rtt_ewma was last updated.
+  ev_tstamp rtt_ewma_last;
+  // Adaptive limit of the number of requests in flight to this
+  // address.  It is only maintained if
+  // SharedDownstreamAddr::concurrency_limit > 0.
+  double concurrency_limit;
+  // The minimum time to the first response header observed in the
+  // current window.  0 means that nothing has been observed yet.
+  ev_tstamp min_rtt;
+  // The timestamp when the current window of min_rtt started.
+  ev_tstamp min_rtt_window_start;
+  // The number of requests rejected because concurrency_limit has
+  // been reached.
+  uint64_t num_concurrency_rejected;
+  // The number of consecutive failed requests to this address.  It
+  // is only maintained if passive outlier detection is enabled.
+  size_t outlier_errors;
+  // The number of times this address has been ejected in a row.
+  size_t num_ejections;
+  // The timestamp when this address was ejected last time.
+  ev_tstamp ejected_at;
   // the sequence number of this address to randomize the order access
   // threads.
   size_t seq;
@@ -207,6 +256,45 @@ struct WeightGroupEntryGreater {
   }
 };
 
+// The number of the recent samples of the time to the response
+// header which HedgeState keeps.
+inline constexpr size_t HEDGE_NUM_SAMPLES = 128;
+// The minimum number of samples required to start hedging.
+inline constexpr size_t HEDGE_MIN_SAMPLES = 32;
+// The maximum number of hedges which can be accumulated in budget.
+inline constexpr double HEDGE_MAX_TOKENS = 10.;
+
+// HedgeState is the state of hedging of a backend group.
+struct HedgeState {
+  // The ring buffer of the recent time to the response header.
+  std::array<ev_tstamp, HEDGE_NUM_SAMPLES> samples;
+  // The total number of samples added.
+  size_t num_samples;
+  // The delay before a request is hedged.  0 means that there are
+  // not enough samples to hedge.
+  ev_tstamp delay;
+  // The budget of hedges.  A request can be hedged if it is at least
+  // 1.
+  double tokens;
+  // The number of hedged requests.
+  uint64_t num_hedged;
+  // The number of hedged requests which received a response header
+  // from the other backend address.
+  uint64_t num_won;
+};
+
+// Adds the time to the response header |rtt| to |hedge|, and updates
+// its delay to the |percentile|th percentile of the recent samples.
+void hedge_add_sample(HedgeState &hedge, ev_tstamp rtt, uint32_t percentile);
+
+// Adds |ratio| hedges to the budget of |hedge|.  This is called for
+// each request which can be hedged.
+void hedge_add_budget(HedgeState &hedge, double ratio);
+
+// Consumes one hedge from the budget of |hedge|.  It returns false if
+// the budget is exhausted.
+bool hedge_consume_budget(HedgeState &hedge);
+
 struct SharedDownstreamAddr {
   SharedDownstreamAddr() noexcept = default;
   SharedDownstreamAddr(const SharedDownstreamAddr &) = delete;
@@ -224,19 +312,50 @@ struct SharedDownstreamAddr {
   // SessionAffinity::IP.
   std::vector<AffinityHash> affinity_hash;
   // Maps affinity hash of each DownstreamAddr to its index in addrs.
-  // It is only assigned when strict stickiness is enabled.
+  // It is only assigned when strict stickiness or affinity=app-cookie
+  // is enabled.
   std::unordered_map<uint32_t, size_t> affinity_hash_map;
+  // Maglev lookup table.  Each element of its slots is an index into
+  // addrs.  Only used if affinity.hash == AffinityHashMethod::MAGLEV.
+  std::shared_ptr<const MaglevTable> maglev_table;
+  // The backend address which issued each value of the cookie.  Only
+  // used if affinity.type == SessionAffinity::APP_COOKIE.
+  std::shared_ptr<AppCookieTable> app_cookie_table;
 #ifdef HAVE_MRUBY
   std::shared_ptr<mruby::MRubyContext> mruby_ctx;
 #endif // defined(HAVE_MRUBY)
   // Configuration for session affinity
   AffinityConfig affinity{SessionAffinity::NONE};
+  // Load balancing method used if session affinity is disabled.
+  LoadBalancing lb{LoadBalancing::WRR};
+  // The total number of requests in flight to addrs.  It is only
+  // tracked if lb == LoadBalancing::P2C, affinity.max_load > 0,
+  // concurrency_limit > 0, hedge_percentile > 0, or passive outlier
+  // detection is enabled.
+  size_t num_inflight{};
+  // The upper bound of DownstreamAddr::concurrency_limit.  0 disables
+  // the adaptive concurrency limit.
+  size_t concurrency_limit{};
+  // The percentile of the time to the response header used as the
+  // delay of hedging.  0 disables hedging.
+  uint32_t hedge_percentile{};
+  // The ratio of the hedged requests to the requests which can be
+  // hedged.
+  double hedge_budget{};
+  HedgeState hedge{};
+  OutlierConfig outlier{};
+  // The number of responses since latency outliers were searched last
+  // time.
+  size_t num_outlier_samples{};
   // Session affinity
   // true if this group requires that client connection must be TLS,
   // and the request must be redirected to https URI.
   bool redirect_if_not_tls{};
   // true if a request should not be forwarded to a backend.
   bool dnf{};
+  // true if identical cacheable GET requests in flight are collapsed
+  // into a single backend request.
+  bool collapse{};
   // Timeouts for backend connection.
   struct {
     ev_tstamp read;
@@ -266,6 +385,40 @@ struct WorkerStat {
   size_t num_close_waits;
 };
 
+// The kinds of work done in the event loop of Worker whose time is
+// measured separately.
+enum class LoopCategory {
+  // TLS handshake with clients.
+  TLS_HANDSHAKE,
+  // mruby scripts.
+  MRUBY,
+};
+
+// The number of LoopCategory values.
+constexpr size_t NUM_LOOP_CATEGORIES = 2;
+
+// The interval to aggregate the event loop statistics.
+constexpr ev_tstamp LOOP_STAT_INTERVAL = 1.;
+
+// WorkerLoopStat is the event loop statistics of Worker.  A loop
+// iteration is the work done between two polls.  The worker thread
+// updates them every LOOP_STAT_INTERVAL, and the other threads may
+// read them.
+struct WorkerLoopStat {
+  // The longest loop iteration in the last interval.
+  std::atomic<ev_tstamp> max_iteration_time;
+  // The fraction of the last interval spent in loop iterations.
+  std::atomic<double> busy_ratio;
+  // The number of loop iterations in the last interval.
+  std::atomic<uint64_t> num_iterations;
+  // The time spent in each LoopCategory in the last interval.
+  std::array<std::atomic<ev_tstamp>, NUM_LOOP_CATEGORIES> category_time;
+  // true if the worker stops accepting new connections because its
+  // loop iterations take longer than
+  // ListenerConfig::loop_lag_threshold.
+  std::atomic<bool> throttled;
+};
+
 #ifdef ENABLE_HTTP3
 struct QUICPacket {
   QUICPacket() noexcept = default;
@@ -283,6 +436,27 @@ struct QUICPacket {
   ngtcp2_pkt_info pi{};
   std::vector<uint8_t> data;
 };
+
+// QUIC_FORWARD_PKTLEN is the maximum length of QUIC packet which is
+// forwarded to a worker through QUICForwardRing.  A larger packet is
+// sent as WorkerEvent.
+inline constexpr size_t QUIC_FORWARD_PKTLEN = 1500;
+// QUIC_FORWARD_RING_SIZE is the number of packets that
+// QUICForwardRing can hold.
+inline constexpr size_t QUIC_FORWARD_RING_SIZE = 512;
+
+// QUICForwardPacket is a QUIC packet forwarded from another worker or
+// worker process.  It is stored in QUICForwardRing, and reused.
+struct QUICForwardPacket {
+  size_t upstream_addr_index;
+  Address remote_addr;
+  Address local_addr;
+  ngtcp2_pkt_info pi;
+  size_t datalen;
+  std::array<uint8_t, QUIC_FORWARD_PKTLEN> data;
+};
+
+using QUICForwardRing = MPSCRing<QUICForwardPacket, QUIC_FORWARD_RING_SIZE>;
 #endif // defined(ENABLE_HTTP3)
 
 enum class WorkerEventType {
@@ -308,7 +482,7 @@ public:
          tls::CertLookupTree *cert_tree,
 #ifdef ENABLE_HTTP3
          SSL_CTX *quic_sv_ssl_ctx, tls::CertLookupTree *quic_cert_tree,
-         WorkerID wid,
+         SSL_CTX *quic_cl_ssl_ctx, WorkerID wid,
 #endif // defined(ENABLE_HTTP3)
          size_t index, const std::shared_ptr<TicketKeys> &ticket_keys,
          ConnectionHandler *conn_handler,
@@ -318,6 +492,22 @@ public:
   void wait();
   void process_events();
   void send(WorkerEvent event);
+#ifdef ENABLE_HTTP3
+  // forward_quic_packet queues QUIC packet that is handled by this
+  // worker.  |upstream_addr_index| is the index of UpstreamAddr, or
+  // static_cast<size_t>(-1) if it is unknown.  Unlike send(), this
+  // function does not take a lock unless |data| is larger than
+  // QUIC_FORWARD_PKTLEN.  The packet is dropped if the queue is full.
+  // This function is thread-safe.
+  void forward_quic_packet(size_t upstream_addr_index,
+                           const Address &remote_addr,
+                           const Address &local_addr,
+                           const ngtcp2_pkt_info &pi,
+                           std::span<const uint8_t> data);
+  // process_quic_forward_ring handles the packets queued by
+  // forward_quic_packet.
+  void process_quic_forward_ring();
+#endif // defined(ENABLE_HTTP3)
 
   tls::CertLookupTree *get_cert_lookup_tree() const;
 #ifdef ENABLE_HTTP3
@@ -335,6 +525,7 @@ public:
   SSL_CTX *get_cl_ssl_ctx() const;
 #ifdef ENABLE_HTTP3
   SSL_CTX *get_quic_sv_ssl_ctx() const;
+  SSL_CTX *get_quic_cl_ssl_ctx() const;
 #endif // defined(ENABLE_HTTP3)
 
   void set_graceful_shutdown(bool f);
@@ -342,6 +533,10 @@ public:
 
   MemchunkPool *get_mcpool();
   void schedule_clear_mcpool();
+  // Establishes HTTP/2 backend connections so that each address has
+  // at least DownstreamConfig::http2_min_idle_connections connections
+  // which can take a new request, and checks the idle ones.
+  void prewarm_downstream_connections();
 
   std::mt19937 &get_randgen();
 
@@ -356,6 +551,12 @@ public:
 
   ConnectBlocker *get_connect_blocker() const;
 
+#ifdef HAVE_LIBURING
+  // Returns io_uring used by this worker.  It returns nullptr if
+  // io_uring is not used.
+  IOUring *get_io_uring() const;
+#endif // defined(HAVE_LIBURING)
+
   const DownstreamConfig *get_downstream_config() const;
 
   void
@@ -370,9 +571,27 @@ public:
   void disable_listener();
   void sleep_listener(ev_tstamp t);
 
+  // Called just after the event loop returns from poll.
+  void on_loop_check();
+  // Called just before the event loop polls.
+  void on_loop_prepare();
+  // Publishes the event loop statistics of the last interval, and
+  // starts or stops accepting new connections according to the loop
+  // lag.
+  void update_loop_stat();
+  // Adds |t| seconds spent in |cat| to the event loop statistics.
+  void add_loop_time(LoopCategory cat, ev_tstamp t);
+  const WorkerLoopStat &get_loop_stat() const;
+
+  size_t get_index() const;
+
 #ifdef ENABLE_HTTP3
   QUICConnectionHandler *get_quic_connection_handler();
 
+#  ifdef HAVE_SENDMMSG
+  QUICSendQueue *get_quic_send_queue();
+#  endif // defined(HAVE_SENDMMSG)
+
   std::expected<void, Error> setup_quic_server_socket();
 
   const WorkerID &get_worker_id() const;
@@ -402,11 +621,41 @@ public:
 
   DNSTracker *get_dns_tracker();
 
+  // Returns TimerWheel for the coarse timeouts of the connections
+  // handled by this worker.
+  TimerWheel *get_timer_wheel();
+
+  // Returns CollapseEntry which accepts the requests identified by
+  // |key|, or nullptr if there is no such entry.
+  CollapseEntry *find_collapse_entry(std::string_view key) const;
+  // Registers |entry| so that the subsequent identical requests can
+  // find it.  There must be no entry which has the same key.
+  void add_collapse_entry(CollapseEntry *entry);
+  // Unregisters |entry|.
+  void remove_collapse_entry(CollapseEntry *entry);
+
   std::expected<void, Error> handle_connection(int fd, const sockaddr *addr,
                                                socklen_t addrlen,
                                                const UpstreamAddr *faddr);
 
 private:
+  // Makes |addr| in |group| take over the connections, health and
+  // load balancing state of |old_addr| which is the same backend
+  // address in the previous configuration.  |shared_addr| is the
+  // SharedDownstreamAddr which |addr| belongs to.
+  void carry_over_downstream_addr(
+    const std::shared_ptr<DownstreamAddrGroup> &group,
+    const SharedDownstreamAddr &shared_addr, DownstreamAddr &addr,
+    DownstreamAddr &old_addr);
+
+#ifdef ENABLE_HTTP3
+  void handle_forwarded_quic_packet(size_t upstream_addr_index,
+                                    const Address &remote_addr,
+                                    const Address &local_addr,
+                                    const ngtcp2_pkt_info &pi,
+                                    std::span<const uint8_t> data);
+#endif // defined(ENABLE_HTTP3)
+
 #ifndef NOTHREADS
   std::future<void> fut_;
 #endif // !defined(NOTHREADS)
@@ -414,14 +663,43 @@ private:
   size_t index_;
   std::mutex m_;
   std::deque<WorkerEvent> q_;
+#ifdef ENABLE_HTTP3
+  // The packets queued by forward_quic_packet.
+  std::unique_ptr<QUICForwardRing> quic_forward_ring_;
+  // true if w_ has been signaled for quic_forward_ring_, and the
+  // packets have not been processed yet.
+  std::atomic<bool> quic_forward_pending_{};
+#endif // defined(ENABLE_HTTP3)
   std::mt19937 randgen_;
   ev_async w_;
   ev_timer mcpool_clear_timer_;
+  ev_timer prewarm_timer_;
   ev_timer proc_wev_timer_;
   ev_timer disable_listener_timer_;
+  ev_check loop_check_;
+  ev_prepare loop_prepare_;
+  ev_timer loop_stat_timer_;
+  WorkerLoopStat loop_stat_{};
+  // The time when the current interval of the event loop statistics
+  // started.
+  ev_tstamp loop_interval_start_{};
+  // The time when the current loop iteration started.  It is 0 if
+  // the loop is polling.
+  ev_tstamp loop_iteration_start_{};
+  // The following fields are accumulated for the current interval.
+  ev_tstamp loop_busy_time_{};
+  ev_tstamp loop_max_iteration_time_{};
+  uint64_t loop_num_iterations_{};
+  std::array<ev_tstamp, NUM_LOOP_CATEGORIES> loop_category_time_{};
   MemchunkPool mcpool_;
   WorkerStat worker_stat_;
   DNSTracker dns_tracker_;
+  TimerWheel timer_wheel_;
+
+#ifdef HAVE_LIBURING
+  // io_uring used by this worker.  This must outlive listeners_.
+  std::unique_ptr<IOUring> io_uring_;
+#endif // defined(HAVE_LIBURING)
 
   std::vector<UpstreamAddr> upstream_addrs_;
   std::vector<std::unique_ptr<AcceptHandler>> listeners_;
@@ -431,6 +709,10 @@ private:
   std::unique_ptr<QUICKeyingMaterials> quic_keying_materials_;
   std::vector<UpstreamAddr> quic_upstream_addrs_;
   std::vector<std::unique_ptr<QUICListener>> quic_listeners_;
+#  ifdef HAVE_SENDMMSG
+  // quic_send_queue_ refers to quic_upstream_addrs_.
+  QUICSendQueue quic_send_queue_;
+#  endif // defined(HAVE_SENDMMSG)
 #endif // defined(ENABLE_HTTP3)
 
   std::shared_ptr<DownstreamConfig> downstreamconf_;
@@ -448,6 +730,7 @@ private:
 #ifdef ENABLE_HTTP3
   SSL_CTX *quic_sv_ssl_ctx_;
   tls::CertLookupTree *quic_cert_tree_;
+  SSL_CTX *quic_cl_ssl_ctx_;
 
   QUICConnectionHandler quic_conn_handler_;
 #endif // defined(ENABLE_HTTP3)
@@ -459,6 +742,9 @@ private:
   std::shared_ptr<TicketKeys> ticket_keys_;
 #endif // !defined(HAVE_ATOMIC_STD_SHARED_PTR)
   std::vector<std::shared_ptr<DownstreamAddrGroup>> downstream_addr_groups_;
+  // The requests in flight which the identical requests can be
+  // collapsed into.  The key is CollapseEntry::get_key().
+  std::unordered_map<std::string_view, CollapseEntry *> collapse_entries_;
   // Worker level blocker for downstream connection.  For example,
   // this is used when file descriptor is exhausted.
   std::unique_ptr<ConnectBlocker> connect_blocker_;
@@ -478,6 +764,74 @@ size_t match_downstream_addr_group(
   const std::vector<std::shared_ptr<DownstreamAddrGroup>> &groups,
   size_t catch_all, BlockAllocator &balloc);
 
+// The decay time constant of DownstreamAddr::rtt_ewma in seconds.
+inline constexpr ev_tstamp DOWNSTREAM_ADDR_RTT_DECAY = 10.;
+
+// Records the latency |rtt| observed at |now| in |addr|.  If |rtt| is
+// larger than the current estimate, it is adopted immediately.
+// Otherwise, it is blended in using the exponential decay.
+void downstream_addr_observe_rtt(DownstreamAddr &addr, ev_tstamp rtt,
+                                 ev_tstamp now);
+
+// Returns the load of |addr| at |now|, which is used by
+// LoadBalancing::P2C.  The smaller value means the less loaded
+// address.
+double downstream_addr_load(const DownstreamAddr &addr, ev_tstamp now);
+
+// The initial value of DownstreamAddr::concurrency_limit.
+inline constexpr double DOWNSTREAM_ADDR_INITIAL_CONCURRENCY_LIMIT = 20.;
+// The length of the window of DownstreamAddr::min_rtt in seconds.
+// The minimum is measured again after the window ends so that the
+// limit follows the change of the backend capacity.
+inline constexpr ev_tstamp DOWNSTREAM_ADDR_MIN_RTT_WINDOW = 30.;
+
+// Updates the concurrency limit of |addr| using the latency |rtt|
+// observed at |now|.  The limit grows while |rtt| stays close to the
+// minimum latency, and shrinks in proportion to the ratio of the
+// minimum latency to |rtt| otherwise.  The result is clamped to [1,
+// |max_limit|].
+void downstream_addr_update_concurrency_limit(DownstreamAddr &addr,
+                                              ev_tstamp rtt, ev_tstamp now,
+                                              size_t max_limit);
+
+// Decreases the concurrency limit of |addr| multiplicatively.  This
+// is called when a request to |addr| did not get a response.
+void downstream_addr_decrease_concurrency_limit(DownstreamAddr &addr);
+
+// Returns true if another request can be sent to |addr| without
+// exceeding its concurrency limit.
+bool downstream_addr_concurrency_available(const DownstreamAddr &addr);
+
+// The number of responses from a group between the searches for
+// latency outliers.
+inline constexpr size_t OUTLIER_LATENCY_INTERVAL = 64;
+
+// Returns true if passive outlier detection is enabled by |outlier|.
+bool outlier_detection_enabled(const OutlierConfig &outlier);
+
+// Returns the duration to eject an address which has been ejected
+// |num_ejections| times in a row.  It starts from |base|, doubles
+// each time, and is capped by |max|.
+ev_tstamp outlier_ejection_time(ev_tstamp base, size_t num_ejections,
+                                ev_tstamp max);
+
+// Ejects |addr| from the load balancing of |shared_addr| temporarily
+// unless it exceeds the maximum number of ejected addresses, or
+// leaves no address in rotation.  |reason| is logged.  Returns true
+// if |addr| is ejected.
+bool downstream_addr_eject(SharedDownstreamAddr &shared_addr,
+                           DownstreamAddr &addr, ev_tstamp now,
+                           std::string_view reason);
+
+// Records the outcome of a request to |addr| in |shared_addr| for
+// passive outlier detection.  |failure| is true if the backend
+// responded with 5xx status code, or failed before the response
+// header.  This function may eject |addr|, or the other addresses
+// whose latency is an outlier.
+void downstream_addr_record_outcome(SharedDownstreamAddr &shared_addr,
+                                    DownstreamAddr &addr, bool failure,
+                                    ev_tstamp now);
+
 // Calls this function if connecting to backend failed.  |raddr| is
 // the actual address used to connect to backend, and it could be
 // nullptr.  This function may schedule live check.
@@ -34,6 +34,12 @@
 
 #include "shrpx_worker.h"
 #include "shrpx_connect_blocker.h"
+#include "shrpx_connection_handler.h"
+#include "shrpx_http_downstream_connection.h"
+#include "shrpx_downstream_connection_pool.h"
+#include "shrpx_config.h"
+#include "shrpx_timer_wheel.h"
+#include "shrpx_app_cookie_table.h"
 #include "shrpx_log.h"
 
 namespace shrpx {
@@ -41,6 +47,14 @@ namespace shrpx {
 namespace {
 const MunitTest tests[]{
   munit_void_test(test_shrpx_worker_match_downstream_addr_group),
+  munit_void_test(test_shrpx_worker_downstream_addr_load),
+  munit_void_test(test_shrpx_worker_downstream_addr_concurrency_limit),
+  munit_void_test(test_shrpx_worker_hedge),
+  munit_void_test(test_shrpx_worker_outlier_ejection_time),
+  munit_void_test(test_shrpx_worker_outlier_detection),
+  munit_void_test(test_shrpx_worker_timer_wheel),
+  munit_void_test(test_shrpx_worker_app_cookie_table),
+  munit_void_test(test_shrpx_worker_replace_downstream_config),
   munit_test_end(),
 };
 } // namespace
@@ -262,4 +276,520 @@ void test_shrpx_worker_match_downstream_addr_group(void) {
                                           groups, 255, balloc));
 }
 
+void test_shrpx_worker_downstream_addr_load(void) {
+  DownstreamAddr addr{};
+  addr.weight = 1;
+
+  // Nothing is known about the address yet.
+  assert_double(0., ==, downstream_addr_load(addr, 0.));
+
+  // Requests in flight without any observed latency are penalized.
+  addr.num_inflight = 1;
+
+  assert_double(1., <, downstream_addr_load(addr, 0.));
+
+  // Higher latency is adopted immediately.
+  downstream_addr_observe_rtt(addr, 0.1, 1.);
+
+  assert_double(0.1, ==, addr.rtt_ewma);
+  assert_double(1., ==, addr.rtt_ewma_last);
+  assert_double(0.2, ==, downstream_addr_load(addr, 1.));
+
+  // Lower latency moves the estimate smoothly.
+  downstream_addr_observe_rtt(addr, 0.05, 1.);
+
+  assert_double(0.1, ==, addr.rtt_ewma);
+
+  downstream_addr_observe_rtt(addr, 0.05, 1. + DOWNSTREAM_ADDR_RTT_DECAY);
+
+  assert_double(0.05, <, addr.rtt_ewma);
+  assert_double(0.1, >, addr.rtt_ewma);
+
+  // The estimate decays while no response is observed.
+  auto rtt = addr.rtt_ewma;
+
+  assert_double(rtt * 2, >,
+                downstream_addr_load(addr, 2. + DOWNSTREAM_ADDR_RTT_DECAY));
+
+  // Weight divides the load.
+  addr.weight = 2;
+
+  assert_double(rtt, ==,
+                downstream_addr_load(addr, 1. + DOWNSTREAM_ADDR_RTT_DECAY));
+}
+
+void test_shrpx_worker_downstream_addr_concurrency_limit(void) {
+  DownstreamAddr addr{};
+  addr.concurrency_limit = 20.;
+  addr.num_inflight = 20;
+
+  assert_false(downstream_addr_concurrency_available(addr));
+
+  // The limit grows while the latency stays at the minimum.
+  downstream_addr_update_concurrency_limit(addr, 0.1, 1., 100);
+
+  assert_double(0.1, ==, addr.min_rtt);
+  assert_double(20., <, addr.concurrency_limit);
+
+  // The limit is not grown further if it is not the bottleneck.
+  auto limit = addr.concurrency_limit;
+  addr.num_inflight = 1;
+
+  downstream_addr_update_concurrency_limit(addr, 0.1, 1., 100);
+
+  assert_double(limit, ==, addr.concurrency_limit);
+  assert_true(downstream_addr_concurrency_available(addr));
+
+  // The limit shrinks when the latency increases.
+  addr.num_inflight = 20;
+
+  downstream_addr_update_concurrency_limit(addr, 0.2, 2., 100);
+
+  assert_double(0.1, ==, addr.min_rtt);
+  assert_double(limit, >, addr.concurrency_limit);
+  assert_false(downstream_addr_concurrency_available(addr));
+
+  // The minimum latency is measured again after the window ends.
+  downstream_addr_update_concurrency_limit(
+    addr, 0.2, 2. + DOWNSTREAM_ADDR_MIN_RTT_WINDOW, 100);
+
+  assert_double(0.2, ==, addr.min_rtt);
+
+  // The limit never exceeds the upper bound.
+  downstream_addr_update_concurrency_limit(
+    addr, 0.2, 3. + DOWNSTREAM_ADDR_MIN_RTT_WINDOW, 5);
+
+  assert_double(5., ==, addr.concurrency_limit);
+
+  // Failure decreases the limit, but it never goes below 1.
+  downstream_addr_decrease_concurrency_limit(addr);
+
+  assert_double(5., >, addr.concurrency_limit);
+
+  for (size_t i = 0; i < 100; ++i) {
+    downstream_addr_decrease_concurrency_limit(addr);
+  }
+
+  assert_double(1., ==, addr.concurrency_limit);
+
+  addr.num_inflight = 0;
+
+  assert_true(downstream_addr_concurrency_available(addr));
+}
+
+void test_shrpx_worker_hedge(void) {
+  HedgeState hedge{};
+
+  // No delay until enough samples are observed.
+  for (size_t i = 0; i < HEDGE_MIN_SAMPLES - 1; ++i) {
+    hedge_add_sample(hedge, 0.01 * static_cast<double>(i + 1), 90);
+  }
+
+  assert_double(0., ==, hedge.delay);
+
+  hedge_add_sample(hedge, 0.01 * HEDGE_MIN_SAMPLES, 90);
+
+  // 90th percentile of [0.01, 0.32].
+  assert_double(0.01 * 29, ==, hedge.delay);
+
+  // Old samples are replaced with new ones.
+  for (size_t i = 0; i < HEDGE_NUM_SAMPLES; ++i) {
+    hedge_add_sample(hedge, 1., 90);
+  }
+
+  assert_double(1., ==, hedge.delay);
+
+  // Budget
+  assert_false(hedge_consume_budget(hedge));
+
+  for (size_t i = 0; i < 4; ++i) {
+    hedge_add_budget(hedge, 0.25);
+  }
+
+  assert_true(hedge_consume_budget(hedge));
+  assert_false(hedge_consume_budget(hedge));
+
+  for (size_t i = 0; i < 100; ++i) {
+    hedge_add_budget(hedge, 0.25);
+  }
+
+  assert_double(HEDGE_MAX_TOKENS, ==, hedge.tokens);
+}
+
+void test_shrpx_worker_outlier_ejection_time(void) {
+  OutlierConfig outlier{};
+
+  assert_false(outlier_detection_enabled(outlier));
+
+  outlier.errors = 5;
+
+  assert_true(outlier_detection_enabled(outlier));
+
+  outlier = {};
+  outlier.latency = 3;
+
+  assert_true(outlier_detection_enabled(outlier));
+
+  // Ejection time doubles for each consecutive ejection, and is
+  // capped by the maximum.
+  assert_double(30., ==, outlier_ejection_time(30., 0, 120.));
+  assert_double(60., ==, outlier_ejection_time(30., 1, 120.));
+  assert_double(120., ==, outlier_ejection_time(30., 2, 120.));
+  assert_double(120., ==, outlier_ejection_time(30., 3, 120.));
+  assert_double(120., ==, outlier_ejection_time(30., 1000, 120.));
+}
+
+namespace {
+void init_outlier_addrs(SharedDownstreamAddr &shared_addr, size_t naddrs,
+                        std::mt19937 &gen, struct ev_loop *loop) {
+  shared_addr.addrs.resize(naddrs);
+
+  for (auto &addr : shared_addr.addrs) {
+    addr.connect_blocker =
+      std::make_unique<ConnectBlocker>(gen, loop, nullptr, nullptr);
+  }
+}
+} // namespace
+
+void test_shrpx_worker_outlier_detection(void) {
+  auto loop = ev_loop_new(0);
+  auto gen = util::make_mt19937();
+
+  auto downstreamconf = std::make_shared<DownstreamConfig>();
+  downstreamconf->timeout.max_backoff = 120.;
+
+  auto config = mod_config();
+  auto old_downstreamconf =
+    std::exchange(config->conn.downstream, downstreamconf);
+
+  {
+    SharedDownstreamAddr shared_addr;
+    shared_addr.outlier.errors = 3;
+    shared_addr.outlier.ejection_time = 30.;
+    shared_addr.outlier.max_ejection_percent = 50;
+
+    init_outlier_addrs(shared_addr, 4, gen, loop);
+
+    auto &addrs = shared_addr.addrs;
+
+    // Only consecutive failures eject an address.
+    downstream_addr_record_outcome(shared_addr, addrs[0], true, 1.);
+    downstream_addr_record_outcome(shared_addr, addrs[0], true, 1.);
+    downstream_addr_record_outcome(shared_addr, addrs[0], false, 1.);
+
+    assert_size(0, ==, addrs[0].outlier_errors);
+
+    downstream_addr_record_outcome(shared_addr, addrs[0], true, 2.);
+    downstream_addr_record_outcome(shared_addr, addrs[0], true, 2.);
+
+    assert_false(addrs[0].connect_blocker->ejected());
+
+    downstream_addr_record_outcome(shared_addr, addrs[0], true, 2.);
+
+    assert_true(addrs[0].connect_blocker->ejected());
+    assert_size(1, ==, addrs[0].num_ejections);
+    assert_double(2., ==, addrs[0].ejected_at);
+    assert_size(0, ==, addrs[0].outlier_errors);
+
+    // An ejected address is not ejected again.
+    assert_false(downstream_addr_eject(shared_addr, addrs[0], 3., "test"sv));
+
+    // At most 50% of 4 addresses are ejected at the same time.
+    assert_true(downstream_addr_eject(shared_addr, addrs[1], 3., "test"sv));
+    assert_false(downstream_addr_eject(shared_addr, addrs[2], 3., "test"sv));
+    assert_false(addrs[2].connect_blocker->ejected());
+  }
+
+  {
+    SharedDownstreamAddr shared_addr;
+    shared_addr.outlier.errors = 1;
+    shared_addr.outlier.ejection_time = 30.;
+    shared_addr.outlier.max_ejection_percent = 100;
+
+    init_outlier_addrs(shared_addr, 3, gen, loop);
+
+    auto &addrs = shared_addr.addrs;
+
+    addrs[0].connect_blocker->offline();
+
+    // The last available address is never ejected.
+    downstream_addr_record_outcome(shared_addr, addrs[1], true, 1.);
+
+    assert_true(addrs[1].connect_blocker->ejected());
+
+    downstream_addr_record_outcome(shared_addr, addrs[2], true, 1.);
+
+    assert_false(addrs[2].connect_blocker->blocked());
+  }
+
+  {
+    SharedDownstreamAddr shared_addr;
+    shared_addr.outlier.errors = 1;
+    shared_addr.outlier.ejection_time = 30.;
+    shared_addr.outlier.max_ejection_percent = 100;
+
+    init_outlier_addrs(shared_addr, 1, gen, loop);
+
+    downstream_addr_record_outcome(shared_addr, shared_addr.addrs[0], true,
+                                   1.);
+
+    assert_false(shared_addr.addrs[0].connect_blocker->blocked());
+  }
+
+  {
+    SharedDownstreamAddr shared_addr;
+    shared_addr.outlier.latency = 3;
+    shared_addr.outlier.ejection_time = 30.;
+    shared_addr.outlier.max_ejection_percent = 50;
+
+    init_outlier_addrs(shared_addr, 4, gen, loop);
+
+    auto &addrs = shared_addr.addrs;
+
+    addrs[0].rtt_ewma = 0.01;
+    addrs[1].rtt_ewma = 0.01;
+    addrs[2].rtt_ewma = 0.012;
+    addrs[3].rtt_ewma = 0.1;
+
+    // The latency is compared with the median of the group
+    // periodically.
+    for (size_t i = 0; i < OUTLIER_LATENCY_INTERVAL - 1; ++i) {
+      downstream_addr_record_outcome(shared_addr, addrs[0], false, 1.);
+    }
+
+    assert_false(addrs[3].connect_blocker->ejected());
+
+    downstream_addr_record_outcome(shared_addr, addrs[0], false, 1.);
+
+    assert_true(addrs[3].connect_blocker->ejected());
+    assert_double(0., ==, addrs[3].rtt_ewma);
+
+    for (size_t i = 0; i < 3; ++i) {
+      assert_false(addrs[i].connect_blocker->blocked());
+    }
+  }
+
+  config->conn.downstream = std::move(old_downstreamconf);
+
+  ev_loop_destroy(loop);
+}
+
+namespace {
+void count_timeoutcb(TimerWheelEntry *ent) {
+  ++*static_cast<size_t *>(ent->data);
+}
+} // namespace
+
+void test_shrpx_worker_timer_wheel(void) {
+  auto loop = ev_loop_new(0);
+
+  {
+    TimerWheel wheel(loop);
+    size_t nfired_a = 0, nfired_b = 0;
+    TimerWheelEntry a(count_timeoutcb, &nfired_a);
+    TimerWheelEntry b(count_timeoutcb, &nfired_b);
+    auto t0 = ev_now(loop);
+
+    wheel.start(&a, 1., t0);
+    // Longer than one rotation.
+    wheel.start(&b, 200., t0);
+
+    assert_size(2, ==, wheel.size());
+
+    // Never expires early.
+    wheel.expire(t0 + 0.95);
+
+    assert_size(0, ==, nfired_a);
+
+    wheel.expire(t0 + 1.15);
+
+    assert_size(1, ==, nfired_a);
+    assert_false(a.active());
+    assert_size(1, ==, wheel.size());
+
+    // b is visited once per rotation, but not expired yet.
+    wheel.expire(t0 + 150.);
+
+    assert_size(0, ==, nfired_b);
+
+    // Restart
+    wheel.start(&b, 10., t0 + 150.);
+    wheel.expire(t0 + 159.9);
+
+    assert_size(0, ==, nfired_b);
+
+    wheel.expire(t0 + 160.2);
+
+    assert_size(1, ==, nfired_b);
+    assert_size(0, ==, wheel.size());
+
+    // Stop
+    wheel.start(&a, 1., t0 + 200.);
+    wheel.stop(&a);
+    wheel.expire(t0 + 300.);
+
+    assert_size(1, ==, nfired_a);
+    assert_size(0, ==, wheel.size());
+  }
+
+  {
+    TimerWheel wheel(loop);
+    size_t nfired_a = 0, nfired_b = 0;
+    TimerWheelEntry a(count_timeoutcb, &nfired_a);
+    TimerWheelEntry b(count_timeoutcb, &nfired_b);
+
+    ev_now_update(loop);
+
+    wheel.start(&a, 0.3);
+    wheel.start(&b, 0.5);
+
+    auto iteration = ev_iteration(loop);
+
+    ev_run(loop, 0);
+
+    assert_size(1, ==, nfired_a);
+    assert_size(1, ==, nfired_b);
+    assert_size(0, ==, wheel.size());
+    // The wheel wakes up only when the timer is due instead of every
+    // tick.
+    assert_uint(2, >=, ev_iteration(loop) - iteration);
+  }
+
+  ev_loop_destroy(loop);
+}
+
+void test_shrpx_worker_app_cookie_table(void) {
+  AppCookieTable table(2);
+
+  assert_false(table.get("alpha"sv).has_value());
+
+  table.add("alpha"sv, 1);
+  table.add("bravo"sv, 2);
+
+  assert_size(2, ==, table.size());
+  assert_uint32(1, ==, *table.get("alpha"sv));
+  assert_uint32(2, ==, *table.get("bravo"sv));
+
+  // The backend which issued the value last wins.
+  table.add("alpha"sv, 3);
+
+  assert_size(2, ==, table.size());
+  assert_uint32(3, ==, *table.get("alpha"sv));
+
+  // "bravo" is the least recently used one, and is evicted.
+  table.add("charlie"sv, 4);
+
+  assert_size(2, ==, table.size());
+  assert_false(table.get("bravo"sv).has_value());
+  assert_uint32(3, ==, *table.get("alpha"sv));
+  assert_uint32(4, ==, *table.get("charlie"sv));
+
+  // Looking up "charlie" made "alpha" the least recently used one.
+  table.add("delta"sv, 5);
+
+  assert_false(table.get("alpha"sv).has_value());
+  assert_uint32(4, ==, *table.get("charlie"sv));
+  assert_uint32(5, ==, *table.get("delta"sv));
+}
+
+namespace {
+std::shared_ptr<DownstreamConfig>
+create_downstream_config(std::initializer_list<uint16_t> ports) {
+  auto downstreamconf = std::make_shared<DownstreamConfig>();
+
+  auto &g = downstreamconf->addr_groups.emplace_back("/"sv);
+
+  for (auto port : ports) {
+    auto &addr = g.addrs.emplace_back();
+    addr.host = "127.0.0.1"sv;
+    addr.port = port;
+    addr.weight = 1;
+    addr.group_weight = 1;
+    addr.proto = Proto::HTTP1;
+  }
+
+  return downstreamconf;
+}
+} // namespace
+
+void test_shrpx_worker_replace_downstream_config(void) {
+  auto loop = ev_loop_new(0);
+  auto gen = util::make_mt19937();
+
+  auto downstreamconf = create_downstream_config({3000, 3001});
+
+  auto config = mod_config();
+  auto old_downstreamconf =
+    std::exchange(config->conn.downstream, downstreamconf);
+
+  {
+    ConnectionHandler conn_handler(loop, gen);
+    Worker worker(loop, nullptr, nullptr, nullptr,
+#ifdef ENABLE_HTTP3
+                  nullptr, nullptr, nullptr, WorkerID{},
+#endif // defined(ENABLE_HTTP3)
+                  0, nullptr, &conn_handler, downstreamconf);
+
+    auto old_group = worker.get_downstream_addr_groups()[0];
+    auto &old_addrs = old_group->shared_addr->addrs;
+
+    assert_size(2, ==, old_addrs.size());
+
+    auto connect_blocker = old_addrs[0].connect_blocker.get();
+    old_addrs[0].rtt_ewma = 0.25;
+    old_addrs[0].outlier_errors = 3;
+
+    for (auto &addr : old_addrs) {
+      addr.dconn_pool->add_downstream_connection(
+        std::make_unique<HttpDownstreamConnection>(old_group, &addr, loop,
+                                                   &worker));
+    }
+
+    // 127.0.0.1:3001 is removed, and 127.0.0.1:3002 is added.
+    downstreamconf = create_downstream_config({3000, 3002});
+    config->conn.downstream = downstreamconf;
+
+    worker.replace_downstream_config(downstreamconf);
+
+    assert_true(old_group->retired);
+
+    auto &group = worker.get_downstream_addr_groups()[0];
+
+    assert_ptr_not_equal(old_group.get(), group.get());
+
+    auto &addrs = group->shared_addr->addrs;
+
+    assert_size(2, ==, addrs.size());
+
+    // The state of 127.0.0.1:3000 is carried over to the new group.
+    assert_uint16(3000, ==, addrs[0].port);
+    assert_ptr_equal(connect_blocker, addrs[0].connect_blocker.get());
+    assert_double(0.25, ==, addrs[0].rtt_ewma);
+    assert_size(3, ==, old_addrs[0].outlier_errors);
+    assert_size(3, ==, addrs[0].outlier_errors);
+
+    auto dconn = addrs[0].dconn_pool->pop_downstream_connection();
+
+    assert_not_null(dconn.get());
+    assert_ptr_equal(&addrs[0], dconn->get_addr());
+    assert_ptr_equal(group.get(), dconn->get_downstream_addr_group().get());
+
+    // The old address is left with the fresh state.
+    assert_ptr_not_equal(connect_blocker, old_addrs[0].connect_blocker.get());
+    assert_null(old_addrs[0].dconn_pool->pop_downstream_connection().get());
+
+    // The connection to the removed address is closed.
+    assert_null(old_addrs[1].dconn_pool->pop_downstream_connection().get());
+
+    // 127.0.0.1:3002 starts with the fresh state.
+    assert_uint16(3002, ==, addrs[1].port);
+    assert_double(0., ==, addrs[1].rtt_ewma);
+    assert_null(addrs[1].dconn_pool->pop_downstream_connection().get());
+  }
+
+  config->conn.downstream = std::move(old_downstreamconf);
+
+  ev_loop_destroy(loop);
+}
+
 } // namespace shrpx
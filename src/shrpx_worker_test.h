@@ -38,6 +38,14 @@ namespace shrpx {
 extern const MunitSuite worker_suite;
 
 munit_void_test_decl(test_shrpx_worker_match_downstream_addr_group)
+munit_void_test_decl(test_shrpx_worker_downstream_addr_load)
+munit_void_test_decl(test_shrpx_worker_downstream_addr_concurrency_limit)
+munit_void_test_decl(test_shrpx_worker_hedge)
+munit_void_test_decl(test_shrpx_worker_outlier_ejection_time)
+munit_void_test_decl(test_shrpx_worker_outlier_detection)
+munit_void_test_decl(test_shrpx_worker_timer_wheel)
+munit_void_test_decl(test_shrpx_worker_app_cookie_table)
+munit_void_test_decl(test_shrpx_worker_replace_downstream_config)
 
 } // namespace shrpx
 
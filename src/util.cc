@@ -1074,6 +1074,21 @@ int make_socket_nodelay(int fd) {
   return 0;
 }
 
+int make_socket_fastopen_connect(int fd) {
+#ifdef TCP_FASTOPEN_CONNECT
+  int val = 1;
+  if (setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT,
+                 reinterpret_cast<char *>(&val), sizeof(val)) == -1) {
+    return -1;
+  }
+  return 0;
+#else  // !defined(TCP_FASTOPEN_CONNECT)
+  (void)fd;
+
+  return -1;
+#endif // !defined(TCP_FASTOPEN_CONNECT)
+}
+
 std::expected<int, Error> create_nonblock_socket(int family) {
 #ifdef SOCK_NONBLOCK
   auto fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
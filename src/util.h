@@ -1109,6 +1109,11 @@ template <typename Duration> ev_tstamp ev_tstamp_from(const Duration &d) {
 int make_socket_closeonexec(int fd);
 int make_socket_nonblocking(int fd);
 int make_socket_nodelay(int fd);
+// Enables client side TCP Fast Open on |fd|.  It must be called
+// before connect(2).  The data written first after connect(2) is
+// sent in SYN.  This function returns -1 if it fails, or the platform
+// does not support it.
+int make_socket_fastopen_connect(int fd);
 
 std::expected<int, Error> create_nonblock_socket(int family);
 std::expected<int, Error> create_nonblock_udp_socket(int family);